@@ -0,0 +1,146 @@
+#include <benchmark/benchmark.h>
+
+#include "ColumnEvaluator.hpp"
+#include "Compiler.hpp"
+#include "Evaluator.hpp"
+#include "FormulaParser.hpp"
+#include "Lexer.hpp"
+#include "Optimizer.hpp"
+#include "bench_workbook.hpp"
+
+#include <array>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+   // Formulas over the input columns of the workbook only, from a simple sum to short-circuit logic and calls.
+   constexpr std::array<std::string_view, 3> cFORMULAS = {
+      "qc - $a * u2",
+      "(qc - (1 - $a) u2) / max(fs, 0.01) + 2 depth",
+      "if(qc > 2 and fs < 0.05 or not (u2 < 0), ln(qc) * sqrt(fs), pow(abs(u2), 0.5))"
+   };
+
+   // Repeated subexpressions, constants and a dead branch, as formulas written by hand often have.
+   constexpr std::string_view cREDUNDANT_FORMULA =
+      "(qc - fs u2) / max(abs(qc - fs u2), 1) * (2 * 0.5) + if(1 > 0, sqrt(abs(qc - fs u2)), depth)";
+
+   //! The input columns of the workbook, and a formula compiled against them.
+   struct EvaluatorFixture
+   {
+      explicit EvaluatorFixture(std::string_view aFormula, bool aOptimize = false)
+         : mSheet(rjcpt::bench::MakeInputSheet(rjcpt::bench::cWORKBOOK_ROWS))
+      {
+         for (const std::string_view name : {"depth", "qc", "fs", "u2"})
+         {
+            // Input columns get slots in the order they were created.
+            mColumns.push_back(mSheet.Column(name).data());
+         }
+         mParameters.push_back(mSheet.Parameter("a"));
+
+         const auto tokens = rjcpt::TokenizeExpression(aFormula);
+         const auto nodes  = rjcpt::ParseFormula(tokens);
+         mProgram = rjcpt::CompileFormula(aFormula, tokens, *nodes, mSheet).value();
+         if (aOptimize)
+         {
+            rjcpt::OptimizeProgram(mProgram);
+         }
+      }
+
+      rjcpt::EvaluationContext Context(std::size_t aRow = 0) const { return {mColumns, mParameters, aRow}; }
+
+      rjcpt::Sheet               mSheet;
+      std::vector<const double*> mColumns;
+      std::vector<double>        mParameters;
+      rjcpt::Program             mProgram;
+   };
+
+   void BM_CompileFormula(benchmark::State& aState)
+   {
+      const rjcpt::Sheet     sheet   = rjcpt::bench::MakeInputSheet(1);
+      const std::string_view formula = cFORMULAS[static_cast<std::size_t>(aState.range(0))];
+      const auto             tokens  = rjcpt::TokenizeExpression(formula);
+      const auto             nodes   = rjcpt::ParseFormula(tokens);
+      for (auto _ : aState)
+      {
+         benchmark::DoNotOptimize(rjcpt::CompileFormula(formula, tokens, *nodes, sheet));
+      }
+   }
+   BENCHMARK(BM_CompileFormula)->DenseRange(0, cFORMULAS.size() - 1);
+
+   // The same as BM_CompileFormula, with the literals already in a constant pool, as for later formulas of a sheet.
+   void BM_CompileFormula_ConstantPool(benchmark::State& aState)
+   {
+      const rjcpt::Sheet     sheet   = rjcpt::bench::MakeInputSheet(1);
+      const std::string_view formula = cFORMULAS[static_cast<std::size_t>(aState.range(0))];
+      const auto             tokens  = rjcpt::TokenizeExpression(formula);
+      const auto             nodes   = rjcpt::ParseFormula(tokens);
+      rjcpt::ConstantPool    pool;
+      for (auto _ : aState)
+      {
+         benchmark::DoNotOptimize(
+            rjcpt::CompileFormula(formula, tokens, *nodes, sheet, std::pmr::get_default_resource(), &pool));
+      }
+   }
+   BENCHMARK(BM_CompileFormula_ConstantPool)->DenseRange(0, cFORMULAS.size() - 1);
+
+   // One row at a time, as the reference implementation.
+   void BM_Evaluate(benchmark::State& aState)
+   {
+      const EvaluatorFixture fixture(cFORMULAS[static_cast<std::size_t>(aState.range(0))]);
+      for (auto _ : aState)
+      {
+         for (std::size_t row = 0; row < rjcpt::bench::cWORKBOOK_ROWS; row++)
+         {
+            benchmark::DoNotOptimize(rjcpt::Evaluate(fixture.mProgram, fixture.Context(row)));
+         }
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * rjcpt::bench::cWORKBOOK_ROWS));
+   }
+   BENCHMARK(BM_Evaluate)->DenseRange(0, cFORMULAS.size() - 1)->Unit(benchmark::kMillisecond);
+
+   void BM_ColumnEvaluator(benchmark::State& aState)
+   {
+      const EvaluatorFixture fixture(cFORMULAS[static_cast<std::size_t>(aState.range(0))]);
+      rjcpt::ColumnEvaluator evaluator;
+      std::vector<double>    output(rjcpt::bench::cWORKBOOK_ROWS);
+      for (auto _ : aState)
+      {
+         evaluator.Evaluate(fixture.mProgram, fixture.Context(), output);
+         benchmark::ClobberMemory();
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * rjcpt::bench::cWORKBOOK_ROWS));
+   }
+   BENCHMARK(BM_ColumnEvaluator)->DenseRange(0, cFORMULAS.size() - 1)->Unit(benchmark::kMillisecond);
+
+   void BM_ColumnEvaluator_Threaded(benchmark::State& aState)
+   {
+      const EvaluatorFixture       fixture(cFORMULAS[static_cast<std::size_t>(aState.range(0))]);
+      rjcpt::ColumnEvaluator       evaluator;
+      const rjcpt::ThreadedProgram threaded = rjcpt::ThreadedProgram::Compile(fixture.mProgram, evaluator.Level()).value();
+      std::vector<double>          output(rjcpt::bench::cWORKBOOK_ROWS);
+      for (auto _ : aState)
+      {
+         evaluator.Evaluate(threaded, fixture.Context(), output);
+         benchmark::ClobberMemory();
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * rjcpt::bench::cWORKBOOK_ROWS));
+   }
+   BENCHMARK(BM_ColumnEvaluator_Threaded)->DenseRange(0, cFORMULAS.size() - 1)->Unit(benchmark::kMillisecond);
+
+   // 0 evaluates the formula as compiled, 1 after OptimizeProgram.
+   void BM_ColumnEvaluator_Optimizer(benchmark::State& aState)
+   {
+      const EvaluatorFixture fixture(cREDUNDANT_FORMULA, aState.range(0) != 0);
+      rjcpt::ColumnEvaluator evaluator;
+      std::vector<double>    output(rjcpt::bench::cWORKBOOK_ROWS);
+      for (auto _ : aState)
+      {
+         evaluator.Evaluate(fixture.mProgram, fixture.Context(), output);
+         benchmark::ClobberMemory();
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * rjcpt::bench::cWORKBOOK_ROWS));
+      aState.counters["instructions"] = static_cast<double>(fixture.mProgram.mCode.size());
+   }
+   BENCHMARK(BM_ColumnEvaluator_Optimizer)->DenseRange(0, 1)->Unit(benchmark::kMillisecond);
+}
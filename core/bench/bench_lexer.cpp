@@ -0,0 +1,59 @@
+#include <benchmark/benchmark.h>
+
+#include "Lexer.hpp"
+#include "bench_workbook.hpp"
+
+#include <string_view>
+#include <vector>
+
+namespace
+{
+   std::vector<std::string_view> Corpus(const std::vector<std::pair<std::string, std::string>>& aFormulas)
+   {
+      std::vector<std::string_view> retval;
+      for (const auto& formula : aFormulas)
+      {
+         retval.push_back(formula.second);
+      }
+      return retval;
+   }
+
+   std::size_t CorpusBytes(const std::vector<std::string_view>& aCorpus)
+   {
+      std::size_t retval = 0;
+      for (const std::string_view expression : aCorpus)
+      {
+         retval += expression.size();
+      }
+      return retval;
+   }
+
+   void BM_TokenizeExpression(benchmark::State& aState)
+   {
+      const auto formulas = rjcpt::bench::MakeFormulas(rjcpt::bench::cWORKBOOK_FORMULAS);
+      const auto corpus   = Corpus(formulas);
+      for (auto _ : aState)
+      {
+         for (const std::string_view expression : corpus)
+         {
+            benchmark::DoNotOptimize(rjcpt::TokenizeExpression(expression));
+         }
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * corpus.size()));
+      aState.SetBytesProcessed(static_cast<std::int64_t>(aState.iterations() * CorpusBytes(corpus)));
+   }
+   BENCHMARK(BM_TokenizeExpression);
+
+   void BM_TokenizeExpressions(benchmark::State& aState)
+   {
+      const auto formulas = rjcpt::bench::MakeFormulas(rjcpt::bench::cWORKBOOK_FORMULAS);
+      const auto corpus   = Corpus(formulas);
+      for (auto _ : aState)
+      {
+         benchmark::DoNotOptimize(rjcpt::TokenizeExpressions(corpus));
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * corpus.size()));
+      aState.SetBytesProcessed(static_cast<std::int64_t>(aState.iterations() * CorpusBytes(corpus)));
+   }
+   BENCHMARK(BM_TokenizeExpressions);
+}
@@ -0,0 +1,252 @@
+#include <benchmark/benchmark.h>
+
+#include "FormulaParser.hpp"
+#include "Lexer.hpp"
+#include "ParserLL.hpp"
+#include "bench_workbook.hpp"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+   std::vector<std::vector<rjcpt::Token>> TokenizedCorpus()
+   {
+      std::vector<std::vector<rjcpt::Token>> retval;
+      for (const auto& formula : rjcpt::bench::MakeFormulas(rjcpt::bench::cWORKBOOK_FORMULAS))
+      {
+         retval.push_back(rjcpt::TokenizeExpression(formula.second));
+      }
+      return retval;
+   }
+
+   //! Only provides the formula grammar, for parser_util::FindRule.
+   class GrammarContext : public rjcpt::ParseContext
+   {
+   public:
+      rjcpt::GrammarView GetGrammar() const override { return rjcpt::GetFormulaGrammar(); }
+
+      rjcpt::GrammarNode GetEOF_Node() const override { return rjcpt::GrammarNode(); }
+      rjcpt::GrammarNode GetStartRule() const override { return GetGrammar().NonTerminal("Formula"); }
+
+      bool CheckValidator(const rjcpt::Token&, std::uint16_t) const override { return false; }
+      bool RunActor(const rjcpt::Token&, std::uint32_t, std::uint16_t) override { return false; }
+   };
+
+   void BM_CompileGrammar(benchmark::State& aState)
+   {
+      for (auto _ : aState)
+      {
+         benchmark::DoNotOptimize(rjcpt::detail::CompileFormulaGrammar());
+      }
+   }
+   BENCHMARK(BM_CompileGrammar);
+
+   void BM_ParseFormula(benchmark::State& aState)
+   {
+      const auto corpus = TokenizedCorpus();
+      for (auto _ : aState)
+      {
+         for (const auto& tokens : corpus)
+         {
+            benchmark::DoNotOptimize(rjcpt::ParseFormula(tokens));
+         }
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * corpus.size()));
+   }
+   BENCHMARK(BM_ParseFormula);
+
+   // The same as BM_ParseFormula, with the nodes stored in an arena that is reset for every pass over the corpus.
+   void BM_ParseFormula_Arena(benchmark::State& aState)
+   {
+      const auto   corpus = TokenizedCorpus();
+      rjcpt::Arena arena;
+      for (auto _ : aState)
+      {
+         arena.Reset();
+         for (const auto& tokens : corpus)
+         {
+            benchmark::DoNotOptimize(rjcpt::ParseFormula(tokens, arena));
+         }
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * corpus.size()));
+   }
+   BENCHMARK(BM_ParseFormula_Arena);
+
+   // The same as BM_ParseFormula_Arena, with the precedence engine instead of the grammar.
+   void BM_ParseFormula_Precedence(benchmark::State& aState)
+   {
+      const auto   corpus = TokenizedCorpus();
+      rjcpt::Arena arena;
+      for (auto _ : aState)
+      {
+         arena.Reset();
+         for (const auto& tokens : corpus)
+         {
+            benchmark::DoNotOptimize(rjcpt::ParseFormula(tokens, arena, rjcpt::ParserEngine::Precedence));
+         }
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * corpus.size()));
+   }
+   BENCHMARK(BM_ParseFormula_Precedence);
+
+   // The same as BM_ParseFormula, with validators and actors called through the virtual ParseContext.
+   void BM_ParseFormulaDynamic(benchmark::State& aState)
+   {
+      const auto corpus = TokenizedCorpus();
+      for (auto _ : aState)
+      {
+         for (const auto& tokens : corpus)
+         {
+            benchmark::DoNotOptimize(rjcpt::detail::ParseFormulaDynamic(tokens));
+         }
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * corpus.size()));
+   }
+   BENCHMARK(BM_ParseFormulaDynamic);
+
+   void BM_FindRule(benchmark::State& aState)
+   {
+      const auto               corpus = TokenizedCorpus();
+      const GrammarContext     context;
+      const rjcpt::GrammarNode start = context.GetStartRule();
+      std::size_t              lookups = 0;
+      for (auto _ : aState)
+      {
+         for (const auto& tokens : corpus)
+         {
+            for (const rjcpt::Token& token : tokens)
+            {
+               benchmark::DoNotOptimize(rjcpt::parser_util::FindRule(context, token, start));
+            }
+            lookups += tokens.size();
+         }
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(lookups));
+   }
+   BENCHMARK(BM_FindRule);
+
+   //! A long formula: the first aCount workbook formulas added together.
+   std::string LongFormula(std::size_t aCount)
+   {
+      std::string retval;
+      for (const auto& formula : rjcpt::bench::MakeFormulas(aCount))
+      {
+         retval += retval.empty() ? "(" : " + (";
+         retval += formula.second;
+         retval += ")";
+      }
+      return retval;
+   }
+
+   // Checking a long formula with an error near the start, the text not yet lexed.
+   void BM_ValidateFormula_Tokenized(benchmark::State& aState)
+   {
+      const std::string text = "1 + * " + LongFormula(static_cast<std::size_t>(aState.range(0)));
+      for (auto _ : aState)
+      {
+         const auto tokens = rjcpt::TokenizeExpression(text);
+         benchmark::DoNotOptimize(rjcpt::ParseFormula(tokens));
+      }
+   }
+   BENCHMARK(BM_ValidateFormula_Tokenized)->Arg(64);
+
+   // The same as BM_ValidateFormula_Tokenized, but lexing as it parses, which stops at the error.
+   void BM_ValidateFormula_Stream(benchmark::State& aState)
+   {
+      const std::string text = "1 + * " + LongFormula(static_cast<std::size_t>(aState.range(0)));
+      for (auto _ : aState)
+      {
+         benchmark::DoNotOptimize(rjcpt::ValidateFormula(text));
+      }
+   }
+   BENCHMARK(BM_ValidateFormula_Stream)->Arg(64);
+
+   // Lexing and parsing every workbook formula from its text.
+   void BM_LexAndParse(benchmark::State& aState)
+   {
+      const auto   corpus = rjcpt::bench::MakeFormulas(rjcpt::bench::cWORKBOOK_FORMULAS);
+      rjcpt::Arena arena;
+      for (auto _ : aState)
+      {
+         arena.Reset();
+         for (const auto& formula : corpus)
+         {
+            const auto tokens = rjcpt::TokenizeExpression(formula.second, arena);
+            benchmark::DoNotOptimize(rjcpt::ParseFormula(tokens, arena));
+         }
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * corpus.size()));
+   }
+   BENCHMARK(BM_LexAndParse);
+
+   // The same as BM_LexAndParse, but lexing as it parses.
+   void BM_LexAndParse_Stream(benchmark::State& aState)
+   {
+      const auto   corpus = rjcpt::bench::MakeFormulas(rjcpt::bench::cWORKBOOK_FORMULAS);
+      rjcpt::Arena arena;
+      for (auto _ : aState)
+      {
+         arena.Reset();
+         for (const auto& formula : corpus)
+         {
+            benchmark::DoNotOptimize(rjcpt::ParseFormula(formula.second, arena));
+         }
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * corpus.size()));
+   }
+   BENCHMARK(BM_LexAndParse_Stream);
+
+   // The same as BM_LexAndParse_Stream, with the precedence engine.
+   void BM_LexAndParse_Precedence(benchmark::State& aState)
+   {
+      const auto   corpus = rjcpt::bench::MakeFormulas(rjcpt::bench::cWORKBOOK_FORMULAS);
+      rjcpt::Arena arena;
+      for (auto _ : aState)
+      {
+         arena.Reset();
+         for (const auto& formula : corpus)
+         {
+            benchmark::DoNotOptimize(rjcpt::ParseFormula(formula.second, arena, rjcpt::ParserEngine::Precedence));
+         }
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * corpus.size()));
+   }
+   BENCHMARK(BM_LexAndParse_Precedence);
+
+   // Typing the last characters of a long formula, one at a time, with feedback after every keystroke.
+   void BM_TypeFormula_Incremental(benchmark::State& aState)
+   {
+      const std::string text = LongFormula(static_cast<std::size_t>(aState.range(0)));
+      const std::size_t typed = 40;
+      for (auto _ : aState)
+      {
+         aState.PauseTiming();
+         rjcpt::IncrementalFormula formula(text.substr(0, text.size() - typed));
+         aState.ResumeTiming();
+         for (std::size_t i = text.size() - typed; i < text.size(); i++)
+         {
+            formula.Edit(static_cast<std::uint32_t>(i), 0, std::string_view(text).substr(i, 1));
+         }
+         benchmark::DoNotOptimize(formula.Nodes().data());
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * typed));
+   }
+   BENCHMARK(BM_TypeFormula_Incremental)->Arg(4)->Arg(64);
+
+   void BM_TypeFormula_Full(benchmark::State& aState)
+   {
+      const std::string text = LongFormula(static_cast<std::size_t>(aState.range(0)));
+      const std::size_t typed = 40;
+      for (auto _ : aState)
+      {
+         for (std::size_t i = text.size() - typed; i < text.size(); i++)
+         {
+            const auto tokens = rjcpt::TokenizeExpression(std::string_view(text).substr(0, i + 1));
+            benchmark::DoNotOptimize(rjcpt::ParseFormula(tokens));
+         }
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * typed));
+   }
+   BENCHMARK(BM_TypeFormula_Full)->Arg(4)->Arg(64);
+}
@@ -0,0 +1,166 @@
+#include <benchmark/benchmark.h>
+
+#include "DataFile.hpp"
+#include "Sheet.hpp"
+#include "ThreadPool.hpp"
+#include "WorkbookTemplate.hpp"
+#include "bench_workbook.hpp"
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+// End-to-end benchmarks on a synthetic workbook: cWORKBOOK_ROWS rows of CPT data and cWORKBOOK_FORMULAS formulas.
+
+namespace
+{
+   rjcpt::Sheet MakeWorkbook()
+   {
+      rjcpt::Sheet retval = rjcpt::bench::MakeInputSheet(rjcpt::bench::cWORKBOOK_ROWS);
+      for (const auto& [name, formula] : rjcpt::bench::MakeFormulas(rjcpt::bench::cWORKBOOK_FORMULAS))
+      {
+         if (const auto result = retval.SetFormula(name, formula); !result)
+         {
+            throw std::runtime_error(name + ": " + result.error());
+         }
+      }
+      return retval;
+   }
+
+   //! The input columns of the workbook as a delimited text file.
+   std::string MakeDataText()
+   {
+      const rjcpt::Sheet sheet = rjcpt::bench::MakeInputSheet(rjcpt::bench::cWORKBOOK_ROWS);
+      std::string        retval = "depth;qc;fs;u2\n";
+      char               line[128];
+      for (std::size_t i = 0; i < sheet.RowCount(); i++)
+      {
+         const int length = std::snprintf(line, sizeof(line), "%.3f;%.4f;%.5f;%.5f\n", sheet.Column("depth")[i],
+                                          sheet.Column("qc")[i], sheet.Column("fs")[i], sheet.Column("u2")[i]);
+         retval.append(line, static_cast<std::size_t>(length));
+      }
+      return retval;
+   }
+
+   void BM_Workbook_SetFormulas(benchmark::State& aState)
+   {
+      const auto formulas = rjcpt::bench::MakeFormulas(rjcpt::bench::cWORKBOOK_FORMULAS);
+      for (auto _ : aState)
+      {
+         aState.PauseTiming();
+         rjcpt::Sheet sheet = rjcpt::bench::MakeInputSheet(1);
+         aState.ResumeTiming();
+         for (const auto& [name, formula] : formulas)
+         {
+            benchmark::DoNotOptimize(sheet.SetFormula(name, formula));
+         }
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * formulas.size()));
+   }
+   BENCHMARK(BM_Workbook_SetFormulas)->Unit(benchmark::kMillisecond);
+
+   // The same formulas in a new sheet each time, as in batch runs, sharing one cache.
+   void BM_Workbook_SetFormulas_Cache(benchmark::State& aState)
+   {
+      const auto          formulas = rjcpt::bench::MakeFormulas(rjcpt::bench::cWORKBOOK_FORMULAS);
+      rjcpt::FormulaCache cache;
+      for (auto _ : aState)
+      {
+         aState.PauseTiming();
+         rjcpt::Sheet sheet = rjcpt::bench::MakeInputSheet(1);
+         sheet.SetFormulaCache(&cache);
+         aState.ResumeTiming();
+         for (const auto& [name, formula] : formulas)
+         {
+            benchmark::DoNotOptimize(sheet.SetFormula(name, formula));
+         }
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * formulas.size()));
+   }
+   BENCHMARK(BM_Workbook_SetFormulas_Cache)->Unit(benchmark::kMillisecond);
+
+   //! Reads the workbook's formulas from a compiled template and sets them, which parses nothing.
+   void BM_Workbook_SetFormulas_Precompiled(benchmark::State& aState)
+   {
+      rjcpt::WorkbookTemplate workbook;
+      for (const auto& [name, formula] : rjcpt::bench::MakeFormulas(rjcpt::bench::cWORKBOOK_FORMULAS))
+      {
+         workbook.mFormulas.push_back(rjcpt::WorkbookTemplate::Formula{name, formula});
+      }
+      rjcpt::PrecompileTemplate(workbook);
+      const std::string data = rjcpt::WriteCompiledTemplate(workbook);
+      for (auto _ : aState)
+      {
+         aState.PauseTiming();
+         rjcpt::Sheet sheet = rjcpt::bench::MakeInputSheet(1);
+         aState.ResumeTiming();
+         benchmark::DoNotOptimize(rjcpt::ApplyTemplate(sheet, rjcpt::ParseWorkbookTemplate(data).value()));
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * workbook.mFormulas.size()));
+   }
+   BENCHMARK(BM_Workbook_SetFormulas_Precompiled)->Unit(benchmark::kMillisecond);
+
+   // Looks up every column of the workbook by name, as compiling and binding formulas does.
+   void BM_Workbook_Resolve(benchmark::State& aState)
+   {
+      const auto   formulas = rjcpt::bench::MakeFormulas(rjcpt::bench::cWORKBOOK_FORMULAS);
+      rjcpt::Sheet sheet    = rjcpt::bench::MakeInputSheet(1);
+      for (const auto& [name, formula] : formulas)
+      {
+         benchmark::DoNotOptimize(sheet.SetFormula(name, formula));
+      }
+      for (auto _ : aState)
+      {
+         for (const auto& [name, formula] : formulas)
+         {
+            benchmark::DoNotOptimize(sheet.Resolve(name));
+         }
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * formulas.size()));
+   }
+   BENCHMARK(BM_Workbook_Resolve);
+
+   // Changing the parameter makes every formula out of date.
+   void BM_Workbook_Recalculate(benchmark::State& aState)
+   {
+      rjcpt::Sheet sheet = MakeWorkbook();
+      double       a     = 0.8;
+      for (auto _ : aState)
+      {
+         a = 1.6 - a;
+         sheet.SetParameter("a", a);
+         benchmark::DoNotOptimize(sheet.Recalculate());
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * rjcpt::bench::cWORKBOOK_FORMULAS *
+                                                         rjcpt::bench::cWORKBOOK_ROWS));
+   }
+   BENCHMARK(BM_Workbook_Recalculate)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+   void BM_Workbook_RecalculateParallel(benchmark::State& aState)
+   {
+      rjcpt::Sheet      sheet = MakeWorkbook();
+      rjcpt::ThreadPool pool;
+      double            a = 0.8;
+      for (auto _ : aState)
+      {
+         a = 1.6 - a;
+         sheet.SetParameter("a", a);
+         benchmark::DoNotOptimize(sheet.Recalculate(pool));
+      }
+      aState.SetItemsProcessed(static_cast<std::int64_t>(aState.iterations() * rjcpt::bench::cWORKBOOK_FORMULAS *
+                                                         rjcpt::bench::cWORKBOOK_ROWS));
+      aState.counters["threads"] = static_cast<double>(pool.ThreadCount());
+   }
+   BENCHMARK(BM_Workbook_RecalculateParallel)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+   void BM_Workbook_ParseDataFile(benchmark::State& aState)
+   {
+      const std::string text = MakeDataText();
+      for (auto _ : aState)
+      {
+         benchmark::DoNotOptimize(rjcpt::ParseDataFile(text));
+      }
+      aState.SetBytesProcessed(static_cast<std::int64_t>(aState.iterations() * text.size()));
+   }
+   BENCHMARK(BM_Workbook_ParseDataFile)->Unit(benchmark::kMillisecond);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Sheet.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rjcpt::bench
+{
+   constexpr std::size_t cWORKBOOK_ROWS     = 100000;
+   constexpr std::size_t cWORKBOOK_FORMULAS = 300;
+
+   //! Returns aCount synthetic formulas named f0, f1, ..., in the style of CPT interpretations.
+   //! Each formula reads the input columns, the parameter "a" and up to two earlier formulas, so the formulas form
+   //! a deep dependency graph with some independent branches. Every formula depends on $a.
+   inline std::vector<std::pair<std::string, std::string>> MakeFormulas(std::size_t aCount)
+   {
+      std::vector<std::pair<std::string, std::string>> retval;
+      retval.reserve(aCount);
+      retval.emplace_back("f0", "qc + (1 - $a) u2");
+      for (std::size_t i = 1; i < aCount; i++)
+      {
+         const std::string p = "f" + std::to_string(i - 1);
+         const std::string q = "f" + std::to_string(i / 2);
+         std::string       formula;
+         switch (i % 6)
+         {
+         case 0:
+            formula = p + " + $a * fs";
+            break;
+         case 1:
+            formula = "(" + p + " - " + q + ") / max(abs(" + q + "), 1)";
+            break;
+         case 2:
+            formula = "if(" + p + " > " + q + ", sqrt(abs(" + p + ")), ln(1 + abs(" + q + ")))";
+            break;
+         case 3:
+            formula = "min(" + p + ", qc) * 0.5 + max(" + q + ", fs) * 0.5";
+            break;
+         case 4:
+            formula = p + " < " + q + " and " + q + " < depth or not (fs > 0.1)";
+            break;
+         default:
+            formula = "pow(abs(" + p + "), 0.5) + 2 depth - $a";
+            break;
+         }
+         retval.emplace_back("f" + std::to_string(i), std::move(formula));
+      }
+      return retval;
+   }
+
+   //! Returns a sheet with aRows rows of smooth synthetic CPT data in the columns depth, qc, fs and u2,
+   //! and the parameter a. No formulas are set.
+   inline Sheet MakeInputSheet(std::size_t aRows)
+   {
+      std::vector<double> depth(aRows);
+      std::vector<double> qc(aRows);
+      std::vector<double> fs(aRows);
+      std::vector<double> u2(aRows);
+      for (std::size_t i = 0; i < aRows; i++)
+      {
+         const double x = static_cast<double>(i);
+         depth[i] = x * 0.02;
+         qc[i]    = 1.0 + 5.0 * std::sin(x * 0.01) * std::sin(x * 0.01);
+         fs[i]    = 0.02 + 0.05 * std::cos(x * 0.003) * std::cos(x * 0.003);
+         u2[i]    = 0.01 * depth[i] + 0.1 * std::sin(x * 0.07);
+      }
+      Sheet retval;
+      retval.SetColumn("depth", std::move(depth));
+      retval.SetColumn("qc", std::move(qc));
+      retval.SetColumn("fs", std::move(fs));
+      retval.SetColumn("u2", std::move(u2));
+      retval.SetParameter("a", 0.8);
+      return retval;
+   }
+}
@@ -0,0 +1,181 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Besides the usual Google Benchmark flags, rjcpt_core_bench accepts:
+//   --baseline=<file>   JSON written by an earlier run with --benchmark_out=<file>. After running, each benchmark's
+//                       CPU time is compared with the baseline, and the run fails if any is slower than allowed.
+//                       Results are then printed to the console, whatever --benchmark_format says.
+//   --threshold=<pct>   Allowed slowdown against the baseline, in percent. Defaults to 10.
+// For example:
+//   rjcpt_core_bench --benchmark_out=baseline.json --benchmark_out_format=json
+//   rjcpt_core_bench --baseline=baseline.json --benchmark_repetitions=5 --benchmark_report_aggregates_only=true
+
+namespace
+{
+   //! CPU time per iteration in seconds, by benchmark name.
+   using Timings = std::map<std::string, double, std::less<>>;
+
+   double UnitsPerSecond(std::string_view aUnit)
+   {
+      if (aUnit == "ns")
+      {
+         return 1e9;
+      }
+      else if (aUnit == "us")
+      {
+         return 1e6;
+      }
+      else if (aUnit == "ms")
+      {
+         return 1e3;
+      }
+      return 1.0;
+   }
+
+   //! Returns the string value of a "key": "value" line, or an empty view if aLine does not hold aKey.
+   std::string_view StringValue(std::string_view aLine, std::string_view aKey)
+   {
+      const std::size_t pos = aLine.find("\"" + std::string(aKey) + "\": \"");
+      if (pos == std::string_view::npos)
+      {
+         return {};
+      }
+      const std::size_t begin = pos + aKey.size() + 5;
+      const std::size_t end   = aLine.find('"', begin);
+      return end == std::string_view::npos ? std::string_view() : aLine.substr(begin, end - begin);
+   }
+
+   //! Reads the benchmark results from a file written with --benchmark_out_format=json.
+   //! Google Benchmark writes one key per line, which is all this relies on.
+   bool ReadBaseline(const std::string& aPath, Timings& aTimings)
+   {
+      std::ifstream file(aPath);
+      if (!file)
+      {
+         return false;
+      }
+      std::string name;
+      double      cpuTime = 0.0;
+      std::string line;
+      while (std::getline(file, line))
+      {
+         if (const std::string_view value = StringValue(line, "name"); !value.empty())
+         {
+            name = value;
+         }
+         else if (const std::size_t pos = line.find("\"cpu_time\": "); pos != std::string::npos)
+         {
+            cpuTime = std::strtod(line.c_str() + pos + 12, nullptr);
+         }
+         else if (const std::string_view unit = StringValue(line, "time_unit"); !unit.empty() && !name.empty())
+         {
+            aTimings[name] = cpuTime / UnitsPerSecond(unit);
+            name.clear();
+         }
+      }
+      return true;
+   }
+
+   //! Prints results to the console like the default reporter, and remembers them for the comparison.
+   class RecordingReporter : public benchmark::ConsoleReporter
+   {
+   public:
+      void ReportRuns(const std::vector<Run>& aRuns) override
+      {
+         for (const Run& run : aRuns)
+         {
+            if (!run.error_occurred)
+            {
+               mTimings[run.benchmark_name()] = run.GetAdjustedCPUTime() / benchmark::GetTimeUnitMultiplier(run.time_unit);
+            }
+         }
+         ConsoleReporter::ReportRuns(aRuns);
+      }
+
+      const Timings& Results() const { return mTimings; }
+
+   private:
+      Timings mTimings;
+   };
+
+   //! Prints the change of each benchmark against the baseline. Returns the number of benchmarks that are slower
+   //! than allowed.
+   int Compare(const Timings& aBaseline, const Timings& aResults, double aThreshold)
+   {
+      int retval = 0;
+      std::printf("\nComparison with baseline (allowed slowdown %.1f%%):\n", aThreshold);
+      for (const auto& [name, seconds] : aResults)
+      {
+         const auto baseline = aBaseline.find(name);
+         if (baseline == aBaseline.end() || baseline->second <= 0.0)
+         {
+            std::printf("  %-60s      new\n", name.c_str());
+            continue;
+         }
+         const double change = (seconds / baseline->second - 1.0) * 100.0;
+         const bool   slower = change > aThreshold;
+         std::printf("  %-60s %+7.1f%%%s\n", name.c_str(), change, slower ? "  SLOWER" : "");
+         retval += slower ? 1 : 0;
+      }
+      return retval;
+   }
+}
+
+int main(int argc, char** argv)
+{
+   std::string baselinePath;
+   double      threshold = 10.0;
+
+   // Remove our own flags before Google Benchmark sees them.
+   std::vector<char*> arguments;
+   for (int i = 0; i < argc; i++)
+   {
+      const std::string_view argument(argv[i]);
+      if (argument.starts_with("--baseline="))
+      {
+         baselinePath = argument.substr(11);
+      }
+      else if (argument.starts_with("--threshold="))
+      {
+         threshold = std::strtod(argv[i] + 12, nullptr);
+      }
+      else
+      {
+         arguments.push_back(argv[i]);
+      }
+   }
+   int count = static_cast<int>(arguments.size());
+
+   benchmark::Initialize(&count, arguments.data());
+   if (benchmark::ReportUnrecognizedArguments(count, arguments.data()))
+   {
+      return 1;
+   }
+
+   Timings baseline;
+   if (!baselinePath.empty() && !ReadBaseline(baselinePath, baseline))
+   {
+      std::fprintf(stderr, "Cannot read baseline %s\n", baselinePath.c_str());
+      return 1;
+   }
+
+   if (baselinePath.empty())
+   {
+      // Without a baseline, --benchmark_format chooses the reporter as usual.
+      benchmark::RunSpecifiedBenchmarks();
+      benchmark::Shutdown();
+      return 0;
+   }
+
+   RecordingReporter reporter;
+   benchmark::RunSpecifiedBenchmarks(&reporter);
+   benchmark::Shutdown();
+   return Compare(baseline, reporter.Results(), threshold) > 0 ? 2 : 0;
+}
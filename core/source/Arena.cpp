@@ -0,0 +1,58 @@
+#include "Arena.hpp"
+
+#include <algorithm>
+
+rjcpt::Arena::Arena(std::size_t aChunkSize)
+   : mChunkSize(std::max<std::size_t>(aChunkSize, 256))
+{
+}
+
+void rjcpt::Arena::Reset()
+{
+   mCurrent = 0;
+   mOffset  = 0;
+   mUsed    = 0;
+}
+
+void rjcpt::Arena::Release()
+{
+   mChunks.clear();
+   Reset();
+}
+
+std::size_t rjcpt::Arena::Capacity() const
+{
+   std::size_t retval = 0;
+   for (const Chunk& chunk : mChunks)
+   {
+      retval += chunk.mSize;
+   }
+   return retval;
+}
+
+void* rjcpt::Arena::do_allocate(std::size_t aBytes, std::size_t aAlignment)
+{
+   // Chunks are kept after Reset(), so look through the remaining ones before allocating a new one.
+   for (; mCurrent < mChunks.size(); ++mCurrent, mOffset = 0)
+   {
+      Chunk&            chunk   = mChunks[mCurrent];
+      const auto        address = reinterpret_cast<std::uintptr_t>(chunk.mData.get()) + mOffset;
+      const std::size_t padding = (aAlignment - address % aAlignment) % aAlignment;
+      if (mOffset + padding + aBytes <= chunk.mSize)
+      {
+         mOffset += padding + aBytes;
+         mUsed   += padding + aBytes;
+         return chunk.mData.get() + mOffset - aBytes;
+      }
+   }
+
+   // Memory from operator new[] is aligned for any fundamental type. Larger alignments get extra room.
+   const std::size_t size    = std::max(mChunkSize, aBytes + aAlignment);
+   Chunk&            chunk   = mChunks.emplace_back(Chunk{std::make_unique_for_overwrite<std::byte[]>(size), size});
+   const auto        address = reinterpret_cast<std::uintptr_t>(chunk.mData.get());
+   const std::size_t padding = (aAlignment - address % aAlignment) % aAlignment;
+   mCurrent = mChunks.size() - 1;
+   mOffset  = padding + aBytes;
+   mUsed   += padding + aBytes;
+   return chunk.mData.get() + padding;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "rjcpt_core_export.h"
+
+namespace rjcpt
+{
+   //! A memory resource that hands out memory from large chunks, and frees it all at once.
+   //! Deallocation does nothing; Reset() makes all of the memory available again, keeping the chunks, so an arena
+   //! that is reset between batches of similar size stops allocating from the heap after the first batch.
+   //! Allocations are contiguous within a chunk. An Arena must not move while memory from it is in use,
+   //! since containers that use it keep a pointer to it.
+   class RJCPT_CORE_EXPORT Arena : public std::pmr::memory_resource
+   {
+   public:
+      static constexpr std::size_t cDEFAULT_CHUNK_SIZE = 64 * 1024;
+
+      explicit Arena(std::size_t aChunkSize = cDEFAULT_CHUNK_SIZE);
+
+      Arena(const Arena&) = delete;
+      Arena& operator=(const Arena&) = delete;
+
+      //! Copies aValues into the arena. T must be trivially copyable.
+      template<typename T>
+      std::span<T> Copy(std::span<const T> aValues)
+      {
+         static_assert(std::is_trivially_copyable_v<T>);
+         T* data = static_cast<T*>(allocate(aValues.size_bytes() == 0 ? 1 : aValues.size_bytes(), alignof(T)));
+         std::uninitialized_copy(aValues.begin(), aValues.end(), data);
+         return std::span<T>(data, aValues.size());
+      }
+
+      //! Makes all memory available again. Everything allocated from the arena must no longer be in use.
+      void Reset();
+      //! Same as Reset(), and also returns the chunks to the heap.
+      void Release();
+
+      //! Number of bytes handed out since the last Reset(), including padding for alignment.
+      std::size_t BytesUsed() const { return mUsed; }
+      //! Total size of the chunks.
+      std::size_t Capacity() const;
+
+   private:
+      void* do_allocate(std::size_t aBytes, std::size_t aAlignment) override;
+      void  do_deallocate(void*, std::size_t, std::size_t) override {}
+      bool  do_is_equal(const std::pmr::memory_resource& aOther) const noexcept override { return this == &aOther; }
+
+      struct Chunk
+      {
+         std::unique_ptr<std::byte[]> mData;
+         std::size_t                  mSize = 0;
+      };
+
+      std::size_t        mChunkSize;
+      std::vector<Chunk> mChunks;
+      std::size_t        mCurrent = 0; // Chunk that allocations come from.
+      std::size_t        mOffset  = 0; // First free byte in the current chunk.
+      std::size_t        mUsed    = 0;
+   };
+}
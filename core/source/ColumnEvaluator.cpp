@@ -0,0 +1,885 @@
+#include "ColumnEvaluator.hpp"
+
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define RJCPT_X86_64 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// MSVC allows AVX intrinsics in any function.
+#define RJCPT_TARGET_AVX2
+#else
+#define RJCPT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define RJCPT_X86_64 0
+#endif
+
+namespace
+{
+   using OC = rjcpt::OpCode;
+
+   constexpr double AsDouble(bool aValue)
+   {
+      return aValue ? 1.0 : 0.0;
+   }
+
+   constexpr bool IsTrue(double aValue)
+   {
+      return aValue != 0.0;
+   }
+
+   bool Compare(rjcpt::CompareKind aKind, double aLeft, double aRight)
+   {
+      using CK = rjcpt::CompareKind;
+      switch (aKind)
+      {
+      case CK::Equal:
+         return aLeft == aRight;
+      case CK::NotEqual:
+         return aLeft != aRight;
+      case CK::LessThan:
+         return aLeft < aRight;
+      case CK::LessOrEqual:
+         return aLeft <= aRight;
+      case CK::GreaterThan:
+         return aLeft > aRight;
+      case CK::GreaterOrEqual:
+         return aLeft >= aRight;
+      }
+      return false;
+   }
+
+   // Kernels apply one instruction to aCount rows, writing to aOut, which may be the same as an operand.
+   // Binary kernels combine aLeft and aRight. AndEnd and OrEnd combine both operands of "and" and "or".
+   using BinaryKernel = void (*)(OC aOpCode, double* aOut, const double* aLeft, const double* aRight, std::size_t aCount);
+   using UnaryKernel  = void (*)(OC aOpCode, double* aOut, const double* aValues, std::size_t aCount);
+
+   // The scalar kernels mirror the interpreter in Evaluator.cpp exactly.
+   void BinaryScalar(OC aOpCode, double* aOut, const double* aLeft, const double* aRight, std::size_t aCount)
+   {
+      switch (aOpCode)
+      {
+      case OC::Add:
+         for (std::size_t i = 0; i < aCount; i++) aOut[i] = aLeft[i] + aRight[i];
+         break;
+      case OC::Subtract:
+         for (std::size_t i = 0; i < aCount; i++) aOut[i] = aLeft[i] - aRight[i];
+         break;
+      case OC::Multiply:
+         for (std::size_t i = 0; i < aCount; i++) aOut[i] = aLeft[i] * aRight[i];
+         break;
+      case OC::Divide:
+         for (std::size_t i = 0; i < aCount; i++) aOut[i] = aLeft[i] / aRight[i];
+         break;
+      case OC::CompareEqual:
+         for (std::size_t i = 0; i < aCount; i++) aOut[i] = AsDouble(aLeft[i] == aRight[i]);
+         break;
+      case OC::CompareNotEqual:
+         for (std::size_t i = 0; i < aCount; i++) aOut[i] = AsDouble(aLeft[i] != aRight[i]);
+         break;
+      case OC::CompareLessThan:
+         for (std::size_t i = 0; i < aCount; i++) aOut[i] = AsDouble(aLeft[i] < aRight[i]);
+         break;
+      case OC::CompareLessOrEqual:
+         for (std::size_t i = 0; i < aCount; i++) aOut[i] = AsDouble(aLeft[i] <= aRight[i]);
+         break;
+      case OC::CompareGreaterThan:
+         for (std::size_t i = 0; i < aCount; i++) aOut[i] = AsDouble(aLeft[i] > aRight[i]);
+         break;
+      case OC::CompareGreaterOrEqual:
+         for (std::size_t i = 0; i < aCount; i++) aOut[i] = AsDouble(aLeft[i] >= aRight[i]);
+         break;
+      case OC::AndEnd:
+         for (std::size_t i = 0; i < aCount; i++) aOut[i] = AsDouble(IsTrue(aLeft[i]) && IsTrue(aRight[i]));
+         break;
+      case OC::OrEnd:
+         for (std::size_t i = 0; i < aCount; i++) aOut[i] = AsDouble(IsTrue(aLeft[i]) || IsTrue(aRight[i]));
+         break;
+      default:
+         assert(false);
+         break;
+      }
+   }
+
+   void UnaryScalar(OC aOpCode, double* aOut, const double* aValues, std::size_t aCount)
+   {
+      switch (aOpCode)
+      {
+      case OC::Negate:
+         for (std::size_t i = 0; i < aCount; i++) aOut[i] = -aValues[i];
+         break;
+      case OC::LogicalNot:
+         for (std::size_t i = 0; i < aCount; i++) aOut[i] = AsDouble(!IsTrue(aValues[i]));
+         break;
+      default:
+         assert(false);
+         break;
+      }
+   }
+
+#if RJCPT_X86_64
+   // Comparisons use ordered predicates, except for "not equal", which is true for NaN like the scalar operator.
+   // Masks are turned into 1.0 and 0.0 by and-ing them with 1.0.
+#define RJCPT_SIMD_LOOP(WIDTH, STATEMENT) \
+   for (; i + (WIDTH) <= aCount; i += (WIDTH)) { STATEMENT; }
+
+   void BinarySse2(OC aOpCode, double* aOut, const double* aLeft, const double* aRight, std::size_t aCount)
+   {
+      const __m128d one  = _mm_set1_pd(1.0);
+      const __m128d zero = _mm_setzero_pd();
+      std::size_t i = 0;
+#define RJCPT_SSE2_BINARY(EXPR) \
+      RJCPT_SIMD_LOOP(2, const __m128d a = _mm_loadu_pd(aLeft + i); const __m128d b = _mm_loadu_pd(aRight + i); _mm_storeu_pd(aOut + i, (EXPR)))
+      switch (aOpCode)
+      {
+      case OC::Add:
+         RJCPT_SSE2_BINARY(_mm_add_pd(a, b));
+         break;
+      case OC::Subtract:
+         RJCPT_SSE2_BINARY(_mm_sub_pd(a, b));
+         break;
+      case OC::Multiply:
+         RJCPT_SSE2_BINARY(_mm_mul_pd(a, b));
+         break;
+      case OC::Divide:
+         RJCPT_SSE2_BINARY(_mm_div_pd(a, b));
+         break;
+      case OC::CompareEqual:
+         RJCPT_SSE2_BINARY(_mm_and_pd(_mm_cmpeq_pd(a, b), one));
+         break;
+      case OC::CompareNotEqual:
+         RJCPT_SSE2_BINARY(_mm_and_pd(_mm_cmpneq_pd(a, b), one));
+         break;
+      case OC::CompareLessThan:
+         RJCPT_SSE2_BINARY(_mm_and_pd(_mm_cmplt_pd(a, b), one));
+         break;
+      case OC::CompareLessOrEqual:
+         RJCPT_SSE2_BINARY(_mm_and_pd(_mm_cmple_pd(a, b), one));
+         break;
+      case OC::CompareGreaterThan:
+         RJCPT_SSE2_BINARY(_mm_and_pd(_mm_cmpgt_pd(a, b), one));
+         break;
+      case OC::CompareGreaterOrEqual:
+         RJCPT_SSE2_BINARY(_mm_and_pd(_mm_cmpge_pd(a, b), one));
+         break;
+      case OC::AndEnd:
+         RJCPT_SSE2_BINARY(_mm_and_pd(_mm_and_pd(_mm_cmpneq_pd(a, zero), _mm_cmpneq_pd(b, zero)), one));
+         break;
+      case OC::OrEnd:
+         RJCPT_SSE2_BINARY(_mm_and_pd(_mm_or_pd(_mm_cmpneq_pd(a, zero), _mm_cmpneq_pd(b, zero)), one));
+         break;
+      default:
+         break;
+      }
+#undef RJCPT_SSE2_BINARY
+      BinaryScalar(aOpCode, aOut + i, aLeft + i, aRight + i, aCount - i);
+   }
+
+   void UnarySse2(OC aOpCode, double* aOut, const double* aValues, std::size_t aCount)
+   {
+      const __m128d one  = _mm_set1_pd(1.0);
+      const __m128d zero = _mm_setzero_pd();
+      const __m128d sign = _mm_set1_pd(-0.0);
+      std::size_t i = 0;
+      switch (aOpCode)
+      {
+      case OC::Negate:
+         RJCPT_SIMD_LOOP(2, _mm_storeu_pd(aOut + i, _mm_xor_pd(_mm_loadu_pd(aValues + i), sign)));
+         break;
+      case OC::LogicalNot:
+         RJCPT_SIMD_LOOP(2, _mm_storeu_pd(aOut + i, _mm_and_pd(_mm_cmpeq_pd(_mm_loadu_pd(aValues + i), zero), one)));
+         break;
+      default:
+         break;
+      }
+      UnaryScalar(aOpCode, aOut + i, aValues + i, aCount - i);
+   }
+
+   RJCPT_TARGET_AVX2 void BinaryAvx2(OC aOpCode, double* aOut, const double* aLeft, const double* aRight, std::size_t aCount)
+   {
+      const __m256d one  = _mm256_set1_pd(1.0);
+      const __m256d zero = _mm256_setzero_pd();
+      std::size_t i = 0;
+#define RJCPT_AVX2_BINARY(EXPR) \
+      RJCPT_SIMD_LOOP(4, const __m256d a = _mm256_loadu_pd(aLeft + i); const __m256d b = _mm256_loadu_pd(aRight + i); _mm256_storeu_pd(aOut + i, (EXPR)))
+      switch (aOpCode)
+      {
+      case OC::Add:
+         RJCPT_AVX2_BINARY(_mm256_add_pd(a, b));
+         break;
+      case OC::Subtract:
+         RJCPT_AVX2_BINARY(_mm256_sub_pd(a, b));
+         break;
+      case OC::Multiply:
+         RJCPT_AVX2_BINARY(_mm256_mul_pd(a, b));
+         break;
+      case OC::Divide:
+         RJCPT_AVX2_BINARY(_mm256_div_pd(a, b));
+         break;
+      case OC::CompareEqual:
+         RJCPT_AVX2_BINARY(_mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_EQ_OQ), one));
+         break;
+      case OC::CompareNotEqual:
+         RJCPT_AVX2_BINARY(_mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_NEQ_UQ), one));
+         break;
+      case OC::CompareLessThan:
+         RJCPT_AVX2_BINARY(_mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_LT_OQ), one));
+         break;
+      case OC::CompareLessOrEqual:
+         RJCPT_AVX2_BINARY(_mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_LE_OQ), one));
+         break;
+      case OC::CompareGreaterThan:
+         RJCPT_AVX2_BINARY(_mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_GT_OQ), one));
+         break;
+      case OC::CompareGreaterOrEqual:
+         RJCPT_AVX2_BINARY(_mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_GE_OQ), one));
+         break;
+      case OC::AndEnd:
+         RJCPT_AVX2_BINARY(_mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(a, zero, _CMP_NEQ_UQ), _mm256_cmp_pd(b, zero, _CMP_NEQ_UQ)), one));
+         break;
+      case OC::OrEnd:
+         RJCPT_AVX2_BINARY(_mm256_and_pd(_mm256_or_pd(_mm256_cmp_pd(a, zero, _CMP_NEQ_UQ), _mm256_cmp_pd(b, zero, _CMP_NEQ_UQ)), one));
+         break;
+      default:
+         break;
+      }
+#undef RJCPT_AVX2_BINARY
+      BinaryScalar(aOpCode, aOut + i, aLeft + i, aRight + i, aCount - i);
+   }
+
+   RJCPT_TARGET_AVX2 void UnaryAvx2(OC aOpCode, double* aOut, const double* aValues, std::size_t aCount)
+   {
+      const __m256d one  = _mm256_set1_pd(1.0);
+      const __m256d zero = _mm256_setzero_pd();
+      const __m256d sign = _mm256_set1_pd(-0.0);
+      std::size_t i = 0;
+      switch (aOpCode)
+      {
+      case OC::Negate:
+         RJCPT_SIMD_LOOP(4, _mm256_storeu_pd(aOut + i, _mm256_xor_pd(_mm256_loadu_pd(aValues + i), sign)));
+         break;
+      case OC::LogicalNot:
+         RJCPT_SIMD_LOOP(4, _mm256_storeu_pd(aOut + i, _mm256_and_pd(_mm256_cmp_pd(_mm256_loadu_pd(aValues + i), zero, _CMP_EQ_OQ), one)));
+         break;
+      default:
+         break;
+      }
+      UnaryScalar(aOpCode, aOut + i, aValues + i, aCount - i);
+   }
+#undef RJCPT_SIMD_LOOP
+#endif
+
+   BinaryKernel GetBinaryKernel(rjcpt::SimdLevel aLevel)
+   {
+      switch (aLevel)
+      {
+#if RJCPT_X86_64
+      case rjcpt::SimdLevel::Avx2:
+         return &BinaryAvx2;
+      case rjcpt::SimdLevel::Sse2:
+         return &BinarySse2;
+#endif
+      default:
+         return &BinaryScalar;
+      }
+   }
+
+   UnaryKernel GetUnaryKernel(rjcpt::SimdLevel aLevel)
+   {
+      switch (aLevel)
+      {
+#if RJCPT_X86_64
+      case rjcpt::SimdLevel::Avx2:
+         return &UnaryAvx2;
+      case rjcpt::SimdLevel::Sse2:
+         return &UnarySse2;
+#endif
+      default:
+         return &UnaryScalar;
+      }
+   }
+}
+
+rjcpt::SimdLevel rjcpt::DetectSimdLevel()
+{
+#if RJCPT_X86_64
+#if defined(_MSC_VER) && !defined(__clang__)
+   std::array<int, 4> info = {};
+   __cpuid(info.data(), 0);
+   if (info[0] >= 7)
+   {
+      __cpuid(info.data(), 1);
+      const bool osxsave = (info[2] & (1 << 27)) != 0;
+      const bool avx     = (info[2] & (1 << 28)) != 0;
+      __cpuidex(info.data(), 7, 0);
+      const bool avx2 = (info[1] & (1 << 5)) != 0;
+      if (osxsave && avx && avx2 && (_xgetbv(0) & 0x6) == 0x6)
+      {
+         return SimdLevel::Avx2;
+      }
+   }
+#else
+   if (__builtin_cpu_supports("avx2"))
+   {
+      return SimdLevel::Avx2;
+   }
+#endif
+   // SSE2 is part of the x86-64 baseline.
+   return SimdLevel::Sse2;
+#else
+   return SimdLevel::Scalar;
+#endif
+}
+
+rjcpt::ColumnEvaluator::ColumnEvaluator(SimdLevel aLevel)
+   : mLevel(std::min(aLevel, DetectSimdLevel()))
+{
+}
+
+void rjcpt::ColumnEvaluator::Evaluate(const Program& aProgram, const EvaluationContext& aContext, std::span<double> aOutput)
+{
+   RJCPT_TRACE_SCOPE("EvaluateColumn");
+   RJCPT_TRACE_COUNT(EvaluatedRows, aOutput.size());
+   constexpr std::size_t B = cBLOCK_SIZE;
+   mValues.resize(std::size_t{aProgram.mMaxStackDepth} * B);
+   mComparisons.resize(std::size_t{aProgram.mMaxStackDepth} * B);
+   mLocals.resize(std::size_t{aProgram.mLocalCount} * B);
+
+   const BinaryKernel binary = GetBinaryKernel(mLevel);
+   const UnaryKernel  unary  = GetUnaryKernel(mLevel);
+
+   for (std::size_t first = 0; first < aOutput.size(); first += B)
+   {
+      const std::size_t count = std::min(B, aOutput.size() - first);
+      const std::size_t row   = aContext.mRow + first;
+
+      // Entry k of each stack occupies [k * B, k * B + count).
+      double* values          = mValues.data();
+      double* comparisons     = mComparisons.data();
+      std::size_t valueCount      = 0;
+      std::size_t comparisonCount = 0;
+      auto top = [&](std::size_t aDepth = 0) { return values + (valueCount - 1 - aDepth) * B; };
+
+      for (const EvaluatorInstruction& instruction : aProgram.mCode)
+      {
+         switch (instruction.mOpCode)
+         {
+         case OpCode::Return:
+            assert(valueCount == 1);
+            std::memcpy(aOutput.data() + first, values, count * sizeof(double));
+            break;
+         case OpCode::PushConstant:
+            ++valueCount;
+            std::fill_n(top(), count, aProgram.mConstants[instruction.mOperand]);
+            break;
+         case OpCode::LoadColumn:
+            ++valueCount;
+            std::memcpy(top(), aContext.mColumns[instruction.mOperand] + row, count * sizeof(double));
+            break;
+         case OpCode::LoadParameter:
+            ++valueCount;
+            std::fill_n(top(), count, aContext.mParameters[instruction.mOperand]);
+            break;
+         case OpCode::StoreLocal:
+            std::memcpy(mLocals.data() + instruction.mOperand * B, top(), count * sizeof(double));
+            break;
+         case OpCode::LoadLocal:
+            ++valueCount;
+            std::memcpy(top(), mLocals.data() + instruction.mOperand * B, count * sizeof(double));
+            break;
+         case OpCode::Negate:
+         case OpCode::LogicalNot:
+            unary(instruction.mOpCode, top(), top(), count);
+            break;
+         case OpCode::Add:
+         case OpCode::Subtract:
+         case OpCode::Multiply:
+         case OpCode::Divide:
+         case OpCode::CompareEqual:
+         case OpCode::CompareNotEqual:
+         case OpCode::CompareLessThan:
+         case OpCode::CompareLessOrEqual:
+         case OpCode::CompareGreaterThan:
+         case OpCode::CompareGreaterOrEqual:
+         case OpCode::AndEnd:
+         case OpCode::OrEnd:
+            binary(instruction.mOpCode, top(1), top(1), top(), count);
+            --valueCount;
+            break;
+         case OpCode::AndJump:
+         case OpCode::OrJump:
+            // Keep the left operand; AndEnd and OrEnd combine it with the right operand.
+            break;
+         case OpCode::ChainBegin:
+            std::fill_n(comparisons + comparisonCount * B, count, 1.0);
+            ++comparisonCount;
+            break;
+         case OpCode::ChainCompare:
+         {
+            const auto kind   = static_cast<CompareKind>(instruction.mOperand);
+            double*    result = comparisons + (comparisonCount - 1) * B;
+            double*    left   = top(1);
+            double*    right  = top();
+            for (std::size_t i = 0; i < count; i++)
+            {
+               result[i] = AsDouble(IsTrue(result[i]) && ::Compare(kind, left[i], right[i]));
+               left[i]   = right[i];
+            }
+            --valueCount;
+            break;
+         }
+         case OpCode::ChainEnd:
+            --comparisonCount;
+            std::memcpy(top(), comparisons + comparisonCount * B, count * sizeof(double));
+            break;
+         case OpCode::Call:
+         {
+            const std::size_t argc     = instruction.mOperand >> 8;
+            const auto        function = static_cast<BuiltinFunction>(instruction.mOperand & 0xFFU);
+            const double*     args     = values + (valueCount - argc) * B;
+            std::array<double, 256> rowArgs;
+            for (std::size_t i = 0; i < count; i++)
+            {
+               for (std::size_t a = 0; a < argc; a++)
+               {
+                  rowArgs[a] = args[a * B + i];
+               }
+               // The result overwrites the first argument, which has already been read for this row.
+               values[(valueCount - argc) * B + i] = CallBuiltin(function, std::span<const double>(rowArgs.data(), argc));
+            }
+            valueCount = valueCount - argc + 1;
+            break;
+         }
+         default:
+            assert(false);
+            break;
+         }
+      }
+   }
+}
+
+struct rjcpt::ThreadedProgram::Frame
+{
+   const double* const* mSlots;     // Where the values of each slot are.
+   double*              mScratch;   // Scratch blocks of all slots, which steps write to.
+   const std::uint32_t* mArguments;
+   std::size_t          mCount = 0; // Rows in the current block.
+
+   double* Out(const Step& aStep) const { return mScratch + aStep.mOut * ColumnEvaluator::cBLOCK_SIZE; }
+};
+
+//! The functions steps point to. Each one handles a single instruction, or a single function, for a whole block.
+struct rjcpt::ThreadedProgram::Steps
+{
+   template <BinaryKernel tKernel>
+   static void Binary(const Step& aStep, const Frame& aFrame)
+   {
+      tKernel(aStep.mOpCode, aFrame.Out(aStep), aFrame.mSlots[aStep.mLeft], aFrame.mSlots[aStep.mRight], aFrame.mCount);
+   }
+
+   template <UnaryKernel tKernel>
+   static void Unary(const Step& aStep, const Frame& aFrame)
+   {
+      tKernel(aStep.mOpCode, aFrame.Out(aStep), aFrame.mSlots[aStep.mLeft], aFrame.mCount);
+   }
+
+   static void Copy(const Step& aStep, const Frame& aFrame)
+   {
+      std::memcpy(aFrame.Out(aStep), aFrame.mSlots[aStep.mLeft], aFrame.mCount * sizeof(double));
+   }
+
+   static void ChainBegin(const Step& aStep, const Frame& aFrame)
+   {
+      std::fill_n(aFrame.Out(aStep), aFrame.mCount, 1.0);
+   }
+
+   template <CompareKind tKind>
+   static void ChainCompare(const Step& aStep, const Frame& aFrame)
+   {
+      double*       result = aFrame.Out(aStep);
+      const double* left   = aFrame.mSlots[aStep.mLeft];
+      const double* right  = aFrame.mSlots[aStep.mRight];
+      for (std::size_t i = 0; i < aFrame.mCount; i++)
+      {
+         result[i] = AsDouble(IsTrue(result[i]) && ::Compare(tKind, left[i], right[i]));
+      }
+   }
+
+   template <BuiltinFunction tFunction>
+   static void CallUnary(const Step& aStep, const Frame& aFrame)
+   {
+      using BF = BuiltinFunction;
+      double*       out = aFrame.Out(aStep);
+      const double* x   = aFrame.mSlots[aFrame.mArguments[aStep.mLeft]];
+      for (std::size_t i = 0; i < aFrame.mCount; i++)
+      {
+         if constexpr (tFunction == BF::Abs) out[i] = std::fabs(x[i]);
+         else if constexpr (tFunction == BF::Sqrt) out[i] = std::sqrt(x[i]);
+         else if constexpr (tFunction == BF::Exp) out[i] = std::exp(x[i]);
+         else if constexpr (tFunction == BF::Ln) out[i] = std::log(x[i]);
+         else out[i] = std::log10(x[i]);
+      }
+   }
+
+   static void CallPow(const Step& aStep, const Frame& aFrame)
+   {
+      double*       out = aFrame.Out(aStep);
+      const double* x   = aFrame.mSlots[aFrame.mArguments[aStep.mLeft]];
+      const double* y   = aFrame.mSlots[aFrame.mArguments[aStep.mLeft + 1]];
+      for (std::size_t i = 0; i < aFrame.mCount; i++)
+      {
+         out[i] = std::pow(x[i], y[i]);
+      }
+   }
+
+   static void CallIf(const Step& aStep, const Frame& aFrame)
+   {
+      double*       out       = aFrame.Out(aStep);
+      const double* condition = aFrame.mSlots[aFrame.mArguments[aStep.mLeft]];
+      const double* yes       = aFrame.mSlots[aFrame.mArguments[aStep.mLeft + 1]];
+      const double* no        = aFrame.mSlots[aFrame.mArguments[aStep.mLeft + 2]];
+      for (std::size_t i = 0; i < aFrame.mCount; i++)
+      {
+         out[i] = IsTrue(condition[i]) ? yes[i] : no[i];
+      }
+   }
+
+   //! Keeps the first of the smallest (or largest) arguments, like std::ranges::min_element (or max_element).
+   template <bool tMax>
+   static void CallMinMax(const Step& aStep, const Frame& aFrame)
+   {
+      double*              out       = aFrame.Out(aStep);
+      const std::uint32_t* arguments = aFrame.mArguments + aStep.mLeft;
+      // Only the first argument can be in the same place as the result.
+      if (aFrame.mSlots[arguments[0]] != out)
+      {
+         std::memcpy(out, aFrame.mSlots[arguments[0]], aFrame.mCount * sizeof(double));
+      }
+      for (std::uint32_t a = 1; a < aStep.mDetail; a++)
+      {
+         const double* values = aFrame.mSlots[arguments[a]];
+         for (std::size_t i = 0; i < aFrame.mCount; i++)
+         {
+            if (tMax ? out[i] < values[i] : values[i] < out[i])
+            {
+               out[i] = values[i];
+            }
+         }
+      }
+   }
+
+   //! Any other function, one row at a time.
+   static void Call(const Step& aStep, const Frame& aFrame)
+   {
+      const auto              function  = static_cast<BuiltinFunction>(aStep.mRight);
+      double*                 out       = aFrame.Out(aStep);
+      const std::uint32_t*    arguments = aFrame.mArguments + aStep.mLeft;
+      std::array<double, 256> rowArgs;
+      for (std::size_t i = 0; i < aFrame.mCount; i++)
+      {
+         for (std::uint32_t a = 0; a < aStep.mDetail; a++)
+         {
+            rowArgs[a] = aFrame.mSlots[arguments[a]][i];
+         }
+         out[i] = CallBuiltin(function, std::span<const double>(rowArgs.data(), aStep.mDetail));
+      }
+   }
+
+   static StepFunction ForBinary(SimdLevel aLevel)
+   {
+      switch (aLevel)
+      {
+#if RJCPT_X86_64
+      case SimdLevel::Avx2:
+         return &Binary<&BinaryAvx2>;
+      case SimdLevel::Sse2:
+         return &Binary<&BinarySse2>;
+#endif
+      default:
+         return &Binary<&BinaryScalar>;
+      }
+   }
+
+   static StepFunction ForUnary(SimdLevel aLevel)
+   {
+      switch (aLevel)
+      {
+#if RJCPT_X86_64
+      case SimdLevel::Avx2:
+         return &Unary<&UnaryAvx2>;
+      case SimdLevel::Sse2:
+         return &Unary<&UnarySse2>;
+#endif
+      default:
+         return &Unary<&UnaryScalar>;
+      }
+   }
+
+   static StepFunction ForChainCompare(CompareKind aKind)
+   {
+      using CK = CompareKind;
+      switch (aKind)
+      {
+      case CK::Equal:
+         return &ChainCompare<CK::Equal>;
+      case CK::NotEqual:
+         return &ChainCompare<CK::NotEqual>;
+      case CK::LessThan:
+         return &ChainCompare<CK::LessThan>;
+      case CK::LessOrEqual:
+         return &ChainCompare<CK::LessOrEqual>;
+      case CK::GreaterThan:
+         return &ChainCompare<CK::GreaterThan>;
+      case CK::GreaterOrEqual:
+         return &ChainCompare<CK::GreaterOrEqual>;
+      }
+      return nullptr;
+   }
+
+   static StepFunction ForCall(BuiltinFunction aFunction, std::uint32_t aArgumentCount)
+   {
+      using BF = BuiltinFunction;
+      switch (aFunction)
+      {
+      case BF::Abs:
+         return aArgumentCount == 1 ? &CallUnary<BF::Abs> : &Call;
+      case BF::Sqrt:
+         return aArgumentCount == 1 ? &CallUnary<BF::Sqrt> : &Call;
+      case BF::Exp:
+         return aArgumentCount == 1 ? &CallUnary<BF::Exp> : &Call;
+      case BF::Ln:
+         return aArgumentCount == 1 ? &CallUnary<BF::Ln> : &Call;
+      case BF::Log10:
+         return aArgumentCount == 1 ? &CallUnary<BF::Log10> : &Call;
+      case BF::Pow:
+         return aArgumentCount == 2 ? &CallPow : &Call;
+      case BF::If:
+         return aArgumentCount == 3 ? &CallIf : &Call;
+      case BF::Min:
+         return aArgumentCount >= 1 ? &CallMinMax<false> : &Call;
+      case BF::Max:
+         return aArgumentCount >= 1 ? &CallMinMax<true> : &Call;
+      default:
+         return &Call;
+      }
+   }
+};
+
+std::optional<rjcpt::ThreadedProgram> rjcpt::ThreadedProgram::Compile(const Program& aProgram, SimdLevel aLevel)
+{
+   RJCPT_TRACE_SCOPE("CompileThreaded");
+   constexpr std::uint32_t cNO_SLOT = 0xFFFFFFFFU;
+   aLevel = std::min(aLevel, DetectSimdLevel());
+
+   // Slot i < depth holds entry i of the evaluation stack, and is only ever on the stack as entry i. Slot depth + i
+   // holds local i. Other slots are added as needed.
+   const std::uint32_t depth = aProgram.mMaxStackDepth;
+   ThreadedProgram retval;
+   retval.mSlots.resize(std::size_t{depth} + aProgram.mLocalCount);
+   std::vector<std::uint32_t> stack;
+   std::vector<std::uint32_t> chains;
+   std::vector<std::uint32_t> locals(aProgram.mLocalCount, cNO_SLOT);
+
+   const auto addSlot = [&](SlotKind aKind, std::uint32_t aIndex, double aConstant = 0.0)
+      {
+         for (std::uint32_t i = depth + aProgram.mLocalCount; i < retval.mSlots.size(); i++)
+         {
+            const Slot& slot = retval.mSlots[i];
+            if (slot.mKind == aKind && slot.mIndex == aIndex &&
+                std::bit_cast<std::uint64_t>(slot.mConstant) == std::bit_cast<std::uint64_t>(aConstant))
+            {
+               return i;
+            }
+         }
+         retval.mSlots.push_back(Slot{aKind, aIndex, aConstant});
+         return static_cast<std::uint32_t>(retval.mSlots.size() - 1);
+      };
+   const auto emit = [&](StepFunction aRun, std::uint32_t aOut, std::uint32_t aLeft = 0, std::uint32_t aRight = 0,
+                         std::uint32_t aDetail = 0, OpCode aOpCode = OpCode::Return)
+      {
+         retval.mSteps.push_back(Step{aRun, aOpCode, aOut, aLeft, aRight, aDetail});
+      };
+
+   for (const EvaluatorInstruction& instruction : aProgram.mCode)
+   {
+      const auto position = static_cast<std::uint32_t>(stack.size());
+      switch (instruction.mOpCode)
+      {
+      case OpCode::Return:
+         if (stack.size() != 1)
+         {
+            return std::nullopt;
+         }
+         retval.mResult = stack.back();
+         return retval;
+      case OpCode::PushConstant:
+         stack.push_back(addSlot(SlotKind::Constant, 0, aProgram.mConstants[instruction.mOperand]));
+         continue;
+      case OpCode::LoadColumn:
+         stack.push_back(addSlot(SlotKind::Column, instruction.mOperand));
+         continue;
+      case OpCode::LoadParameter:
+         stack.push_back(addSlot(SlotKind::Parameter, instruction.mOperand));
+         continue;
+      case OpCode::StoreLocal:
+         if (stack.empty() || instruction.mOperand >= locals.size())
+         {
+            return std::nullopt;
+         }
+         // Stack entries are overwritten later, anything else can be read in place.
+         locals[instruction.mOperand] = stack.back();
+         if (stack.back() < depth)
+         {
+            locals[instruction.mOperand] = depth + instruction.mOperand;
+            emit(&Steps::Copy, depth + instruction.mOperand, stack.back());
+         }
+         continue;
+      case OpCode::LoadLocal:
+         if (instruction.mOperand >= locals.size() || locals[instruction.mOperand] == cNO_SLOT)
+         {
+            return std::nullopt;
+         }
+         stack.push_back(locals[instruction.mOperand]);
+         continue;
+      case OpCode::AndJump:
+      case OpCode::OrJump:
+         // Both operands are evaluated, as by the interpreter.
+         continue;
+      case OpCode::ChainBegin:
+         retval.mSlots.emplace_back();
+         chains.push_back(static_cast<std::uint32_t>(retval.mSlots.size() - 1));
+         emit(&Steps::ChainBegin, chains.back());
+         continue;
+      case OpCode::ChainEnd:
+         if (chains.empty() || stack.empty())
+         {
+            return std::nullopt;
+         }
+         // Each chain has a slot of its own, which nothing else writes to.
+         stack.back() = chains.back();
+         chains.pop_back();
+         continue;
+      default:
+         break;
+      }
+
+      // Everything else replaces operands by a result, which goes into the slot of the first operand's entry.
+      std::uint32_t operands = 2;
+      if (instruction.mOpCode == OpCode::Negate || instruction.mOpCode == OpCode::LogicalNot)
+      {
+         operands = 1;
+      }
+      else if (instruction.mOpCode == OpCode::Call)
+      {
+         operands = instruction.mOperand >> 8;
+      }
+      if (operands == 0 || operands > position || position - operands >= depth)
+      {
+         return std::nullopt;
+      }
+      const std::uint32_t out = position - operands;
+      switch (instruction.mOpCode)
+      {
+      case OpCode::Negate:
+      case OpCode::LogicalNot:
+         emit(Steps::ForUnary(aLevel), out, stack[out], 0, 0, instruction.mOpCode);
+         break;
+      case OpCode::Add:
+      case OpCode::Subtract:
+      case OpCode::Multiply:
+      case OpCode::Divide:
+      case OpCode::CompareEqual:
+      case OpCode::CompareNotEqual:
+      case OpCode::CompareLessThan:
+      case OpCode::CompareLessOrEqual:
+      case OpCode::CompareGreaterThan:
+      case OpCode::CompareGreaterOrEqual:
+      case OpCode::AndEnd:
+      case OpCode::OrEnd:
+         emit(Steps::ForBinary(aLevel), out, stack[out], stack[out + 1], 0, instruction.mOpCode);
+         break;
+      case OpCode::ChainCompare:
+      {
+         if (chains.empty() || instruction.mOperand > static_cast<std::uint32_t>(CompareKind::GreaterOrEqual))
+         {
+            return std::nullopt;
+         }
+         const std::uint32_t right = stack[out + 1];
+         emit(Steps::ForChainCompare(static_cast<CompareKind>(instruction.mOperand)), chains.back(), stack[out], right);
+         // The right operand is the left operand of the next comparison. It must move down if it is a stack entry.
+         stack.pop_back();
+         stack.back() = right;
+         if (right == out + 1)
+         {
+            stack.back() = out;
+            emit(&Steps::Copy, out, right);
+         }
+         continue;
+      }
+      case OpCode::Call:
+      {
+         const auto function = static_cast<BuiltinFunction>(instruction.mOperand & 0xFFU);
+         emit(Steps::ForCall(function, operands), out, static_cast<std::uint32_t>(retval.mArguments.size()),
+              static_cast<std::uint32_t>(function), operands);
+         retval.mArguments.insert(retval.mArguments.end(), stack.begin() + out, stack.end());
+         break;
+      }
+      default:
+         return std::nullopt;
+      }
+      stack.resize(out);
+      stack.push_back(out);
+   }
+   return std::nullopt;
+}
+
+void rjcpt::ColumnEvaluator::Evaluate(const ThreadedProgram& aProgram, const EvaluationContext& aContext, std::span<double> aOutput)
+{
+   RJCPT_TRACE_SCOPE("EvaluateColumnThreaded");
+   RJCPT_TRACE_COUNT(EvaluatedRows, aOutput.size());
+   using SK = ThreadedProgram::SlotKind;
+   constexpr std::size_t B = cBLOCK_SIZE;
+   const std::vector<ThreadedProgram::Slot>& slots = aProgram.mSlots;
+   mValues.resize(slots.size() * B);
+   mSlots.resize(slots.size());
+   for (std::size_t s = 0; s < slots.size(); s++)
+   {
+      double* block = mValues.data() + s * B;
+      mSlots[s] = block;
+      if (slots[s].mKind == SK::Constant)
+      {
+         std::fill_n(block, B, slots[s].mConstant);
+      }
+      else if (slots[s].mKind == SK::Parameter)
+      {
+         std::fill_n(block, B, aContext.mParameters[slots[s].mIndex]);
+      }
+   }
+
+   ThreadedProgram::Frame frame{mSlots.data(), mValues.data(), aProgram.mArguments.data()};
+   for (std::size_t first = 0; first < aOutput.size(); first += B)
+   {
+      frame.mCount = std::min(B, aOutput.size() - first);
+      for (std::size_t s = 0; s < slots.size(); s++)
+      {
+         if (slots[s].mKind == SK::Column)
+         {
+            mSlots[s] = aContext.mColumns[slots[s].mIndex] + aContext.mRow + first;
+         }
+      }
+      for (const ThreadedProgram::Step& step : aProgram.mSteps)
+      {
+         step.mRun(step, frame);
+      }
+      std::memcpy(aOutput.data() + first, mSlots[aProgram.mResult], frame.mCount * sizeof(double));
+   }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "Evaluator.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "rjcpt_core_export.h"
+
+namespace rjcpt
+{
+   //! Instruction sets the ColumnEvaluator can use.
+   enum class SimdLevel
+   {
+      Scalar,
+      Sse2,
+      Avx2
+   };
+
+   //! Returns the best instruction set supported by the current CPU.
+   RJCPT_CORE_EXPORT SimdLevel DetectSimdLevel();
+
+   //! A Program translated into closure-threaded code for the ColumnEvaluator: a list of steps, each a pointer to a
+   //! function specialized for its instruction and instruction set, with the locations of its operands bound in
+   //! advance. Columns, constants, parameters and locals are read where they are rather than copied onto the stack
+   //! first, and function calls run a loop specialized for their function instead of calling CallBuiltin per row.
+   //! Nothing is decoded while running. Translating takes longer than a single evaluation, so it only pays off for
+   //! formulas evaluated over many rows; see Sheet::SetThreadedTierRows.
+   //! Results are bit-identical to interpreting the Program.
+   class RJCPT_CORE_EXPORT ThreadedProgram
+   {
+   public:
+      //! Returns nothing if aProgram uses an instruction that cannot be translated; it should be interpreted instead.
+      //! aLevel is clamped to what the current CPU supports.
+      static std::optional<ThreadedProgram> Compile(const Program& aProgram, SimdLevel aLevel);
+
+      std::size_t StepCount() const { return mSteps.size(); }
+
+   private:
+      friend class ColumnEvaluator;
+
+      //! Where the values of a slot are. Each slot has a block of scratch memory, except for column slots.
+      enum class SlotKind : std::uint8_t
+      {
+         Scratch,   // Computed by a step.
+         Column,    // Read from column mIndex.
+         Constant,  // Filled with mConstant once per evaluation.
+         Parameter, // Filled with parameter mIndex once per evaluation.
+      };
+      struct Slot
+      {
+         SlotKind      mKind     = SlotKind::Scratch;
+         std::uint32_t mIndex    = 0;
+         double        mConstant = 0.0;
+      };
+
+      struct Frame;
+      struct Step;
+      struct Steps;
+      using StepFunction = void (*)(const Step& aStep, const Frame& aFrame);
+      struct Step
+      {
+         StepFunction  mRun    = nullptr;
+         OpCode        mOpCode = OpCode::Return;
+         std::uint32_t mOut    = 0; // Slot written by the step.
+         std::uint32_t mLeft   = 0; // Slot of the operand, or index of the first argument in mArguments.
+         std::uint32_t mRight  = 0;
+         std::uint32_t mDetail = 0; // CompareKind of ChainCompare, or number of arguments.
+      };
+
+      std::vector<Step>          mSteps;
+      std::vector<Slot>          mSlots;
+      std::vector<std::uint32_t> mArguments; // Slots of the arguments of function calls.
+      std::uint32_t              mResult = 0;
+   };
+
+   //! Evaluates a Program over many consecutive rows at once.
+   //! Rows are processed in blocks of cBLOCK_SIZE; each instruction is applied to a whole block before moving on
+   //! to the next instruction, using SIMD kernels where possible.
+   //! Results are bit-identical to calling rjcpt::Evaluate for each row.
+   //! Both sides of "and" and "or" are always evaluated, since formulas have no side effects.
+   //! A ColumnEvaluator reuses its scratch memory between calls, so it should not be shared between threads.
+   class RJCPT_CORE_EXPORT ColumnEvaluator
+   {
+   public:
+      static constexpr std::size_t cBLOCK_SIZE = 512;
+
+      //! aLevel is clamped to what the current CPU supports.
+      explicit ColumnEvaluator(SimdLevel aLevel = DetectSimdLevel());
+
+      SimdLevel Level() const { return mLevel; }
+
+      //! Evaluates aProgram for rows [aContext.mRow, aContext.mRow + aOutput.size()), writing one result per row.
+      void Evaluate(const Program& aProgram, const EvaluationContext& aContext, std::span<double> aOutput);
+      //! Same, with a program translated by ThreadedProgram::Compile.
+      void Evaluate(const ThreadedProgram& aProgram, const EvaluationContext& aContext, std::span<double> aOutput);
+
+   private:
+      SimdLevel                  mLevel;
+      std::vector<double>        mValues;      // Evaluation stack, one block per entry, or one block per slot.
+      std::vector<double>        mComparisons; // Comparison results stack, one block per entry.
+      std::vector<double>        mLocals;      // One block per local.
+      std::vector<const double*> mSlots;       // Where the values of each slot of a ThreadedProgram are.
+   };
+}
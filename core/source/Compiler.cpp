@@ -0,0 +1,417 @@
+#include "Compiler.hpp"
+
+#include "PerfectHash.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <optional>
+
+namespace
+{
+   using PNT = rjcpt::ParseNodeType;
+
+   struct BuiltinInfo
+   {
+      std::string_view       mName;
+      rjcpt::BuiltinFunction mFunction;
+      std::uint32_t          mMinArguments;
+      std::uint32_t          mMaxArguments;
+   };
+
+   constexpr std::uint32_t cVARIADIC = 0xFFU;
+
+   constexpr std::array<BuiltinInfo, static_cast<std::size_t>(rjcpt::BuiltinFunction::cMAX_FUNCTION)> cBUILTINS = {{
+      {"abs", rjcpt::BuiltinFunction::Abs, 1, 1},
+      {"sqrt", rjcpt::BuiltinFunction::Sqrt, 1, 1},
+      {"exp", rjcpt::BuiltinFunction::Exp, 1, 1},
+      {"ln", rjcpt::BuiltinFunction::Ln, 1, 1},
+      {"log", rjcpt::BuiltinFunction::Log10, 1, 1},
+      {"pow", rjcpt::BuiltinFunction::Pow, 2, 2},
+      {"min", rjcpt::BuiltinFunction::Min, 1, cVARIADIC},
+      {"max", rjcpt::BuiltinFunction::Max, 1, cVARIADIC},
+      {"if", rjcpt::BuiltinFunction::If, 3, 3}
+   }};
+
+   constexpr rjcpt::PerfectHashMap<rjcpt::BuiltinFunction, cBUILTINS.size()> cBUILTIN_NAMES = []()
+      {
+         std::array<rjcpt::PerfectHashMap<rjcpt::BuiltinFunction, cBUILTINS.size()>::Entry, cBUILTINS.size()> entries;
+         std::ranges::transform(cBUILTINS, entries.begin(), [](const BuiltinInfo& aInfo)
+            { return decltype(entries)::value_type{aInfo.mName, aInfo.mFunction}; });
+         return rjcpt::PerfectHashMap<rjcpt::BuiltinFunction, cBUILTINS.size()>(entries);
+      }();
+
+   //! Maps a comparison node to its chained comparison kind.
+   rjcpt::CompareKind CompareKindOf(PNT aType)
+   {
+      return static_cast<rjcpt::CompareKind>(static_cast<unsigned>(aType) - static_cast<unsigned>(PNT::CompareEqual));
+   }
+
+   bool IsComparison(PNT aType)
+   {
+      return aType >= PNT::CompareEqual && aType <= PNT::CompareGreaterOrEqual;
+   }
+
+   //! Buffers a FormulaCompiler builds the program in. They are kept per thread and reused, so that compiling
+   //! only allocates the finished program.
+   struct CompilerScratch
+   {
+      std::vector<rjcpt::EvaluatorInstruction> mCode;
+      std::vector<double>                      mConstants;
+      std::vector<std::size_t>                 mStarts;
+   };
+
+   thread_local CompilerScratch tScratch;
+
+   //! Lowers one formula. Tracks the first instruction of each value on the evaluation stack,
+   //! so that short-circuit jumps can be inserted in front of the right-hand operand of "and" and "or".
+   class FormulaCompiler
+   {
+   public:
+      FormulaCompiler(std::string_view                  aExpression,
+                      std::span<const rjcpt::Token>     aTokens,
+                      std::span<const rjcpt::ParseNode> aNodes,
+                      const rjcpt::SymbolResolver&      aResolver,
+                      rjcpt::ConstantPool*              aPool)
+         : mExpression(aExpression)
+         , mTokens(aTokens)
+         , mNodes(aNodes)
+         , mResolver(aResolver)
+         , mPool(aPool)
+         , mCode(tScratch.mCode)
+         , mConstants(tScratch.mConstants)
+         , mStarts(tScratch.mStarts)
+      {
+         mCode.clear();
+         mConstants.clear();
+         mStarts.clear();
+      }
+
+      std::expected<rjcpt::Program, std::string> Run(std::pmr::memory_resource* aResource)
+      {
+         for (std::size_t i = 0; i < mNodes.size(); i++)
+         {
+            std::string error = Lower(i);
+            if (!error.empty())
+            {
+               return std::unexpected(std::move(error));
+            }
+            if (mFinished)
+            {
+               rjcpt::Program retval(aResource);
+               retval.mCode.assign(mCode.begin(), mCode.end());
+               retval.mConstants.assign(mConstants.begin(), mConstants.end());
+               retval.mMaxStackDepth = mMaxStackDepth;
+               return retval;
+            }
+         }
+         return std::unexpected("Formula is incomplete.");
+      }
+
+   private:
+      std::string_view TokenText(std::uint32_t aTokenIndex) const
+      {
+         const rjcpt::Token& token = mTokens[aTokenIndex];
+         return mExpression.substr(token.mStartIndex, token.mLength);
+      }
+
+      PNT NextType(std::size_t aIndex) const
+      {
+         return aIndex + 1 < mNodes.size() ? mNodes[aIndex + 1].mType : PNT::cMAX_PARSE_NODE;
+      }
+
+      void Emit(rjcpt::OpCode aOpCode, std::uint32_t aOperand = 0)
+      {
+         mCode.push_back(rjcpt::EvaluatorInstruction{aOpCode, aOperand});
+      }
+
+      //! Records that a value starting at aStart was pushed.
+      void PushValue(std::size_t aStart)
+      {
+         mStarts.push_back(aStart);
+         mMaxStackDepth = std::max(mMaxStackDepth, static_cast<std::uint32_t>(mStarts.size()));
+      }
+
+      //! Emits an instruction that pushes a value.
+      void EmitPush(rjcpt::OpCode aOpCode, std::uint32_t aOperand)
+      {
+         PushValue(mCode.size());
+         Emit(aOpCode, aOperand);
+      }
+
+      std::uint32_t AddConstant(double aValue)
+      {
+         const auto iter = std::ranges::find(mConstants, std::bit_cast<std::uint64_t>(aValue), [](double aConstant) { return std::bit_cast<std::uint64_t>(aConstant); });
+         if (iter != mConstants.end())
+         {
+            return static_cast<std::uint32_t>(iter - mConstants.begin());
+         }
+         mConstants.push_back(aValue);
+         return static_cast<std::uint32_t>(mConstants.size() - 1);
+      }
+
+      //! Lowers the node at aIndex, possibly along with the nodes that follow it.
+      //! Returns an error message on failure.
+      std::string Lower(std::size_t& aIndex)
+      {
+         using OC = rjcpt::OpCode;
+         const rjcpt::ParseNode& node = mNodes[aIndex];
+         if (mStarts.size() < Arity(node))
+         {
+            return "Malformed parse tree.";
+         }
+         switch (node.mType)
+         {
+         case PNT::Finished:
+            if (mStarts.size() != 1)
+            {
+               return "Malformed parse tree.";
+            }
+            Emit(OC::Return);
+            mFinished = true;
+            return {};
+         case PNT::Number:
+         {
+            const std::string_view text = TokenText(node.mStartTokenIndex);
+            std::optional<double>  value;
+            if (mPool)
+            {
+               if (const std::uint32_t index = mPool->Add(text); index != rjcpt::ConstantPool::cINVALID)
+               {
+                  value = mPool->Value(index);
+               }
+            }
+            else
+            {
+               value = rjcpt::ParseNumberLiteral(text);
+            }
+            if (!value)
+            {
+               return "Invalid number: " + std::string(text);
+            }
+            EmitPush(OC::PushConstant, AddConstant(*value));
+            return {};
+         }
+         case PNT::LogicalTrue:
+            EmitPush(OC::PushConstant, AddConstant(1.0));
+            return {};
+         case PNT::LogicalFalse:
+            EmitPush(OC::PushConstant, AddConstant(0.0));
+            return {};
+         case PNT::Identifier:
+            return LowerIdentifier(aIndex);
+         case PNT::RowLookup:
+            return "'$' must be followed by a name.";
+         case PNT::UnaryPlus:
+            return {};
+         case PNT::UnaryMinus:
+            Emit(OC::Negate);
+            return {};
+         case PNT::LogicalNot:
+            Emit(OC::LogicalNot);
+            return {};
+         case PNT::Addition:
+            return LowerBinary(OC::Add);
+         case PNT::Subtraction:
+            return LowerBinary(OC::Subtract);
+         case PNT::Multiplication:
+         case PNT::Concatenation:
+            return LowerBinary(OC::Multiply);
+         case PNT::Division:
+            return LowerBinary(OC::Divide);
+         case PNT::LogicalAnd:
+            return LowerShortCircuit(OC::AndJump, OC::AndEnd);
+         case PNT::LogicalOr:
+            return LowerShortCircuit(OC::OrJump, OC::OrEnd);
+         case PNT::CompareBegin:
+            if (IsComparison(NextType(aIndex)) && NextType(aIndex + 1) == PNT::CompareEnd)
+            {
+               // A single comparison doesn't need the chain machinery.
+               const auto kind = static_cast<std::uint32_t>(CompareKindOf(mNodes[aIndex + 1].mType));
+               aIndex += 2;
+               return LowerBinary(static_cast<OC>(static_cast<std::uint32_t>(OC::CompareEqual) + kind));
+            }
+            Emit(OC::ChainBegin);
+            return {};
+         case PNT::CompareEqual:
+         case PNT::CompareNotEqual:
+         case PNT::CompareLessThan:
+         case PNT::CompareLessOrEqual:
+         case PNT::CompareGreateThan:
+         case PNT::CompareGreaterOrEqual:
+            mStarts.pop_back();
+            Emit(OC::ChainCompare, static_cast<std::uint32_t>(CompareKindOf(node.mType)));
+            return {};
+         case PNT::CompareEnd:
+            Emit(OC::ChainEnd);
+            return {};
+         case PNT::Invoke:
+            return LowerInvoke(node);
+         default:
+            return "Unexpected parse node.";
+         }
+      }
+
+      //! Returns the number of values a node needs on the stack.
+      static std::size_t Arity(const rjcpt::ParseNode& aNode)
+      {
+         switch (aNode.mType)
+         {
+         case PNT::Number:
+         case PNT::Identifier:
+         case PNT::LogicalTrue:
+         case PNT::LogicalFalse:
+         case PNT::Finished:
+            return 0;
+         case PNT::UnaryPlus:
+         case PNT::UnaryMinus:
+         case PNT::RowLookup:
+         case PNT::LogicalNot:
+         case PNT::CompareEnd:
+            return 1;
+         case PNT::Invoke:
+            return aNode.mAuxData;
+         default:
+            return 2;
+         }
+      }
+
+      std::string LowerIdentifier(std::size_t& aIndex)
+      {
+         const rjcpt::ParseNode& node = mNodes[aIndex];
+         const std::string_view  name = TokenText(node.mStartTokenIndex);
+         switch (NextType(aIndex))
+         {
+         case PNT::Invoke:
+            // The invocable is resolved along with the Invoke node.
+            return {};
+         case PNT::RowLookup:
+         {
+            ++aIndex;
+            const rjcpt::Symbol symbol = mResolver.Resolve(name);
+            if (symbol.mKind != rjcpt::SymbolKind::Parameter)
+            {
+               return "'$" + std::string(name) + "' does not refer to a parameter.";
+            }
+            EmitPush(rjcpt::OpCode::LoadParameter, symbol.mSlot);
+            return {};
+         }
+         default:
+         {
+            const rjcpt::Symbol symbol = mResolver.Resolve(name);
+            switch (symbol.mKind)
+            {
+            case rjcpt::SymbolKind::Column:
+               EmitPush(rjcpt::OpCode::LoadColumn, symbol.mSlot);
+               return {};
+            case rjcpt::SymbolKind::Parameter:
+               EmitPush(rjcpt::OpCode::LoadParameter, symbol.mSlot);
+               return {};
+            default:
+               return "Unknown identifier: " + std::string(name);
+            }
+         }
+         }
+      }
+
+      std::string LowerBinary(rjcpt::OpCode aOpCode)
+      {
+         mStarts.pop_back();
+         Emit(aOpCode);
+         return {};
+      }
+
+      //! "a and b" becomes [a] AndJump [b] AndEnd, where AndJump skips past AndEnd.
+      std::string LowerShortCircuit(rjcpt::OpCode aJump, rjcpt::OpCode aEnd)
+      {
+         const std::size_t rightStart = mStarts.back();
+         mStarts.pop_back();
+         // Jumps are relative, so jumps inside the right operand are unaffected by the insertion.
+         mCode.insert(mCode.begin() + static_cast<std::ptrdiff_t>(rightStart), rjcpt::EvaluatorInstruction{aJump, 0});
+         Emit(aEnd);
+         mCode[rightStart].mOperand = static_cast<std::uint32_t>(mCode.size() - rightStart);
+         return {};
+      }
+
+      std::string LowerInvoke(const rjcpt::ParseNode& aNode)
+      {
+         const std::string_view name     = TokenText(aNode.mStartTokenIndex);
+         const auto             function = rjcpt::FindBuiltinFunction(name);
+         if (function == rjcpt::BuiltinFunction::cMAX_FUNCTION)
+         {
+            return "Unknown function: " + std::string(name);
+         }
+         const BuiltinInfo& info = cBUILTINS[static_cast<std::size_t>(function)];
+         const std::uint32_t argc = aNode.mAuxData;
+         if (argc < info.mMinArguments || argc > info.mMaxArguments)
+         {
+            return "Wrong number of arguments to " + std::string(name) + ": " + std::to_string(argc);
+         }
+         const std::size_t start = argc > 0 ? mStarts[mStarts.size() - argc] : mCode.size();
+         mStarts.resize(mStarts.size() - argc);
+         PushValue(start);
+         Emit(rjcpt::OpCode::Call, (argc << 8) | static_cast<std::uint32_t>(function));
+         return {};
+      }
+
+      std::string_view                  mExpression;
+      std::span<const rjcpt::Token>     mTokens;
+      std::span<const rjcpt::ParseNode> mNodes;
+      const rjcpt::SymbolResolver&      mResolver;
+      rjcpt::ConstantPool*              mPool;
+
+      std::vector<rjcpt::EvaluatorInstruction>& mCode;
+      std::vector<double>&                      mConstants;
+      std::vector<std::size_t>&                 mStarts;
+      std::uint32_t                             mMaxStackDepth = 0;
+      bool                                      mFinished      = false;
+   };
+}
+
+std::vector<rjcpt::Reference> rjcpt::FindReferences(std::string_view           aExpression,
+                                                    std::span<const Token>     aTokens,
+                                                    std::span<const ParseNode> aNodes)
+{
+   std::vector<Reference> retval;
+   for (std::size_t i = 0; i < aNodes.size(); i++)
+   {
+      if (aNodes[i].mType != PNT::Identifier)
+      {
+         continue;
+      }
+      const PNT next = i + 1 < aNodes.size() ? aNodes[i + 1].mType : PNT::cMAX_PARSE_NODE;
+      if (next != PNT::Invoke)
+      {
+         const Token& token = aTokens[aNodes[i].mStartTokenIndex];
+         retval.push_back(Reference{aExpression.substr(token.mStartIndex, token.mLength), next == PNT::RowLookup});
+      }
+   }
+   return retval;
+}
+
+rjcpt::BuiltinFunction rjcpt::FindBuiltinFunction(std::string_view aName)
+{
+   return cBUILTIN_NAMES.FindOr(aName, BuiltinFunction::cMAX_FUNCTION);
+}
+
+bool rjcpt::IsValidArgumentCount(BuiltinFunction aFunction, std::uint32_t aCount)
+{
+   if (aFunction >= BuiltinFunction::cMAX_FUNCTION)
+   {
+      return false;
+   }
+   const BuiltinInfo& info = cBUILTINS[static_cast<std::size_t>(aFunction)];
+   return aCount >= info.mMinArguments && aCount <= info.mMaxArguments;
+}
+
+std::expected<rjcpt::Program, std::string> rjcpt::CompileFormula(std::string_view           aExpression,
+                                                                 std::span<const Token>     aTokens,
+                                                                 std::span<const ParseNode> aNodes,
+                                                                 const SymbolResolver&      aResolver,
+                                                                 std::pmr::memory_resource* aResource,
+                                                                 ConstantPool*              aConstants)
+{
+   RJCPT_TRACE_SAMPLED_SCOPE("CompileFormula");
+   return FormulaCompiler(aExpression, aTokens, aNodes, aResolver, aConstants).Run(aResource);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "ConstantPool.hpp"
+#include "Evaluator.hpp"
+#include "ParseNode.hpp"
+#include "Token.hpp"
+
+#include <expected>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "rjcpt_core_export.h"
+
+namespace rjcpt
+{
+   enum class SymbolKind
+   {
+      Unknown,
+      Column,   // A value that varies by row.
+      Parameter // A single value shared by all rows.
+   };
+
+   //! The result of looking up a name in a SymbolResolver.
+   struct Symbol
+   {
+      SymbolKind    mKind = SymbolKind::Unknown;
+      std::uint32_t mSlot = 0;
+   };
+
+   //! Maps identifiers in a formula to the slots they are read from at evaluation time.
+   class SymbolResolver
+   {
+   public:
+      // Virtual destructor shouldn't be necessary, but it silences compiler warnings.
+      virtual ~SymbolResolver() = default;
+      //! Returns the symbol with the given name, or a symbol of kind Unknown.
+      virtual Symbol Resolve(std::string_view aName) const = 0;
+   };
+
+   //! A name a formula reads from.
+   struct Reference
+   {
+      std::string_view mName;
+      //! True if the name was used with the '$' (RowLookup) operator.
+      bool             mRowLookup = false;
+   };
+
+   //! Returns the names referred to by Identifier nodes in aNodes, excluding the names of invoked functions.
+   //! Names are views into aExpression, in the order they appear. Duplicates are not removed.
+   RJCPT_CORE_EXPORT std::vector<Reference> FindReferences(std::string_view           aExpression,
+                                                           std::span<const Token>     aTokens,
+                                                           std::span<const ParseNode> aNodes);
+
+   //! Returns the built-in function with the given name.
+   //! Returns BuiltinFunction::cMAX_FUNCTION on failure.
+   RJCPT_CORE_EXPORT BuiltinFunction FindBuiltinFunction(std::string_view aName);
+   //! Returns true if aFunction can be called with aCount arguments.
+   RJCPT_CORE_EXPORT bool IsValidArgumentCount(BuiltinFunction aFunction, std::uint32_t aCount);
+
+   //! Lowers a list of postfix ParseNodes (from ParseFormula) to a Program.
+   //! aExpression and aTokens are the source the nodes were parsed from, used to read numbers and names.
+   //!   * Identifiers are resolved with aResolver. "$name" may only refer to a parameter.
+   //!   * Function calls are resolved to built-in functions, and their argument counts checked.
+   //!   * "and" and "or" are compiled to short-circuit jumps.
+   //!   * Comparison chains with a single comparison are compiled to a plain comparison.
+   //!   * Number literals are looked up in aConstants if given, so that each distinct literal is only converted once
+   //!     for all the formulas compiled with the same pool. New literals are added to it.
+   //! The program's code and constants are allocated from aResource, exactly sized. Compiling a formula does not
+   //! allocate anything else, unless it fails or adds to aConstants.
+   //! On failure, returns a description of the error.
+   RJCPT_CORE_EXPORT std::expected<Program, std::string> CompileFormula(
+      std::string_view           aExpression,
+      std::span<const Token>     aTokens,
+      std::span<const ParseNode> aNodes,
+      const SymbolResolver&      aResolver,
+      std::pmr::memory_resource* aResource  = std::pmr::get_default_resource(),
+      ConstantPool*              aConstants = nullptr);
+}
@@ -0,0 +1,38 @@
+#include "ConstantPool.hpp"
+
+#include <charconv>
+#include <system_error>
+
+std::optional<double> rjcpt::ParseNumberLiteral(std::string_view aText)
+{
+   // libstdc++ converts with the Eisel-Lemire fast path, falling back to exact arithmetic in the rare cases that
+   // need it.
+   double     value  = 0.0;
+   const auto result = std::from_chars(aText.data(), aText.data() + aText.size(), value);
+   if (result.ec != std::errc() || result.ptr != aText.data() + aText.size())
+   {
+      return std::nullopt;
+   }
+   return value;
+}
+
+std::uint32_t rjcpt::ConstantPool::Add(std::string_view aLiteral)
+{
+   if (const std::uint32_t id = mLiterals.Find(aLiteral); id != Interner::cNOT_FOUND)
+   {
+      return id;
+   }
+   const std::optional<double> value = ParseNumberLiteral(aLiteral);
+   if (!value)
+   {
+      return cINVALID;
+   }
+   mValues.push_back(*value);
+   return mLiterals.Intern(aLiteral);
+}
+
+void rjcpt::ConstantPool::Clear()
+{
+   mLiterals.Clear();
+   mValues.clear();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Interner.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "rjcpt_core_export.h"
+
+namespace rjcpt
+{
+   //! Converts the text of a Number token to its value, correctly rounded.
+   //! Returns nothing if the text is not a number, or is out of the range of a double.
+   RJCPT_CORE_EXPORT std::optional<double> ParseNumberLiteral(std::string_view aText);
+
+   //! The values of the number literals in a set of formulas, such as those of a sheet. Each distinct literal is
+   //! converted once, however many formulas it appears in; after that, it is found by hashing its text.
+   class RJCPT_CORE_EXPORT ConstantPool
+   {
+   public:
+      static constexpr std::uint32_t cINVALID = Interner::cNOT_FOUND;
+
+      //! Returns the index of the value of aLiteral, converting it if it is new.
+      //! Returns cINVALID, and adds nothing, if ParseNumberLiteral fails.
+      std::uint32_t Add(std::string_view aLiteral);
+
+      double      Value(std::uint32_t aIndex) const { return mValues[aIndex]; }
+      std::size_t Size() const { return mValues.size(); }
+
+      void Clear();
+
+   private:
+      Interner            mLiterals;
+      std::vector<double> mValues; // Indexed by literal id.
+   };
+}
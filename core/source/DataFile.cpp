@@ -0,0 +1,667 @@
+#include "DataFile.hpp"
+
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+   constexpr double cNAN = std::numeric_limits<double>::quiet_NaN();
+
+   // WriteDataFile writes the text in blocks of about this size.
+   constexpr std::size_t cWRITE_BLOCK_BYTES = 1 << 16;
+
+   // Files smaller than this are not worth splitting up.
+   constexpr std::size_t cMIN_CHUNK_BYTES = 1 << 16;
+   // Chunks per worker, so that workers that finish early can steal from the others.
+   constexpr std::size_t cCHUNKS_PER_WORKER = 4;
+
+   // Newlines are not spaces here, since they end records.
+   bool IsSpace(char aCharacter)
+   {
+      return aCharacter == ' ' || aCharacter == '\t' || aCharacter == '\r' || aCharacter == '\v' || aCharacter == '\f';
+   }
+
+   std::string_view Trim(std::string_view aText)
+   {
+      while (!aText.empty() && IsSpace(aText.front()))
+      {
+         aText.remove_prefix(1);
+      }
+      while (!aText.empty() && IsSpace(aText.back()))
+      {
+         aText.remove_suffix(1);
+      }
+      return aText;
+   }
+
+   // Returns the line starting at aOffset without its newline, and moves aOffset to the start of the next line.
+   std::string_view NextLine(std::string_view aText, std::size_t& aOffset)
+   {
+      const std::size_t begin = aOffset;
+      const std::size_t end   = std::min(aText.find('\n', begin), aText.size());
+      aOffset = std::min(end + 1, aText.size());
+      return aText.substr(begin, end - begin);
+   }
+
+   // Splits a header line into trimmed fields. A ' ' separator splits at runs of whitespace.
+   std::vector<std::string_view> SplitFields(std::string_view aLine, char aSeparator)
+   {
+      std::vector<std::string_view> retval;
+      aLine = Trim(aLine);
+      while (!aLine.empty())
+      {
+         const auto isSeparator = [aSeparator](char aCharacter)
+            {
+               return aSeparator == ' ' ? IsSpace(aCharacter) : aCharacter == aSeparator;
+            };
+         const auto end = static_cast<std::size_t>(std::ranges::find_if(aLine, isSeparator) - aLine.begin());
+         retval.push_back(Trim(aLine.substr(0, end)));
+         aLine = Trim(aLine.substr(std::min(end + 1, aLine.size())));
+      }
+      return retval;
+   }
+
+   template<typename T>
+   bool ParseNumber(std::string_view aText, T& aValue)
+   {
+      aText = Trim(aText);
+      if (aText.starts_with('+'))
+      {
+         aText.remove_prefix(1);
+      }
+      const auto [end, error] = std::from_chars(aText.data(), aText.data() + aText.size(), aValue);
+      return error == std::errc() && end == aText.data() + aText.size() && !aText.empty();
+   }
+
+   bool IsIdentifierCharacter(char aCharacter)
+   {
+      return std::isalnum(static_cast<unsigned char>(aCharacter)) || aCharacter == '_' || aCharacter == '%' ||
+             aCharacter == '.';
+   }
+
+   // Turns a column description into something the lexer reads as a single identifier.
+   std::string MakeIdentifier(std::string_view aName)
+   {
+      std::string retval;
+      for (const char c : Trim(aName))
+      {
+         if (IsIdentifierCharacter(c))
+         {
+            retval.push_back(c);
+         }
+         else if (!retval.empty() && retval.back() != '_')
+         {
+            retval.push_back('_');
+         }
+      }
+      while (!retval.empty() && retval.back() == '_')
+      {
+         retval.pop_back();
+      }
+      if (!retval.empty() && (std::isdigit(static_cast<unsigned char>(retval.front())) || retval.front() == '.'))
+      {
+         retval.insert(retval.begin(), '_');
+      }
+      if (retval == "and" || retval == "or" || retval == "not" || retval == "true" || retval == "false")
+      {
+         retval.push_back('_');
+      }
+      return retval;
+   }
+
+   // Fills in missing names, and appends the column number to names that are used more than once.
+   void FinishNames(std::vector<std::string>& aNames)
+   {
+      for (std::size_t i = 0; i < aNames.size(); i++)
+      {
+         if (aNames[i].empty())
+         {
+            aNames[i] = "column" + std::to_string(i + 1);
+         }
+      }
+      for (std::size_t i = 0; i < aNames.size(); i++)
+      {
+         if (std::count(aNames.begin(), aNames.begin() + i, aNames[i]) > 0)
+         {
+            aNames[i] += "_" + std::to_string(i + 1);
+         }
+      }
+   }
+
+   // Short names for the quantity numbers used by GEF-CPT files.
+   std::string_view GefQuantityName(int aQuantity)
+   {
+      switch (aQuantity)
+      {
+      case 1:
+         return "length";
+      case 2:
+         return "qc";
+      case 3:
+         return "fs";
+      case 4:
+         return "rf";
+      case 5:
+         return "u1";
+      case 6:
+         return "u2";
+      case 7:
+         return "u3";
+      case 8:
+         return "inclination";
+      case 11:
+         return "depth";
+      case 12:
+         return "time";
+      default:
+         return {};
+      }
+   }
+
+   std::expected<rjcpt::DataLayout, std::string> ParseGefHeader(std::string_view aText)
+   {
+      rjcpt::DataLayout retval;
+      std::size_t offset = 0;
+      std::size_t line   = 1;
+      std::size_t columnCount = 0;
+      std::vector<std::pair<std::size_t, std::string>> names;
+      std::vector<std::pair<std::size_t, double>>      voids;
+
+      const auto error = [&line](std::string_view aMessage)
+         {
+            return std::unexpected("Line " + std::to_string(line) + ": " + std::string(aMessage));
+         };
+
+      while (true)
+      {
+         if (offset >= aText.size())
+         {
+            return std::unexpected(std::string("Missing #EOH in GEF header"));
+         }
+         const std::string_view text = Trim(NextLine(aText, offset));
+         if (text.empty())
+         {
+            ++line;
+            continue;
+         }
+         const std::size_t equals = text.find('=');
+         if (!text.starts_with('#') || equals == std::string_view::npos)
+         {
+            return error("Expected a GEF header line");
+         }
+         const std::string_view key    = Trim(text.substr(1, equals - 1));
+         const std::string_view value  = Trim(text.substr(equals + 1));
+         const auto             fields = SplitFields(value, ',');
+         std::size_t index = 0;
+
+         if (key == "EOH")
+         {
+            retval.mDataOffset = offset;
+            retval.mDataLine   = line + 1;
+            break;
+         }
+         else if (key == "COLUMN")
+         {
+            if (!ParseNumber(value, index))
+            {
+               return error("Invalid #COLUMN");
+            }
+            columnCount = std::max(columnCount, index);
+         }
+         else if (key == "COLUMNINFO")
+         {
+            if (fields.empty() || !ParseNumber(fields[0], index) || index == 0)
+            {
+               return error("Invalid #COLUMNINFO");
+            }
+            int quantity = 0;
+            std::string name;
+            if (fields.size() > 3 && ParseNumber(fields[3], quantity) && !GefQuantityName(quantity).empty())
+            {
+               name = GefQuantityName(quantity);
+            }
+            else if (fields.size() > 2)
+            {
+               name = MakeIdentifier(fields[2]);
+            }
+            names.emplace_back(index - 1, std::move(name));
+            columnCount = std::max(columnCount, index);
+         }
+         else if (key == "COLUMNVOID")
+         {
+            double voidValue = 0.0;
+            if (fields.size() < 2 || !ParseNumber(fields[0], index) || index == 0 || !ParseNumber(fields[1], voidValue))
+            {
+               return error("Invalid #COLUMNVOID");
+            }
+            voids.emplace_back(index - 1, voidValue);
+            columnCount = std::max(columnCount, index);
+         }
+         else if (key == "COLUMNSEPARATOR" && !value.empty())
+         {
+            retval.mColumnSeparator = value.front();
+         }
+         else if (key == "RECORDSEPARATOR" && !value.empty())
+         {
+            retval.mRecordSeparator = value.front();
+         }
+         ++line;
+      }
+
+      retval.mNames.resize(columnCount);
+      retval.mVoidValues.resize(columnCount, cNAN);
+      for (auto& [index, name] : names)
+      {
+         retval.mNames[index] = std::move(name);
+      }
+      for (const auto& [index, value] : voids)
+      {
+         retval.mVoidValues[index] = value;
+      }
+      FinishNames(retval.mNames);
+      return retval;
+   }
+
+   rjcpt::DataLayout ParseDelimitedHeader(std::string_view aText)
+   {
+      rjcpt::DataLayout retval;
+      std::size_t offset = 0;
+      std::size_t line   = 1;
+      while (offset < aText.size())
+      {
+         const std::size_t      lineStart = offset;
+         const std::string_view text      = Trim(NextLine(aText, offset));
+         if (text.empty() || text.starts_with('#'))
+         {
+            ++line;
+            continue;
+         }
+
+         retval.mColumnSeparator = text.find(';') != std::string_view::npos   ? ';'
+                                   : text.find(',') != std::string_view::npos ? ','
+                                                                              : ' ';
+         const auto fields = SplitFields(text, retval.mColumnSeparator);
+         double     value  = 0.0;
+         if (ParseNumber(fields.front(), value))
+         {
+            retval.mNames.resize(fields.size());
+            retval.mDataOffset = lineStart;
+            retval.mDataLine   = line;
+         }
+         else
+         {
+            for (const std::string_view field : fields)
+            {
+               retval.mNames.push_back(MakeIdentifier(field));
+            }
+            retval.mDataOffset = offset;
+            retval.mDataLine   = line + 1;
+         }
+         retval.mVoidValues.resize(retval.mNames.size(), cNAN);
+         FinishNames(retval.mNames);
+         return retval;
+      }
+      retval.mDataOffset = aText.size();
+      retval.mDataLine   = line;
+      return retval;
+   }
+
+   // Walks through the non-blank records of a block of text.
+   struct RecordCursor
+   {
+      std::string_view mText;
+      char             mRecordSeparator;
+      std::size_t      mOffset = 0;
+      std::size_t      mLine   = 1;
+
+      // Finds the next non-blank record. Returns false at the end of mText.
+      bool Next(std::string_view& aRecord, std::size_t& aRecordLine)
+      {
+         const char* const end = mText.data() + mText.size();
+         while (mOffset < mText.size())
+         {
+            const char* const begin = mText.data() + mOffset;
+            const char*       stop  = nullptr;
+            if (mRecordSeparator == '\n')
+            {
+               stop = static_cast<const char*>(std::memchr(begin, '\n', static_cast<std::size_t>(end - begin)));
+               stop = stop == nullptr ? end : stop;
+            }
+            else
+            {
+               stop = std::find_if(begin, end, [this](char c) { return c == '\n' || c == mRecordSeparator; });
+            }
+
+            aRecordLine = mLine;
+            aRecord     = std::string_view(begin, static_cast<std::size_t>(stop - begin));
+            mOffset     = std::min(static_cast<std::size_t>(stop - mText.data()) + 1, mText.size());
+            if (stop != end && *stop == '\n')
+            {
+               ++mLine;
+            }
+            if (!std::ranges::all_of(aRecord, IsSpace))
+            {
+               return true;
+            }
+         }
+         return false;
+      }
+   };
+
+   // Parses the values of one record into aRow, which has one entry per column.
+   std::expected<void, std::string> ParseRecord(std::string_view         aRecord,
+                                                const rjcpt::DataLayout& aLayout,
+                                                std::span<double>        aRow)
+   {
+      const char  separator = aLayout.mColumnSeparator;
+      const char* pos       = aRecord.data();
+      const char* const end = pos + aRecord.size();
+      std::size_t count     = 0;
+
+      const auto skipSpace = [&pos, end]()
+         {
+            while (pos != end && IsSpace(*pos))
+            {
+               ++pos;
+            }
+         };
+
+      skipSpace();
+      while (pos != end)
+      {
+         // Two separators in a row leave a value empty.
+         double value = cNAN;
+         if (*pos != separator)
+         {
+            const char* const begin = pos;
+            if (*pos == '+')
+            {
+               ++pos;
+            }
+            const auto result = std::from_chars(pos, end, value);
+            pos = result.ptr;
+            if (result.ec != std::errc() || (pos != end && !IsSpace(*pos) && *pos != separator))
+            {
+               const char* const valueEnd =
+                  std::find_if(begin, end, [separator](char c) { return IsSpace(c) || c == separator; });
+               return std::unexpected("Invalid value '" + std::string(begin, valueEnd) + "'");
+            }
+         }
+         if (count < aRow.size())
+         {
+            aRow[count] = value == aLayout.mVoidValues[count] ? cNAN : value;
+         }
+         ++count;
+         skipSpace();
+         if (pos != end && *pos == separator)
+         {
+            ++pos;
+            skipSpace();
+         }
+      }
+
+      if (count != aRow.size())
+      {
+         return std::unexpected("Expected " + std::to_string(aRow.size()) + " values, found " + std::to_string(count));
+      }
+      return {};
+   }
+
+   std::string LineError(std::size_t aLine, std::string_view aMessage)
+   {
+      return "Line " + std::to_string(aLine) + ": " + std::string(aMessage);
+   }
+}
+
+std::expected<rjcpt::DataLayout, std::string> rjcpt::ParseDataHeader(std::string_view aText)
+{
+   if (aText.starts_with("#GEFID"))
+   {
+      return ::ParseGefHeader(aText);
+   }
+   return ::ParseDelimitedHeader(aText);
+}
+
+std::expected<rjcpt::DataTable, std::string> rjcpt::ParseDataFile(std::string_view aText, ThreadPool* aPool)
+{
+   RJCPT_TRACE_SCOPE("ParseDataFile");
+   const auto layout = ParseDataHeader(aText);
+   if (!layout)
+   {
+      return std::unexpected(layout.error());
+   }
+   const std::string_view data = aText.substr(layout->mDataOffset);
+
+   // Split the data into chunks at newlines, since a newline always ends a record.
+   std::size_t chunkCount = 1;
+   if (aPool != nullptr)
+   {
+      chunkCount = std::clamp<std::size_t>(data.size() / cMIN_CHUNK_BYTES, 1, aPool->ThreadCount() * cCHUNKS_PER_WORKER);
+   }
+   std::vector<std::size_t> bounds{0};
+   for (std::size_t i = 1; i < chunkCount; i++)
+   {
+      const std::size_t newline = data.find('\n', std::max(data.size() / chunkCount * i, bounds.back()));
+      if (newline == std::string_view::npos)
+      {
+         break;
+      }
+      bounds.push_back(newline + 1);
+   }
+   bounds.push_back(data.size());
+   chunkCount = bounds.size() - 1;
+
+   const auto forEachChunk = [aPool, chunkCount](const auto& aFunction)
+      {
+         for (std::size_t i = 0; i < chunkCount; i++)
+         {
+            if (aPool != nullptr && chunkCount > 1)
+            {
+               aPool->Submit([&aFunction, i](std::size_t) { aFunction(i); });
+            }
+            else
+            {
+               aFunction(i);
+            }
+         }
+         if (aPool != nullptr && chunkCount > 1)
+         {
+            aPool->Wait();
+         }
+      };
+
+   struct Chunk
+   {
+      std::string_view mText;
+      std::size_t      mFirstRow  = 0;
+      std::size_t      mRows      = 0;
+      std::size_t      mFirstLine = 0;
+      std::size_t      mLines     = 0;
+      std::string      mError;
+   };
+   std::vector<Chunk> chunks(chunkCount);
+   for (std::size_t i = 0; i < chunkCount; i++)
+   {
+      chunks[i].mText = data.substr(bounds[i], bounds[i + 1] - bounds[i]);
+   }
+
+   // First pass: count the records in each chunk, so that every chunk knows where its rows go.
+   forEachChunk([&chunks, &layout](std::size_t aIndex)
+      {
+         Chunk&           chunk = chunks[aIndex];
+         RecordCursor     cursor{chunk.mText, layout->mRecordSeparator};
+         std::string_view record;
+         std::size_t      line = 0;
+         while (cursor.Next(record, line))
+         {
+            ++chunk.mRows;
+         }
+         chunk.mLines = static_cast<std::size_t>(std::ranges::count(chunk.mText, '\n'));
+      });
+
+   std::size_t rows = 0;
+   std::size_t line = layout->mDataLine;
+   for (Chunk& chunk : chunks)
+   {
+      chunk.mFirstRow  = rows;
+      chunk.mFirstLine = line;
+      rows += chunk.mRows;
+      line += chunk.mLines;
+   }
+
+   DataTable retval;
+   retval.mNames = layout->mNames;
+   retval.mColumns.resize(layout->mNames.size());
+   for (auto& column : retval.mColumns)
+   {
+      column.resize(rows);
+   }
+
+   // Second pass: parse each chunk straight into the columns.
+   forEachChunk([&chunks, &layout, &retval](std::size_t aIndex)
+      {
+         Chunk&              chunk = chunks[aIndex];
+         RecordCursor        cursor{chunk.mText, layout->mRecordSeparator, 0, chunk.mFirstLine};
+         std::vector<double> values(retval.mColumns.size());
+         std::string_view    record;
+         std::size_t         recordLine = 0;
+         for (std::size_t row = chunk.mFirstRow; cursor.Next(record, recordLine); row++)
+         {
+            if (const auto result = ParseRecord(record, *layout, values); !result)
+            {
+               chunk.mError = LineError(recordLine, result.error());
+               return;
+            }
+            for (std::size_t c = 0; c < values.size(); c++)
+            {
+               retval.mColumns[c][row] = values[c];
+            }
+         }
+      });
+
+   for (const Chunk& chunk : chunks)
+   {
+      if (!chunk.mError.empty())
+      {
+         return std::unexpected(chunk.mError);
+      }
+   }
+   return retval;
+}
+
+std::expected<rjcpt::DataTable, std::string> rjcpt::LoadDataFile(const std::filesystem::path& aPath, ThreadPool* aPool)
+{
+   const auto file = MappedFile::Open(aPath);
+   if (!file)
+   {
+      return std::unexpected(file.error());
+   }
+   return ParseDataFile(file->Data(), aPool);
+}
+
+void rjcpt::SetColumns(Sheet& aSheet, DataTable aTable)
+{
+   for (std::size_t i = 0; i < aTable.mNames.size(); i++)
+   {
+      aSheet.SetColumn(aTable.mNames[i], std::move(aTable.mColumns[i]));
+   }
+}
+
+bool rjcpt::WriteDataFile(std::ostream&                            aStream,
+                          std::span<const std::string>             aNames,
+                          std::span<const std::span<const double>> aColumns,
+                          char                                     aSeparator)
+{
+   RJCPT_TRACE_SCOPE("WriteDataFile");
+   std::string block;
+   block.reserve(cWRITE_BLOCK_BYTES + 1024);
+   for (std::size_t i = 0; i < aNames.size(); i++)
+   {
+      block += aNames[i];
+      block += i + 1 < aNames.size() ? aSeparator : '\n';
+   }
+
+   std::size_t rows = 0;
+   for (const std::span<const double> column : aColumns)
+   {
+      rows = std::max(rows, column.size());
+   }
+   // Enough for any double in its shortest form, and a separator.
+   constexpr std::size_t cMAX_VALUE_CHARACTERS = 32;
+   for (std::size_t row = 0; row < rows; row++)
+   {
+      for (std::size_t i = 0; i < aColumns.size(); i++)
+      {
+         const std::span<const double> column = aColumns[i];
+         char       buffer[cMAX_VALUE_CHARACTERS];
+         const auto result = std::to_chars(buffer, buffer + sizeof(buffer), row < column.size() ? column[row] : cNAN);
+         block.append(buffer, result.ptr);
+         block += i + 1 < aColumns.size() ? aSeparator : '\n';
+      }
+      if (block.size() >= cWRITE_BLOCK_BYTES)
+      {
+         aStream.write(block.data(), static_cast<std::streamsize>(block.size()));
+         block.clear();
+      }
+   }
+   aStream.write(block.data(), static_cast<std::streamsize>(block.size()));
+   return static_cast<bool>(aStream);
+}
+
+std::expected<rjcpt::DataFileReader, std::string> rjcpt::DataFileReader::Open(const std::filesystem::path& aPath)
+{
+   auto file = MappedFile::Open(aPath);
+   if (!file)
+   {
+      return std::unexpected(file.error());
+   }
+   auto layout = ParseDataHeader(file->Data());
+   if (!layout)
+   {
+      return std::unexpected(layout.error());
+   }
+
+   DataFileReader retval;
+   retval.mFile   = std::move(*file);
+   retval.mLayout = std::move(*layout);
+   retval.mOffset = retval.mLayout.mDataOffset;
+   retval.mLine   = retval.mLayout.mDataLine;
+   return retval;
+}
+
+std::expected<std::size_t, std::string> rjcpt::DataFileReader::ReadRows(std::size_t aMaxRows, DataTable& aTable)
+{
+   if (aTable.mNames.empty())
+   {
+      aTable.mNames = mLayout.mNames;
+      aTable.mColumns.resize(mLayout.mNames.size());
+   }
+
+   RecordCursor        cursor{mFile.Data(), mLayout.mRecordSeparator, mOffset, mLine};
+   std::vector<double> values(mLayout.mNames.size());
+   std::string_view    record;
+   std::size_t         recordLine = 0;
+   std::size_t         retval     = 0;
+   while (retval < aMaxRows && cursor.Next(record, recordLine))
+   {
+      if (const auto result = ParseRecord(record, mLayout, values); !result)
+      {
+         mOffset = cursor.mOffset;
+         mLine   = cursor.mLine;
+         return std::unexpected(LineError(recordLine, result.error()));
+      }
+      for (std::size_t c = 0; c < values.size(); c++)
+      {
+         aTable.mColumns[c].push_back(values[c]);
+      }
+      ++retval;
+   }
+   mOffset = cursor.mOffset;
+   mLine   = cursor.mLine;
+   return retval;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "MappedFile.hpp"
+#include "Sheet.hpp"
+#include "ThreadPool.hpp"
+
+#include <cstddef>
+#include <expected>
+#include <filesystem>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "rjcpt_core_export.h"
+
+namespace rjcpt
+{
+   //! Named numeric columns read from a data file.
+   struct DataTable
+   {
+      std::vector<std::string>         mNames;
+      std::vector<std::vector<double>> mColumns; // Indexed like mNames. All columns have the same length.
+
+      std::size_t RowCount() const { return mColumns.empty() ? 0 : mColumns.front().size(); }
+   };
+
+   //! How the numeric part of a data file is laid out, as read from its header.
+   //! Two formats are recognized:
+   //!   * GEF: "#KEY= value" lines up to "#EOH=". Column names come from #COLUMNINFO, using short names
+   //!     (qc, fs, u2, ...) for the standard CPT quantities. #COLUMNVOID values are read as NaN.
+   //!     #COLUMNSEPARATOR and #RECORDSEPARATOR are honored.
+   //!   * Delimited text: blank lines and lines starting with '#' are skipped. If the first remaining line does
+   //!     not start with a number, it holds the column names. Values are separated by ';' or ',' if the first
+   //!     line contains one, and by whitespace otherwise.
+   //! Column names are changed where needed so that formulas can refer to them as identifiers.
+   struct DataLayout
+   {
+      std::vector<std::string> mNames;
+      std::vector<double>      mVoidValues;            // Indexed like mNames. NaN if the column has none.
+      char                     mColumnSeparator = ' '; // Whitespace always separates values as well.
+      char                     mRecordSeparator = '\n'; // A newline always ends a record as well.
+      std::size_t              mDataOffset = 0;         // Offset of the first data record in the file.
+      std::size_t              mDataLine   = 1;         // Line number of mDataOffset, for error messages.
+   };
+
+   //! Reads the header of a data file. On failure, returns a description of the error.
+   RJCPT_CORE_EXPORT std::expected<DataLayout, std::string> ParseDataHeader(std::string_view aText);
+
+   //! Parses a whole data file. If aPool is given, the records are split into chunks that are parsed in parallel.
+   //! Values are written straight into the columns of the result.
+   RJCPT_CORE_EXPORT std::expected<DataTable, std::string> ParseDataFile(std::string_view aText, ThreadPool* aPool = nullptr);
+
+   //! Maps the file at aPath into memory and parses it with ParseDataFile.
+   RJCPT_CORE_EXPORT std::expected<DataTable, std::string> LoadDataFile(const std::filesystem::path& aPath,
+                                                                       ThreadPool*                  aPool = nullptr);
+
+   //! Moves every column of aTable into aSheet as an input column.
+   RJCPT_CORE_EXPORT void SetColumns(Sheet& aSheet, DataTable aTable);
+
+   //! Writes columns as delimited text that ParseDataFile reads back exactly: a line with the names, then one record
+   //! per row with the values separated by aSeparator. Values are written in their shortest exact form, and NaN as
+   //! "nan". Rows past the end of a shorter column are written as NaN.
+   //! The text is written in blocks as it is formatted, rather than built up in memory.
+   //! Returns false if writing to aStream failed.
+   RJCPT_CORE_EXPORT bool WriteDataFile(std::ostream&                            aStream,
+                                        std::span<const std::string>             aNames,
+                                        std::span<const std::span<const double>> aColumns,
+                                        char                                     aSeparator = ';');
+
+   //! Reads a data file a few rows at a time, so that the first rows can be shown before the rest is read.
+   //! Only the parts of the file that have been read are loaded from disk.
+   class RJCPT_CORE_EXPORT DataFileReader
+   {
+   public:
+      //! Maps the file at aPath into memory and reads its header.
+      static std::expected<DataFileReader, std::string> Open(const std::filesystem::path& aPath);
+
+      const DataLayout& Layout() const { return mLayout; }
+      bool              AtEnd() const { return mOffset >= mFile.Data().size(); }
+
+      //! Reads up to aMaxRows more rows and appends them to aTable, which must be empty or hold the rows read so far.
+      //! Returns the number of rows read, which is 0 at the end of the file.
+      //! On failure, the rows before the invalid record are kept, and the next call continues after it.
+      std::expected<std::size_t, std::string> ReadRows(std::size_t aMaxRows, DataTable& aTable);
+
+   private:
+      MappedFile  mFile;
+      DataLayout  mLayout;
+      std::size_t mOffset = 0;
+      std::size_t mLine   = 1;
+   };
+}
@@ -0,0 +1,122 @@
+#include "DependencyGraph.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+rjcpt::DependencyGraph::NodeId rjcpt::DependencyGraph::AddNode()
+{
+   mNodes.emplace_back();
+   return static_cast<NodeId>(mNodes.size() - 1);
+}
+
+bool rjcpt::DependencyGraph::SetDependencies(NodeId aNode, std::span<const NodeId> aDependencies)
+{
+   // A dependency that aNode already reaches would close a loop.
+   for (const NodeId dependency : aDependencies)
+   {
+      if (Reaches(aNode, dependency))
+      {
+         return false;
+      }
+   }
+
+   Node& node = mNodes[aNode];
+   for (const NodeId old : node.mDependencies)
+   {
+      std::erase(mNodes[old].mDependents, aNode);
+   }
+   node.mDependencies.assign(aDependencies.begin(), aDependencies.end());
+   std::ranges::sort(node.mDependencies);
+   const auto duplicates = std::ranges::unique(node.mDependencies);
+   node.mDependencies.erase(duplicates.begin(), duplicates.end());
+   for (const NodeId dependency : node.mDependencies)
+   {
+      mNodes[dependency].mDependents.push_back(aNode);
+   }
+   MarkDirty(aNode);
+   return true;
+}
+
+bool rjcpt::DependencyGraph::Reaches(NodeId aFrom, NodeId aNode) const
+{
+   std::vector<bool>   visited(mNodes.size());
+   std::vector<NodeId> pending = {aFrom};
+   visited[aFrom] = true;
+   while (!pending.empty())
+   {
+      const NodeId next = pending.back();
+      pending.pop_back();
+      if (next == aNode)
+      {
+         return true;
+      }
+      for (const NodeId dependent : mNodes[next].mDependents)
+      {
+         if (!visited[dependent])
+         {
+            visited[dependent] = true;
+            pending.push_back(dependent);
+         }
+      }
+   }
+   return false;
+}
+
+void rjcpt::DependencyGraph::MarkDirty(NodeId aNode)
+{
+   // The dependents of a dirty node are always dirty, so the search stops at nodes that are already dirty.
+   if (mNodes[aNode].mDirty)
+   {
+      return;
+   }
+   mNodes[aNode].mDirty = true;
+   std::vector<NodeId> pending = {aNode};
+   while (!pending.empty())
+   {
+      const NodeId next = pending.back();
+      pending.pop_back();
+      for (const NodeId dependent : mNodes[next].mDependents)
+      {
+         if (!mNodes[dependent].mDirty)
+         {
+            mNodes[dependent].mDirty = true;
+            pending.push_back(dependent);
+         }
+      }
+   }
+}
+
+std::vector<rjcpt::DependencyGraph::NodeId> rjcpt::DependencyGraph::TakeDirty()
+{
+   // Kahn's algorithm, restricted to the dirty nodes.
+   std::vector<std::uint32_t> waitingOn(mNodes.size());
+   std::vector<NodeId>        retval;
+   for (NodeId i = 0; i < mNodes.size(); i++)
+   {
+      if (!mNodes[i].mDirty)
+      {
+         continue;
+      }
+      waitingOn[i] = static_cast<std::uint32_t>(std::ranges::count_if(mNodes[i].mDependencies, [this](NodeId aDependency) { return mNodes[aDependency].mDirty; }));
+      if (waitingOn[i] == 0)
+      {
+         retval.push_back(i);
+      }
+   }
+   for (std::size_t next = 0; next < retval.size(); next++)
+   {
+      for (const NodeId dependent : mNodes[retval[next]].mDependents)
+      {
+         assert(mNodes[dependent].mDirty);
+         if (--waitingOn[dependent] == 0)
+         {
+            retval.push_back(dependent);
+         }
+      }
+   }
+   for (const NodeId node : retval)
+   {
+      mNodes[node].mDirty = false;
+   }
+   return retval;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "rjcpt_core_export.h"
+
+namespace rjcpt
+{
+   //! Tracks which nodes (columns, parameters, ...) are computed from which other nodes,
+   //! and which of them need to be recomputed.
+   //! The graph is kept acyclic: an edit that would create a cycle is rejected.
+   class RJCPT_CORE_EXPORT DependencyGraph
+   {
+   public:
+      using NodeId = std::uint32_t;
+
+      //! Adds a node with no dependencies. New nodes are dirty.
+      NodeId      AddNode();
+      std::size_t Size() const { return mNodes.size(); }
+
+      //! Replaces the dependencies of aNode, and marks it dirty.
+      //! Returns false and leaves the graph unchanged if this would create a cycle.
+      bool SetDependencies(NodeId aNode, std::span<const NodeId> aDependencies);
+
+      std::span<const NodeId> Dependencies(NodeId aNode) const { return mNodes[aNode].mDependencies; }
+      std::span<const NodeId> Dependents(NodeId aNode) const { return mNodes[aNode].mDependents; }
+
+      //! Returns true if aNode can be reached from aFrom by following dependents (including aNode == aFrom).
+      bool Reaches(NodeId aFrom, NodeId aNode) const;
+
+      //! Marks aNode and everything that depends on it, directly or indirectly, as dirty.
+      void MarkDirty(NodeId aNode);
+      bool IsDirty(NodeId aNode) const { return mNodes[aNode].mDirty; }
+
+      //! Returns the dirty nodes ordered so that every node comes after its dependencies,
+      //! and clears their dirty flags.
+      std::vector<NodeId> TakeDirty();
+
+   private:
+      struct Node
+      {
+         std::vector<NodeId> mDependencies;
+         std::vector<NodeId> mDependents;
+         bool                mDirty = true;
+      };
+      std::vector<Node> mNodes;
+   };
+}
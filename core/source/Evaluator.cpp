@@ -0,0 +1,212 @@
+#include "Evaluator.hpp"
+
+#include "Stack.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace
+{
+   //! Stack entries kept on the machine stack. Deeper programs allocate theirs.
+   constexpr std::size_t cINLINE_STACK_DEPTH = 64;
+
+   constexpr double AsDouble(bool aValue)
+   {
+      return aValue ? 1.0 : 0.0;
+   }
+
+   constexpr bool IsTrue(double aValue)
+   {
+      // NaN compares unequal to zero, so it is true.
+      return aValue != 0.0;
+   }
+
+   bool Compare(rjcpt::CompareKind aKind, double aLeft, double aRight)
+   {
+      using CK = rjcpt::CompareKind;
+      switch (aKind)
+      {
+      case CK::Equal:
+         return aLeft == aRight;
+      case CK::NotEqual:
+         return aLeft != aRight;
+      case CK::LessThan:
+         return aLeft < aRight;
+      case CK::LessOrEqual:
+         return aLeft <= aRight;
+      case CK::GreaterThan:
+         return aLeft > aRight;
+      case CK::GreaterOrEqual:
+         return aLeft >= aRight;
+      }
+      return false;
+   }
+}
+
+double rjcpt::CallBuiltin(BuiltinFunction aFunction, std::span<const double> aArguments)
+{
+   using BF = BuiltinFunction;
+   switch (aFunction)
+   {
+   case BF::Abs:
+      return std::fabs(aArguments[0]);
+   case BF::Sqrt:
+      return std::sqrt(aArguments[0]);
+   case BF::Exp:
+      return std::exp(aArguments[0]);
+   case BF::Ln:
+      return std::log(aArguments[0]);
+   case BF::Log10:
+      return std::log10(aArguments[0]);
+   case BF::Pow:
+      return std::pow(aArguments[0], aArguments[1]);
+   case BF::Min:
+      return *std::ranges::min_element(aArguments);
+   case BF::Max:
+      return *std::ranges::max_element(aArguments);
+   case BF::If:
+      return IsTrue(aArguments[0]) ? aArguments[1] : aArguments[2];
+   default:
+      assert(false);
+      return 0.0;
+   }
+}
+
+double rjcpt::Evaluate(const Program& aProgram, const EvaluationContext& aContext)
+{
+   // The stacks and locals are left uninitialized; the compiler guarantees nothing is read before it is written.
+   // They only allocate for programs deeper than almost any formula.
+   InlineBuffer<double, cINLINE_STACK_DEPTH>  values(aProgram.mMaxStackDepth);
+   InlineBuffer<bool, cINLINE_STACK_DEPTH>    comparisons(aProgram.mMaxStackDepth);
+   InlineBuffer<double, Program::cMAX_LOCALS> locals(aProgram.mLocalCount);
+   std::size_t valueCount      = 0;
+   std::size_t comparisonCount = 0;
+
+   const EvaluatorInstruction* const code = aProgram.mCode.data();
+   const double* const constants = aProgram.mConstants.data();
+   std::size_t ip = 0;
+   while (true)
+   {
+      const EvaluatorInstruction instruction = code[ip++];
+      switch (instruction.mOpCode)
+      {
+      case OpCode::Return:
+         assert(valueCount == 1);
+         return values[0];
+      case OpCode::PushConstant:
+         values[valueCount++] = constants[instruction.mOperand];
+         break;
+      case OpCode::LoadColumn:
+         values[valueCount++] = aContext.mColumns[instruction.mOperand][aContext.mRow];
+         break;
+      case OpCode::LoadParameter:
+         values[valueCount++] = aContext.mParameters[instruction.mOperand];
+         break;
+      case OpCode::StoreLocal:
+         locals[instruction.mOperand] = values[valueCount - 1];
+         break;
+      case OpCode::LoadLocal:
+         values[valueCount++] = locals[instruction.mOperand];
+         break;
+      case OpCode::Negate:
+         values[valueCount - 1] = -values[valueCount - 1];
+         break;
+      case OpCode::LogicalNot:
+         values[valueCount - 1] = AsDouble(!IsTrue(values[valueCount - 1]));
+         break;
+      case OpCode::Add:
+         --valueCount;
+         values[valueCount - 1] += values[valueCount];
+         break;
+      case OpCode::Subtract:
+         --valueCount;
+         values[valueCount - 1] -= values[valueCount];
+         break;
+      case OpCode::Multiply:
+         --valueCount;
+         values[valueCount - 1] *= values[valueCount];
+         break;
+      case OpCode::Divide:
+         --valueCount;
+         values[valueCount - 1] /= values[valueCount];
+         break;
+      case OpCode::CompareEqual:
+         --valueCount;
+         values[valueCount - 1] = AsDouble(values[valueCount - 1] == values[valueCount]);
+         break;
+      case OpCode::CompareNotEqual:
+         --valueCount;
+         values[valueCount - 1] = AsDouble(values[valueCount - 1] != values[valueCount]);
+         break;
+      case OpCode::CompareLessThan:
+         --valueCount;
+         values[valueCount - 1] = AsDouble(values[valueCount - 1] < values[valueCount]);
+         break;
+      case OpCode::CompareLessOrEqual:
+         --valueCount;
+         values[valueCount - 1] = AsDouble(values[valueCount - 1] <= values[valueCount]);
+         break;
+      case OpCode::CompareGreaterThan:
+         --valueCount;
+         values[valueCount - 1] = AsDouble(values[valueCount - 1] > values[valueCount]);
+         break;
+      case OpCode::CompareGreaterOrEqual:
+         --valueCount;
+         values[valueCount - 1] = AsDouble(values[valueCount - 1] >= values[valueCount]);
+         break;
+      case OpCode::ChainBegin:
+         comparisons[comparisonCount++] = true;
+         break;
+      case OpCode::ChainCompare:
+      {
+         --valueCount;
+         const bool result = ::Compare(static_cast<CompareKind>(instruction.mOperand), values[valueCount - 1], values[valueCount]);
+         comparisons[comparisonCount - 1] = comparisons[comparisonCount - 1] && result;
+         values[valueCount - 1] = values[valueCount];
+         break;
+      }
+      case OpCode::ChainEnd:
+         values[valueCount - 1] = AsDouble(comparisons[--comparisonCount]);
+         break;
+      case OpCode::AndJump:
+         if (!IsTrue(values[valueCount - 1]))
+         {
+            values[valueCount - 1] = 0.0;
+            ip += instruction.mOperand - 1;
+         }
+         else
+         {
+            --valueCount;
+         }
+         break;
+      case OpCode::OrJump:
+         if (IsTrue(values[valueCount - 1]))
+         {
+            values[valueCount - 1] = 1.0;
+            ip += instruction.mOperand - 1;
+         }
+         else
+         {
+            --valueCount;
+         }
+         break;
+      case OpCode::AndEnd:
+      case OpCode::OrEnd:
+         values[valueCount - 1] = AsDouble(IsTrue(values[valueCount - 1]));
+         break;
+      case OpCode::Call:
+      {
+         const std::size_t argc = instruction.mOperand >> 8;
+         valueCount -= argc;
+         values[valueCount] = CallBuiltin(static_cast<BuiltinFunction>(instruction.mOperand & 0xFFU),
+                                          std::span<const double>(values.Data() + valueCount, argc));
+         ++valueCount;
+         break;
+      }
+      default:
+         assert(false);
+         return 0.0;
+      }
+   }
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <vector>
+
+#include "rjcpt_core_export.h"
+
+namespace rjcpt
+{
+   // EvaluatorInstructions are executed in order on a stack of doubles.
+   // Booleans are represented as 1.0 and 0.0. Any non-zero value (including NaN) is considered true.
+   enum class OpCode : std::uint8_t
+   {
+      // Stops evaluation. The top value on the stack is the result.
+      Return,
+
+      // Push a value onto the stack.
+      PushConstant,  // Operand is an index into Program::mConstants.
+      LoadColumn,    // Operand is a column slot. Pushes the column's value at the current row.
+      LoadParameter, // Operand is a parameter slot.
+
+      // Locals hold values computed once and used several times. Operand is a local slot.
+      StoreLocal, // Copies the top value into the local, leaving it on the stack.
+      LoadLocal,  // Pushes the value of the local.
+
+      // Replace the top value on the stack.
+      Negate,
+      LogicalNot,
+
+      // Pop two values and push the result.
+      Add,
+      Subtract,
+      Multiply,
+      Divide,
+      CompareEqual,
+      CompareNotEqual,
+      CompareLessThan,
+      CompareLessOrEqual,
+      CompareGreaterThan,
+      CompareGreaterOrEqual,
+
+      // Chained comparisons, e.g. "a < b < c".
+      // ChainBegin pushes 'true' onto a separate 'comparison results' stack.
+      // ChainCompare pops two values, pushes the second one back, and combines the result
+      //    of the comparison (Operand is a CompareKind) with the top comparison result.
+      // ChainEnd replaces the top value with the top comparison result, and pops that result.
+      ChainBegin,
+      ChainCompare,
+      ChainEnd,
+
+      // Short-circuit logic. "a and b" compiles to: [a] AndJump [b] AndEnd
+      // AndJump: If the top value is false, replace it with 0.0 and jump forward by Operand instructions
+      //          to just past the matching AndEnd. Otherwise, pop it.
+      // AndEnd:  Replace the top value with 1.0 if it is true, or 0.0 otherwise.
+      // OrJump and OrEnd are the same, except that OrJump jumps if the top value is true.
+      AndJump,
+      AndEnd,
+      OrJump,
+      OrEnd,
+
+      // Calls a built-in function. Operand is (argument count << 8) | BuiltinFunction.
+      // Pops the arguments and pushes the result.
+      Call,
+
+      cMAX_OPCODE
+   };
+
+   //! The kinds of comparison used by ChainCompare.
+   enum class CompareKind : std::uint8_t
+   {
+      Equal,
+      NotEqual,
+      LessThan,
+      LessOrEqual,
+      GreaterThan,
+      GreaterOrEqual
+   };
+
+   //! Functions that can be called from formulas.
+   //! Arguments are always evaluated before the call, including for If.
+   enum class BuiltinFunction : std::uint8_t
+   {
+      Abs,   // abs(x)
+      Sqrt,  // sqrt(x)
+      Exp,   // exp(x)
+      Ln,    // ln(x)
+      Log10, // log(x)
+      Pow,   // pow(x, y)
+      Min,   // min(x, ...)
+      Max,   // max(x, ...)
+      If,    // if(condition, whenTrue, whenFalse)
+      cMAX_FUNCTION
+   };
+
+   struct EvaluatorInstruction
+   {
+      OpCode        mOpCode  = OpCode::Return;
+      std::uint32_t mOperand = 0;
+   };
+
+   //! A compiled formula.
+   //! The code and constants are allocated from a memory resource, so that programs can live in an Arena or pool.
+   //! Note that assigning a Program keeps the resource of the destination.
+   struct Program
+   {
+      //! Largest number of locals a program may use.
+      static constexpr std::uint32_t cMAX_LOCALS = 64;
+
+      Program() = default;
+      explicit Program(std::pmr::memory_resource* aResource)
+         : mCode(aResource)
+         , mConstants(aResource)
+      {
+      }
+
+      std::pmr::vector<EvaluatorInstruction> mCode;
+      std::pmr::vector<double>               mConstants;
+      std::uint32_t                          mMaxStackDepth = 0;
+      std::uint32_t                          mLocalCount    = 0;
+   };
+
+   //! The values a Program can refer to.
+   struct EvaluationContext
+   {
+      //! Pointers to the first row of each column, indexed by column slot.
+      std::span<const double* const> mColumns;
+      //! Parameter values, indexed by parameter slot.
+      std::span<const double>        mParameters;
+      //! The row that LoadColumn reads from.
+      std::size_t                    mRow = 0;
+   };
+
+   //! Evaluates aProgram for a single row.
+   RJCPT_CORE_EXPORT double Evaluate(const Program& aProgram, const EvaluationContext& aContext);
+
+   //! Calls a built-in function with the given arguments.
+   RJCPT_CORE_EXPORT double CallBuiltin(BuiltinFunction aFunction, std::span<const double> aArguments);
+}
@@ -0,0 +1,305 @@
+#include "FormulaCache.hpp"
+
+#include "FormulaParser.hpp"
+#include "Lexer.hpp"
+#include "Optimizer.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <mutex>
+#include <optional>
+
+struct rjcpt::FormulaCache::Shape
+{
+   //! False if the shape cannot be compiled with placeholders, for example because it doesn't parse.
+   //! Formulas of such shapes are compiled in full every time.
+   bool              mValid = false;
+   //! Placeholder i is loaded by a LoadColumn or LoadParameter instruction with operand i.
+   Program           mProgram;
+   //! True for placeholders used with the '$' operator, which may only refer to parameters.
+   std::vector<bool> mRowLookup;
+};
+
+namespace
+{
+   //! Buffers reused by every Compile on a thread.
+   struct CacheScratch
+   {
+      rjcpt::Arena               mArena;
+      std::string                mKey;
+      std::vector<rjcpt::Symbol> mSymbols;
+   };
+
+   thread_local CacheScratch tScratch;
+
+   //! Builds the key of a formula's shape into aKey: the type of each token, followed by the text of numbers, the text
+   //! of names followed by '(' (which name functions), and the placeholder number of other names. Token types are
+   //! below ' ', so they cannot be mistaken for text. aNames receives the name of each placeholder.
+   //! Returns false if the formula has a lexical error.
+   bool MakeShapeKey(std::string_view                aExpression,
+                     std::span<const rjcpt::Token>   aTokens,
+                     std::string&                    aKey,
+                     std::vector<std::string_view>&  aNames)
+   {
+      static_assert(rjcpt::cNUM_TOKEN_TYPES < ' ');
+      aKey.clear();
+      aNames.clear();
+      for (std::size_t i = 0; i < aTokens.size(); i++)
+      {
+         const rjcpt::Token&    token = aTokens[i];
+         const std::string_view text  = aExpression.substr(token.mStartIndex, token.mLength);
+         aKey.push_back(static_cast<char>(token.mType));
+         switch (token.mType)
+         {
+         case rjcpt::TokenType::Error:
+            return false;
+         case rjcpt::TokenType::Number:
+            aKey.append(text);
+            break;
+         case rjcpt::TokenType::Identifier:
+            if (i + 1 < aTokens.size() && aTokens[i + 1].mType == rjcpt::TokenType::LeftParenthesis)
+            {
+               aKey.append(text);
+            }
+            else
+            {
+               auto iter = std::ranges::find(aNames, text);
+               if (iter == aNames.end())
+               {
+                  aNames.push_back(text);
+                  iter = aNames.end() - 1;
+               }
+               char       digits[16];
+               const auto result = std::to_chars(digits, digits + sizeof(digits), iter - aNames.begin());
+               aKey.append(digits, result.ptr);
+            }
+            break;
+         default:
+            break;
+         }
+      }
+      return true;
+   }
+
+   //! Resolves the names of a formula to placeholders.
+   class PlaceholderResolver : public rjcpt::SymbolResolver
+   {
+   public:
+      PlaceholderResolver(std::span<const std::string_view> aNames, const std::vector<bool>& aRowLookup)
+         : mNames(aNames)
+         , mRowLookup(aRowLookup)
+      {
+      }
+
+      rjcpt::Symbol Resolve(std::string_view aName) const override
+      {
+         const auto iter = std::ranges::find(mNames, aName);
+         if (iter == mNames.end())
+         {
+            return {};
+         }
+         const auto slot = static_cast<std::uint32_t>(iter - mNames.begin());
+         return rjcpt::Symbol{mRowLookup[slot] ? rjcpt::SymbolKind::Parameter : rjcpt::SymbolKind::Column, slot};
+      }
+
+   private:
+      std::span<const std::string_view> mNames;
+      const std::vector<bool>&          mRowLookup;
+   };
+
+   //! Replaces the placeholders of aProgram with the slots of aNames.
+   //! Returns nothing if a name is unknown, or is used with '$' but is not a parameter.
+   template<typename Name>
+   std::optional<rjcpt::Program> Bind(const rjcpt::Program&        aProgram,
+                                      const std::vector<bool>&     aRowLookup,
+                                      std::span<const Name>        aNames,
+                                      const rjcpt::SymbolResolver& aResolver,
+                                      std::pmr::memory_resource*   aResource)
+   {
+      using OC = rjcpt::OpCode;
+      // Each name is resolved once, however often it is used.
+      std::vector<rjcpt::Symbol>& symbols = tScratch.mSymbols;
+      symbols.clear();
+      for (std::size_t i = 0; i < aNames.size(); i++)
+      {
+         const rjcpt::Symbol symbol = aResolver.Resolve(aNames[i]);
+         if (symbol.mKind == rjcpt::SymbolKind::Unknown ||
+             (aRowLookup[i] && symbol.mKind != rjcpt::SymbolKind::Parameter))
+         {
+            return std::nullopt;
+         }
+         symbols.push_back(symbol);
+      }
+
+      rjcpt::Program retval(aResource);
+      retval.mCode.assign(aProgram.mCode.begin(), aProgram.mCode.end());
+      retval.mConstants.assign(aProgram.mConstants.begin(), aProgram.mConstants.end());
+      retval.mMaxStackDepth = aProgram.mMaxStackDepth;
+      retval.mLocalCount    = aProgram.mLocalCount;
+      for (rjcpt::EvaluatorInstruction& instruction : retval.mCode)
+      {
+         if (instruction.mOpCode != OC::LoadColumn && instruction.mOpCode != OC::LoadParameter)
+         {
+            continue;
+         }
+         const rjcpt::Symbol symbol = symbols[instruction.mOperand];
+         instruction.mOpCode  = symbol.mKind == rjcpt::SymbolKind::Column ? OC::LoadColumn : OC::LoadParameter;
+         instruction.mOperand = symbol.mSlot;
+      }
+      return retval;
+   }
+
+   //! Parses and compiles a formula with aNames, the names from its shape key, replaced by placeholders.
+   //! aProgram and aRowLookup are left empty if it does not compile that way.
+   bool CompilePlaceholders(std::string_view                  aExpression,
+                            std::span<const rjcpt::Token>     aTokens,
+                            std::span<const std::string_view> aNames,
+                            rjcpt::ParserEngine               aEngine,
+                            rjcpt::Program&                   aProgram,
+                            std::vector<bool>&                aRowLookup)
+   {
+      const auto nodes = rjcpt::ParseFormula(aTokens, tScratch.mArena, aEngine);
+      if (!nodes)
+      {
+         return false;
+      }
+      aRowLookup.assign(aNames.size(), false);
+      for (const rjcpt::Reference& reference : rjcpt::FindReferences(aExpression, aTokens, *nodes))
+      {
+         const auto iter = std::ranges::find(aNames, reference.mName);
+         if (iter != aNames.end() && reference.mRowLookup)
+         {
+            aRowLookup[static_cast<std::size_t>(iter - aNames.begin())] = true;
+         }
+      }
+      auto program = rjcpt::CompileFormula(aExpression, aTokens, *nodes, PlaceholderResolver(aNames, aRowLookup));
+      if (!program)
+      {
+         aRowLookup.clear();
+         return false;
+      }
+      rjcpt::OptimizeProgram(*program);
+      aProgram = std::move(*program);
+      return true;
+   }
+
+   //! Compiles a formula without the cache, and lists the names it reads from.
+   std::expected<rjcpt::Program, std::string> CompileInFull(std::string_view               aExpression,
+                                                            std::span<const rjcpt::Token>  aTokens,
+                                                            const rjcpt::SymbolResolver&   aResolver,
+                                                            std::pmr::memory_resource*     aResource,
+                                                            rjcpt::ParserEngine            aEngine,
+                                                            std::vector<std::string_view>& aReferences)
+   {
+      const auto nodes = rjcpt::ParseFormula(aTokens, tScratch.mArena, aEngine);
+      if (!nodes)
+      {
+         return std::unexpected(nodes.error());
+      }
+      auto retval = rjcpt::CompileFormula(aExpression, aTokens, *nodes, aResolver, aResource);
+      if (retval)
+      {
+         OptimizeProgram(*retval);
+         aReferences.clear();
+         for (const rjcpt::Reference& reference : rjcpt::FindReferences(aExpression, aTokens, *nodes))
+         {
+            if (std::ranges::find(aReferences, reference.mName) == aReferences.end())
+            {
+               aReferences.push_back(reference.mName);
+            }
+         }
+      }
+      return retval;
+   }
+}
+
+rjcpt::FormulaCache::FormulaCache() = default;
+
+rjcpt::FormulaCache::~FormulaCache() = default;
+
+std::expected<rjcpt::Program, std::string> rjcpt::FormulaCache::Compile(std::string_view               aExpression,
+                                                                        const SymbolResolver&          aResolver,
+                                                                        std::pmr::memory_resource*     aResource,
+                                                                        std::vector<std::string_view>& aReferences)
+{
+   RJCPT_TRACE_SAMPLED_SCOPE("FormulaCache::Compile");
+   tScratch.mArena.Reset();
+   const auto tokens = TokenizeExpression(aExpression, tScratch.mArena);
+   if (MakeShapeKey(aExpression, tokens, tScratch.mKey, aReferences))
+   {
+      std::shared_ptr<const Shape> shape;
+      {
+         std::shared_lock lock(mMutex);
+         if (const auto iter = mShapes.find(tScratch.mKey); iter != mShapes.end())
+         {
+            shape = iter->second;
+         }
+      }
+      if (shape)
+      {
+         mHits.fetch_add(1, std::memory_order_relaxed);
+      }
+      else
+      {
+         auto created = std::make_shared<Shape>();
+         created->mValid = CompilePlaceholders(aExpression, tokens, aReferences, mParserEngine, created->mProgram,
+                                               created->mRowLookup);
+         // Another thread may have added the same shape meanwhile. Either one will do.
+         std::unique_lock lock(mMutex);
+         shape = mShapes.try_emplace(tScratch.mKey, std::move(created)).first->second;
+      }
+
+      if (shape->mValid)
+      {
+         if (auto retval = Bind(shape->mProgram, shape->mRowLookup, std::span<const std::string_view>(aReferences),
+                                aResolver, aResource))
+         {
+            return std::move(*retval);
+         }
+      }
+   }
+   // Compiled in full, so that errors are the same as without the cache.
+   return CompileInFull(aExpression, tokens, aResolver, aResource, mParserEngine, aReferences);
+}
+
+std::size_t rjcpt::FormulaCache::Size() const
+{
+   std::shared_lock lock(mMutex);
+   return mShapes.size();
+}
+
+std::size_t rjcpt::FormulaCache::Hits() const
+{
+   return mHits.load(std::memory_order_relaxed);
+}
+
+void rjcpt::FormulaCache::Clear()
+{
+   std::unique_lock lock(mMutex);
+   mShapes.clear();
+   mHits = 0;
+}
+
+std::optional<rjcpt::PrecompiledFormula> rjcpt::PrecompileFormula(std::string_view aExpression, ParserEngine aEngine)
+{
+   tScratch.mArena.Reset();
+   const auto                    tokens = TokenizeExpression(aExpression, tScratch.mArena);
+   std::vector<std::string_view> names;
+   PrecompiledFormula            retval;
+   if (!MakeShapeKey(aExpression, tokens, tScratch.mKey, names) ||
+       !CompilePlaceholders(aExpression, tokens, names, aEngine, retval.mProgram, retval.mRowLookup))
+   {
+      return std::nullopt;
+   }
+   retval.mNames.assign(names.begin(), names.end());
+   return retval;
+}
+
+std::optional<rjcpt::Program> rjcpt::BindFormula(const PrecompiledFormula&  aFormula,
+                                                 const SymbolResolver&      aResolver,
+                                                 std::pmr::memory_resource* aResource)
+{
+   return Bind(aFormula.mProgram, aFormula.mRowLookup, std::span<const std::string>(aFormula.mNames), aResolver,
+               aResource);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Compiler.hpp"
+#include "FormulaParser.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <expected>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "rjcpt_core_export.h"
+
+namespace rjcpt
+{
+   //! A formula compiled with its names replaced by placeholders, so that it can be bound to the slots of any sheet
+   //! without being parsed again. Placeholder i is the operand of the LoadColumn or LoadParameter instructions that
+   //! read mNames[i].
+   struct PrecompiledFormula
+   {
+      Program                  mProgram;
+      std::vector<std::string> mNames;     // In order of first appearance.
+      std::vector<bool>        mRowLookup; // True for names used with '$', which must be parameters.
+   };
+
+   //! Parses, compiles and optimizes aExpression with placeholders for its names, as FormulaCache does for shapes.
+   //! Returns nothing if it cannot be compiled that way, for example because it doesn't parse.
+   RJCPT_CORE_EXPORT std::optional<PrecompiledFormula> PrecompileFormula(std::string_view aExpression,
+                                                                         ParserEngine aEngine = ParserEngine::Grammar);
+
+   //! Replaces the placeholders of aFormula with the slots its names resolve to in aResolver. The result is the same
+   //! as compiling the formula's text. Returns nothing if a name is unknown, or is used with '$' but is not a
+   //! parameter; compiling the text gives the error.
+   RJCPT_CORE_EXPORT std::optional<Program> BindFormula(const PrecompiledFormula&  aFormula,
+                                                        const SymbolResolver&      aResolver,
+                                                        std::pmr::memory_resource* aResource = std::pmr::get_default_resource());
+
+   //! Compiled formulas, shared by all formulas of the same shape.
+   //! Formulas have the same shape if they only differ in spacing and in the names they read from, such as
+   //! "f1 + $a * fs" and "f7 + $a * qc". Each shape is parsed and compiled once, with its names replaced by
+   //! placeholders numbered in order of first appearance. Compiling another formula of that shape then only
+   //! tokenizes it, and binds the placeholders of the cached program to the slots of its names.
+   //! Can be used from several threads, and by several sheets, at once.
+   class RJCPT_CORE_EXPORT FormulaCache
+   {
+   public:
+      FormulaCache();
+      ~FormulaCache();
+
+      FormulaCache(const FormulaCache&) = delete;
+      FormulaCache& operator=(const FormulaCache&) = delete;
+
+      //! Same as TokenizeExpression, ParseFormula, CompileFormula and OptimizeProgram, with the same results and errors.
+      //! aReferences receives the names the formula reads from, without duplicates, as views into aExpression.
+      std::expected<Program, std::string> Compile(std::string_view               aExpression,
+                                                  const SymbolResolver&          aResolver,
+                                                  std::pmr::memory_resource*     aResource,
+                                                  std::vector<std::string_view>& aReferences);
+
+      //! The engine that shapes are parsed with from now on. Set it before sharing the cache between threads.
+      void SetParserEngine(ParserEngine aEngine) { mParserEngine = aEngine; }
+
+      //! Number of shapes compiled so far.
+      std::size_t Size() const;
+      //! Number of calls to Compile that found their shape in the cache.
+      std::size_t Hits() const;
+
+      void Clear();
+
+   private:
+      struct Shape;
+      //! Allows looking up shapes by string_view.
+      struct KeyHash
+      {
+         using is_transparent = void;
+         std::size_t operator()(std::string_view aKey) const { return std::hash<std::string_view>()(aKey); }
+      };
+
+      mutable std::shared_mutex mMutex;
+      std::unordered_map<std::string, std::shared_ptr<const Shape>, KeyHash, std::equal_to<>> mShapes;
+      std::atomic<std::size_t>  mHits = 0;
+      ParserEngine              mParserEngine = ParserEngine::Grammar;
+   };
+}
@@ -0,0 +1,836 @@
+#include "FormulaParser.hpp"
+
+#include "ParserLL.hpp"
+#include "Stack.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace
+{
+   using TT  = rjcpt::TokenType;
+   using PNT = rjcpt::ParseNodeType;
+
+   // Operators are listed from lowest to highest precedence.
+   // Actors without a validator run with the look-ahead token, and don't consume it.
+   //   * Operator remembers the index of the current token so that a later actor can emit a node for it.
+   //   * Unary, Binary and Compare emit the node for the most recently remembered operator.
+   constexpr std::string_view cFORMULA_GRAMMAR = R"grammar(
+      Formula=       Or
+
+      Or=            And OrTail
+      OrTail=        Or>Operator And >Binary OrTail
+         |
+
+      And=           Not AndTail
+      AndTail=       And>Operator Not >Binary AndTail
+         |
+
+      Not=           Not>Operator Not >Unary
+         |           Compare
+
+      # "a < b < c" is equivalent to "(a < b) and (b < c)", except that b is only evaluated once.
+      Compare=       Sum CompareChain
+      CompareChain=  Comparator Sum >CompareBegin >Compare CompareTail >CompareEnd
+         |
+      CompareTail=   Comparator Sum >Compare CompareTail
+         |
+      Comparator=    Equals>Operator
+         |           NotEquals>Operator
+         |           LessThan>Operator
+         |           LessOrEqual>Operator
+         |           GreaterThan>Operator
+         |           GreaterOrEqual>Operator
+
+      Sum=           Product SumTail
+      SumTail=       Plus>Operator Product >Binary SumTail
+         |           Hyphen>Operator Product >Binary SumTail
+         |
+
+      # Two operands with no operator between them are multiplied ("2 qc").
+      # The right-hand operand cannot start with a parenthesis, since "f (x)" is a function call.
+      Product=       Unary ProductTail
+      ProductTail=   Asterisk>Operator Unary >Binary ProductTail
+         |           Slash>Operator Unary >Binary ProductTail
+         |           >Operator Concatenand >Concatenate ProductTail
+         |
+      Concatenand=   Atom
+         |           DollarSign>Operator Unary >Unary
+
+      Unary=         Plus>Operator Unary >Unary
+         |           Hyphen>Operator Unary >Unary
+         |           DollarSign>Operator Unary >Unary
+         |           Primary
+
+      Primary=       Atom
+         |           LParen> Or RParen>
+      Atom=          Number>Number
+         |           True>True
+         |           False>False
+         |           Identifier>Operator CallOrName
+
+      # An identifier immediately followed by parentheses is a function call.
+      CallOrName=    LParen>BeginCall Arguments RParen> >Invoke
+         |           >Identifier
+      Arguments=     Or >Argument ArgumentsTail
+         |
+      ArgumentsTail= Comma> Or >Argument ArgumentsTail
+         |
+   )grammar";
+
+   // Validators accept exactly one token type. Their index is the token type plus one.
+   constexpr std::array<std::pair<std::string_view, TT>, 22> cVALIDATORS = {{
+      {"EOF", TT::EndOfData},
+      {"Number", TT::Number},
+      {"Identifier", TT::Identifier},
+      {"Plus", TT::Plus},
+      {"Hyphen", TT::Hyphen},
+      {"Asterisk", TT::Asterisk},
+      {"Slash", TT::Slash},
+      {"Comma", TT::Comma},
+      {"DollarSign", TT::DollarSign},
+      {"LParen", TT::LeftParenthesis},
+      {"RParen", TT::RightParenthesis},
+      {"Equals", TT::Equals},
+      {"NotEquals", TT::NotEquals},
+      {"LessThan", TT::LessThan},
+      {"LessOrEqual", TT::LessOrEqual},
+      {"GreaterThan", TT::GreaterThan},
+      {"GreaterOrEqual", TT::GreaterOrEqual},
+      {"And", TT::KeywordAnd},
+      {"Or", TT::KeywordOr},
+      {"Not", TT::KeywordNot},
+      {"True", TT::KeywordTrue},
+      {"False", TT::KeywordFalse}
+   }};
+
+   enum class Actor : std::uint16_t
+   {
+      None = 0,
+      Finished,
+      Operator,
+      Number,
+      True,
+      False,
+      Identifier,
+      Unary,
+      Binary,
+      Concatenate,
+      CompareBegin,
+      Compare,
+      CompareEnd,
+      BeginCall,
+      Argument,
+      Invoke,
+      cCOUNT
+   };
+
+   constexpr std::array<std::string_view, static_cast<std::size_t>(Actor::cCOUNT)> cACTORS = {
+      "",
+      "Finished",
+      "Operator",
+      "Number",
+      "True",
+      "False",
+      "Identifier",
+      "Unary",
+      "Binary",
+      "Concatenate",
+      "CompareBegin",
+      "Compare",
+      "CompareEnd",
+      "BeginCall",
+      "Argument",
+      "Invoke"
+   };
+
+   class FormulaLocator : public rjcpt::GrammarLocator
+   {
+   public:
+      // Declared explicitly so that the locator can be used in constant expressions.
+      constexpr ~FormulaLocator() override {}
+
+      constexpr std::uint16_t FindValidator(std::string_view aName) const override
+      {
+         const auto iter = std::ranges::find(cVALIDATORS, aName, &std::pair<std::string_view, TT>::first);
+         return iter == cVALIDATORS.end() ? 0 : ValidatorOf(iter->second);
+      }
+      constexpr std::uint16_t FindActor(std::string_view aName) const override
+      {
+         const auto iter = std::ranges::find(cACTORS, aName);
+         return (iter == cACTORS.begin() || iter == cACTORS.end()) ? 0 : static_cast<std::uint16_t>(iter - cACTORS.begin());
+      }
+      constexpr rjcpt::TokenSet ValidatorTokens(std::uint16_t aValidator) const override
+      {
+         rjcpt::TokenSet retval;
+         retval.set(aValidator - 1U);
+         return retval;
+      }
+
+      static constexpr std::uint16_t ValidatorOf(TT aType) { return static_cast<std::uint16_t>(aType) + 1; }
+   };
+
+   // The formula grammar is compiled at compile time, so it needs no initialization at startup.
+   constexpr auto cFORMULA_GRAMMAR_SIZE = rjcpt::grammar_util::GetGrammarSize(cFORMULA_GRAMMAR);
+   constexpr auto cFORMULA_COMPILED     =
+      rjcpt::CompileStaticGrammar<cFORMULA_GRAMMAR_SIZE.mNumRules, cFORMULA_GRAMMAR_SIZE.mNumNodes>(FormulaLocator(),
+                                                                                                 cFORMULA_GRAMMAR);
+   constexpr rjcpt::GrammarNode cSTART_RULE = cFORMULA_COMPILED.View().NonTerminal("Formula");
+
+   //! Maps an operator token to the type of node it produces when used as a prefix operator.
+   PNT UnaryNodeType(TT aType)
+   {
+      switch (aType)
+      {
+      case TT::Plus:
+         return PNT::UnaryPlus;
+      case TT::Hyphen:
+         return PNT::UnaryMinus;
+      case TT::DollarSign:
+         return PNT::RowLookup;
+      case TT::KeywordNot:
+         return PNT::LogicalNot;
+      default:
+         return PNT::cERROR_UNEXPECTED_SYMBOL;
+      }
+   }
+
+   //! Maps an operator token to the type of node it produces when used as an infix operator.
+   PNT BinaryNodeType(TT aType)
+   {
+      switch (aType)
+      {
+      case TT::Plus:
+         return PNT::Addition;
+      case TT::Hyphen:
+         return PNT::Subtraction;
+      case TT::Asterisk:
+         return PNT::Multiplication;
+      case TT::Slash:
+         return PNT::Division;
+      case TT::KeywordAnd:
+         return PNT::LogicalAnd;
+      case TT::KeywordOr:
+         return PNT::LogicalOr;
+      case TT::Equals:
+         return PNT::CompareEqual;
+      case TT::NotEquals:
+         return PNT::CompareNotEqual;
+      case TT::LessThan:
+         return PNT::CompareLessThan;
+      case TT::LessOrEqual:
+         return PNT::CompareLessOrEqual;
+      case TT::GreaterThan:
+         return PNT::CompareGreateThan;
+      case TT::GreaterOrEqual:
+         return PNT::CompareGreaterOrEqual;
+      default:
+         return PNT::cERROR_UNEXPECTED_SYMBOL;
+      }
+   }
+
+   //! Emits ParseNodes in postfix order as the formula grammar is parsed.
+   //! This is a StaticParseContext, so that validators and actors are dispatched without virtual calls.
+   class FormulaContext
+   {
+   public:
+      //! aCheckpoints is only needed for rjcpt::Reparse.
+      explicit FormulaContext(std::vector<rjcpt::ParseNode>&      aOutput,
+                              rjcpt::detail::FormulaCheckpoints* aCheckpoints = nullptr)
+         : mOutput(aOutput)
+         , mCheckpoints(aCheckpoints)
+      {
+      }
+
+      rjcpt::GrammarView GetGrammar() const { return cFORMULA_COMPILED; }
+
+      rjcpt::GrammarNode GetEOF_Node() const
+      {
+         rjcpt::GrammarNode retval;
+         retval.SetTerminal(FormulaLocator::ValidatorOf(TT::EndOfData), static_cast<std::uint16_t>(Actor::Finished));
+         return retval;
+      }
+      rjcpt::GrammarNode GetStartRule() const { return cSTART_RULE; }
+
+      void BeginParsing()
+      {
+         mOutput.clear();
+         if (mCheckpoints)
+         {
+            *mCheckpoints = rjcpt::detail::FormulaCheckpoints();
+         }
+      }
+      bool CheckValidator(const rjcpt::Token& aToken, std::uint16_t aValidator) const
+      {
+         return FormulaLocator::ValidatorOf(aToken.mType) == aValidator;
+      }
+      void SaveCheckpoint(std::uint32_t)
+      {
+         mCheckpoints->mOperators.insert(mCheckpoints->mOperators.end(), mOperators.Items().begin(), mOperators.Items().end());
+         mCheckpoints->mArgumentCounts.insert(mCheckpoints->mArgumentCounts.end(), mArgumentCounts.Items().begin(),
+                                              mArgumentCounts.Items().end());
+         mCheckpoints->mPoints.push_back({static_cast<std::uint32_t>(mOutput.size()),
+                                          static_cast<std::uint32_t>(mCheckpoints->mOperators.size()),
+                                          static_cast<std::uint32_t>(mCheckpoints->mArgumentCounts.size())});
+      }
+      void RestoreCheckpoint(std::uint32_t aTokenIndex)
+      {
+         const auto& points = mCheckpoints->mPoints;
+         const auto  point  = points[aTokenIndex];
+         const auto  before = aTokenIndex == 0 ? rjcpt::detail::FormulaCheckpoints::Point() : points[aTokenIndex - 1];
+         mOutput.resize(point.mOutputSize);
+         mOperators.Clear();
+         for (std::uint32_t i = before.mOperatorsEnd; i < point.mOperatorsEnd; i++)
+         {
+            mOperators.Push(mCheckpoints->mOperators[i]);
+         }
+         mArgumentCounts.Clear();
+         for (std::uint32_t i = before.mArgumentCountsEnd; i < point.mArgumentCountsEnd; i++)
+         {
+            mArgumentCounts.Push(mCheckpoints->mArgumentCounts[i]);
+         }
+         mCheckpoints->mPoints.resize(aTokenIndex);
+         mCheckpoints->mOperators.resize(before.mOperatorsEnd);
+         mCheckpoints->mArgumentCounts.resize(before.mArgumentCountsEnd);
+      }
+
+      bool RunActor(const rjcpt::Token& aToken, std::uint32_t aTokenIndex, std::uint16_t aActor)
+      {
+         switch (static_cast<Actor>(aActor))
+         {
+         case Actor::Finished:
+            Emit(PNT::Finished, aTokenIndex);
+            return true;
+         case Actor::Operator:
+            mOperators.Push({aTokenIndex, aToken.mType});
+            return true;
+         case Actor::Number:
+            Emit(PNT::Number, aTokenIndex);
+            return true;
+         case Actor::True:
+            Emit(PNT::LogicalTrue, aTokenIndex);
+            return true;
+         case Actor::False:
+            Emit(PNT::LogicalFalse, aTokenIndex);
+            return true;
+         case Actor::Identifier:
+            Emit(PNT::Identifier, mOperators.Pop().mTokenIndex);
+            return true;
+         case Actor::Unary:
+         {
+            const auto op = mOperators.Pop();
+            return Emit(UnaryNodeType(op.mType), op.mTokenIndex);
+         }
+         case Actor::Binary:
+         case Actor::Compare:
+         {
+            const auto op = mOperators.Pop();
+            return Emit(BinaryNodeType(op.mType), op.mTokenIndex);
+         }
+         case Actor::Concatenate:
+         {
+            // The remembered token is the first token of the right-hand operand.
+            Emit(PNT::Concatenation, mOperators.Pop().mTokenIndex);
+            return true;
+         }
+         case Actor::CompareBegin:
+            Emit(PNT::CompareBegin, aTokenIndex);
+            return true;
+         case Actor::CompareEnd:
+            Emit(PNT::CompareEnd, aTokenIndex);
+            return true;
+         case Actor::BeginCall:
+            mArgumentCounts.Push(0);
+            return true;
+         case Actor::Argument:
+            ++mArgumentCounts.Top();
+            return true;
+         case Actor::Invoke:
+         {
+            // The invocable is pushed after its arguments.
+            const std::uint32_t callee = mOperators.Pop().mTokenIndex;
+            Emit(PNT::Identifier, callee);
+            auto& node = mOutput.emplace_back();
+            node.mType            = PNT::Invoke;
+            node.mStartTokenIndex = callee;
+            node.mStopTokenIndex  = aTokenIndex - 1; // The closing parenthesis.
+            node.mAuxData         = mArgumentCounts.Pop();
+            return true;
+         }
+         default:
+            return false;
+         }
+      }
+
+   private:
+      //! Appends a node of the given type. Returns false if aType is an error.
+      bool Emit(PNT aType, std::uint32_t aTokenIndex)
+      {
+         if (rjcpt::IsErrorType(aType))
+         {
+            return false;
+         }
+         auto& node = mOutput.emplace_back();
+         node.mType            = aType;
+         node.mStartTokenIndex = aTokenIndex;
+         node.mStopTokenIndex  = aTokenIndex;
+         return true;
+      }
+
+      std::vector<rjcpt::ParseNode>&     mOutput;
+      rjcpt::detail::FormulaCheckpoints* mCheckpoints;
+
+      // Operator tokens whose nodes have not been emitted yet.
+      rjcpt::Stack<rjcpt::detail::PendingOperator, 256> mOperators;
+      // Number of arguments seen so far for each function call being parsed.
+      rjcpt::Stack<std::uint32_t, 64>  mArgumentCounts;
+   };
+
+   //! Parses formulas by operator precedence, without the grammar tables. Emits the same nodes as FormulaContext, and
+   //! fails on the same token. Pending operators are kept on an explicit stack rather than in recursive calls, so
+   //! nesting depth is only limited by memory, as with the grammar engine.
+   class PrecedenceParser
+   {
+   public:
+      explicit PrecedenceParser(std::vector<rjcpt::ParseNode>& aOutput)
+         : mOutput(aOutput)
+      {
+      }
+
+      //! aTokens is a SpanTokens or a TokenStream. Returns an empty string on success, or a description of the error.
+      template<typename Tokens>
+      std::string Run(Tokens& aTokens)
+      {
+         RJCPT_TRACE_SAMPLED_SCOPE("ParsePrecedence");
+         mOutput.clear();
+         mPending.Clear();
+         State         state = State::Operand;
+         std::uint32_t name  = 0;
+         while (true)
+         {
+            const TT            type  = aTokens.Current().mType;
+            const std::uint32_t index = aTokens.Index();
+            switch (state)
+            {
+            case State::CallOpen:
+               if (type == TT::RightParenthesis)
+               {
+                  CloseCall(index, 0);
+                  state = State::Operator;
+                  break;
+               }
+               state = State::Operand;
+               continue;
+            case State::Operand:
+               switch (type)
+               {
+               case TT::Number:
+                  Emit(PNT::Number, index);
+                  state = State::Operator;
+                  break;
+               case TT::KeywordTrue:
+                  Emit(PNT::LogicalTrue, index);
+                  state = State::Operator;
+                  break;
+               case TT::KeywordFalse:
+                  Emit(PNT::LogicalFalse, index);
+                  state = State::Operator;
+                  break;
+               case TT::Identifier:
+                  name  = index;
+                  state = State::Name;
+                  break;
+               case TT::LeftParenthesis:
+                  mPending.Push({Kind::Group, 0, PNT::cMAX_PARSE_NODE, index, 0});
+                  break;
+               case TT::Plus:
+               case TT::Hyphen:
+               case TT::DollarSign:
+                  mPending.Push({Kind::Prefix, cUNARY, UnaryNodeType(type), index, 0});
+                  break;
+               case TT::KeywordNot:
+                  // Only allowed where the grammar's Not is: at the start of an operand of "and", "or" or "not".
+                  if (mPending.Size() > 0 && mPending.Top().mPrecedence > cNOT)
+                  {
+                     return Error("Expected an operand", index);
+                  }
+                  mPending.Push({Kind::Prefix, cNOT, PNT::LogicalNot, index, 0});
+                  break;
+               default:
+                  return Error("Expected an operand", index);
+               }
+               break;
+            case State::Name:
+               if (type == TT::LeftParenthesis)
+               {
+                  mPending.Push({Kind::Call, 0, PNT::Invoke, name, 0});
+                  state = State::CallOpen;
+                  break;
+               }
+               Emit(PNT::Identifier, name);
+               state = State::Operator;
+               continue;
+            case State::Operator:
+               switch (type)
+               {
+               case TT::EndOfData:
+                  Reduce(cOR, index);
+                  if (mPending.Size() > 0)
+                  {
+                     return Error("Missing right parenthesis", index);
+                  }
+                  Emit(PNT::Finished, index);
+                  return std::string();
+               case TT::RightParenthesis:
+                  Reduce(cOR, index);
+                  if (mPending.Size() == 0)
+                  {
+                     return Error("Unexpected right parenthesis", index);
+                  }
+                  if (mPending.Top().mKind == Kind::Call)
+                  {
+                     CloseCall(index, mPending.Top().mArguments + 1);
+                  }
+                  else
+                  {
+                     mPending.Pop();
+                  }
+                  break;
+               case TT::Comma:
+                  Reduce(cOR, index);
+                  if (mPending.Size() == 0 || mPending.Top().mKind != Kind::Call)
+                  {
+                     return Error("Unexpected comma", index);
+                  }
+                  ++mPending.Top().mArguments;
+                  state = State::Operand;
+                  break;
+               case TT::KeywordOr:
+               case TT::KeywordAnd:
+               case TT::Plus:
+               case TT::Hyphen:
+               case TT::Asterisk:
+               case TT::Slash:
+               {
+                  const std::uint8_t precedence = BinaryPrecedence(type);
+                  Reduce(precedence, index);
+                  mPending.Push({Kind::Binary, precedence, BinaryNodeType(type), index, 0});
+                  state = State::Operand;
+                  break;
+               }
+               case TT::Equals:
+               case TT::NotEquals:
+               case TT::LessThan:
+               case TT::LessOrEqual:
+               case TT::GreaterThan:
+               case TT::GreaterOrEqual:
+               {
+                  // A comparison after another one continues its chain.
+                  const bool chained = Reduce(cCOMPARE, index, true);
+                  mPending.Push({chained ? Kind::ChainedCompare : Kind::Compare, cCOMPARE, BinaryNodeType(type), index, 0});
+                  state = State::Operand;
+                  break;
+               }
+               case TT::Number:
+               case TT::KeywordTrue:
+               case TT::KeywordFalse:
+               case TT::Identifier:
+               case TT::DollarSign:
+                  // Two operands with no operator between them are multiplied. The token is the first of the
+                  // right-hand operand, so it is not consumed.
+                  Reduce(cPRODUCT, index);
+                  mPending.Push({Kind::Binary, cPRODUCT, PNT::Concatenation, index, 0});
+                  state = State::Operand;
+                  continue;
+               default:
+                  return Error("Expected an operator", index);
+               }
+               break;
+            }
+            aTokens.Advance();
+         }
+      }
+
+   private:
+      enum class State : std::uint8_t
+      {
+         Operand,  // Expecting an operand.
+         Name,     // After an identifier, which is a call if a parenthesis follows.
+         CallOpen, // After the parenthesis of a call, where it may be closed with no arguments.
+         Operator  // After an operand.
+      };
+      enum class Kind : std::uint8_t
+      {
+         Prefix,
+         Binary,
+         Compare,        // The first comparison of a chain.
+         ChainedCompare, // A later comparison of a chain.
+         Group,          // An open parenthesis.
+         Call            // The open parenthesis of a call.
+      };
+      //! An operator or parenthesis whose node has not been emitted yet.
+      struct Pending
+      {
+         Kind          mKind       = Kind::Group;
+         std::uint8_t  mPrecedence = 0; // Parentheses have 0, so that operators are never reduced past them.
+         PNT           mNode       = PNT::cMAX_PARSE_NODE;
+         std::uint32_t mTokenIndex = 0;
+         std::uint32_t mArguments  = 0; // For calls, the number of arguments before the current one.
+      };
+
+      // The levels of the grammar, from lowest to highest precedence.
+      static constexpr std::uint8_t cOR      = 1;
+      static constexpr std::uint8_t cAND     = 2;
+      static constexpr std::uint8_t cNOT     = 3;
+      static constexpr std::uint8_t cCOMPARE = 4;
+      static constexpr std::uint8_t cSUM     = 5;
+      static constexpr std::uint8_t cPRODUCT = 6;
+      static constexpr std::uint8_t cUNARY   = 7;
+
+      static std::uint8_t BinaryPrecedence(TT aType)
+      {
+         switch (aType)
+         {
+         case TT::KeywordOr:
+            return cOR;
+         case TT::KeywordAnd:
+            return cAND;
+         case TT::Plus:
+         case TT::Hyphen:
+            return cSUM;
+         default:
+            return cPRODUCT;
+         }
+      }
+
+      //! Emits the pending operators of at least aPrecedence, which all take the operand just read.
+      //! aIndex is the token after that operand. Returns true if a comparison was emitted and aContinueChain is set,
+      //! in which case its chain is left open for the next comparison.
+      bool Reduce(std::uint8_t aPrecedence, std::uint32_t aIndex, bool aContinueChain = false)
+      {
+         while (mPending.Size() > 0 && mPending.Top().mPrecedence >= aPrecedence)
+         {
+            const Pending op = mPending.Pop();
+            switch (op.mKind)
+            {
+            case Kind::Compare:
+               Emit(PNT::CompareBegin, aIndex);
+               [[fallthrough]];
+            case Kind::ChainedCompare:
+               Emit(op.mNode, op.mTokenIndex);
+               if (aContinueChain)
+               {
+                  return true;
+               }
+               Emit(PNT::CompareEnd, aIndex);
+               break;
+            default:
+               Emit(op.mNode, op.mTokenIndex);
+               break;
+            }
+         }
+         return false;
+      }
+
+      //! Closes the call on top of the stack at its right parenthesis, aIndex.
+      void CloseCall(std::uint32_t aIndex, std::uint32_t aArguments)
+      {
+         const std::uint32_t callee = mPending.Pop().mTokenIndex;
+         Emit(PNT::Identifier, callee);
+         auto& node = mOutput.emplace_back();
+         node.mType            = PNT::Invoke;
+         node.mStartTokenIndex = callee;
+         node.mStopTokenIndex  = aIndex;
+         node.mAuxData         = aArguments;
+      }
+
+      void Emit(PNT aType, std::uint32_t aTokenIndex)
+      {
+         auto& node = mOutput.emplace_back();
+         node.mType            = aType;
+         node.mStartTokenIndex = aTokenIndex;
+         node.mStopTokenIndex  = aTokenIndex;
+      }
+
+      static std::string Error(std::string_view aMessage, std::uint32_t aIndex)
+      {
+         return std::string(aMessage) + " at token " + std::to_string(aIndex);
+      }
+
+      std::vector<rjcpt::ParseNode>& mOutput;
+      rjcpt::Stack<Pending, 256>     mPending;
+   };
+
+   //! Parses aTokens with aEngine into aOutput. Returns an empty string on success, or a description of the error.
+   std::string ParseWith(rjcpt::ParserEngine aEngine, std::span<const rjcpt::Token> aTokens,
+                         std::vector<rjcpt::ParseNode>& aOutput)
+   {
+      if (aEngine == rjcpt::ParserEngine::Precedence)
+      {
+         rjcpt::detail::SpanTokens tokens(aTokens, 0);
+         return PrecedenceParser(aOutput).Run(tokens);
+      }
+      FormulaContext context(aOutput);
+      return rjcpt::Parse(context, aTokens);
+   }
+   std::string ParseWith(rjcpt::ParserEngine aEngine, rjcpt::TokenStream& aTokens, std::vector<rjcpt::ParseNode>& aOutput)
+   {
+      if (aEngine == rjcpt::ParserEngine::Precedence)
+      {
+         return PrecedenceParser(aOutput).Run(aTokens);
+      }
+      FormulaContext context(aOutput);
+      return rjcpt::Parse(context, aTokens);
+   }
+}
+
+rjcpt::GrammarView rjcpt::GetFormulaGrammar()
+{
+   return cFORMULA_COMPILED;
+}
+
+std::uint64_t rjcpt::FormulaGrammarHash()
+{
+   // FNV-1a.
+   static constexpr std::uint64_t cHASH = []
+   {
+      std::uint64_t retval = 14695981039346656037ULL;
+      for (const char c : cFORMULA_GRAMMAR)
+      {
+         retval = (retval ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+      }
+      return retval;
+   }();
+   return cHASH;
+}
+
+std::expected<std::vector<rjcpt::ParseNode>, std::string> rjcpt::ParseFormula(std::span<const Token> aTokens,
+                                                                               ParserEngine           aEngine)
+{
+   std::vector<ParseNode> retval;
+   std::string error = ParseWith(aEngine, aTokens, retval);
+   if (!error.empty())
+   {
+      return std::unexpected(std::move(error));
+   }
+   return retval;
+}
+
+std::expected<std::span<const rjcpt::ParseNode>, std::string> rjcpt::ParseFormula(std::span<const Token> aTokens,
+                                                                                  Arena&                 aArena,
+                                                                                  ParserEngine           aEngine)
+{
+   // Parse into a buffer that is reused by the thread, since the number of nodes isn't known up front.
+   thread_local std::vector<ParseNode> tNodes;
+   tNodes.clear();
+   std::string error = ParseWith(aEngine, aTokens, tNodes);
+   if (!error.empty())
+   {
+      return std::unexpected(std::move(error));
+   }
+   return aArena.Copy<ParseNode>(tNodes);
+}
+
+std::expected<std::vector<rjcpt::ParseNode>, std::string> rjcpt::ParseFormula(std::string_view aExpression,
+                                                                               ParserEngine     aEngine)
+{
+   std::vector<ParseNode> retval;
+   TokenStream tokens(aExpression);
+   std::string error = ParseWith(aEngine, tokens, retval);
+   if (!error.empty())
+   {
+      return std::unexpected(std::move(error));
+   }
+   return retval;
+}
+
+std::expected<rjcpt::ParsedFormula, std::string> rjcpt::ParseFormula(std::string_view aExpression, Arena& aArena,
+                                                                     ParserEngine aEngine)
+{
+   // The same buffers as above, since the numbers of tokens and nodes aren't known up front.
+   thread_local std::vector<Token>     tTokens;
+   thread_local std::vector<ParseNode> tNodes;
+   tTokens.clear();
+   tNodes.clear();
+   TokenStream tokens(aExpression, &tTokens);
+   std::string error = ParseWith(aEngine, tokens, tNodes);
+   if (!error.empty())
+   {
+      return std::unexpected(std::move(error));
+   }
+   return ParsedFormula{aArena.Copy<Token>(tTokens), aArena.Copy<ParseNode>(tNodes)};
+}
+
+std::expected<void, std::string> rjcpt::ValidateFormula(std::string_view aExpression, ParserEngine aEngine)
+{
+   thread_local std::vector<ParseNode> tNodes;
+   TokenStream tokens(aExpression);
+   std::string error = ParseWith(aEngine, tokens, tNodes);
+   if (!error.empty())
+   {
+      return std::unexpected(std::move(error));
+   }
+   return {};
+}
+
+rjcpt::CompiledGrammar rjcpt::detail::CompileFormulaGrammar()
+{
+   return CompileGrammar(FormulaLocator(), cFORMULA_GRAMMAR);
+}
+
+std::expected<std::vector<rjcpt::ParseNode>, std::string> rjcpt::detail::ParseFormulaDynamic(std::span<const Token> aTokens)
+{
+   std::vector<ParseNode> retval;
+   FormulaContext context(retval);
+   ParseContextAdapter<FormulaContext> adapter(context);
+   std::string error = Parse(static_cast<ParseContext&>(adapter), aTokens);
+   if (!error.empty())
+   {
+      return std::unexpected(std::move(error));
+   }
+   return retval;
+}
+
+rjcpt::IncrementalFormula::IncrementalFormula(std::string aExpression)
+{
+   SetExpression(std::move(aExpression));
+}
+
+void rjcpt::IncrementalFormula::SetExpression(std::string aExpression)
+{
+   mExpression = std::move(aExpression);
+   mTokens     = TokenizeExpression(mExpression);
+   Reparse(0);
+}
+
+void rjcpt::IncrementalFormula::Edit(std::uint32_t aStart, std::uint32_t aRemovedLength, std::string_view aText)
+{
+   if (aStart > mExpression.size() || aRemovedLength > mExpression.size() - aStart)
+   {
+      throw std::out_of_range("Edit outside the expression");
+   }
+   mExpression.replace(aStart, aRemovedLength, aText);
+   const TextEdit edit{aStart, aRemovedLength, static_cast<std::uint32_t>(aText.size())};
+   const std::uint32_t firstChanged = RetokenizeExpression(mExpression, edit, mTokens);
+   if (firstChanged < mTokens.size())
+   {
+      Reparse(firstChanged);
+   }
+   else
+   {
+      // Parsing only depends on the token types, so the nodes are still valid.
+      mFirstChanged = firstChanged;
+   }
+}
+
+void rjcpt::IncrementalFormula::Reparse(std::uint32_t aFirstChanged)
+{
+   FormulaContext context(mNodes, &mFormulaCheckpoints);
+   mError        = rjcpt::Reparse(context, mTokens, mParseCheckpoints, aFirstChanged);
+   mFirstChanged = aFirstChanged;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "Arena.hpp"
+#include "GrammarLL.hpp"
+#include "Lexer.hpp"
+#include "ParseNode.hpp"
+#include "ParserLL.hpp"
+#include "Token.hpp"
+
+#include <expected>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "rjcpt_core_export.h"
+
+namespace rjcpt
+{
+   //! Returns the compiled grammar for formulas.
+   //! The grammar is compiled at compile time into a constant table.
+   RJCPT_CORE_EXPORT GrammarView GetFormulaGrammar();
+   //! Returns a hash of the text of the formula grammar, which changes whenever the grammar does.
+   RJCPT_CORE_EXPORT std::uint64_t FormulaGrammarHash();
+
+   //! The ways a formula can be parsed. Both give the same nodes, and fail on the same token, though their error
+   //! messages differ.
+   enum class ParserEngine
+   {
+      //! The generic LL parser, driven by the formula grammar.
+      Grammar,
+      //! A parser written for the formula language, which handles operators by precedence. Faster than Grammar.
+      Precedence
+   };
+
+   //! Parses a tokenized formula into a list of ParseNodes in postfix order.
+   //! The last node is always ParseNodeType::Finished.
+   //! On failure, returns a description of the error.
+   RJCPT_CORE_EXPORT std::expected<std::vector<ParseNode>, std::string> ParseFormula(std::span<const Token> aTokens,
+                                                                                     ParserEngine aEngine = ParserEngine::Grammar);
+   //! Same as above, but the nodes are stored contiguously in aArena. Does not allocate from the heap once the
+   //! arena has grown large enough, unless parsing fails.
+   RJCPT_CORE_EXPORT std::expected<std::span<const ParseNode>, std::string> ParseFormula(std::span<const Token> aTokens,
+                                                                                          Arena&                 aArena,
+                                                                                          ParserEngine aEngine = ParserEngine::Grammar);
+
+   //! Same as above, but lexes aExpression as it is parsed, through a TokenStream, rather than needing its tokens
+   //! up front. Stops at the first error without lexing the rest.
+   RJCPT_CORE_EXPORT std::expected<std::vector<ParseNode>, std::string> ParseFormula(std::string_view aExpression,
+                                                                                     ParserEngine aEngine = ParserEngine::Grammar);
+
+   //! The tokens and nodes of a formula, both stored in an arena.
+   struct ParsedFormula
+   {
+      std::span<const Token>     mTokens;
+      std::span<const ParseNode> mNodes;
+   };
+   //! Same as above, but the tokens and nodes are stored contiguously in aArena, so that they can be compiled.
+   RJCPT_CORE_EXPORT std::expected<ParsedFormula, std::string> ParseFormula(std::string_view aExpression, Arena& aArena,
+                                                                              ParserEngine aEngine = ParserEngine::Grammar);
+
+   //! Returns whether aExpression is a valid formula, or a description of the error, without keeping its tokens or
+   //! nodes. Does not allocate from the heap once its buffers have grown large enough.
+   RJCPT_CORE_EXPORT std::expected<void, std::string> ValidateFormula(std::string_view aExpression,
+                                                                      ParserEngine     aEngine = ParserEngine::Grammar);
+
+   namespace detail
+   {
+      //! An operator token whose node has not been emitted yet.
+      struct PendingOperator
+      {
+         std::uint32_t mTokenIndex = 0;
+         TokenType     mType       = TokenType::Error;
+      };
+
+      //! The state of the formula parser at each ParseCheckpoints checkpoint.
+      struct FormulaCheckpoints
+      {
+         struct Point
+         {
+            std::uint32_t mOutputSize         = 0;
+            std::uint32_t mOperatorsEnd       = 0; // End of this point's pending operators in mOperators.
+            std::uint32_t mArgumentCountsEnd  = 0; // End of this point's argument counts in mArgumentCounts.
+         };
+
+         std::vector<Point>         mPoints;
+         std::vector<PendingOperator> mOperators;    // Pending operators of each point, one after another.
+         std::vector<std::uint32_t> mArgumentCounts; // Argument counts of each point, one after another.
+      };
+
+      //! Same as ParseFormula, but calls the formula's validators and actors through the virtual ParseContext.
+      //! Used to compare the two forms of dispatch.
+      RJCPT_CORE_EXPORT std::expected<std::vector<ParseNode>, std::string> ParseFormulaDynamic(std::span<const Token> aTokens);
+
+      //! Compiles the formula grammar at run time. The result is equal to GetFormulaGrammar().
+      RJCPT_CORE_EXPORT CompiledGrammar CompileFormulaGrammar();
+   }
+
+   //! A formula that is being edited, for example as it is typed.
+   //! After an edit, only the tokens around it are lexed again, and the formula is only parsed again from the first
+   //! token whose type changed. The results are always the same as TokenizeExpression and ParseFormula.
+   class RJCPT_CORE_EXPORT IncrementalFormula
+   {
+   public:
+      explicit IncrementalFormula(std::string aExpression = std::string());
+
+      //! Replaces the whole expression, and lexes and parses it from scratch.
+      void SetExpression(std::string aExpression);
+      //! Replaces aRemovedLength characters at aStart with aText.
+      //! Throws std::out_of_range if the removed characters are not all in the expression.
+      void Edit(std::uint32_t aStart, std::uint32_t aRemovedLength, std::string_view aText);
+
+      const std::string&         Expression() const { return mExpression; }
+      std::span<const Token>     Tokens() const { return mTokens; }
+      //! The nodes ParseFormula would return, or an empty span if the formula has an error.
+      std::span<const ParseNode> Nodes() const { return mError.empty() ? std::span<const ParseNode>(mNodes) : std::span<const ParseNode>(); }
+      //! The error ParseFormula would return, or an empty string.
+      const std::string&         Error() const { return mError; }
+      //! The first token whose type was changed by the last change, or Tokens().size() if none was.
+      //! Nodes for earlier tokens were kept.
+      std::uint32_t              FirstChangedToken() const { return mFirstChanged; }
+
+   private:
+      void Reparse(std::uint32_t aFirstChanged);
+
+      std::string                mExpression;
+      std::vector<Token>         mTokens;
+      std::vector<ParseNode>     mNodes;
+      std::string                mError;
+      std::uint32_t              mFirstChanged = 0;
+      ParseCheckpoints           mParseCheckpoints;
+      detail::FormulaCheckpoints mFormulaCheckpoints;
+   };
+}
@@ -1,15 +1,22 @@
 #pragma once
 
 #include "SmallString.hpp"
+#include "Token.hpp"
 
-#include <bitset>
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cstdint>
 #include <functional>
+#include <span>
+#include <stdexcept>
+#include <string>
 #include <string_view>
 #include <vector>
-#include <span>
 
-#include "rjcpt_core_export.h"
+// Grammar compilation is constexpr, so that grammars known at compile time can be compiled into static tables
+// (see StaticGrammar). It is all defined in this header for that reason.
+// Errors are reported by throwing, which fails the build when a grammar is compiled at compile time.
 
 namespace rjcpt
 {
@@ -20,43 +27,42 @@ namespace rjcpt
    //!   * The actor is a function that acts on the information held in the token.
    //!   * An index of zero indicates the validator or actor is not present.
    //! A non-terminal GrammarNode references a list of GrammarRules it could refer to.
+   //! Nodes are copied onto the parse stack, so they are kept to 4 bytes. Their names from the grammar text are
+   //! stored separately, in the mNodeNames of the compiled grammar.
    class GrammarNode
    {
    public:
       static constexpr std::uint16_t cTERMINAL_MASK = 0x8000U;
       using string_type = SmallString<28>;
 
-      GrammarNode() = default;
+      constexpr GrammarNode() = default;
 
-      void SetTerminal(std::uint16_t aValidator, std::uint16_t aActor)
+      constexpr void SetTerminal(std::uint16_t aValidator, std::uint16_t aActor)
       {
          assert(!(aValidator & cTERMINAL_MASK));
          mData1 = aValidator | cTERMINAL_MASK;
          mData2 = aActor;
       }
-      void SetNonTerminal(std::uint16_t aBegin, std::uint16_t aEnd)
+      constexpr void SetNonTerminal(std::uint16_t aBegin, std::uint16_t aEnd)
       {
          assert(!(aBegin & cTERMINAL_MASK));
          mData1 = aBegin & ~cTERMINAL_MASK;
          mData2 = aEnd;
       }
-      
-      bool          IsTerminal() const { return mData1 & cTERMINAL_MASK; }
-      std::uint16_t ValidatorIndex() const { assert(IsTerminal()); return mData1 & ~cTERMINAL_MASK; }
-      std::uint16_t ActorIndex() const { assert(IsTerminal()); return mData2; }
-      std::uint16_t RulesBegin() const { assert(!IsTerminal()); return mData1 & ~cTERMINAL_MASK; }
-      std::uint16_t RulesEnd() const { assert(!IsTerminal()); return mData2; }
-      
-      void               SetText(const string_type& aText) { mRawText = aText; }
-      const string_type& RawText() const { return mRawText; }
 
-   private:
-      // Debug info
-      string_type mRawText;
+      constexpr bool          IsTerminal() const { return mData1 & cTERMINAL_MASK; }
+      constexpr std::uint16_t ValidatorIndex() const { assert(IsTerminal()); return mData1 & ~cTERMINAL_MASK; }
+      constexpr std::uint16_t ActorIndex() const { assert(IsTerminal()); return mData2; }
+      constexpr std::uint16_t RulesBegin() const { assert(!IsTerminal()); return mData1 & ~cTERMINAL_MASK; }
+      constexpr std::uint16_t RulesEnd() const { assert(!IsTerminal()); return mData2; }
 
+      friend constexpr bool operator==(const GrammarNode&, const GrammarNode&) = default;
+
+   private:
       std::uint16_t mData1 = 0;
       std::uint16_t mData2 = 0;
    };
+   static_assert(sizeof(GrammarNode) == 4);
    struct GrammarRule
    {
       SmallString<16> mName;
@@ -64,26 +70,142 @@ namespace rjcpt
       std::uint32_t   mEnd   = 0;
    };
 
+   //! A set of token types, indexed by TokenType.
+   //! Has the parts of the std::bitset interface the grammar needs, but unlike std::bitset, is usable in constexpr.
+   class TokenSet
+   {
+   public:
+      constexpr TokenSet& set(std::size_t aType)
+      {
+         mBits |= Bit(aType);
+         return *this;
+      }
+      constexpr bool test(std::size_t aType) const { return (mBits & Bit(aType)) != 0; }
+      constexpr bool any() const { return mBits != 0; }
+
+      constexpr TokenSet& operator|=(const TokenSet& aOther)
+      {
+         mBits |= aOther.mBits;
+         return *this;
+      }
+      friend constexpr bool operator==(const TokenSet&, const TokenSet&) = default;
+
+   private:
+      static_assert(cNUM_TOKEN_TYPES <= 32);
+      static constexpr std::uint32_t Bit(std::size_t aType) { return std::uint32_t{1} << aType; }
+
+      std::uint32_t mBits = 0;
+   };
+
+   //! Maps the names used in a grammar to validators and actors.
+   //! Overrides may be constexpr, in which case a constexpr locator can be used to compile a grammar at compile time.
    class GrammarLocator
    {
    public:
       // Virtual destructor shouldn't be necessary, but it silences compiler warnings.
-      virtual ~GrammarLocator() = default;
+      constexpr virtual ~GrammarLocator() = default;
       //! Returns the numeric index/id of the validator with the given name.
       //! Returns 0 on failure.
       virtual std::uint16_t FindValidator(std::string_view aName) const = 0;
       //! Returns the numeric index/id of the actor with the given name.
       //! Returns 0 on failure.
       virtual std::uint16_t FindActor(std::string_view aName) const = 0;
+      //! Returns the set of token types the validator with the given index can accept.
+      //! Used to build the parse table, so it must agree with ParseContext::CheckValidator.
+      virtual TokenSet ValidatorTokens(std::uint16_t aValidator) const = 0;
    };
 
+   //! Parse table entry for a non-terminal that cannot start with a given token.
+   inline constexpr std::uint16_t cNO_RULE = 0xFFFFU;
+
+   //! A non-owning view of a compiled grammar. This is what the parser works with.
+   struct GrammarView
+   {
+      std::span<const GrammarRule>   mRules;
+      std::span<const GrammarNode>   mNodes;
+      //! LL(1) parse table holding the index of the rule to expand for each non-terminal and look-ahead token.
+      //! Rows are indexed by the non-terminal's RulesBegin(), columns by TokenType.
+      std::span<const std::uint16_t> mParseTable;
+      //! Names of the nodes in the grammar text, indexed like mNodes. Only used for error messages.
+      std::span<const GrammarNode::string_type> mNodeNames;
+
+      //! Returns the rule to expand for aNonTerminal when the next token is aType, or cNO_RULE.
+      constexpr std::uint16_t LookupRule(const GrammarNode& aNonTerminal, TokenType aType) const
+      {
+         assert(!aNonTerminal.IsTerminal());
+         return mParseTable[aNonTerminal.RulesBegin() * std::size_t{cNUM_TOKEN_TYPES} + static_cast<std::size_t>(aType)];
+      }
+
+      //! Returns a non-terminal node that expands to the rules with the given name.
+      //! Throws if there is no such rule.
+      constexpr GrammarNode NonTerminal(std::string_view aName) const
+      {
+         const auto rules = std::ranges::equal_range(mRules, aName, std::less<void>(),
+                                                     [](const GrammarRule& aRule) { return aRule.mName.view(); });
+         if (rules.empty())
+         {
+            throw std::runtime_error("Cannot find rule: " + std::string(aName));
+         }
+         GrammarNode retval;
+         retval.SetNonTerminal(static_cast<std::uint16_t>(rules.begin() - mRules.begin()),
+                               static_cast<std::uint16_t>(rules.end() - mRules.begin()));
+         return retval;
+      }
+
+      //! Returns the name of aNode in the grammar text: the rule name for a non-terminal, or "Validator>Actor" for a
+      //! terminal. Returns an empty string for nodes that are not part of the grammar.
+      constexpr std::string_view NodeName(const GrammarNode& aNode) const
+      {
+         if (!aNode.IsTerminal())
+         {
+            return aNode.RulesBegin() < mRules.size() ? mRules[aNode.RulesBegin()].mName.view() : std::string_view();
+         }
+         // Terminals with the same validator and actor have the same name, so any match will do.
+         const auto iter = std::ranges::find(mNodes, aNode);
+         return iter == mNodes.end() ? std::string_view() : mNodeNames[iter - mNodes.begin()].view();
+      }
+   };
+
+   //! A compiled grammar whose size is only known at run time.
    struct CompiledGrammar
    {
-      std::vector<GrammarRule> mRules;
-      std::vector<GrammarNode> mNodes;
+      std::vector<GrammarRule>   mRules;
+      std::vector<GrammarNode>   mNodes;
+      std::vector<std::uint16_t> mParseTable;
+      std::vector<GrammarNode::string_type> mNodeNames;
+
+      constexpr GrammarView View() const { return GrammarView{mRules, mNodes, mParseTable, mNodeNames}; }
+      constexpr operator GrammarView() const { return View(); }
+
+      constexpr std::uint16_t LookupRule(const GrammarNode& aNonTerminal, TokenType aType) const
+      {
+         return View().LookupRule(aNonTerminal, aType);
+      }
+   };
+
+   //! A compiled grammar in fixed-size storage, so that it can be built at compile time and stored in a constant.
+   //! Use grammar_util::GetGrammarSize to find the template arguments.
+   template<std::size_t NumRules, std::size_t NumNodes>
+   struct StaticGrammar
+   {
+      std::array<GrammarRule, NumRules>                       mRules{};
+      std::array<GrammarNode, NumNodes>                       mNodes{};
+      std::array<std::uint16_t, NumRules * cNUM_TOKEN_TYPES> mParseTable{};
+      std::array<GrammarNode::string_type, NumNodes>          mNodeNames{};
+
+      constexpr GrammarView View() const { return GrammarView{mRules, mNodes, mParseTable, mNodeNames}; }
+      constexpr operator GrammarView() const { return View(); }
    };
 
-   CompiledGrammar CompileGrammar(const GrammarLocator& aLocators, std::string_view aGrammarText);
+   constexpr CompiledGrammar CompileGrammar(const GrammarLocator& aLocator, std::string_view aGrammarText);
+
+   //! Compiles a grammar into fixed-size storage. Meant to initialize a constexpr or constinit variable:
+   //!    constexpr auto cSIZE    = grammar_util::GetGrammarSize(cTEXT);
+   //!    constexpr auto cGRAMMAR = CompileStaticGrammar<cSIZE.mNumRules, cSIZE.mNumNodes>(Locator(), cTEXT);
+   //! A grammar that fails to compile then fails the build.
+   template<std::size_t NumRules, std::size_t NumNodes>
+   constexpr StaticGrammar<NumRules, NumNodes> CompileStaticGrammar(const GrammarLocator& aLocator,
+                                                                    std::string_view      aGrammarText);
 
    namespace grammar_util
    {
@@ -118,7 +240,7 @@ namespace rjcpt
       //! aInput is modified to the next character after the read word.
       //! If there is no more data left to extract, does nothing and returns false.
       //! Automatically skips whitespace and comments ('#' through end-of-line).
-      RJCPT_CORE_EXPORT bool ExtractWord(const char*& aInput, std::string_view& aOutput);
+      constexpr bool ExtractWord(const char*& aInput, std::string_view& aOutput);
 
       struct GrammarSize
       {
@@ -126,16 +248,405 @@ namespace rjcpt
          std::size_t mNumNodes = 0;
       };
       //! Returns the number of rules and nodes in a grammar.
-      RJCPT_CORE_EXPORT GrammarSize GetGrammarSize(std::string_view aGrammarText);
+      constexpr GrammarSize GetGrammarSize(std::string_view aGrammarText);
 
       //! Creates a GrammarNode that corresponds to the given grammar string.
       //! If the string is a terminal, the node is fully initialized.
       //! If the string is a non-terminal, the node has indices (0, 0).
-      RJCPT_CORE_EXPORT GrammarNode MakeGrammarNode(const GrammarLocator& aLocator, std::string_view aGrammarString);
+      constexpr GrammarNode MakeGrammarNode(const GrammarLocator& aLocator, std::string_view aGrammarString);
 
       //! Performs the second step of grammar compilation: setting the being/end indices in non-terminal nodes.
       //! The order of the rules may be modified.
-      RJCPT_CORE_EXPORT void SetNonTerminalIndices(CompiledGrammar& aGrammar);
+      constexpr void SetNonTerminalIndices(CompiledGrammar& aGrammar);
+
+      //! Performs the third step of grammar compilation: computing FIRST/FOLLOW sets and filling in mParseTable.
+      //! Rules that no other rule refers to are treated as start rules, and are followed by TokenType::EndOfData.
+      //! Throws if the grammar is not LL(1), i.e. two alternatives of a rule can start with the same token.
+      constexpr void BuildParseTable(const GrammarLocator& aLocator, CompiledGrammar& aGrammar);
+   }
+
+   namespace detail
+   {
+      //! std::to_string is not constexpr.
+      constexpr std::string ToString(std::size_t aValue)
+      {
+         std::string retval;
+         do
+         {
+            retval.insert(retval.begin(), static_cast<char>('0' + aValue % 10));
+            aValue /= 10;
+         } while (aValue > 0);
+         return retval;
+      }
+
+      //! FIRST set of a sequence of grammar nodes, and whether the sequence can match no tokens at all.
+      struct FirstSet
+      {
+         TokenSet mTokens;
+         bool     mNullable = true;
+      };
+
+      //! Working state for building the parse table.
+      //! Non-terminals are identified by the index of their first rule.
+      class ParseTableBuilder
+      {
+      public:
+         constexpr ParseTableBuilder(const GrammarLocator& aLocator, const CompiledGrammar& aGrammar)
+            : mGrammar(aGrammar)
+            , mFirst(aGrammar.mRules.size())
+            , mFollow(aGrammar.mRules.size())
+            , mValidatorTokens(aGrammar.mNodes.size())
+         {
+            for (std::size_t i = 0; i < aGrammar.mNodes.size(); i++)
+            {
+               const GrammarNode& node = aGrammar.mNodes[i];
+               if (node.IsTerminal() && node.ValidatorIndex())
+               {
+                  mValidatorTokens[i] = aLocator.ValidatorTokens(node.ValidatorIndex());
+               }
+            }
+         }
+
+         //! Returns the index of the first rule sharing a name with aRuleIndex.
+         constexpr std::size_t GroupOf(std::size_t aRuleIndex) const
+         {
+            while (aRuleIndex > 0 && mGrammar.mRules[aRuleIndex - 1].mName == mGrammar.mRules[aRuleIndex].mName)
+            {
+               --aRuleIndex;
+            }
+            return aRuleIndex;
+         }
+
+         //! Returns the FIRST set of nodes [aBegin, aEnd) using the current FIRST sets of the non-terminals.
+         constexpr FirstSet SequenceFirst(std::size_t aBegin, std::size_t aEnd) const
+         {
+            FirstSet retval;
+            for (std::size_t i = aBegin; i < aEnd && retval.mNullable; i++)
+            {
+               const GrammarNode& node = mGrammar.mNodes[i];
+               if (node.IsTerminal())
+               {
+                  // Terminals without a validator only run an actor, and don't consume a token.
+                  if (node.ValidatorIndex())
+                  {
+                     retval.mTokens |= mValidatorTokens[i];
+                     retval.mNullable = false;
+                  }
+               }
+               else
+               {
+                  const FirstSet& first = mFirst[node.RulesBegin()];
+                  retval.mTokens |= first.mTokens;
+                  retval.mNullable = first.mNullable;
+               }
+            }
+            return retval;
+         }
+
+         constexpr void ComputeFirst()
+         {
+            for (FirstSet& first : mFirst)
+            {
+               first.mNullable = false;
+            }
+            bool changed = true;
+            while (changed)
+            {
+               changed = false;
+               for (std::size_t r = 0; r < mGrammar.mRules.size(); r++)
+               {
+                  const auto&    rule  = mGrammar.mRules[r];
+                  const FirstSet body  = SequenceFirst(rule.mBegin, rule.mEnd);
+                  FirstSet&      first = mFirst[GroupOf(r)];
+                  const auto     old   = first.mTokens;
+                  first.mTokens |= body.mTokens;
+                  if ((body.mNullable && !first.mNullable) || old != first.mTokens)
+                  {
+                     first.mNullable = first.mNullable || body.mNullable;
+                     changed = true;
+                  }
+               }
+            }
+         }
+
+         constexpr void ComputeFollow()
+         {
+            std::vector<bool> referenced(mGrammar.mRules.size());
+            for (const auto& node : mGrammar.mNodes)
+            {
+               if (!node.IsTerminal())
+               {
+                  referenced[node.RulesBegin()] = true;
+               }
+            }
+            for (std::size_t r = 0; r < mGrammar.mRules.size(); r++)
+            {
+               if (GroupOf(r) == r && !referenced[r])
+               {
+                  mFollow[r].set(static_cast<std::size_t>(TokenType::EndOfData));
+               }
+            }
+
+            bool changed = true;
+            while (changed)
+            {
+               changed = false;
+               for (std::size_t r = 0; r < mGrammar.mRules.size(); r++)
+               {
+                  const auto& rule = mGrammar.mRules[r];
+                  const auto  self = GroupOf(r);
+                  for (std::size_t i = rule.mBegin; i < rule.mEnd; i++)
+                  {
+                     const GrammarNode& node = mGrammar.mNodes[i];
+                     if (node.IsTerminal())
+                     {
+                        continue;
+                     }
+                     const FirstSet rest   = SequenceFirst(i + 1, rule.mEnd);
+                     auto&          follow = mFollow[node.RulesBegin()];
+                     const auto     old    = follow;
+                     follow |= rest.mTokens;
+                     if (rest.mNullable)
+                     {
+                        follow |= mFollow[self];
+                     }
+                     changed = changed || old != follow;
+                  }
+               }
+            }
+         }
+
+         constexpr std::vector<std::uint16_t> MakeTable() const
+         {
+            constexpr std::size_t cCOLUMNS = cNUM_TOKEN_TYPES;
+            std::vector<std::uint16_t> retval(mGrammar.mRules.size() * cCOLUMNS, cNO_RULE);
+            for (std::size_t r = 0; r < mGrammar.mRules.size(); r++)
+            {
+               const auto&    rule   = mGrammar.mRules[r];
+               const auto     group  = GroupOf(r);
+               const FirstSet body   = SequenceFirst(rule.mBegin, rule.mEnd);
+               TokenSet       tokens = body.mTokens;
+               if (body.mNullable)
+               {
+                  tokens |= mFollow[group];
+               }
+               for (std::size_t t = 0; t < cCOLUMNS; t++)
+               {
+                  if (!tokens.test(t))
+                  {
+                     continue;
+                  }
+                  auto& entry = retval[group * cCOLUMNS + t];
+                  if (entry != cNO_RULE)
+                  {
+                     throw std::runtime_error("Grammar conflict in rule " + rule.mName.str() +
+                                              ": alternatives " + ToString(entry - group) +
+                                              " and " + ToString(r - group) +
+                                              " both accept token type " + ToString(t));
+                  }
+                  entry = static_cast<std::uint16_t>(r);
+               }
+            }
+            return retval;
+         }
+
+      private:
+         const CompiledGrammar& mGrammar;
+         std::vector<FirstSet>  mFirst;  // Indexed by the first rule of each non-terminal.
+         std::vector<TokenSet>  mFollow; // Indexed by the first rule of each non-terminal.
+         std::vector<TokenSet>  mValidatorTokens; // Indexed by node.
+      };
+   }
+}
+
+constexpr rjcpt::CompiledGrammar rjcpt::CompileGrammar(const GrammarLocator& aLocator, std::string_view aGrammarText)
+{
+   rjcpt::CompiledGrammar retval;
+
+   const auto size = grammar_util::GetGrammarSize(aGrammarText);
+   retval.mRules.reserve(size.mNumRules);
+   retval.mNodes.reserve(size.mNumNodes);
+   retval.mNodeNames.reserve(size.mNumNodes);
+
+   const char* iter = aGrammarText.data();
+   std::string_view word;
+   while (grammar_util::ExtractWord(iter, word))
+   {
+      if (word.ends_with('='))
+      {
+         // Begin new rule.
+         auto& rule  = retval.mRules.emplace_back();
+         rule.mName  = word.substr(0, word.size() - 1);
+         rule.mBegin = static_cast<std::uint32_t>(retval.mNodes.size());
+         rule.mEnd   = rule.mBegin;
+      }
+      else if (retval.mRules.empty())
+      {
+         throw std::logic_error("Grammar must begin with a named rule.");
+      }
+      else if (word == "|")
+      {
+         auto  alternateOf = retval.mRules.back();
+         auto& rule        = retval.mRules.emplace_back();
+         rule.mName        = alternateOf.mName;
+         rule.mBegin       = alternateOf.mEnd;
+         rule.mEnd         = rule.mBegin;
+      }
+      else
+      {
+         retval.mNodes.push_back(grammar_util::MakeGrammarNode(aLocator, word));
+         retval.mNodeNames.emplace_back(word);
+         ++retval.mRules.back().mEnd;
+      }
+   }
+
+   grammar_util::SetNonTerminalIndices(retval);
+   grammar_util::BuildParseTable(aLocator, retval);
+
+   return retval;
+}
+
+template<std::size_t NumRules, std::size_t NumNodes>
+constexpr rjcpt::StaticGrammar<NumRules, NumNodes> rjcpt::CompileStaticGrammar(const GrammarLocator& aLocator,
+                                                                               std::string_view      aGrammarText)
+{
+   const CompiledGrammar grammar = CompileGrammar(aLocator, aGrammarText);
+   if (grammar.mRules.size() != NumRules || grammar.mNodes.size() != NumNodes)
+   {
+      throw std::logic_error("StaticGrammar size does not match the grammar text.");
+   }
+   StaticGrammar<NumRules, NumNodes> retval;
+   std::ranges::copy(grammar.mRules, retval.mRules.begin());
+   std::ranges::copy(grammar.mNodes, retval.mNodes.begin());
+   std::ranges::copy(grammar.mParseTable, retval.mParseTable.begin());
+   std::ranges::copy(grammar.mNodeNames, retval.mNodeNames.begin());
+   return retval;
+}
+
+constexpr bool rjcpt::grammar_util::ExtractWord(const char*& aInput, std::string_view& aOutput)
+{
+   const char* beginWord = SkipSpace(aInput);
+   aInput = beginWord;
+   if (*beginWord)
+   {
+      while (*aInput && !IsSpace(*aInput))
+      {
+         ++aInput;
+      }
+      aOutput = std::string_view(beginWord, aInput);
+      return true;
+   }
+   return false;
+}
+
+constexpr rjcpt::grammar_util::GrammarSize rjcpt::grammar_util::GetGrammarSize(std::string_view aGrammarText)
+{
+   GrammarSize retval;
+
+   const char* iter = aGrammarText.data();
+   std::string_view word;
+   while (ExtractWord(iter, word))
+   {
+      if (word.ends_with('='))
+      {
+         ++retval.mNumRules;
+      }
+      else if (word == "|")
+      {
+         ++retval.mNumRules;
+      }
+      else
+      {
+         ++retval.mNumNodes;
+      }
    }
+   return retval;
 }
 
+constexpr rjcpt::GrammarNode rjcpt::grammar_util::MakeGrammarNode(const GrammarLocator& aLocator,
+                                                                  std::string_view      aGrammarString)
+{
+   GrammarNode retval;
+   if (aGrammarString.contains('>'))
+   {
+      // Make terminal. Set validator and actor indices.
+      std::size_t index = aGrammarString.find('>');
+      std::string_view validatorName = aGrammarString.substr(0, index);
+      std::string_view actorName = aGrammarString.substr(index + 1);
+
+      std::uint16_t validatorIndex = 0;
+      std::uint16_t actorIndex = 0;
+
+      if (!validatorName.empty())
+      {
+         validatorIndex = aLocator.FindValidator(validatorName);
+         if (validatorIndex == 0)
+         {
+            throw std::runtime_error("Unknown validator: " + std::string(validatorName));
+         }
+      }
+      if (!actorName.empty())
+      {
+         actorIndex = aLocator.FindActor(actorName);
+         if (actorIndex == 0)
+         {
+            throw std::runtime_error("Unknown actor: " + std::string(actorName));
+         }
+      }
+
+      retval.SetTerminal(validatorIndex, actorIndex);
+   }
+   else
+   {
+      // Add non-terminal. Set dummy indices to be overwritten later.
+      retval.SetNonTerminal(0, 0);
+   }
+   return retval;
+}
+
+constexpr void rjcpt::grammar_util::SetNonTerminalIndices(CompiledGrammar& aGrammar)
+{
+   using cmpLess = std::less<void>;
+   auto ruleName = [](const GrammarRule& aRule) -> decltype(auto) { return aRule.mName; };
+
+   // Alternatives of a rule must stay in order. std::stable_sort is not constexpr, and grammars are small,
+   // so use an insertion sort.
+   auto& rules = aGrammar.mRules;
+   for (std::size_t i = 1; i < rules.size(); i++)
+   {
+      for (std::size_t j = i; j > 0 && rules[j].mName < rules[j - 1].mName; j--)
+      {
+         std::swap(rules[j], rules[j - 1]);
+      }
+   }
+
+   const auto begin = aGrammar.mRules.begin();
+   for (std::size_t i = 0; i < aGrammar.mNodes.size(); i++)
+   {
+      GrammarNode& node = aGrammar.mNodes[i];
+      if (!node.IsTerminal())
+      {
+         const auto& name  = aGrammar.mNodeNames[i];
+         const auto  range = std::ranges::equal_range(aGrammar.mRules, name, cmpLess(), ruleName);
+         if (range.empty())
+         {
+            throw std::runtime_error("Cannot find rule: " + name.str());
+         }
+
+         node.SetNonTerminal(static_cast<std::uint16_t>(range.begin() - begin),
+                             static_cast<std::uint16_t>(range.end() - begin));
+      }
+   }
+}
+
+constexpr void rjcpt::grammar_util::BuildParseTable(const GrammarLocator& aLocator, CompiledGrammar& aGrammar)
+{
+   if (aGrammar.mRules.size() >= cNO_RULE)
+   {
+      throw std::runtime_error("Grammar has too many rules.");
+   }
+   detail::ParseTableBuilder builder(aLocator, aGrammar);
+   builder.ComputeFirst();
+   builder.ComputeFollow();
+   aGrammar.mParseTable = builder.MakeTable();
+}
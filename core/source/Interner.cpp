@@ -0,0 +1,88 @@
+#include "Interner.hpp"
+
+#include <cstring>
+#include <functional>
+
+namespace
+{
+   constexpr std::size_t cINITIAL_BUCKETS = 64;
+}
+
+rjcpt::Interner::Interner()
+   : mStrings(std::make_unique<Arena>(4096))
+   , mBuckets(cINITIAL_BUCKETS, 0)
+{
+}
+
+rjcpt::Interner::~Interner() = default;
+
+rjcpt::Interner::Interner(Interner&&) noexcept = default;
+
+rjcpt::Interner& rjcpt::Interner::operator=(Interner&&) noexcept = default;
+
+std::uint32_t rjcpt::Interner::Intern(std::string_view aName)
+{
+   const std::size_t hash   = std::hash<std::string_view>()(aName);
+   std::size_t       bucket = Probe(aName, hash);
+   if (mBuckets[bucket] != 0)
+   {
+      return mBuckets[bucket] - 1;
+   }
+
+   // At most half full, so that probe sequences stay short.
+   if ((mNames.size() + 1) * 2 > mBuckets.size())
+   {
+      Grow();
+      bucket = Probe(aName, hash);
+   }
+   char* copy = static_cast<char*>(mStrings->allocate(aName.empty() ? 1 : aName.size(), 1));
+   std::memcpy(copy, aName.data(), aName.size());
+   const auto id = static_cast<std::uint32_t>(mNames.size());
+   mNames.emplace_back(copy, aName.size());
+   mHashes.push_back(hash);
+   mBuckets[bucket] = id + 1;
+   return id;
+}
+
+std::uint32_t rjcpt::Interner::Find(std::string_view aName) const
+{
+   // An empty bucket holds 0, which wraps around to cNOT_FOUND.
+   static_assert(cNOT_FOUND == std::uint32_t{0} - 1);
+   return mBuckets[Probe(aName, std::hash<std::string_view>()(aName))] - 1;
+}
+
+void rjcpt::Interner::Clear()
+{
+   mStrings->Reset();
+   mNames.clear();
+   mHashes.clear();
+   mBuckets.assign(cINITIAL_BUCKETS, 0);
+}
+
+std::size_t rjcpt::Interner::Probe(std::string_view aName, std::size_t aHash) const
+{
+   const std::size_t mask = mBuckets.size() - 1;
+   for (std::size_t bucket = aHash & mask;; bucket = (bucket + 1) & mask)
+   {
+      const std::uint32_t entry = mBuckets[bucket];
+      if (entry == 0 || (mHashes[entry - 1] == aHash && mNames[entry - 1] == aName))
+      {
+         return bucket;
+      }
+   }
+}
+
+void rjcpt::Interner::Grow()
+{
+   mBuckets.assign(mBuckets.size() * 2, 0);
+   const std::size_t mask = mBuckets.size() - 1;
+   for (std::uint32_t id = 0; id < mNames.size(); id++)
+   {
+      std::size_t bucket = mHashes[id] & mask;
+      while (mBuckets[bucket] != 0)
+      {
+         bucket = (bucket + 1) & mask;
+      }
+      mBuckets[bucket] = id + 1;
+   }
+}
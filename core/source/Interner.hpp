@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Arena.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "rjcpt_core_export.h"
+
+namespace rjcpt
+{
+   //! Assigns dense ids to strings: 0 to the first distinct string interned, 1 to the next, and so on.
+   //! Strings are copied into the interner, so views returned by Name stay valid until it is destroyed or cleared.
+   //! Looking a string up hashes it once and usually compares it with a single candidate, however many strings are
+   //! interned, so that everything after that can work with ids instead of strings.
+   class RJCPT_CORE_EXPORT Interner
+   {
+   public:
+      static constexpr std::uint32_t cNOT_FOUND = 0xFFFFFFFFU;
+
+      Interner();
+      ~Interner();
+      Interner(Interner&&) noexcept;
+      Interner& operator=(Interner&&) noexcept;
+
+      //! Returns the id of aName, adding it if needed.
+      std::uint32_t Intern(std::string_view aName);
+      //! Returns the id of aName, or cNOT_FOUND.
+      std::uint32_t Find(std::string_view aName) const;
+
+      std::string_view Name(std::uint32_t aId) const { return mNames[aId]; }
+      std::size_t      Size() const { return mNames.size(); }
+
+      void Clear();
+
+   private:
+      //! Returns the bucket that holds aName, or the empty bucket where it would go.
+      std::size_t Probe(std::string_view aName, std::size_t aHash) const;
+      void        Grow();
+
+      std::unique_ptr<Arena>        mStrings;
+      std::vector<std::string_view> mNames;   // Indexed by id.
+      std::vector<std::size_t>      mHashes;  // Indexed by id, so that growing doesn't hash again.
+      std::vector<std::uint32_t>    mBuckets; // Open addressing with linear probing. Holds id + 1, or 0 if empty.
+   };
+}
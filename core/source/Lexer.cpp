@@ -1,215 +1,432 @@
 #include "Lexer.hpp"
 
-#include <cctype>
+#include "PerfectHash.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define RJCPT_X86_64 1
+// SSE2 is part of x86-64, so it needs no runtime check.
+#include <emmintrin.h>
+#else
+#define RJCPT_X86_64 0
+#endif
 
 namespace
 {
-   bool IsSpace(char aCharacter)
+   using TT = rjcpt::TokenType;
+
+   // Character classes, as bit flags in cCHAR_CLASSES.
+   // These match the "C" locale, regardless of the current locale.
+   enum CharClass : std::uint8_t
    {
-      return std::isspace(static_cast<unsigned char>(aCharacter));
-   }
+      cSPACE               = 1 << 0, // ' ', '\t', '\n', '\v', '\f', '\r'
+      cDIGIT               = 1 << 1,
+      cALPHA               = 1 << 2, // ASCII letters
+      cNUMBER_BEGIN        = 1 << 3, // Digits and '.'
+      cIDENTIFIER_ANY      = 1 << 4, // Letters, '_' and '%'
+      cIDENTIFIER_CONTINUE = 1 << 5  // Letters, '_', '%', digits and '.'
+   };
 
-   bool IsDigit(char aCharacter)
+   constexpr std::array<std::uint8_t, 256> cCHAR_CLASSES = []()
    {
-      return std::isdigit(static_cast<unsigned char>(aCharacter));
-   }
+      std::array<std::uint8_t, 256> retval{};
+      for (const unsigned char c : {' ', '\t', '\n', '\v', '\f', '\r'})
+      {
+         retval[c] |= cSPACE;
+      }
+      for (unsigned char c = '0'; c <= '9'; c++)
+      {
+         retval[c] |= cDIGIT | cNUMBER_BEGIN | cIDENTIFIER_CONTINUE;
+      }
+      for (unsigned char c = 'a'; c <= 'z'; c++)
+      {
+         retval[c] |= cALPHA | cIDENTIFIER_ANY | cIDENTIFIER_CONTINUE;
+         retval[c - 'a' + 'A'] |= cALPHA | cIDENTIFIER_ANY | cIDENTIFIER_CONTINUE;
+      }
+      for (const unsigned char c : {'_', '%'})
+      {
+         retval[c] |= cIDENTIFIER_ANY | cIDENTIFIER_CONTINUE;
+      }
+      retval['.'] |= cNUMBER_BEGIN | cIDENTIFIER_CONTINUE;
+      return retval;
+   }();
 
-   bool IsNumberBegin(char aCharacter)
+   // Tokens made of a single character, regardless of what follows. Error for every other character.
+   constexpr std::array<TT, 256> cSINGLE_TOKENS = []()
    {
-      return IsDigit(aCharacter) || aCharacter == '.';
+      std::array<TT, 256> retval{};
+      retval.fill(TT::Error);
+      retval['+'] = TT::Plus;
+      retval['-'] = TT::Hyphen;
+      retval['*'] = TT::Asterisk;
+      retval['/'] = TT::Slash;
+      retval[','] = TT::Comma;
+      retval['$'] = TT::DollarSign;
+      retval['('] = TT::LeftParenthesis;
+      retval[')'] = TT::RightParenthesis;
+      retval['['] = TT::LeftBracket;
+      retval[']'] = TT::RightBracket;
+      retval['='] = TT::Equals;
+      return retval;
+   }();
+
+   constexpr bool Is(char aCharacter, std::uint8_t aClass)
+   {
+      return (cCHAR_CLASSES[static_cast<unsigned char>(aCharacter)] & aClass) != 0;
    }
 
-   bool IsIdentifierAny(char aCharacter)
+#if RJCPT_X86_64
+   // Sets each byte of the result to 0xFF if the byte in aChars is in [aLow, aHigh].
+   __m128i InRange(__m128i aChars, char aLow, char aHigh)
    {
-      return std::isalpha(static_cast<unsigned char>(aCharacter)) || aCharacter == '_' || aCharacter == '%';
+      // Shifting aLow to -128 turns the range check into a single signed comparison.
+      const __m128i shifted = _mm_add_epi8(aChars, _mm_set1_epi8(static_cast<char>(0x80 - aLow)));
+      return _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(0x80 + aHigh - aLow + 1)));
    }
 
-   bool IsIdentifierBegin(char aCharacter)
+   // Returns a 16-bit mask with a bit set for each byte of aChars that is in aClass.
+   template<std::uint8_t aClass>
+   unsigned MatchClass(__m128i aChars)
    {
-      return IsIdentifierAny(aCharacter) || aCharacter == '%';
+      if constexpr (aClass == cSPACE)
+      {
+         const __m128i space = _mm_cmpeq_epi8(aChars, _mm_set1_epi8(' '));
+         return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(space, InRange(aChars, '\t', '\r'))));
+      }
+      else
+      {
+         static_assert(aClass == cIDENTIFIER_CONTINUE);
+         // Setting bit 5 maps upper case letters to lower case, and nothing else into [a, z].
+         const __m128i alpha  = InRange(_mm_or_si128(aChars, _mm_set1_epi8(0x20)), 'a', 'z');
+         const __m128i digit  = InRange(aChars, '0', '9');
+         const __m128i symbol = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(aChars, _mm_set1_epi8('_')),
+                                                          _mm_cmpeq_epi8(aChars, _mm_set1_epi8('%'))),
+                                             _mm_cmpeq_epi8(aChars, _mm_set1_epi8('.')));
+         return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), symbol)));
+      }
    }
+#endif
 
-   bool IsIdentifierContinue(char aCharacter)
+   // Returns the index of the first character at or after aStart that is not in aClass.
+   // Whitespace and identifier runs are checked 16 characters at a time where possible.
+   template<std::uint8_t aClass>
+   std::uint32_t FindRunEnd(std::string_view aExpression, std::uint32_t aStart)
    {
-      return IsIdentifierAny(aCharacter) || IsNumberBegin(aCharacter);
+      const auto    size = static_cast<std::uint32_t>(aExpression.size());
+      std::uint32_t i    = aStart;
+#if RJCPT_X86_64
+      if constexpr (aClass == cSPACE || aClass == cIDENTIFIER_CONTINUE)
+      {
+         // Most runs are short, so check a few characters before loading whole blocks.
+         for (const std::uint32_t end = std::min(i + 4, size); i < end; i++)
+         {
+            if (!Is(aExpression[i], aClass))
+            {
+               return i;
+            }
+         }
+         for (; i + 16 <= size; i += 16)
+         {
+            const __m128i  chars    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aExpression.data() + i));
+            const unsigned mismatch = ~MatchClass<aClass>(chars) & 0xFFFFU;
+            if (mismatch != 0)
+            {
+               return i + static_cast<std::uint32_t>(std::countr_zero(mismatch));
+            }
+         }
+      }
+#endif
+      for (; i < size; i++)
+      {
+         if (!Is(aExpression[i], aClass))
+         {
+            return i;
+         }
+      }
+      return size;
    }
 
-   char NextChar(std::string_view aExpression, std::uint32_t aIndex)
+   constexpr rjcpt::PerfectHashMap<TT, 5> cKEYWORDS({{
+      {"and", TT::KeywordAnd},
+      {"or", TT::KeywordOr},
+      {"not", TT::KeywordNot},
+      {"true", TT::KeywordTrue},
+      {"false", TT::KeywordFalse}
+   }});
+
+   TT GetWordType(std::string_view aWord)
    {
-      return (aIndex + 1 >= aExpression.size()) ? '\0' : aExpression[aIndex + 1];
+      return cKEYWORDS.FindOr(aWord, TT::Identifier);
    }
 
-   rjcpt::TokenType GetWordType(std::string_view aWord)
+   std::pair<std::uint32_t, bool> FindExponentEnd(std::string_view aExpression, std::uint32_t aStart)
    {
-      using TT = rjcpt::TokenType;
-      if (aWord == "and")
+      if (aStart >= aExpression.size())
+      {
+         return {static_cast<std::uint32_t>(aExpression.size()), false};
+      }
+      const char first = aExpression[aStart];
+      if (first == '+' || first == '-')
       {
-         return TT::KeywordAnd;
+         ++aStart;
       }
-      else if (aWord == "or")
+      const std::uint32_t endPos = FindRunEnd<cDIGIT>(aExpression, aStart);
+      return {endPos, endPos > aStart};
+   }
+
+   // Scans a number in a single pass. On failure, the end index covers the rest of the malformed number.
+   std::pair<std::uint32_t, bool> FindNumberEnd(std::string_view aExpression, std::uint32_t aStart)
+   {
+      bool hasDigits  = false;
+      bool hasDecimal = false;
+
+      for (std::uint32_t i = aStart; i < aExpression.size(); i++)
       {
-         return TT::KeywordOr;
+         const char c = aExpression[i];
+         if (Is(c, cDIGIT))
+         {
+            hasDigits = true;
+         }
+         else if (c == '.')
+         {
+            if (hasDecimal)
+            {
+               return {FindRunEnd<cIDENTIFIER_ANY>(aExpression, i), false};
+            }
+            hasDecimal = true;
+         }
+         else if (c == 'e' || c == 'E')
+         {
+            return FindExponentEnd(aExpression, i + 1);
+         }
+         else if (Is(c, cALPHA))
+         {
+            return {FindRunEnd<cIDENTIFIER_ANY>(aExpression, i), false};
+         }
+         else
+         {
+            return {i, hasDigits};
+         }
       }
-      else if (aWord == "not")
+      return {static_cast<std::uint32_t>(aExpression.size()), hasDigits};
+   }
+
+   rjcpt::Token NextToken(std::string_view aExpression, std::uint32_t aIndex)
+   {
+      const std::uint32_t wordStart = FindRunEnd<cSPACE>(aExpression, aIndex);
+
+      if (wordStart >= aExpression.size())
       {
-         return TT::KeywordNot;
+         return rjcpt::Token{TT::EndOfData, wordStart, 0};
       }
-      else if (aWord == "true")
+      const char first = aExpression[wordStart];
+      if (const TT type = cSINGLE_TOKENS[static_cast<unsigned char>(first)]; type != TT::Error)
       {
-         return TT::KeywordTrue;
+         return rjcpt::Token{type, wordStart, 1};
       }
-      else if (aWord == "false")
+      const char next = wordStart + 1 < aExpression.size() ? aExpression[wordStart + 1] : '\0';
+      switch (first)
       {
-         return TT::KeywordFalse;
+      case '<':
+         if (next == '=')
+         {
+            return rjcpt::Token{TT::LessOrEqual, wordStart, 2};
+         }
+         else if (next == '>')
+         {
+            return rjcpt::Token{TT::NotEquals, wordStart, 2};
+         }
+         return rjcpt::Token{TT::LessThan, wordStart, 1};
+      case '>':
+         if (next == '=')
+         {
+            return rjcpt::Token{TT::GreaterOrEqual, wordStart, 2};
+         }
+         return rjcpt::Token{TT::GreaterThan, wordStart, 1};
+      default:
+         if (Is(first, cNUMBER_BEGIN))
+         {
+            const auto endPos = FindNumberEnd(aExpression, wordStart);
+            const auto type   = endPos.second ? TT::Number : TT::Error;
+            return rjcpt::Token{type, wordStart, endPos.first - wordStart};
+         }
+         else if (Is(first, cIDENTIFIER_ANY))
+         {
+            const std::uint32_t    endPos = FindRunEnd<cIDENTIFIER_CONTINUE>(aExpression, wordStart + 1);
+            const std::string_view word   = aExpression.substr(wordStart, endPos - wordStart);
+            return rjcpt::Token{GetWordType(word), wordStart, endPos - wordStart};
+         }
+         return rjcpt::Token{TT::Error, wordStart, 1};
       }
-      return TT::Identifier;
    }
 
-   template<bool IsWordChar(char)>
-   std::uint32_t FindWordEnd(std::string_view aExpression, std::uint32_t aStart)
+   void AppendTokens(std::string_view aExpression, std::vector<rjcpt::Token>& aTokens)
    {
-      for (std::uint32_t i = aStart; i < aExpression.size(); i++)
+      std::uint32_t index = 0;
+      while (true)
       {
-         if (!IsWordChar(aExpression[i]))
+         const rjcpt::Token t = NextToken(aExpression, index);
+         index = t.mStartIndex + t.mLength;
+         aTokens.push_back(t);
+         if (t.mType == TT::EndOfData || t.mType == TT::Error)
          {
-            return i;
+            break;
          }
       }
-      return static_cast<std::uint32_t>(aExpression.size());
    }
 }
 
 std::pair<std::uint32_t, bool> rjcpt::detail::FindExponentEnd(std::string_view aExpression, std::uint32_t aStart)
 {
-   if (aStart >= aExpression.size())
+   return ::FindExponentEnd(aExpression, aStart);
+}
+
+std::pair<std::uint32_t, bool> rjcpt::detail::FindNumberEnd(std::string_view aExpression, std::uint32_t aStart)
+{
+   return ::FindNumberEnd(aExpression, aStart);
+}
+
+rjcpt::Token rjcpt::detail::FindNextToken(std::string_view aExpression, std::uint32_t aIndex)
+{
+   return ::NextToken(aExpression, aIndex);
+}
+
+std::vector<rjcpt::Token> rjcpt::TokenizeExpression(std::string_view aExpression)
+{
+   RJCPT_TRACE_SAMPLED_SCOPE("TokenizeExpression", trace::Counter::LexerTicks);
+   std::vector<Token> retval;
+   ::AppendTokens(aExpression, retval);
+   RJCPT_TRACE_COUNT(Tokens, retval.size());
+   return retval;
+}
+
+std::span<const rjcpt::Token> rjcpt::TokenizeExpression(std::string_view aExpression, Arena& aArena)
+{
+   RJCPT_TRACE_SAMPLED_SCOPE("TokenizeExpression", trace::Counter::LexerTicks);
+   // Lex into a buffer that is reused by the thread, since the number of tokens isn't known up front.
+   thread_local std::vector<Token> tTokens;
+   tTokens.clear();
+   ::AppendTokens(aExpression, tTokens);
+   RJCPT_TRACE_COUNT(Tokens, tTokens.size());
+   return aArena.Copy<Token>(tTokens);
+}
+
+rjcpt::TokenStream::TokenStream(std::string_view aExpression, std::vector<Token>* aRecord)
+   : mExpression(aExpression)
+   , mRecord(aRecord)
+   , mCurrent(::NextToken(aExpression, 0))
+{
+   if (mRecord)
+   {
+      mRecord->push_back(mCurrent);
+   }
+}
+
+void rjcpt::TokenStream::Advance()
+{
+   if (mCurrent.mType == TT::EndOfData || mCurrent.mType == TT::Error)
    {
-      return {aExpression.size(), false};
+      return;
    }
-   const char first = aExpression[aStart];
-   if (first == '+' || first == '-')
+   mCurrent = ::NextToken(mExpression, mCurrent.mStartIndex + mCurrent.mLength);
+   ++mIndex;
+   if (mRecord)
    {
-      ++aStart;
+      mRecord->push_back(mCurrent);
    }
-   const std::uint32_t endPos = FindWordEnd<::IsDigit>(aExpression, aStart);
-   return {endPos, endPos > aStart};
 }
 
-std::pair<std::uint32_t, bool> rjcpt::detail::FindNumberEnd(std::string_view aExpression, std::uint32_t aStart)
+std::uint32_t rjcpt::RetokenizeExpression(std::string_view aExpression, const TextEdit& aEdit, std::vector<Token>& aTokens)
 {
-   bool hasDigits  = false;
-   bool hasDecimal = false;
+   RJCPT_TRACE_SAMPLED_SCOPE("RetokenizeExpression", trace::Counter::LexerTicks);
+   const auto oldEditEnd = aEdit.mStart + aEdit.mRemovedLength;
+   const auto newEditEnd = aEdit.mStart + aEdit.mInsertedLength;
 
-   for (std::uint32_t i = aStart; i < aExpression.size(); i++)
-   {
-      const char c = aExpression[i];
-      if (std::isdigit(static_cast<unsigned char>(c)))
+   // A token's extent depends on its characters and the one after it, so tokens ending before the edit are kept.
+   const auto first = std::ranges::partition_point(aTokens, [&](const Token& aToken)
       {
-         hasDigits = true;
-      }
-      else if (c == '.')
+         return aToken.mStartIndex + aToken.mLength < aEdit.mStart;
+      });
+   if (first == aTokens.end())
+   {
+      // Lexing stopped at an error before the edit.
+      return static_cast<std::uint32_t>(aTokens.size());
+   }
+   const auto firstIndex = static_cast<std::uint32_t>(first - aTokens.begin());
+
+   // Lex from the end of the last kept token until a new token lines up with an old one after the edit.
+   // From there on, the old tokens only need to be shifted.
+   std::vector<Token> relexed;
+   auto               old   = first;
+   std::uint32_t      index = firstIndex == 0 ? 0 : first[-1].mStartIndex + first[-1].mLength;
+   bool               resynchronized = false;
+   while (true)
+   {
+      const Token t = ::NextToken(aExpression, index);
+      index = t.mStartIndex + t.mLength;
+      if (t.mStartIndex >= newEditEnd)
       {
-         if (hasDecimal)
+         const std::uint32_t oldStart = t.mStartIndex - aEdit.mInsertedLength + aEdit.mRemovedLength;
+         while (old != aTokens.end() && (old->mStartIndex < oldStart || old->mStartIndex < oldEditEnd))
          {
-            return {FindWordEnd<::IsIdentifierAny>(aExpression, i), false};
+            ++old;
+         }
+         if (old != aTokens.end() && old->mStartIndex == oldStart && old->mType == t.mType && old->mLength == t.mLength)
+         {
+            resynchronized = true;
+            break;
          }
-         hasDecimal = true;
-      }
-      else if (c == 'e' || c == 'E')
-      {
-         return FindExponentEnd(aExpression, i + 1);
-      }
-      else if (std::isalpha(static_cast<unsigned char>(c)))
-      {
-         return {FindWordEnd<::IsIdentifierAny>(aExpression, i), false};
       }
-      else
+      relexed.push_back(t);
+      if (t.mType == TT::EndOfData || t.mType == TT::Error)
       {
-         return {i, hasDigits};
+         break;
       }
    }
-   return {aExpression.size(), hasDigits};
-}
 
-rjcpt::Token rjcpt::detail::FindNextToken(std::string_view aExpression, std::uint32_t aIndex)
-{
-   const std::uint32_t wordStart = ::FindWordEnd<::IsSpace>(aExpression, aIndex);
-
-   if (wordStart >= aExpression.size())
+   const auto tail = resynchronized ? old : aTokens.end();
+   for (auto iter = tail; iter != aTokens.end(); ++iter)
    {
-      return Token{TokenType::EndOfData, wordStart, 0};
+      iter->mStartIndex = iter->mStartIndex + aEdit.mInsertedLength - aEdit.mRemovedLength;
    }
-   const char first = aExpression[wordStart];
-   switch (first)
+
+   // Find the first token whose type changed. Since the tokens after tail are unchanged, the types only changed
+   // if the relexed tokens differ from the ones they replace.
+   const auto replacedCount = static_cast<std::size_t>(tail - first);
+   std::size_t same = 0;
+   while (same < relexed.size() && same < replacedCount && relexed[same].mType == first[same].mType)
    {
-   case '+':
-      return Token{TokenType::Plus, wordStart, 1};
-   case '-':
-      return Token{TokenType::Hyphen, wordStart, 1};
-   case '*':
-      return Token{TokenType::Asterisk, wordStart, 1};
-   case '/':
-      return Token{TokenType::Slash, wordStart, 1};
-   case ',':
-      return Token{TokenType::Comma, wordStart, 1};
-   case '$':
-      return Token{TokenType::DollarSign, wordStart, 1};
-   case '(':
-      return Token{TokenType::LeftParenthesis, wordStart, 1};
-   case ')':
-      return Token{TokenType::RightParenthesis, wordStart, 1};
-   case '[':
-      return Token{TokenType::LeftBracket, wordStart, 1};
-   case ']':
-      return Token{TokenType::RightBracket, wordStart, 1};
-   case '=':
-      return Token{TokenType::Equals, wordStart, 1};
-   case '<':
-      if (const char c = ::NextChar(aExpression, wordStart); c == '=')
-      {
-         return Token{TokenType::LessOrEqual, wordStart, 2};
-      }
-      else if (c == '>')
-      {
-         return Token{TokenType::NotEquals, wordStart, 2};
-      }
-      return Token{TokenType::LessThan, wordStart, 1};
-   case '>':
-      if (::NextChar(aExpression, wordStart) == '=')
-      {
-         return Token{TokenType::GreaterOrEqual, wordStart, 2};
-      }
-      return Token{TokenType::GreaterThan, wordStart, 1};
-   default:
-      if (::IsNumberBegin(first))
-      {
-         const auto endPos = detail::FindNumberEnd(aExpression, wordStart);
-         const auto type   = endPos.second ? TokenType::Number : TokenType::Error;
-         return Token{type, wordStart, endPos.first - wordStart};
-      }
-      else if (::IsIdentifierBegin(first))
-      {
-         const std::uint32_t endPos = ::FindWordEnd<::IsIdentifierContinue>(aExpression, wordStart);
-         const std::string_view word = aExpression.substr(wordStart, endPos - wordStart);
-         const TokenType     type   = ::GetWordType(word);
-         return Token{type, wordStart, endPos - wordStart};
-      }
-      return Token{TokenType::Error, wordStart, 1};
+      ++same;
    }
+   const bool typesChanged = same < relexed.size() || same < replacedCount;
+
+   const auto insertAt = aTokens.erase(first, tail);
+   aTokens.insert(insertAt, relexed.begin(), relexed.end());
+   return typesChanged ? firstIndex + static_cast<std::uint32_t>(same) : static_cast<std::uint32_t>(aTokens.size());
 }
 
-std::vector<rjcpt::Token> rjcpt::TokenizeExpression(std::string_view aExpression)
+rjcpt::TokenBuffer rjcpt::TokenizeExpressions(std::span<const std::string_view> aExpressions)
 {
-   std::vector<Token> retval;
-   std::uint32_t      index = 0;
-   while (true)
+   RJCPT_TRACE_SCOPE("TokenizeExpressions", trace::Counter::LexerTicks);
+   // Formulas average well over two characters per token, so this rarely needs to grow.
+   std::size_t characters = 0;
+   for (const std::string_view expression : aExpressions)
    {
-      const Token t = detail::FindNextToken(aExpression, index);
-      index = t.mStartIndex + t.mLength;
-      retval.push_back(t);
-      if (t.mType == TokenType::EndOfData || t.mType == TokenType::Error)
-      {
-         break;
-      }
+      characters += expression.size();
+   }
+   TokenBuffer retval;
+   retval.mTokens.reserve(characters / 2 + aExpressions.size());
+   retval.mOffsets.reserve(aExpressions.size() + 1);
+   retval.mOffsets.push_back(0);
+   for (const std::string_view expression : aExpressions)
+   {
+      ::AppendTokens(expression, retval.mTokens);
+      retval.mOffsets.push_back(static_cast<std::uint32_t>(retval.mTokens.size()));
    }
+   RJCPT_TRACE_COUNT(Tokens, retval.mTokens.size());
    return retval;
 }
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <cstddef>
+#include <span>
 #include <string_view>
 #include <utility>
 #include <vector>
 
+#include "Arena.hpp"
 #include "Token.hpp"
 
 #include "rjcpt_core_export.h"
@@ -26,4 +29,65 @@ namespace rjcpt
 
    //! Takes an expression and tokenizes it as if by calling FindNextToken repeatedly.
    RJCPT_CORE_EXPORT std::vector<Token> TokenizeExpression(std::string_view aExpression);
+   //! Same as above, but the tokens are stored contiguously in aArena. Does not allocate from the heap once the
+   //! arena has grown large enough.
+   RJCPT_CORE_EXPORT std::span<const Token> TokenizeExpression(std::string_view aExpression, Arena& aArena);
+
+   //! Lexes an expression one token at a time, as the tokens are asked for, rather than all at once.
+   //! Parse can pull tokens from a stream, so that lexing and parsing run together in a single pass over the text,
+   //! and nothing after the first parse error is lexed.
+   class RJCPT_CORE_EXPORT TokenStream
+   {
+   public:
+      //! If aRecord is given, every token is appended to it as it is lexed, so that the tokens read so far are
+      //! available after parsing, the same as from TokenizeExpression.
+      explicit TokenStream(std::string_view aExpression, std::vector<Token>* aRecord = nullptr);
+
+      const Token&  Current() const { return mCurrent; }
+      //! The index of the current token, as in the result of TokenizeExpression.
+      std::uint32_t Index() const { return mIndex; }
+
+      //! Moves to the next token. Does nothing once the current token is EndOfData or Error.
+      void Advance();
+
+   private:
+      std::string_view    mExpression;
+      std::vector<Token>* mRecord;
+      Token               mCurrent;
+      std::uint32_t       mIndex = 0;
+   };
+
+   //! The tokens of many expressions, stored one after another in a single buffer.
+   struct TokenBuffer
+   {
+      std::vector<Token>         mTokens;
+      //! The tokens of expression i are mTokens[mOffsets[i], mOffsets[i + 1]).
+      std::vector<std::uint32_t> mOffsets;
+
+      std::size_t            Size() const { return mOffsets.empty() ? 0 : mOffsets.size() - 1; }
+      std::span<const Token> Tokens(std::size_t aIndex) const
+      {
+         return std::span<const Token>(mTokens).subspan(mOffsets[aIndex], mOffsets[aIndex + 1] - mOffsets[aIndex]);
+      }
+   };
+
+   //! Tokenizes each expression as if by TokenizeExpression.
+   //! Token indices are relative to the start of their own expression.
+   RJCPT_CORE_EXPORT TokenBuffer TokenizeExpressions(std::span<const std::string_view> aExpressions);
+
+   //! Replacement of mRemovedLength characters at mStart by mInsertedLength new characters.
+   struct TextEdit
+   {
+      std::uint32_t mStart          = 0;
+      std::uint32_t mRemovedLength  = 0;
+      std::uint32_t mInsertedLength = 0;
+   };
+
+   //! Updates aTokens, the result of TokenizeExpression for the text before aEdit, to match aExpression, the text
+   //! after it. Only the tokens around the edit are lexed again; the tokens after them are shifted.
+   //! The result is the same as TokenizeExpression(aExpression).
+   //! Returns the index of the first token whose type changed, or aTokens.size() if the types are all the same.
+   //! Since parsing only depends on token types, a formula only needs to be parsed again from that token.
+   RJCPT_CORE_EXPORT std::uint32_t RetokenizeExpression(std::string_view aExpression, const TextEdit& aEdit,
+                                                        std::vector<Token>& aTokens);
 }
@@ -0,0 +1,123 @@
+#include "MappedFile.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::expected<rjcpt::MappedFile, std::string> rjcpt::MappedFile::Open(const std::filesystem::path& aPath)
+{
+   const auto failure = [&aPath]() { return std::unexpected("Could not open " + aPath.string()); };
+   MappedFile retval;
+
+#ifdef _WIN32
+   HANDLE file = ::CreateFileW(aPath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                               FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+   if (file == INVALID_HANDLE_VALUE)
+   {
+      return failure();
+   }
+   LARGE_INTEGER size{};
+   if (!::GetFileSizeEx(file, &size))
+   {
+      ::CloseHandle(file);
+      return failure();
+   }
+   if (size.QuadPart > 0)
+   {
+      // The view keeps the mapping alive, so both handles can be closed once it exists.
+      HANDLE mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      ::CloseHandle(file);
+      if (mapping == nullptr)
+      {
+         return failure();
+      }
+      retval.mData = static_cast<const char*>(::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+      ::CloseHandle(mapping);
+      if (retval.mData == nullptr)
+      {
+         return failure();
+      }
+      retval.mSize = static_cast<std::size_t>(size.QuadPart);
+   }
+   else
+   {
+      ::CloseHandle(file);
+   }
+#else
+   const int file = ::open(aPath.c_str(), O_RDONLY | O_CLOEXEC);
+   if (file < 0)
+   {
+      return failure();
+   }
+   struct stat status{};
+   if (::fstat(file, &status) != 0)
+   {
+      ::close(file);
+      return failure();
+   }
+   if (status.st_size > 0)
+   {
+      // The mapping stays valid after the file is closed.
+      void* data = ::mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+      ::close(file);
+      if (data == MAP_FAILED)
+      {
+         return failure();
+      }
+      ::madvise(data, static_cast<std::size_t>(status.st_size), MADV_SEQUENTIAL);
+      retval.mData = static_cast<const char*>(data);
+      retval.mSize = static_cast<std::size_t>(status.st_size);
+   }
+   else
+   {
+      ::close(file);
+   }
+#endif
+   return retval;
+}
+
+rjcpt::MappedFile::MappedFile(MappedFile&& aOther) noexcept
+   : mData(std::exchange(aOther.mData, nullptr))
+   , mSize(std::exchange(aOther.mSize, 0))
+{
+}
+
+rjcpt::MappedFile& rjcpt::MappedFile::operator=(MappedFile&& aOther) noexcept
+{
+   if (this != &aOther)
+   {
+      Close();
+      mData = std::exchange(aOther.mData, nullptr);
+      mSize = std::exchange(aOther.mSize, 0);
+   }
+   return *this;
+}
+
+rjcpt::MappedFile::~MappedFile()
+{
+   Close();
+}
+
+void rjcpt::MappedFile::Close()
+{
+   if (mData != nullptr)
+   {
+#ifdef _WIN32
+      ::UnmapViewOfFile(mData);
+#else
+      ::munmap(const_cast<char*>(mData), mSize);
+#endif
+      mData = nullptr;
+      mSize = 0;
+   }
+}
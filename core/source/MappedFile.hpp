@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <expected>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include "rjcpt_core_export.h"
+
+namespace rjcpt
+{
+   //! A read-only view of a whole file, mapped into memory.
+   //! Pages are only read from disk when they are first touched.
+   class RJCPT_CORE_EXPORT MappedFile
+   {
+   public:
+      //! Maps the file at aPath. On failure, returns a description of the error.
+      static std::expected<MappedFile, std::string> Open(const std::filesystem::path& aPath);
+
+      MappedFile() = default;
+      MappedFile(MappedFile&& aOther) noexcept;
+      MappedFile& operator=(MappedFile&& aOther) noexcept;
+      ~MappedFile();
+
+      std::string_view Data() const { return std::string_view(mData, mSize); }
+
+   private:
+      void Close();
+
+      const char* mData = nullptr;
+      std::size_t mSize = 0;
+   };
+}
@@ -0,0 +1,587 @@
+#include "Optimizer.hpp"
+
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <compare>
+#include <map>
+#include <optional>
+#include <vector>
+
+namespace
+{
+   using OC = rjcpt::OpCode;
+
+   constexpr std::uint32_t cNONE = 0xFFFFFFFFU;
+
+   //! A value in the expression graph of a program. Identical nodes are only stored once.
+   struct Node
+   {
+      Node() = default;
+      Node(OC aOpCode, std::vector<std::uint32_t> aChildren, std::uint32_t aOperand = 0)
+         : mOpCode(aOpCode)
+         , mOperand(aOperand)
+         , mChildren(std::move(aChildren))
+      {
+      }
+
+      //! The instruction that computes the node. Chains use ChainBegin, "and" AndEnd, and "or" OrEnd.
+      OC                         mOpCode  = OC::Return;
+      std::uint32_t              mOperand = 0;
+      std::uint64_t              mBits    = 0; // Value of a constant.
+      std::vector<std::uint32_t> mChildren;
+      std::vector<std::uint32_t> mKinds; // CompareKind of each comparison in a chain.
+
+      auto operator<=>(const Node&) const = default;
+   };
+
+   bool IsLeaf(OC aOpCode)
+   {
+      return aOpCode == OC::PushConstant || aOpCode == OC::LoadColumn || aOpCode == OC::LoadParameter;
+   }
+
+   bool IsBinary(OC aOpCode)
+   {
+      return aOpCode >= OC::Add && aOpCode <= OC::CompareGreaterOrEqual;
+   }
+
+   bool IsTrue(double aValue)
+   {
+      return aValue != 0.0;
+   }
+
+   class Optimizer
+   {
+   public:
+      explicit Optimizer(const rjcpt::Program& aProgram)
+         : mProgram(aProgram)
+      {
+      }
+
+      //! Builds the expression graph of the program. Returns false if the code is not as the compiler emits it.
+      bool Build()
+      {
+         std::vector<std::uint32_t> values;
+         std::vector<std::uint32_t> locals(mProgram.mLocalCount, cNONE);
+         std::vector<Node>          chains;
+         const auto pop = [&](std::uint32_t& aValue)
+            {
+               if (values.empty())
+               {
+                  return false;
+               }
+               aValue = values.back();
+               values.pop_back();
+               return true;
+            };
+
+         for (const rjcpt::EvaluatorInstruction& instruction : mProgram.mCode)
+         {
+            std::uint32_t left  = 0;
+            std::uint32_t right = 0;
+            switch (instruction.mOpCode)
+            {
+            case OC::Return:
+               if (values.size() != 1 || !chains.empty())
+               {
+                  return false;
+               }
+               mRoot = values.back();
+               return true;
+            case OC::PushConstant:
+               if (instruction.mOperand >= mProgram.mConstants.size())
+               {
+                  return false;
+               }
+               values.push_back(Constant(mProgram.mConstants[instruction.mOperand]));
+               break;
+            case OC::LoadColumn:
+            case OC::LoadParameter:
+               values.push_back(Intern(Node(instruction.mOpCode, {}, instruction.mOperand)));
+               break;
+            case OC::StoreLocal:
+               if (values.empty() || instruction.mOperand >= locals.size())
+               {
+                  return false;
+               }
+               locals[instruction.mOperand] = values.back();
+               break;
+            case OC::LoadLocal:
+               if (instruction.mOperand >= locals.size() || locals[instruction.mOperand] == cNONE)
+               {
+                  return false;
+               }
+               values.push_back(locals[instruction.mOperand]);
+               break;
+            case OC::Negate:
+            case OC::LogicalNot:
+               if (!pop(right))
+               {
+                  return false;
+               }
+               values.push_back(Make(Node(instruction.mOpCode, {right})));
+               break;
+            case OC::AndJump:
+            case OC::OrJump:
+               // The left operand stays on the stack until AndEnd or OrEnd.
+               break;
+            case OC::ChainBegin:
+               chains.emplace_back().mOpCode = OC::ChainBegin;
+               break;
+            case OC::ChainCompare:
+               if (chains.empty() || !pop(right) || !pop(left))
+               {
+                  return false;
+               }
+               if (chains.back().mChildren.empty())
+               {
+                  chains.back().mChildren.push_back(left);
+               }
+               chains.back().mChildren.push_back(right);
+               chains.back().mKinds.push_back(instruction.mOperand);
+               values.push_back(right);
+               break;
+            case OC::ChainEnd:
+               if (chains.empty() || chains.back().mKinds.empty() || !pop(right))
+               {
+                  return false;
+               }
+               values.push_back(Make(std::move(chains.back())));
+               chains.pop_back();
+               break;
+            case OC::Call:
+            {
+               const std::size_t argc = instruction.mOperand >> 8;
+               if (argc > values.size())
+               {
+                  return false;
+               }
+               Node call(OC::Call, {values.end() - static_cast<std::ptrdiff_t>(argc), values.end()}, instruction.mOperand);
+               values.resize(values.size() - argc);
+               values.push_back(Make(std::move(call)));
+               break;
+            }
+            default:
+               if (!IsBinary(instruction.mOpCode) && instruction.mOpCode != OC::AndEnd && instruction.mOpCode != OC::OrEnd)
+               {
+                  return false;
+               }
+               if (!pop(right) || !pop(left))
+               {
+                  return false;
+               }
+               values.push_back(Make(Node(instruction.mOpCode, {left, right})));
+               break;
+            }
+         }
+         return false;
+      }
+
+      //! Emits the code of the graph into aProgram.
+      void Emit(rjcpt::Program& aProgram)
+      {
+         CountUses();
+         mLocalOf.assign(mNodes.size(), cNONE);
+         mCode.clear();
+         mConstants.clear();
+
+         struct Frame
+         {
+            std::uint32_t mNode  = 0;
+            std::uint32_t mChild = 0;
+            std::size_t   mJump  = 0; // AndJump or OrJump before the right operand.
+            std::size_t   mScope = 0; // Size of mScoped when the right operand started.
+         };
+         std::vector<Frame> frames;
+         if (!EmitSimple(mRoot))
+         {
+            frames.push_back(Frame{mRoot});
+         }
+         while (!frames.empty())
+         {
+            Frame&              frame = frames.back();
+            const Node&         node  = mNodes[frame.mNode];
+            const std::uint32_t child = frame.mChild;
+            if (child < node.mChildren.size())
+            {
+               // Instructions that go between the operands.
+               if (child >= 1 && node.mOpCode == OC::ChainBegin)
+               {
+                  child == 1 ? EmitInstruction(OC::ChainBegin) : EmitInstruction(OC::ChainCompare, node.mKinds[child - 2]);
+               }
+               if (child == 1 && (node.mOpCode == OC::AndEnd || node.mOpCode == OC::OrEnd))
+               {
+                  frame.mJump  = mCode.size();
+                  frame.mScope = mScoped.size();
+                  EmitInstruction(node.mOpCode == OC::AndEnd ? OC::AndJump : OC::OrJump);
+               }
+               ++frame.mChild;
+               const std::uint32_t next = node.mChildren[child];
+               if (!EmitSimple(next))
+               {
+                  frames.push_back(Frame{next}); // Invalidates frame.
+               }
+               continue;
+            }
+
+            switch (node.mOpCode)
+            {
+            case OC::ChainBegin:
+               EmitInstruction(OC::ChainCompare, node.mKinds.back());
+               EmitInstruction(OC::ChainEnd);
+               break;
+            case OC::AndEnd:
+            case OC::OrEnd:
+               EmitInstruction(node.mOpCode);
+               mCode[frame.mJump].mOperand = static_cast<std::uint32_t>(mCode.size() - frame.mJump);
+               // Values computed in the right operand may not have been computed at all.
+               for (std::size_t i = frame.mScope; i < mScoped.size(); i++)
+               {
+                  mLocalOf[mScoped[i]] = cNONE;
+               }
+               mScoped.resize(frame.mScope);
+               break;
+            default:
+               EmitInstruction(node.mOpCode, node.mOperand);
+               break;
+            }
+            if (mUses[frame.mNode] > 1 && mLocalCount < rjcpt::Program::cMAX_LOCALS)
+            {
+               mLocalOf[frame.mNode] = mLocalCount;
+               mScoped.push_back(frame.mNode);
+               EmitInstruction(OC::StoreLocal, mLocalCount++);
+               ++mShared;
+            }
+            frames.pop_back();
+         }
+         EmitInstruction(OC::Return);
+
+         aProgram.mCode.assign(mCode.begin(), mCode.end());
+         aProgram.mConstants.assign(mConstants.begin(), mConstants.end());
+         aProgram.mLocalCount    = mLocalCount;
+         aProgram.mMaxStackDepth = MaxStackDepth();
+      }
+
+      std::size_t CodeSize() const { return mCode.size(); }
+      std::size_t Folded() const { return mFolded; }
+      std::size_t Shared() const { return mShared; }
+
+   private:
+      std::uint32_t Intern(Node aNode)
+      {
+         const auto [iter, inserted] = mIds.try_emplace(std::move(aNode), static_cast<std::uint32_t>(mNodes.size()));
+         if (inserted)
+         {
+            mNodes.push_back(iter->first);
+         }
+         return iter->second;
+      }
+
+      std::uint32_t Constant(double aValue)
+      {
+         Node constant(OC::PushConstant, {});
+         constant.mBits = std::bit_cast<std::uint64_t>(aValue);
+         return Intern(std::move(constant));
+      }
+
+      std::optional<double> ConstantValue(std::uint32_t aNode) const
+      {
+         if (mNodes[aNode].mOpCode != OC::PushConstant)
+         {
+            return std::nullopt;
+         }
+         return std::bit_cast<double>(mNodes[aNode].mBits);
+      }
+
+      bool IsConstant(std::uint32_t aNode, double aValue) const
+      {
+         return mNodes[aNode].mOpCode == OC::PushConstant && mNodes[aNode].mBits == std::bit_cast<std::uint64_t>(aValue);
+      }
+
+      //! Adds a node, unless it can be simplified to another one.
+      std::uint32_t Make(Node aNode)
+      {
+         if (const auto simplified = Simplify(aNode))
+         {
+            ++mFolded;
+            return *simplified;
+         }
+         return Intern(std::move(aNode));
+      }
+
+      //! Returns a node that is 1.0 if aNode is true, and 0.0 otherwise, as "and" and "or" do with their operands.
+      std::uint32_t Truth(std::uint32_t aNode)
+      {
+         switch (mNodes[aNode].mOpCode)
+         {
+         case OC::LogicalNot:
+         case OC::ChainBegin:
+         case OC::AndEnd:
+         case OC::OrEnd:
+            return aNode;
+         default:
+            if (IsConstant(aNode, 0.0) || IsConstant(aNode, 1.0) ||
+                (IsBinary(mNodes[aNode].mOpCode) && mNodes[aNode].mOpCode >= OC::CompareEqual))
+            {
+               return aNode;
+            }
+            const std::uint32_t inverse = Make(Node(OC::LogicalNot, {aNode}));
+            return Make(Node(OC::LogicalNot, {inverse}));
+         }
+      }
+
+      //! Computes a node whose operands are all constants, with the evaluator.
+      double Fold(const Node& aNode)
+      {
+         rjcpt::Program program;
+         for (const std::uint32_t child : aNode.mChildren)
+         {
+            program.mCode.push_back({OC::PushConstant, static_cast<std::uint32_t>(program.mConstants.size())});
+            program.mConstants.push_back(*ConstantValue(child));
+            if (aNode.mOpCode == OC::ChainBegin)
+            {
+               if (program.mConstants.size() == 1)
+               {
+                  program.mCode.push_back({OC::ChainBegin});
+               }
+               else
+               {
+                  program.mCode.push_back({OC::ChainCompare, aNode.mKinds[program.mConstants.size() - 2]});
+               }
+            }
+         }
+         switch (aNode.mOpCode)
+         {
+         case OC::ChainBegin:
+            program.mCode.push_back({OC::ChainEnd});
+            break;
+         case OC::AndEnd:
+         case OC::OrEnd:
+            // Both operands are constants, so jumping or not gives the same result.
+            program.mCode.insert(program.mCode.begin() + 1, {aNode.mOpCode == OC::AndEnd ? OC::AndJump : OC::OrJump, 3});
+            program.mCode.push_back({aNode.mOpCode});
+            break;
+         default:
+            program.mCode.push_back({aNode.mOpCode, aNode.mOperand});
+            break;
+         }
+         program.mCode.push_back({OC::Return});
+         program.mMaxStackDepth = static_cast<std::uint32_t>(aNode.mChildren.size());
+         return rjcpt::Evaluate(program, rjcpt::EvaluationContext{});
+      }
+
+      std::optional<std::uint32_t> Simplify(const Node& aNode)
+      {
+         const std::vector<std::uint32_t>& children = aNode.mChildren;
+         if (std::ranges::all_of(children, [&](std::uint32_t aChild) { return ConstantValue(aChild).has_value(); }))
+         {
+            return Constant(Fold(aNode));
+         }
+         switch (aNode.mOpCode)
+         {
+         case OC::Negate:
+            if (mNodes[children[0]].mOpCode == OC::Negate)
+            {
+               return mNodes[children[0]].mChildren[0];
+            }
+            break;
+         case OC::Multiply:
+            if (IsConstant(children[1], 1.0))
+            {
+               return children[0];
+            }
+            if (IsConstant(children[0], 1.0))
+            {
+               return children[1];
+            }
+            break;
+         case OC::Divide:
+            if (IsConstant(children[1], 1.0))
+            {
+               return children[0];
+            }
+            break;
+         case OC::Subtract:
+            if (IsConstant(children[1], 0.0))
+            {
+               return children[0];
+            }
+            break;
+         case OC::AndEnd:
+         case OC::OrEnd:
+         {
+            // "a and b" is false if either is false, and "a or b" true if either is true. Otherwise, it is the truth of
+            // the other operand.
+            const bool isAnd = aNode.mOpCode == OC::AndEnd;
+            for (std::size_t i = 0; i < 2; i++)
+            {
+               if (const auto value = ConstantValue(children[i]))
+               {
+                  if (IsTrue(*value) != isAnd)
+                  {
+                     return Constant(isAnd ? 0.0 : 1.0);
+                  }
+                  return Truth(children[1 - i]);
+               }
+            }
+            break;
+         }
+         case OC::Call:
+            if (static_cast<rjcpt::BuiltinFunction>(aNode.mOperand & 0xFFU) == rjcpt::BuiltinFunction::If &&
+                children.size() == 3)
+            {
+               if (const auto condition = ConstantValue(children[0]))
+               {
+                  return IsTrue(*condition) ? children[1] : children[2];
+               }
+               if (children[1] == children[2])
+               {
+                  return children[1];
+               }
+            }
+            break;
+         default:
+            break;
+         }
+         return std::nullopt;
+      }
+
+      void CountUses()
+      {
+         mUses.assign(mNodes.size(), 0);
+         std::vector<bool>          visited(mNodes.size(), false);
+         std::vector<std::uint32_t> pending = {mRoot};
+         visited[mRoot] = true;
+         while (!pending.empty())
+         {
+            const std::uint32_t node = pending.back();
+            pending.pop_back();
+            for (const std::uint32_t child : mNodes[node].mChildren)
+            {
+               ++mUses[child];
+               if (!visited[child])
+               {
+                  visited[child] = true;
+                  pending.push_back(child);
+               }
+            }
+         }
+      }
+
+      //! Emits a leaf, or a load of a value already computed. Returns false for other nodes.
+      bool EmitSimple(std::uint32_t aNode)
+      {
+         const Node& node = mNodes[aNode];
+         if (mLocalOf[aNode] != cNONE)
+         {
+            EmitInstruction(OC::LoadLocal, mLocalOf[aNode]);
+            return true;
+         }
+         if (node.mOpCode == OC::PushConstant)
+         {
+            const double value = std::bit_cast<double>(node.mBits);
+            auto iter = std::ranges::find(mConstants, node.mBits, [](double aValue) { return std::bit_cast<std::uint64_t>(aValue); });
+            if (iter == mConstants.end())
+            {
+               mConstants.push_back(value);
+               iter = mConstants.end() - 1;
+            }
+            EmitInstruction(OC::PushConstant, static_cast<std::uint32_t>(iter - mConstants.begin()));
+            return true;
+         }
+         if (IsLeaf(node.mOpCode))
+         {
+            EmitInstruction(node.mOpCode, node.mOperand);
+            return true;
+         }
+         return false;
+      }
+
+      void EmitInstruction(OC aOpCode, std::uint32_t aOperand = 0)
+      {
+         mCode.push_back(rjcpt::EvaluatorInstruction{aOpCode, aOperand});
+      }
+
+      //! Depth of the stacks as the ColumnEvaluator runs the code, which keeps the left operand of "and" and "or".
+      std::uint32_t MaxStackDepth() const
+      {
+         std::int64_t values      = 0;
+         std::int64_t comparisons = 0;
+         std::int64_t retval      = 0;
+         for (const rjcpt::EvaluatorInstruction& instruction : mCode)
+         {
+            switch (instruction.mOpCode)
+            {
+            case OC::PushConstant:
+            case OC::LoadColumn:
+            case OC::LoadParameter:
+            case OC::LoadLocal:
+               ++values;
+               break;
+            case OC::ChainBegin:
+               ++comparisons;
+               break;
+            case OC::ChainCompare:
+               --values;
+               break;
+            case OC::ChainEnd:
+               --comparisons;
+               break;
+            case OC::Call:
+               values -= static_cast<std::int64_t>(instruction.mOperand >> 8) - 1;
+               break;
+            default:
+               if (IsBinary(instruction.mOpCode) || instruction.mOpCode == OC::AndEnd || instruction.mOpCode == OC::OrEnd)
+               {
+                  --values;
+               }
+               break;
+            }
+            retval = std::max({retval, values, comparisons});
+         }
+         return static_cast<std::uint32_t>(retval);
+      }
+
+      const rjcpt::Program&           mProgram;
+      std::vector<Node>               mNodes;
+      std::map<Node, std::uint32_t>   mIds;
+      std::uint32_t                   mRoot   = 0;
+      std::size_t                     mFolded = 0;
+      std::size_t                     mShared = 0;
+
+      std::vector<std::uint32_t>               mUses;
+      std::vector<std::uint32_t>               mLocalOf; // Local holding each node, or cNONE.
+      std::vector<std::uint32_t>               mScoped;  // Nodes given a local, in order, for invalidating them.
+      std::uint32_t                            mLocalCount = 0;
+      std::vector<rjcpt::EvaluatorInstruction> mCode;
+      std::vector<double>                      mConstants;
+   };
+}
+
+rjcpt::OptimizerReport rjcpt::OptimizeProgram(Program& aProgram)
+{
+   RJCPT_TRACE_SAMPLED_SCOPE("OptimizeProgram");
+   OptimizerReport retval;
+   retval.mInstructionsBefore = aProgram.mCode.size();
+   retval.mInstructionsAfter  = aProgram.mCode.size();
+
+   Optimizer optimizer(aProgram);
+   if (!optimizer.Build())
+   {
+      return retval;
+   }
+   Program optimized;
+   optimizer.Emit(optimized);
+   if (optimized.mCode.size() <= aProgram.mCode.size())
+   {
+      aProgram.mCode.assign(optimized.mCode.begin(), optimized.mCode.end());
+      aProgram.mConstants.assign(optimized.mConstants.begin(), optimized.mConstants.end());
+      aProgram.mMaxStackDepth = optimized.mMaxStackDepth;
+      aProgram.mLocalCount    = optimized.mLocalCount;
+      retval.mInstructionsAfter = aProgram.mCode.size();
+      retval.mFolded            = optimizer.Folded();
+      retval.mShared            = optimizer.Shared();
+   }
+   return retval;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Evaluator.hpp"
+
+#include <cstddef>
+
+#include "rjcpt_core_export.h"
+
+namespace rjcpt
+{
+   //! What OptimizeProgram did to a program.
+   struct OptimizerReport
+   {
+      std::size_t mInstructionsBefore = 0;
+      std::size_t mInstructionsAfter  = 0;
+      std::size_t mFolded = 0; // Operations computed at compile time, simplified away, or skipped as dead branches.
+      std::size_t mShared = 0; // Subexpressions computed once and reused through a local.
+   };
+
+   //! Rewrites a compiled program so that it does less work per row, with the same results.
+   //!   * Constant folding: operations, comparison chains and function calls on constants are computed once, by the
+   //!     evaluator itself, so the results cannot differ.
+   //!   * Simplification: "- -x", "x * 1", "1 * x", "x / 1" and "x - 0" become x. Only rewrites that are exact for
+   //!     every value, including NaN, infinities and -0, are made. "x + 0" is kept, since -0 + 0 is +0.
+   //!   * Dead branches: "and", "or" and "if" whose outcome is decided by a constant are replaced by what is left.
+   //!   * Common subexpressions: identical subexpressions are merged (hash-consed) and computed once. The value is
+   //!     kept in a local and loaded where it is used again, except across the right operand of "and" and "or",
+   //!     which the scalar evaluator may skip.
+   //! The program is left unchanged if the result would be longer. The code and constants keep their memory resource.
+   RJCPT_CORE_EXPORT OptimizerReport OptimizeProgram(Program& aProgram);
+}
@@ -25,7 +25,7 @@ namespace rjcpt
       // Replace the top value on the stack.
       UnaryPlus,  // '+'
       UnaryMinus, // '-'
-      RowLookup,  // '$'
+      RowLookup,  // '$' Looks up a name as a parameter shared by all rows.
       LogicalNot, // 'not'
 
       // Binary infix operators.
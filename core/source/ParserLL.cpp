@@ -1,116 +1,50 @@
 #include "ParserLL.hpp"
 
-#include "Stack.hpp"
-
-std::string rjcpt::Parse(ParseContext& aContext, std::span<const Token> aTokens)
+namespace
 {
-   Stack<GrammarNode, 256> stack;
-   stack.Push(aContext.GetEOF_Node());
-   stack.Push(aContext.GetStartRule());
-
-   auto iter = aTokens.begin();
-   aContext.BeginParsing();
-   while (stack.Size() > 0)
+   //! Describes aNode for error messages, using its name in the grammar text where possible.
+   std::string Describe(const rjcpt::GrammarView& aGrammar, const rjcpt::GrammarNode& aNode)
    {
-      const Token       tok = *iter;
-      const GrammarNode next = stack.Pop();
-      if (next.IsTerminal())
+      const std::string_view name = aGrammar.NodeName(aNode);
+      if (!name.empty())
       {
-         if (next.ValidatorIndex())
-         {
-            if (!aContext.CheckValidator(tok, next.ValidatorIndex()))
-            {
-               return "Failed validator...";
-            }
-            ++iter;
-         }
-         if (next.ActorIndex() && !aContext.RunActor(tok, next.ActorIndex()))
-         {
-            return "Action failed...";
-         }
-      }
-      else
-      {
-         auto nextRule = parser_util::FindRule(aContext, tok, next);
-         if (!nextRule)
-         {
-            return nextRule.error();
-         }
-         const auto& grammar = aContext.GetGrammar();
-         const GrammarRule rule = grammar.mRules[*nextRule];
-         for (std::uint32_t i = rule.mEnd; i > rule.mBegin; i--)
-         {
-            stack.Push(grammar.mNodes[i - 1]);
-         }
+         return std::string(name);
       }
+      return aNode.IsTerminal() ? "validator " + std::to_string(aNode.ValidatorIndex()) + ", actor " +
+                                     std::to_string(aNode.ActorIndex())
+                                : "rule " + std::to_string(aNode.RulesBegin());
    }
+}
 
-   // Parsing successful.
-   return std::string();
+std::string rjcpt::Parse(ParseContext& aContext, std::span<const Token> aTokens)
+{
+   return Parse<ParseContext>(aContext, aTokens);
 }
 
-bool rjcpt::parser_util::TryPeek(const ParseContext& aContext, const Token& aToken, std::uint16_t aRuleIndex)
+std::string rjcpt::parser_util::DescribeError(ParseError aError, const GrammarView& aGrammar, const GrammarNode& aNode,
+                                              std::uint32_t aTokenIndex)
 {
-   struct PeekContext
-   {
-      std::uint32_t mRuleIndex = 0;
-      std::uint32_t mNodeIndex = 0;
-   };
-   Stack<PeekContext, 64> stack;
-   const auto& grammar = aContext.GetGrammar();
-   stack.Emplace(aRuleIndex, grammar.mRules[aRuleIndex].mBegin);
-   while (stack.Size() > 0)
+   const std::string at = " at token " + std::to_string(aTokenIndex);
+   switch (aError)
    {
-      const auto next = stack.Pop();
-      const auto nextNode = grammar.mNodes[next.mNodeIndex];
-      if (next.mNodeIndex + 1 < grammar.mRules[next.mRuleIndex].mEnd)
-      {
-         // Push the next item in the rule for future iterations.
-         stack.Emplace(next.mRuleIndex, next.mNodeIndex + 1);
-      }
-      if (nextNode.IsTerminal())
-      {
-         if (nextNode.ValidatorIndex())
-         {
-            return aContext.CheckValidator(aToken, nextNode.ValidatorIndex());
-         }
-      }
-      else
-      {
-         const auto& rule = grammar.mRules[nextNode.RulesBegin()];
-         stack.Emplace(nextNode.RulesBegin(), rule.mBegin);
-      }
+   case ParseError::FailedValidator:
+      return "Failed validator " + Describe(aGrammar, aNode) + at;
+   case ParseError::FailedAction:
+      return "Action failed " + Describe(aGrammar, aNode) + at;
+   default:
+      return "No matching rule for " + Describe(aGrammar, aNode) + at;
    }
-   // If we get all the way through the rule without failure, assume success.
-   
-   // KNOWN ISSUE: We cannot always assume that this is a valid look-ahead.
-   //              Need to take into account current parse context.
-   return true;
 }
 
 std::expected<std::uint16_t, std::string> rjcpt::parser_util::FindRule(const ParseContext& aContext, const Token& aToken, const GrammarNode& aNode)
 {
    assert(!aNode.IsTerminal());
    assert(aNode.RulesEnd() > aNode.RulesBegin());
-   if (aNode.RulesEnd() - aNode.RulesBegin() == 1)
+   RJCPT_TRACE_COUNT(FindRuleCalls, 1);
+   const std::uint16_t retval = aContext.GetGrammar().LookupRule(aNode, aToken.mType);
+   if (retval == cNO_RULE)
    {
-      return static_cast<int>(aNode.RulesBegin());
+      return std::unexpected("No matching rule for " + Describe(aContext.GetGrammar(), aNode));
    }
-   int retval = -1;
-   for (std::uint16_t i = aNode.RulesBegin(); i < aNode.RulesEnd(); i++)
-   {
-      if (TryPeek(aContext, aToken, i))
-      {
-         if (retval >= 0)
-         {
-            return std::unexpected("Ambiguous rule...");
-         }
-         retval = i;
-      }
-   }
-   if (retval < 0)
-   {
-      return std::unexpected("No matching rule...");
-   }
-   return static_cast<std::uint16_t>(retval);
-}
\ No newline at end of file
+   return retval;
+}
@@ -1,10 +1,17 @@
 #pragma once
 
 #include "GrammarLL.hpp"
+#include "Lexer.hpp"
+#include "Stack.hpp"
 #include "Token.hpp"
+#include "Trace.hpp"
 
+#include <concepts>
 #include <expected>
 #include <span>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "rjcpt_core_export.h"
 
@@ -15,22 +22,237 @@ namespace rjcpt
    public:
       virtual ~ParseContext() = default;
 
-      virtual const CompiledGrammar& GetGrammar() const = 0;
+      virtual GrammarView GetGrammar() const = 0;
 
       virtual GrammarNode GetEOF_Node() const = 0;
       virtual GrammarNode GetStartRule() const = 0;
 
       virtual void BeginParsing() {}
       virtual bool CheckValidator(const Token& aToken, std::uint16_t aValidator) const = 0;
-      virtual bool RunActor(const Token& aToken, std::uint16_t aActor) = 0;
+      //! aTokenIndex is the index of aToken in the list being parsed.
+      virtual bool RunActor(const Token& aToken, std::uint32_t aTokenIndex, std::uint16_t aActor) = 0;
    };
 
-   //! Parses the list of tokens using aContext.
-   RJCPT_CORE_EXPORT std::string Parse(ParseContext& aContext, std::span<const Token> aTokens);
+   //! Any type with the same members as ParseContext, which it does not need to derive from.
+   //! Parsing with such a type calls its members directly, so they can be inlined into the parse loop.
+   template<typename T>
+   concept StaticParseContext = requires(T& aContext, const Token& aToken, std::uint32_t aIndex, std::uint16_t aId) {
+      { std::as_const(aContext).GetGrammar() } -> std::convertible_to<GrammarView>;
+      { std::as_const(aContext).GetEOF_Node() } -> std::convertible_to<GrammarNode>;
+      { std::as_const(aContext).GetStartRule() } -> std::convertible_to<GrammarNode>;
+      aContext.BeginParsing();
+      { std::as_const(aContext).CheckValidator(aToken, aId) } -> std::convertible_to<bool>;
+      { aContext.RunActor(aToken, aIndex, aId) } -> std::convertible_to<bool>;
+   };
+
+   //! Wraps a StaticParseContext so that it can be passed where a ParseContext is expected.
+   template<StaticParseContext Context>
+   class ParseContextAdapter final : public ParseContext
+   {
+   public:
+      explicit ParseContextAdapter(Context& aContext)
+         : mContext(aContext)
+      {
+      }
+
+      GrammarView GetGrammar() const override { return mContext.GetGrammar(); }
+
+      GrammarNode GetEOF_Node() const override { return mContext.GetEOF_Node(); }
+      GrammarNode GetStartRule() const override { return mContext.GetStartRule(); }
+
+      void BeginParsing() override { mContext.BeginParsing(); }
+      bool CheckValidator(const Token& aToken, std::uint16_t aValidator) const override
+      {
+         return mContext.CheckValidator(aToken, aValidator);
+      }
+      bool RunActor(const Token& aToken, std::uint32_t aTokenIndex, std::uint16_t aActor) override
+      {
+         return mContext.RunActor(aToken, aTokenIndex, aActor);
+      }
+
+   private:
+      Context& mContext;
+   };
 
    namespace parser_util
    {
-      RJCPT_CORE_EXPORT bool TryPeek(const ParseContext& aContext, const Token& aToken, std::uint16_t aRuleIndex);
+      enum class ParseError
+      {
+         FailedValidator,
+         FailedAction,
+         NoMatchingRule
+      };
+
+      //! Describes a parse failure at aNode. Kept out of line so that it stays out of the parse loop.
+      RJCPT_CORE_EXPORT std::string DescribeError(ParseError aError, const GrammarView& aGrammar, const GrammarNode& aNode,
+                                                  std::uint32_t aTokenIndex);
+
+      //! Returns the rule that aNode expands to when the next token is aToken, using the grammar's parse table.
       RJCPT_CORE_EXPORT std::expected<std::uint16_t, std::string> FindRule(const ParseContext& aContext, const Token& aToken, const GrammarNode& aNode);
    }
+
+   //! The parser stack at the point where parsing first reads each token, so that parsing can be resumed there.
+   struct ParseCheckpoints
+   {
+      std::vector<GrammarNode>   mStacks;  // The stacks of all checkpoints, one after another.
+      std::vector<std::uint32_t> mOffsets; // The stack of checkpoint i is mStacks[mOffsets[i], mOffsets[i + 1]).
+
+      std::size_t Size() const { return mOffsets.empty() ? 0 : mOffsets.size() - 1; }
+   };
+
+   //! A StaticParseContext that can also save its state at a checkpoint, and go back to it.
+   //!   * SaveCheckpoint(i) is called when parsing first reads token i, for i = 0, 1, 2, ... in order.
+   //!   * RestoreCheckpoint(i) goes back to the state saved for token i, and discards checkpoints i and later.
+   template<typename T>
+   concept ResumableParseContext = StaticParseContext<T> && requires(T& aContext, std::uint32_t aIndex) {
+      aContext.SaveCheckpoint(aIndex);
+      aContext.RestoreCheckpoint(aIndex);
+   };
+
+   namespace detail
+   {
+      //! Reads tokens from a list, with the same members as TokenStream.
+      class SpanTokens
+      {
+      public:
+         SpanTokens(std::span<const Token> aTokens, std::uint32_t aIndex)
+            : mBegin(aTokens.data())
+            , mIter(aTokens.data() + aIndex)
+         {
+         }
+
+         const Token&  Current() const { return *mIter; }
+         std::uint32_t Index() const { return static_cast<std::uint32_t>(mIter - mBegin); }
+         void          Advance() { ++mIter; }
+
+      private:
+         const Token* mBegin;
+         const Token* mIter;
+      };
+
+      //! Runs the parser with the given stack, from the current token of aTokens, which is a SpanTokens or a
+      //! TokenStream. Records checkpoints in aCheckpoints if asked to.
+      template<bool RecordCheckpoints, typename Context, typename Tokens>
+      std::string RunParser(Context& aContext, Tokens& aTokens, Stack<GrammarNode, 256>& aStack,
+                            ParseCheckpoints* aCheckpoints)
+      {
+         using parser_util::ParseError;
+         RJCPT_TRACE_SAMPLED_SCOPE("Parse");
+         trace::Tally tally;
+
+         const GrammarView grammar = aContext.GetGrammar();
+         std::uint32_t nextCheckpoint = aTokens.Index();
+         while (aStack.Size() > 0)
+         {
+            const Token         tok   = aTokens.Current();
+            const std::uint32_t index = aTokens.Index();
+            if constexpr (RecordCheckpoints)
+            {
+               if (index == nextCheckpoint)
+               {
+                  const auto items = aStack.Items();
+                  aCheckpoints->mStacks.insert(aCheckpoints->mStacks.end(), items.begin(), items.end());
+                  aCheckpoints->mOffsets.push_back(static_cast<std::uint32_t>(aCheckpoints->mStacks.size()));
+                  aContext.SaveCheckpoint(index);
+                  ++nextCheckpoint;
+               }
+            }
+            const GrammarNode next = aStack.Pop();
+            if (next.IsTerminal())
+            {
+               if (next.ValidatorIndex())
+               {
+                  if (!aContext.CheckValidator(tok, next.ValidatorIndex()))
+                  {
+                     return parser_util::DescribeError(ParseError::FailedValidator, grammar, next, index);
+                  }
+                  aTokens.Advance();
+               }
+               if (next.ActorIndex() && !aContext.RunActor(tok, index, next.ActorIndex()))
+               {
+                  return parser_util::DescribeError(ParseError::FailedAction, grammar, next, index);
+               }
+            }
+            else
+            {
+               const std::uint16_t nextRule = grammar.LookupRule(next, tok.mType);
+               if (nextRule == cNO_RULE)
+               {
+                  return parser_util::DescribeError(ParseError::NoMatchingRule, grammar, next, index);
+               }
+               const GrammarRule& rule = grammar.mRules[nextRule];
+               for (std::uint32_t i = rule.mEnd; i > rule.mBegin; i--)
+               {
+                  aStack.Push(grammar.mNodes[i - 1]);
+               }
+               tally.Add(trace::Counter::RuleExpansions, 1);
+               tally.Max(trace::Counter::MaxParseStackDepth, aStack.Size());
+            }
+         }
+
+         // Parsing successful.
+         return std::string();
+      }
+   }
+
+   //! Parses the list of tokens using aContext. Returns an empty string on success, or a description of the error.
+   //! The members of aContext are called directly, without going through ParseContext's virtual functions.
+   template<StaticParseContext Context>
+   std::string Parse(Context& aContext, std::span<const Token> aTokens)
+   {
+      Stack<GrammarNode, 256> stack;
+      stack.Push(aContext.GetEOF_Node());
+      stack.Push(aContext.GetStartRule());
+      aContext.BeginParsing();
+      detail::SpanTokens tokens(aTokens, 0);
+      return detail::RunParser<false>(aContext, tokens, stack, nullptr);
+   }
+
+   //! Same as Parse, but pulls tokens from aTokens as they are needed, and stops lexing at the first error.
+   template<StaticParseContext Context>
+   std::string Parse(Context& aContext, TokenStream& aTokens)
+   {
+      Stack<GrammarNode, 256> stack;
+      stack.Push(aContext.GetEOF_Node());
+      stack.Push(aContext.GetStartRule());
+      aContext.BeginParsing();
+      return detail::RunParser<false>(aContext, aTokens, stack, nullptr);
+   }
+
+   //! Same as Parse, but records checkpoints in aCheckpoints so that the tokens can be parsed again after an edit.
+   //! If aCheckpoints holds the checkpoints of an earlier parse, and only tokens from aFirstChanged onwards have
+   //! changed type since then, parsing resumes at the last checkpoint at or before aFirstChanged.
+   //! Pass aFirstChanged = 0 to parse from the start.
+   template<ResumableParseContext Context>
+   std::string Reparse(Context& aContext, std::span<const Token> aTokens, ParseCheckpoints& aCheckpoints,
+                       std::uint32_t aFirstChanged)
+   {
+      Stack<GrammarNode, 256> stack;
+      const auto              available = static_cast<std::uint32_t>(aCheckpoints.Size());
+      if (aFirstChanged == 0 || available == 0)
+      {
+         aCheckpoints.mStacks.clear();
+         aCheckpoints.mOffsets.assign(1, 0);
+         stack.Push(aContext.GetEOF_Node());
+         stack.Push(aContext.GetStartRule());
+         aContext.BeginParsing();
+         detail::SpanTokens tokens(aTokens, 0);
+         return detail::RunParser<true>(aContext, tokens, stack, &aCheckpoints);
+      }
+
+      const std::uint32_t resume = aFirstChanged < available ? aFirstChanged : available - 1;
+      for (std::uint32_t i = aCheckpoints.mOffsets[resume]; i < aCheckpoints.mOffsets[resume + 1]; i++)
+      {
+         stack.Push(aCheckpoints.mStacks[i]);
+      }
+      // RunParser records checkpoint resume again when it starts.
+      aCheckpoints.mStacks.resize(aCheckpoints.mOffsets[resume]);
+      aCheckpoints.mOffsets.resize(resume + 1);
+      aContext.RestoreCheckpoint(resume);
+      detail::SpanTokens tokens(aTokens, resume);
+      return detail::RunParser<true>(aContext, tokens, stack, &aCheckpoints);
+   }
+
+   //! Parses the list of tokens using aContext, calling its members through ParseContext's virtual functions.
+   RJCPT_CORE_EXPORT std::string Parse(ParseContext& aContext, std::span<const Token> aTokens);
 }
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+namespace rjcpt
+{
+   //! A map from a fixed set of strings to values, with a hash function that has no collisions on those strings.
+   //! The seed of the hash is searched for when the map is built, which happens at compile time for constexpr maps.
+   //! A lookup hashes the string once and compares it with the only key that can match, so it costs the same for
+   //! any number of keys.
+   template<typename T, std::size_t N>
+   class PerfectHashMap
+   {
+   public:
+      struct Entry
+      {
+         std::string_view mKey;
+         T                mValue{};
+      };
+
+      //! Throws if aEntries has duplicate keys, which is a compile error for constexpr maps.
+      constexpr explicit PerfectHashMap(const std::array<Entry, N>& aEntries)
+      {
+         for (std::uint32_t seed = 0; seed < cMAX_SEEDS; seed++)
+         {
+            if (TryBuild(aEntries, seed))
+            {
+               return;
+            }
+         }
+         throw std::logic_error("No perfect hash found; are there duplicate keys?");
+      }
+
+      //! Returns nullptr if aKey is not in the map.
+      constexpr const T* Find(std::string_view aKey) const
+      {
+         const Bucket& bucket = mBuckets[Hash(aKey, mSeed) & (cBUCKETS - 1)];
+         return bucket.mUsed && bucket.mEntry.mKey == aKey ? &bucket.mEntry.mValue : nullptr;
+      }
+
+      //! Returns aDefault if aKey is not in the map.
+      constexpr T FindOr(std::string_view aKey, T aDefault) const
+      {
+         const T* value = Find(aKey);
+         return value ? *value : aDefault;
+      }
+
+   private:
+      //! At least twice as many buckets as keys, so that a collision-free seed is quick to find.
+      static constexpr std::size_t   cBUCKETS   = std::bit_ceil(N * 2 + 1);
+      static constexpr std::uint32_t cMAX_SEEDS = 1U << 16;
+
+      struct Bucket
+      {
+         Entry mEntry;
+         bool  mUsed = false;
+      };
+
+      //! FNV-1a, starting from the seed.
+      static constexpr std::uint32_t Hash(std::string_view aKey, std::uint32_t aSeed)
+      {
+         std::uint32_t retval = 2166136261U ^ (aSeed * 16777619U);
+         for (const char c : aKey)
+         {
+            retval = (retval ^ static_cast<unsigned char>(c)) * 16777619U;
+         }
+         return retval ^ (retval >> 15);
+      }
+
+      constexpr bool TryBuild(const std::array<Entry, N>& aEntries, std::uint32_t aSeed)
+      {
+         mBuckets = {};
+         mSeed    = aSeed;
+         for (const Entry& entry : aEntries)
+         {
+            Bucket& bucket = mBuckets[Hash(entry.mKey, aSeed) & (cBUCKETS - 1)];
+            if (bucket.mUsed)
+            {
+               return false;
+            }
+            bucket = Bucket{entry, true};
+         }
+         return true;
+      }
+
+      std::array<Bucket, cBUCKETS> mBuckets{};
+      std::uint32_t                mSeed = 0;
+   };
+}
@@ -0,0 +1,346 @@
+#include "Sheet.hpp"
+
+#include "FormulaParser.hpp"
+#include "Lexer.hpp"
+#include "Optimizer.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+
+void rjcpt::Sheet::SetColumn(std::string_view aName, std::vector<double> aValues)
+{
+   const std::uint32_t slot   = ColumnSlot(aName);
+   ColumnData&         column = mColumns[slot];
+   column.mValues    = std::move(aValues);
+   column.mInputRows = column.mValues.size();
+   if (!column.mFormula.empty())
+   {
+      column.mFormula.clear();
+      column.mProgram.mCode.clear();
+      column.mProgram.mConstants.clear();
+      column.mThreaded.reset();
+      mGraph.SetDependencies(column.mNode, {});
+   }
+   mGraph.MarkDirty(column.mNode);
+   UpdateRowCount();
+}
+
+void rjcpt::Sheet::SetParameter(std::string_view aName, double aValue)
+{
+   const std::uint32_t name = mNames.Intern(aName);
+   if (name == mSymbols.size())
+   {
+      const auto slot = static_cast<std::uint32_t>(mParameters.size());
+      mParameters.push_back(ParameterData{name, mGraph.AddNode()});
+      mParameterValues.push_back(aValue);
+      mNodeSymbols.push_back(Symbol{SymbolKind::Parameter, slot});
+      mSymbols.push_back(Symbol{SymbolKind::Parameter, slot});
+      return;
+   }
+   if (mSymbols[name].mKind != SymbolKind::Parameter)
+   {
+      throw std::invalid_argument("Not a parameter: " + std::string(aName));
+   }
+   const std::uint32_t slot = mSymbols[name].mSlot;
+   if (std::bit_cast<std::uint64_t>(mParameterValues[slot]) != std::bit_cast<std::uint64_t>(aValue))
+   {
+      mParameterValues[slot] = aValue;
+      mGraph.MarkDirty(mParameters[slot].mNode);
+   }
+}
+
+std::expected<void, std::string> rjcpt::Sheet::SetFormula(std::string_view aName, std::string_view aFormula)
+{
+   RJCPT_TRACE_SAMPLED_SCOPE("SetFormula");
+   std::vector<std::string_view> references;
+   // Compiled straight into the sheet's memory, so that assigning it to the column only moves pointers.
+   auto program = mFormulaCache ? mFormulaCache->Compile(aFormula, *this, mProgramMemory.get(), references)
+                                : CompileFormula(aFormula, references);
+   if (!program)
+   {
+      return std::unexpected(program.error());
+   }
+   return InstallFormula(aName, aFormula, std::move(*program), references);
+}
+
+std::expected<void, std::string> rjcpt::Sheet::SetFormula(std::string_view          aName,
+                                                          std::string_view          aFormula,
+                                                          const PrecompiledFormula& aCompiled)
+{
+   RJCPT_TRACE_SAMPLED_SCOPE("SetFormula");
+   auto program = BindFormula(aCompiled, *this, mProgramMemory.get());
+   if (!program)
+   {
+      // Compiling the text reports the error.
+      return SetFormula(aName, aFormula);
+   }
+   std::vector<std::string_view> references(aCompiled.mNames.begin(), aCompiled.mNames.end());
+   return InstallFormula(aName, aFormula, std::move(*program), references);
+}
+
+std::expected<void, std::string> rjcpt::Sheet::InstallFormula(std::string_view                  aName,
+                                                              std::string_view                  aFormula,
+                                                              Program&&                         aProgram,
+                                                              std::span<const std::string_view> aReferences)
+{
+   std::vector<DependencyGraph::NodeId> dependencies;
+   for (const std::string_view reference : aReferences)
+   {
+      // Every reference resolved, or compilation would have failed.
+      const Symbol symbol = Resolve(reference);
+      dependencies.push_back(symbol.mKind == SymbolKind::Column ? mColumns[symbol.mSlot].mNode : mParameters[symbol.mSlot].mNode);
+   }
+
+   const Symbol existing = Resolve(aName);
+   if (existing.mKind != SymbolKind::Unknown)
+   {
+      if (existing.mKind != SymbolKind::Column)
+      {
+         return std::unexpected("Not a column: " + std::string(aName));
+      }
+      if (!mGraph.SetDependencies(mColumns[existing.mSlot].mNode, dependencies))
+      {
+         return std::unexpected("Circular reference in formula for " + std::string(aName));
+      }
+   }
+   else
+   {
+      // A new column cannot be part of a cycle, since nothing refers to it yet.
+      mGraph.SetDependencies(mColumns[ColumnSlot(aName)].mNode, dependencies);
+   }
+
+   ColumnData& column   = mColumns[Resolve(aName).mSlot];
+   const bool  wasInput = column.mFormula.empty() && !column.mValues.empty();
+   column.mFormula = aFormula;
+   column.mProgram = std::move(aProgram);
+   column.mThreaded.reset();
+   column.mEvaluatedRows = 0;
+   column.mTierTried     = false;
+   // Only input columns count towards the row count, so it can only change if this one was an input column.
+   // Checking every column for every formula would make loading a workbook quadratic.
+   if (wasInput)
+   {
+      UpdateRowCount();
+   }
+   return {};
+}
+
+std::expected<rjcpt::Program, std::string> rjcpt::Sheet::CompileFormula(std::string_view               aFormula,
+                                                                        std::vector<std::string_view>& aReferences)
+{
+   mScratch->Reset();
+   // Lexed as it is parsed, so a formula with an error is only read up to the error.
+   const auto parsed = ParseFormula(aFormula, *mScratch, mParserEngine);
+   if (!parsed)
+   {
+      return std::unexpected(parsed.error());
+   }
+   auto retval = rjcpt::CompileFormula(aFormula, parsed->mTokens, parsed->mNodes, *this, mProgramMemory.get(),
+                                       &mConstants);
+   if (retval)
+   {
+      OptimizeProgram(*retval);
+      for (const Reference& reference : FindReferences(aFormula, parsed->mTokens, parsed->mNodes))
+      {
+         aReferences.push_back(reference.mName);
+      }
+   }
+   return retval;
+}
+
+std::size_t rjcpt::Sheet::Recalculate()
+{
+   RJCPT_TRACE_SCOPE("Recalculate");
+   const std::vector<const double*> columns = PrepareColumns();
+   const EvaluationContext context{columns, mParameterValues, 0};
+
+   std::size_t retval = 0;
+   for (const DependencyGraph::NodeId node : mGraph.TakeDirty())
+   {
+      const Symbol symbol = mNodeSymbols[node];
+      if (symbol.mKind == SymbolKind::Column && !mColumns[symbol.mSlot].mFormula.empty())
+      {
+         ColumnData& column = mColumns[symbol.mSlot];
+         TierUp(column);
+         if (column.mThreaded)
+         {
+            mEvaluator.Evaluate(*column.mThreaded, context, column.mValues);
+         }
+         else
+         {
+            mEvaluator.Evaluate(column.mProgram, context, column.mValues);
+         }
+         ++retval;
+      }
+   }
+   return retval;
+}
+
+std::size_t rjcpt::Sheet::Recalculate(ThreadPool& aPool, std::size_t aChunkRows)
+{
+   RJCPT_TRACE_SCOPE("Recalculate");
+   constexpr std::uint32_t cNO_TASK = 0xFFFFFFFFU;
+   const std::vector<const double*> columns = PrepareColumns();
+
+   // One task per dirty formula column. Input columns and parameters have no dependencies of their own,
+   // so formula columns only need to wait for other formula columns.
+   std::vector<std::uint32_t> taskOfNode(mGraph.Size(), cNO_TASK);
+   std::vector<std::uint32_t> taskSlots;
+   std::vector<GraphTask>     tasks;
+   for (const DependencyGraph::NodeId node : mGraph.TakeDirty())
+   {
+      const Symbol symbol = mNodeSymbols[node];
+      if (symbol.mKind != SymbolKind::Column || mColumns[symbol.mSlot].mFormula.empty())
+      {
+         continue;
+      }
+      TierUp(mColumns[symbol.mSlot]);
+      const auto task = static_cast<std::uint32_t>(tasks.size());
+      taskOfNode[node] = task;
+      taskSlots.push_back(symbol.mSlot);
+      auto& graphTask = tasks.emplace_back();
+      graphTask.mRows = mRowCount;
+      // Dependencies come earlier in the dirty list, so their tasks already exist.
+      for (const DependencyGraph::NodeId dependency : mGraph.Dependencies(node))
+      {
+         if (taskOfNode[dependency] != cNO_TASK)
+         {
+            ++graphTask.mDependencyCount;
+            tasks[taskOfNode[dependency]].mDependents.push_back(task);
+         }
+      }
+   }
+
+   std::vector<ColumnEvaluator> evaluators(aPool.ThreadCount());
+   RunTaskGraph(aPool, tasks, aChunkRows, [&](std::size_t aTask, std::size_t aBegin, std::size_t aEnd, std::size_t aWorker)
+      {
+         ColumnData& column = mColumns[taskSlots[aTask]];
+         const EvaluationContext context{columns, mParameterValues, aBegin};
+         const std::span<double> output = std::span<double>(column.mValues).subspan(aBegin, aEnd - aBegin);
+         if (column.mThreaded)
+         {
+            evaluators[aWorker].Evaluate(*column.mThreaded, context, output);
+         }
+         else
+         {
+            evaluators[aWorker].Evaluate(column.mProgram, context, output);
+         }
+      });
+   return tasks.size();
+}
+
+void rjcpt::Sheet::TierUp(ColumnData& aColumn)
+{
+   if (!aColumn.mTierTried && aColumn.mEvaluatedRows >= mThreadedTierRows)
+   {
+      // Programs the translation doesn't support stay interpreted.
+      aColumn.mThreaded  = ThreadedProgram::Compile(aColumn.mProgram, mEvaluator.Level());
+      aColumn.mTierTried = true;
+   }
+   aColumn.mEvaluatedRows += mRowCount;
+}
+
+std::span<const double> rjcpt::Sheet::Column(std::string_view aName) const
+{
+   const Symbol symbol = Resolve(aName);
+   return symbol.mKind == SymbolKind::Column ? std::span<const double>(mColumns[symbol.mSlot].mValues) : std::span<const double>();
+}
+
+std::string_view rjcpt::Sheet::Formula(std::string_view aName) const
+{
+   const Symbol symbol = Resolve(aName);
+   return symbol.mKind == SymbolKind::Column ? std::string_view(mColumns[symbol.mSlot].mFormula) : std::string_view();
+}
+
+double rjcpt::Sheet::Parameter(std::string_view aName) const
+{
+   const Symbol symbol = Resolve(aName);
+   return symbol.mKind == SymbolKind::Parameter ? mParameterValues[symbol.mSlot] : std::nan("");
+}
+
+bool rjcpt::Sheet::IsDirty(std::string_view aName) const
+{
+   const Symbol symbol = Resolve(aName);
+   switch (symbol.mKind)
+   {
+   case SymbolKind::Column:
+      return !mColumns[symbol.mSlot].mFormula.empty() && mGraph.IsDirty(mColumns[symbol.mSlot].mNode);
+   default:
+      return false;
+   }
+}
+
+bool rjcpt::Sheet::IsThreaded(std::string_view aName) const
+{
+   const Symbol symbol = Resolve(aName);
+   return symbol.mKind == SymbolKind::Column && mColumns[symbol.mSlot].mThreaded.has_value();
+}
+
+rjcpt::Symbol rjcpt::Sheet::Resolve(std::string_view aName) const
+{
+   const std::uint32_t name = mNames.Find(aName);
+   return name == Interner::cNOT_FOUND ? Symbol() : mSymbols[name];
+}
+
+std::uint32_t rjcpt::Sheet::ColumnSlot(std::string_view aName)
+{
+   const std::uint32_t name = mNames.Intern(aName);
+   if (name < mSymbols.size())
+   {
+      if (mSymbols[name].mKind != SymbolKind::Column)
+      {
+         throw std::invalid_argument("Not a column: " + std::string(aName));
+      }
+      return mSymbols[name].mSlot;
+   }
+   const auto slot = static_cast<std::uint32_t>(mColumns.size());
+   // The program is constructed with the sheet's memory, since assigning to it later keeps its memory resource.
+   mColumns.emplace_back(name, std::vector<double>(), std::string(), Program(mProgramMemory.get()), mGraph.AddNode());
+   mNodeSymbols.push_back(Symbol{SymbolKind::Column, slot});
+   mSymbols.push_back(Symbol{SymbolKind::Column, slot});
+   return slot;
+}
+
+void rjcpt::Sheet::UpdateRowCount()
+{
+   std::size_t rows = 0;
+   for (const ColumnData& column : mColumns)
+   {
+      if (column.mFormula.empty())
+      {
+         rows = std::max(rows, column.mInputRows);
+      }
+   }
+   const bool changed = rows != mRowCount;
+   mRowCount = rows;
+   for (ColumnData& column : mColumns)
+   {
+      if (column.mFormula.empty())
+      {
+         // Formulas read every row of their inputs, so short input columns are padded. Padding is dropped again
+         // when the row count shrinks, since it is computed from mInputRows.
+         column.mValues.resize(mRowCount, std::nan(""));
+      }
+      else if (changed)
+      {
+         mGraph.MarkDirty(column.mNode);
+      }
+   }
+}
+
+std::vector<const double*> rjcpt::Sheet::PrepareColumns()
+{
+   std::vector<const double*> retval(mColumns.size());
+   for (std::size_t i = 0; i < mColumns.size(); i++)
+   {
+      if (!mColumns[i].mFormula.empty())
+      {
+         mColumns[i].mValues.resize(mRowCount);
+      }
+      retval[i] = mColumns[i].mValues.data();
+   }
+   return retval;
+}
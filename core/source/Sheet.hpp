@@ -0,0 +1,146 @@
+#pragma once
+
+#include "Arena.hpp"
+#include "ColumnEvaluator.hpp"
+#include "Compiler.hpp"
+#include "DependencyGraph.hpp"
+#include "FormulaCache.hpp"
+#include "Interner.hpp"
+#include "ThreadPool.hpp"
+
+#include <expected>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "rjcpt_core_export.h"
+
+namespace rjcpt
+{
+   //! A sheet of CPT data: named columns with one value per row (depth), and named parameters.
+   //! Columns are either input data, or are computed by a formula from other columns and parameters.
+   //! Formula columns are only recomputed by Recalculate(), and only if something they depend on has changed.
+   class RJCPT_CORE_EXPORT Sheet : public SymbolResolver
+   {
+   public:
+      //! Returns the number of rows, which is the length of the longest input column.
+      std::size_t RowCount() const { return mRowCount; }
+
+      //! Sets the values of an input column, creating it if needed.
+      //! If the column had a formula, the formula is removed.
+      //! Throws if aName is already used by a parameter.
+      void SetColumn(std::string_view aName, std::vector<double> aValues);
+
+      //! Sets the value of a parameter, creating it if needed.
+      //! Throws if aName is already used by a column.
+      void SetParameter(std::string_view aName, double aValue);
+
+      //! Sets the formula that computes a column, creating the column if needed.
+      //! Fails if the formula cannot be compiled, refers to an unknown name, or would create a circular reference.
+      //! On failure, the sheet is left unchanged.
+      std::expected<void, std::string> SetFormula(std::string_view aName, std::string_view aFormula);
+      //! Same as above, but binds aCompiled, which was precompiled from aFormula, instead of parsing aFormula.
+      std::expected<void, std::string> SetFormula(std::string_view aName, std::string_view aFormula,
+                                                  const PrecompiledFormula& aCompiled);
+
+      //! Compiles formulas with aCache from now on, so that formulas of the same shape, in this sheet or others
+      //! sharing the cache, are only parsed and compiled once. aCache must outlive the sheet. Null stops using it.
+      void SetFormulaCache(FormulaCache* aCache) { mFormulaCache = aCache; }
+      //! The engine that formulas are parsed with from now on, when they are not compiled with a cache.
+      void SetParserEngine(ParserEngine aEngine) { mParserEngine = aEngine; }
+
+      //! Formulas are interpreted until they have been evaluated over this many rows in total, and are then translated
+      //! into a ThreadedProgram, which evaluates them faster. Changing a formula starts its count again.
+      static constexpr std::uint64_t cDEFAULT_THREADED_TIER_ROWS = 1'000'000;
+      //! 0 translates every formula before its first evaluation. The maximum value never translates any.
+      void SetThreadedTierRows(std::uint64_t aRows) { mThreadedTierRows = aRows; }
+
+      //! Number of rows per task when a column is recomputed in parallel.
+      static constexpr std::size_t cDEFAULT_CHUNK_ROWS = 16384;
+
+      //! Recomputes every formula column that is out of date, in dependency order.
+      //! Returns the number of columns recomputed.
+      std::size_t Recalculate();
+      //! Same as Recalculate(), but runs on aPool. Columns that don't depend on each other are computed at the same
+      //! time, and long columns are split into chunks of aChunkRows rows.
+      //! The results do not depend on the number of threads or the chunk size.
+      std::size_t Recalculate(ThreadPool& aPool, std::size_t aChunkRows = cDEFAULT_CHUNK_ROWS);
+
+      //! Returns the values of a column, or an empty span if there is no such column.
+      std::span<const double> Column(std::string_view aName) const;
+      //! Returns the formula of a column, or an empty string for input columns.
+      std::string_view        Formula(std::string_view aName) const;
+      //! Returns the value of a parameter, or NaN if there is no such parameter.
+      double                  Parameter(std::string_view aName) const;
+
+      //! Returns true if the column will be recomputed by the next Recalculate().
+      bool IsDirty(std::string_view aName) const;
+      //! Returns true if the column's formula has been translated into a ThreadedProgram.
+      bool IsThreaded(std::string_view aName) const;
+
+      Symbol Resolve(std::string_view aName) const override;
+
+   private:
+      struct ColumnData
+      {
+         std::uint32_t         mName = 0; // Id in mNames.
+         std::vector<double>   mValues;
+         std::string           mFormula; // Empty for input columns.
+         Program               mProgram;
+         DependencyGraph::NodeId mNode = 0;
+         std::optional<ThreadedProgram> mThreaded;     // Translated once mEvaluatedRows reaches the tier threshold.
+         std::uint64_t                  mEvaluatedRows = 0;
+         bool                           mTierTried     = false; // Translation was attempted, whether it succeeded or not.
+         std::size_t                    mInputRows     = 0; // Rows set for an input column, before it was padded.
+      };
+      struct ParameterData
+      {
+         std::uint32_t           mName = 0; // Id in mNames.
+         DependencyGraph::NodeId mNode = 0;
+      };
+
+      //! Returns the slot of the named column, creating it if needed.
+      std::uint32_t ColumnSlot(std::string_view aName);
+      //! Updates mRowCount from the lengths the input columns were set with, and pads or truncates them to it.
+      //! Marks all formula columns dirty if it changed.
+      void          UpdateRowCount();
+      //! Sizes formula columns for the current row count, and returns a pointer to each column indexed by slot.
+      std::vector<const double*> PrepareColumns();
+      //! Counts the rows aColumn is about to be evaluated over, translating its formula first if it is due.
+      void          TierUp(ColumnData& aColumn);
+      //! Sets the formula of a column to a compiled program, which reads from aReferences.
+      std::expected<void, std::string> InstallFormula(std::string_view aName, std::string_view aFormula,
+                                                      Program&& aProgram, std::span<const std::string_view> aReferences);
+      //! Compiles and optimizes a formula without a cache, and lists the names it reads from.
+      std::expected<Program, std::string> CompileFormula(std::string_view               aFormula,
+                                                         std::vector<std::string_view>& aReferences);
+
+      //! Tokens and parse nodes of the formula being set. Reset by every SetFormula.
+      std::unique_ptr<Arena> mScratch = std::make_unique<Arena>();
+      FormulaCache*          mFormulaCache = nullptr;
+      ParserEngine           mParserEngine = ParserEngine::Grammar;
+      //! Compiled programs of all columns, kept together. A pool rather than an Arena, since replacing a formula
+      //! frees its old program. Declared before mColumns, which must be destroyed first.
+      std::unique_ptr<std::pmr::unsynchronized_pool_resource> mProgramMemory =
+         std::make_unique<std::pmr::unsynchronized_pool_resource>();
+
+      //! Names of columns and parameters. Resolving a name hashes it once, rather than comparing it with names in a
+      //! tree, which matters for workbooks with hundreds of columns.
+      Interner                   mNames;
+      std::vector<Symbol>        mSymbols;         // Indexed by name id.
+      //! Values of the number literals in the formulas compiled without a cache, each converted once.
+      ConstantPool               mConstants;
+      std::vector<ColumnData>    mColumns;         // Indexed by column slot.
+      std::vector<ParameterData> mParameters;      // Indexed by parameter slot.
+      std::vector<double>        mParameterValues; // Indexed by parameter slot.
+      std::vector<Symbol>        mNodeSymbols;     // Indexed by DependencyGraph::NodeId.
+      DependencyGraph            mGraph;
+      ColumnEvaluator            mEvaluator;
+      std::size_t                mRowCount = 0;
+      std::uint64_t              mThreadedTierRows = cDEFAULT_THREADED_TIER_ROWS;
+   };
+}
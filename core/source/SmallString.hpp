@@ -1,23 +1,28 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <compare>
+#include <cstdint>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 
 namespace rjcpt
 {
+//! A string of fewer than N characters, stored inline. Usable in constant expressions.
 template<std::size_t N>
 class SmallString
 {
+   static_assert(N <= 256, "The length is stored in a byte.");
 public:
    SmallString() = default;
-   SmallString(std::string_view aView)
+   constexpr SmallString(std::string_view aView)
    {
       if (aView.size() < N - 1)
       {
          std::ranges::copy(aView, mData.begin());
+         mSize = static_cast<std::uint8_t>(aView.size());
       }
       else
       {
@@ -25,12 +30,13 @@ public:
       }
    }
    template<std::size_t K>
-   explicit(K > N) SmallString(const SmallString<K>& aOther)
+   constexpr explicit(K > N) SmallString(const SmallString<K>& aOther)
    {
       auto sv = aOther.view();
       if (sv.size() < N - 1)
       {
          std::ranges::copy(sv, mData.begin());
+         mSize = static_cast<std::uint8_t>(sv.size());
       }
       else
       {
@@ -38,27 +44,28 @@ public:
       }
    }
 
-   std::string_view view() const
+   constexpr std::string_view view() const
    {
-      return std::string_view(mData.data());
+      return std::string_view(mData.data(), mSize);
    }
-   std::string str() const
+   constexpr std::string str() const
    {
-      return std::string(mData.data());
+      return std::string(view());
    }
 
    template<std::size_t R>
-   friend bool operator==(const SmallString<N>& aLeft, const SmallString<R>& aRight)
+   friend constexpr bool operator==(const SmallString<N>& aLeft, const SmallString<R>& aRight)
    {
       return aLeft.view() == aRight.view();
    }
    template<std::size_t R>
-   friend auto operator<=>(const SmallString<N>& aLeft, const SmallString<R>& aRight)
+   friend constexpr auto operator<=>(const SmallString<N>& aLeft, const SmallString<R>& aRight)
    {
       return aLeft.view() <=> aRight.view();
    }
 private:
    std::array<char, N> mData = {};
+   std::uint8_t        mSize = 0; // Kept so that comparisons don't need to look for the terminator.
 };
 }
 
@@ -1,16 +1,42 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdlib>
+#include <memory>
+#include <span>
 #include <stdexcept>
 
 namespace rjcpt
 {
+//! A stack that keeps up to N items inline, and moves them to the heap when it grows past that.
+//! The heap block is kept until the stack is destroyed, so a stack that is cleared and reused only allocates when it
+//! grows past its largest size so far.
+//! Pop and Top check for an empty stack in debug builds only.
 template<typename T, std::size_t N>
 class Stack
 {
 public:
+   Stack() = default;
+   Stack(const Stack& aOther) { *this = aOther; }
+   Stack& operator=(const Stack& aOther)
+   {
+      if (this != &aOther)
+      {
+         mCount = 0;
+         Reserve(aOther.mCount);
+         std::copy_n(aOther.mData, aOther.mCount, mData);
+         mCount = aOther.mCount;
+      }
+      return *this;
+   }
+
    std::size_t Size() const { return mCount; }
-   constexpr static std::size_t Capacity() { return N; }
+   //! The number of items the stack can hold before it next allocates.
+   std::size_t Capacity() const { return mCapacity; }
+   constexpr static std::size_t InlineCapacity() { return N; }
+   //! The items from the bottom of the stack to the top.
+   std::span<const T> Items() const { return std::span<const T>(mData, mCount); }
+   void Clear() { mCount = 0; }
 
    template<typename... Args>
    T& Emplace(Args&&... aArgs)
@@ -20,47 +46,85 @@ public:
    }
    void Push(const T& aValue)
    {
-      if (mCount < N)
-      {
-         mData[mCount] = aValue;
-         ++mCount;
-      }
-      else
+      if (mCount == mCapacity)
       {
-         throw std::runtime_error("Stack is full.");
+         // Copy first, since aValue may refer to an item.
+         const T value = aValue;
+         Reserve(mCapacity * 2);
+         mData[mCount++] = value;
+         return;
       }
+      mData[mCount++] = aValue;
    }
    const T& Top() const
    {
-      if (mCount > 0)
-      {
-         return mData[mCount - 1];
-      }
-      throw std::logic_error("Empty stack.");
+      CheckNotEmpty();
+      return mData[mCount - 1];
    }
    T& Top()
    {
-      if (mCount > 0)
-      {
-         return mData[mCount - 1];
-      }
-      throw std::logic_error("Empty stack.");
+      CheckNotEmpty();
+      return mData[mCount - 1];
    }
+   //! Removes the top item. The reference stays valid until the next Push.
    const T& Pop()
    {
-      if (mCount > 0)
+      CheckNotEmpty();
+      return mData[--mCount];
+   }
+
+private:
+   void CheckNotEmpty() const
+   {
+#ifndef NDEBUG
+      if (mCount == 0)
       {
-         --mCount;
-         return mData[mCount];
+         throw std::logic_error("Empty stack.");
       }
-      else
+#endif
+   }
+
+   void Reserve(std::size_t aCapacity)
+   {
+      if (aCapacity <= mCapacity)
       {
-         throw std::logic_error("Empty stack.");
+         return;
       }
+      auto heap = std::make_unique<T[]>(aCapacity);
+      std::copy_n(mData, mCount, heap.get());
+      mHeap     = std::move(heap);
+      mData     = mHeap.get();
+      mCapacity = aCapacity;
+   }
+
+   T                    mInline[N];
+   std::unique_ptr<T[]> mHeap;
+   T*                   mData     = mInline;
+   std::size_t          mCapacity = N;
+   std::size_t          mCount    = 0;
+};
+
+//! A buffer whose size is fixed when it is created, kept inline if it is at most N items, and on the heap otherwise,
+//! for scratch memory that is usually small but has no upper bound. Items are left uninitialized.
+template<typename T, std::size_t N>
+class InlineBuffer
+{
+public:
+   explicit InlineBuffer(std::size_t aSize)
+      : mHeap(aSize > N ? std::make_unique_for_overwrite<T[]>(aSize) : nullptr)
+      , mData(mHeap ? mHeap.get() : mInline)
+   {
    }
+   InlineBuffer(const InlineBuffer&) = delete;
+   InlineBuffer& operator=(const InlineBuffer&) = delete;
+
+   T*       Data() { return mData; }
+   T&       operator[](std::size_t aIndex) { return mData[aIndex]; }
+   const T& operator[](std::size_t aIndex) const { return mData[aIndex]; }
 
 private:
-   T mData[N];
-   std::size_t mCount = 0;
+   T                    mInline[N];
+   std::unique_ptr<T[]> mHeap;
+   T*                   mData;
 };
 }
@@ -0,0 +1,185 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+   // The pool and worker index of the current thread, if it is a worker.
+   thread_local const rjcpt::ThreadPool* tCurrentPool   = nullptr;
+   thread_local std::size_t              tCurrentWorker = 0;
+}
+
+rjcpt::ThreadPool::ThreadPool(std::size_t aThreads)
+{
+   aThreads = std::max<std::size_t>(aThreads, 1);
+   for (std::size_t i = 0; i < aThreads; i++)
+   {
+      mWorkers.push_back(std::make_unique<Worker>());
+   }
+   mThreads.reserve(aThreads);
+   for (std::size_t i = 0; i < aThreads; i++)
+   {
+      mThreads.emplace_back(&ThreadPool::Run, this, i);
+   }
+}
+
+rjcpt::ThreadPool::~ThreadPool()
+{
+   {
+      std::lock_guard lock(mMutex);
+      mStopping = true;
+   }
+   mWake.notify_all();
+   for (auto& thread : mThreads)
+   {
+      thread.join();
+   }
+}
+
+void rjcpt::ThreadPool::Submit(Task aTask)
+{
+   std::size_t index = tCurrentPool == this ? tCurrentWorker : 0;
+   {
+      // Counted before the task is queued, so that it cannot be taken and finished first, which would let
+      // Wait() return while it, or a task it submits, is still running. Counted under mMutex so that a
+      // worker about to sleep cannot miss the task.
+      std::lock_guard lock(mMutex);
+      if (tCurrentPool != this)
+      {
+         index = mNextWorker;
+         mNextWorker = (mNextWorker + 1) % mWorkers.size();
+      }
+      ++mPending;
+      ++mQueued;
+   }
+   {
+      std::lock_guard lock(mWorkers[index]->mMutex);
+      mWorkers[index]->mTasks.push_back(std::move(aTask));
+   }
+   mWake.notify_one();
+}
+
+void rjcpt::ThreadPool::Wait()
+{
+   std::unique_lock lock(mMutex);
+   mIdle.wait(lock, [this] { return mPending == 0; });
+   if (mError)
+   {
+      std::rethrow_exception(std::exchange(mError, nullptr));
+   }
+}
+
+bool rjcpt::ThreadPool::TryTake(std::size_t aIndex, Task& aTask)
+{
+   {
+      Worker& own = *mWorkers[aIndex];
+      std::lock_guard lock(own.mMutex);
+      if (!own.mTasks.empty())
+      {
+         aTask = std::move(own.mTasks.back());
+         own.mTasks.pop_back();
+         return true;
+      }
+   }
+   for (std::size_t offset = 1; offset < mWorkers.size(); offset++)
+   {
+      Worker& victim = *mWorkers[(aIndex + offset) % mWorkers.size()];
+      std::lock_guard lock(victim.mMutex);
+      if (!victim.mTasks.empty())
+      {
+         aTask = std::move(victim.mTasks.front());
+         victim.mTasks.pop_front();
+         return true;
+      }
+   }
+   return false;
+}
+
+void rjcpt::ThreadPool::Run(std::size_t aIndex)
+{
+   tCurrentPool   = this;
+   tCurrentWorker = aIndex;
+   while (true)
+   {
+      Task task;
+      if (TryTake(aIndex, task))
+      {
+         --mQueued;
+         try
+         {
+            task(aIndex);
+         }
+         catch (...)
+         {
+            std::lock_guard lock(mMutex);
+            if (!mError)
+            {
+               mError = std::current_exception();
+            }
+         }
+         std::lock_guard lock(mMutex);
+         if (--mPending == 0)
+         {
+            mIdle.notify_all();
+         }
+         continue;
+      }
+      std::unique_lock lock(mMutex);
+      mWake.wait(lock, [this] { return mStopping || mQueued > 0; });
+      if (mStopping && mQueued == 0)
+      {
+         return;
+      }
+   }
+}
+
+void rjcpt::RunTaskGraph(ThreadPool&                    aPool,
+                         std::span<const GraphTask>     aTasks,
+                         std::size_t                    aChunkRows,
+                         const std::function<void(std::size_t, std::size_t, std::size_t, std::size_t)>& aWork)
+{
+   aChunkRows = std::max<std::size_t>(aChunkRows, 1);
+   std::vector<std::atomic<std::uint32_t>> waiting(aTasks.size());
+   std::vector<std::atomic<std::size_t>>   chunksLeft(aTasks.size());
+   for (std::size_t i = 0; i < aTasks.size(); i++)
+   {
+      waiting[i] = aTasks[i].mDependencyCount;
+   }
+
+   std::function<void(std::size_t)> start = [&](std::size_t aTask)
+      {
+         const std::size_t rows   = aTasks[aTask].mRows;
+         const std::size_t chunks = std::max<std::size_t>((rows + aChunkRows - 1) / aChunkRows, 1);
+         chunksLeft[aTask] = chunks;
+         for (std::size_t c = 0; c < chunks; c++)
+         {
+            aPool.Submit([&, aTask, c, rows](std::size_t aWorker)
+               {
+                  const std::size_t begin = std::min(c * aChunkRows, rows);
+                  const std::size_t end   = std::min(begin + aChunkRows, rows);
+                  aWork(aTask, begin, end, aWorker);
+                  // The last chunk to finish releases the task's dependents.
+                  if (--chunksLeft[aTask] == 0)
+                  {
+                     for (const std::uint32_t dependent : aTasks[aTask].mDependents)
+                     {
+                        if (--waiting[dependent] == 0)
+                        {
+                           start(dependent);
+                        }
+                     }
+                  }
+               });
+         }
+      };
+
+   for (std::size_t i = 0; i < aTasks.size(); i++)
+   {
+      if (aTasks[i].mDependencyCount == 0)
+      {
+         start(i);
+      }
+   }
+   aPool.Wait();
+}
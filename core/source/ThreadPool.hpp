@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "rjcpt_core_export.h"
+
+namespace rjcpt
+{
+   //! A fixed set of worker threads that run submitted tasks.
+   //! Each worker has its own queue. Workers run their newest task first, and when their queue is empty,
+   //! steal the oldest task from another worker.
+   class RJCPT_CORE_EXPORT ThreadPool
+   {
+   public:
+      //! Tasks receive the index of the worker running them, in [0, ThreadCount()),
+      //! so that they can use per-worker scratch memory.
+      using Task = std::function<void(std::size_t aWorker)>;
+
+      //! Starts aThreads workers (at least one).
+      explicit ThreadPool(std::size_t aThreads = std::thread::hardware_concurrency());
+      //! Finishes all queued tasks, then stops the workers.
+      ~ThreadPool();
+
+      ThreadPool(const ThreadPool&) = delete;
+      ThreadPool& operator=(const ThreadPool&) = delete;
+
+      std::size_t ThreadCount() const { return mThreads.size(); }
+
+      //! Queues a task. Tasks submitted from a worker go to that worker's own queue.
+      void Submit(Task aTask);
+
+      //! Blocks until every submitted task, including tasks submitted by other tasks, has finished.
+      //! If a task threw an exception, rethrows the first one.
+      void Wait();
+
+   private:
+      struct Worker
+      {
+         std::mutex       mMutex;
+         std::deque<Task> mTasks;
+      };
+
+      void Run(std::size_t aIndex);
+      bool TryTake(std::size_t aIndex, Task& aTask);
+
+      std::vector<std::unique_ptr<Worker>> mWorkers;
+      std::vector<std::thread>             mThreads;
+
+      std::mutex               mMutex;
+      std::condition_variable  mWake; // Signalled when a task is queued, or when stopping.
+      std::condition_variable  mIdle; // Signalled when the last pending task finishes.
+      std::atomic<std::size_t> mQueued  = 0; // Tasks waiting in a queue, or about to be queued.
+      std::size_t              mPending = 0; // Tasks submitted but not finished. Guarded by mMutex.
+      std::size_t              mNextWorker = 0; // Queue for the next task submitted from outside the pool.
+      bool                     mStopping = false;
+      std::exception_ptr       mError;
+   };
+
+   //! A node in a graph of tasks run by RunTaskGraph.
+   struct GraphTask
+   {
+      //! Number of rows of work. Tasks are split into chunks of rows that can run in parallel.
+      std::size_t                mRows = 0;
+      //! Number of tasks that must finish before this one can start.
+      std::uint32_t              mDependencyCount = 0;
+      //! Tasks that wait for this one.
+      std::vector<std::uint32_t> mDependents;
+   };
+
+   //! Runs every task in aTasks on aPool, starting each task once all of its dependencies have finished.
+   //! Each task's rows are split into chunks of at most aChunkRows, and aWork is called once per chunk
+   //! with (task index, first row, end row, worker index). Blocks until all tasks have finished.
+   RJCPT_CORE_EXPORT void RunTaskGraph(ThreadPool&                    aPool,
+                                       std::span<const GraphTask>     aTasks,
+                                       std::size_t                    aChunkRows,
+                                       const std::function<void(std::size_t, std::size_t, std::size_t, std::size_t)>& aWork);
+}
@@ -58,5 +58,7 @@ namespace rjcpt
       TokenType     mType       = TokenType::Error;
       std::uint32_t mStartIndex = 0;
       std::uint32_t mLength     = 0;
+
+      friend bool operator==(const Token&, const Token&) = default;
    };
 }
@@ -0,0 +1,258 @@
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define RJCPT_X86_64 1
+#else
+#define RJCPT_X86_64 0
+#endif
+
+namespace
+{
+   using rjcpt::trace::Counter;
+   using rjcpt::trace::Counters;
+
+   struct Event
+   {
+      const char*   mName  = nullptr;
+      std::uint64_t mBegin = 0;
+      std::uint64_t mEnd   = 0;
+   };
+
+   //! The events and counters of one thread. Only that thread writes to it.
+   struct ThreadBuffer
+   {
+      std::uint32_t      mThreadId = 0;
+      std::vector<Event> mEvents;   // A ring buffer once it reaches cMAX_EVENTS_PER_THREAD.
+      std::size_t        mNext = 0; // Where the next event goes once the buffer is full.
+      Counters           mCounters{};
+   };
+
+   //! Owns the buffers of every thread that recorded anything, so that they outlive their threads.
+   struct Registry
+   {
+      std::mutex                                 mMutex;
+      std::vector<std::unique_ptr<ThreadBuffer>> mBuffers;
+   };
+
+   Registry& GetRegistry()
+   {
+      static Registry registry;
+      return registry;
+   }
+
+   thread_local ThreadBuffer* tBuffer = nullptr;
+
+   ThreadBuffer& LocalBuffer()
+   {
+      if (!tBuffer)
+      {
+         Registry&        registry = GetRegistry();
+         std::lock_guard  lock(registry.mMutex);
+         auto&            buffer = registry.mBuffers.emplace_back(std::make_unique<ThreadBuffer>());
+         buffer->mThreadId = static_cast<std::uint32_t>(registry.mBuffers.size());
+         // Allocated up front, so that recording an event never allocates.
+         buffer->mEvents.reserve(rjcpt::trace::cMAX_EVENTS_PER_THREAD);
+         tBuffer = buffer.get();
+      }
+      return *tBuffer;
+   }
+
+   std::uint64_t SteadyNanoseconds()
+   {
+      return static_cast<std::uint64_t>(
+         std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+   }
+
+   //! A timestamp in both ticks and nanoseconds, to convert one to the other.
+   struct ClockPoint
+   {
+      std::uint64_t mTicks       = rjcpt::trace::Now();
+      std::uint64_t mNanoseconds = SteadyNanoseconds();
+   };
+
+   //! Taken when the library is loaded. Exported times are relative to it.
+   const ClockPoint cORIGIN;
+
+   //! Microseconds per tick, measured between cORIGIN and now.
+   double MicrosecondsPerTick()
+   {
+#if RJCPT_X86_64
+      const ClockPoint now;
+      if (now.mTicks <= cORIGIN.mTicks || now.mNanoseconds <= cORIGIN.mNanoseconds)
+      {
+         return 0.0;
+      }
+      return static_cast<double>(now.mNanoseconds - cORIGIN.mNanoseconds) * 1e-3 /
+             static_cast<double>(now.mTicks - cORIGIN.mTicks);
+#else
+      return 1e-3;
+#endif
+   }
+
+   void Accumulate(Counters& aTotal, const Counters& aCounters)
+   {
+      for (std::size_t i = 0; i < aTotal.size(); i++)
+      {
+         aTotal[i] = i == static_cast<std::size_t>(Counter::MaxParseStackDepth) ? std::max(aTotal[i], aCounters[i])
+                                                                               : aTotal[i] + aCounters[i];
+      }
+   }
+
+   //! Appends aName as a JSON string. Event names are literals, so only quotes and backslashes are escaped.
+   void AppendString(std::string& aJson, std::string_view aName)
+   {
+      aJson += '"';
+      for (const char c : aName)
+      {
+         if (c == '"' || c == '\\')
+         {
+            aJson += '\\';
+         }
+         aJson += c;
+      }
+      aJson += '"';
+   }
+
+   void AppendNumber(std::string& aJson, double aValue)
+   {
+      char buffer[32];
+      const int length = std::snprintf(buffer, sizeof(buffer), "%.3f", aValue);
+      aJson.append(buffer, static_cast<std::size_t>(length));
+   }
+
+   constexpr std::array<std::string_view, static_cast<std::size_t>(Counter::cCOUNT)> cCOUNTER_NAMES = {
+      "tokens",
+      "lexer_ticks",
+      "rule_expansions",
+      "find_rule_calls",
+      "max_parse_stack_depth",
+      "evaluated_rows"
+   };
+}
+
+std::uint64_t rjcpt::trace::Now()
+{
+#if RJCPT_X86_64
+   // The time stamp counter runs at a constant rate on every x86-64 CPU made in the last decade, and is much
+   // cheaper to read than the system clock.
+   return __rdtsc();
+#else
+   return SteadyNanoseconds();
+#endif
+}
+
+void rjcpt::trace::detail::RecordEvent(const char* aName, std::uint64_t aBegin, std::uint64_t aEnd)
+{
+   ThreadBuffer& buffer = LocalBuffer();
+   if (buffer.mEvents.size() < cMAX_EVENTS_PER_THREAD)
+   {
+      buffer.mEvents.push_back(Event{aName, aBegin, aEnd});
+   }
+   else
+   {
+      buffer.mEvents[buffer.mNext] = Event{aName, aBegin, aEnd};
+      buffer.mNext = (buffer.mNext + 1) % cMAX_EVENTS_PER_THREAD;
+   }
+}
+
+void rjcpt::trace::detail::AddCounters(const Counters& aCounters)
+{
+   Accumulate(LocalBuffer().mCounters, aCounters);
+}
+
+void rjcpt::trace::Add(Counter aCounter, std::uint64_t aValue)
+{
+   std::uint64_t& counter = LocalBuffer().mCounters[static_cast<std::size_t>(aCounter)];
+   counter = aCounter == Counter::MaxParseStackDepth ? std::max(counter, aValue) : counter + aValue;
+}
+
+rjcpt::trace::Counters rjcpt::trace::GetCounters()
+{
+   Registry&       registry = GetRegistry();
+   std::lock_guard lock(registry.mMutex);
+   Counters        retval{};
+   for (const auto& buffer : registry.mBuffers)
+   {
+      Accumulate(retval, buffer->mCounters);
+   }
+   return retval;
+}
+
+std::string rjcpt::trace::ExportChromeTrace()
+{
+   const double   microsecondsPerTick = MicrosecondsPerTick();
+   const Counters counters            = GetCounters();
+   const auto     toMicroseconds      = [&](std::uint64_t aTicks)
+   {
+      return aTicks < cORIGIN.mTicks ? 0.0 : static_cast<double>(aTicks - cORIGIN.mTicks) * microsecondsPerTick;
+   };
+
+   std::string   retval = "{\"traceEvents\":[";
+   std::uint64_t last   = cORIGIN.mTicks;
+   {
+      Registry&       registry = GetRegistry();
+      std::lock_guard lock(registry.mMutex);
+      for (const auto& buffer : registry.mBuffers)
+      {
+         for (const Event& event : buffer->mEvents)
+         {
+            retval += "\n{\"name\":";
+            AppendString(retval, event.mName);
+            retval += ",\"cat\":\"rjcpt\",\"ph\":\"X\",\"ts\":";
+            AppendNumber(retval, toMicroseconds(event.mBegin));
+            retval += ",\"dur\":";
+            AppendNumber(retval, static_cast<double>(event.mEnd - event.mBegin) * microsecondsPerTick);
+            retval += ",\"pid\":1,\"tid\":" + std::to_string(buffer->mThreadId) + "},";
+            last = std::max(last, event.mEnd);
+         }
+      }
+   }
+
+   retval += "\n{\"name\":\"counters\",\"ph\":\"C\",\"ts\":";
+   AppendNumber(retval, toMicroseconds(last));
+   retval += ",\"pid\":1,\"args\":{";
+   for (std::size_t i = 0; i < counters.size(); i++)
+   {
+      AppendString(retval, cCOUNTER_NAMES[i]);
+      retval += ':' + std::to_string(counters[i]) + (i + 1 < counters.size() ? "," : "");
+   }
+   retval += "}}\n],\"otherData\":{\"tokens_per_second\":";
+   const double lexerSeconds =
+      static_cast<double>(counters[static_cast<std::size_t>(Counter::LexerTicks)]) * microsecondsPerTick * 1e-6;
+   AppendNumber(retval,
+                lexerSeconds > 0.0 ? static_cast<double>(counters[static_cast<std::size_t>(Counter::Tokens)]) / lexerSeconds : 0.0);
+   retval += "}}\n";
+   return retval;
+}
+
+bool rjcpt::trace::WriteChromeTrace(const std::filesystem::path& aPath)
+{
+   std::ofstream file(aPath, std::ios::binary);
+   file << ExportChromeTrace();
+   return static_cast<bool>(file);
+}
+
+void rjcpt::trace::Reset()
+{
+   Registry&       registry = GetRegistry();
+   std::lock_guard lock(registry.mMutex);
+   for (const auto& buffer : registry.mBuffers)
+   {
+      buffer->mEvents.clear();
+      buffer->mNext     = 0;
+      buffer->mCounters = Counters{};
+   }
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "rjcpt_core_export.h"
+
+// Tracing is enabled by configuring with -DRJCPT_ENABLE_TRACING=ON.
+// When it is disabled, Scope and Tally are empty, and the macros below compile to nothing.
+#ifndef RJCPT_ENABLE_TRACING
+#define RJCPT_ENABLE_TRACING 0
+#endif
+
+#define RJCPT_TRACE_CONCAT_IMPL(a, b) a##b
+#define RJCPT_TRACE_CONCAT(a, b)      RJCPT_TRACE_CONCAT_IMPL(a, b)
+
+#if RJCPT_ENABLE_TRACING
+//! Records the time from here to the end of the enclosing block as an event.
+//! Takes the arguments of trace::Scope's constructor.
+#define RJCPT_TRACE_SCOPE(...) const ::rjcpt::trace::Scope RJCPT_TRACE_CONCAT(rjcptTraceScope, __LINE__)(__VA_ARGS__)
+//! The same as RJCPT_TRACE_SCOPE, but only records some of the calls. For code that runs in well under a microsecond.
+#define RJCPT_TRACE_SAMPLED_SCOPE(...) \
+   const ::rjcpt::trace::SampledScope RJCPT_TRACE_CONCAT(rjcptTraceScope, __LINE__)(__VA_ARGS__)
+//! Adds aValue to the calling thread's counter.
+#define RJCPT_TRACE_COUNT(aCounter, aValue) ::rjcpt::trace::Add(::rjcpt::trace::Counter::aCounter, aValue)
+#else
+#define RJCPT_TRACE_SCOPE(...) ((void)0)
+#define RJCPT_TRACE_SAMPLED_SCOPE(...) ((void)0)
+#define RJCPT_TRACE_COUNT(aCounter, aValue) ((void)0)
+#endif
+
+namespace rjcpt::trace
+{
+   //! Counters are kept per thread, and summed over all threads when exported.
+   enum class Counter : std::uint8_t
+   {
+      Tokens,             // Tokens produced by the lexer.
+      LexerTicks,         // Time spent in the lexer, in timestamp ticks. Estimated from sampled calls.
+      RuleExpansions,     // Non-terminals expanded by the parser.
+      FindRuleCalls,      // Calls to parser_util::FindRule.
+      MaxParseStackDepth, // Largest parser stack seen. The maximum over all threads, rather than the sum.
+      EvaluatedRows,      // Rows computed by ColumnEvaluator.
+      cCOUNT
+   };
+
+   using Counters = std::array<std::uint64_t, static_cast<std::size_t>(Counter::cCOUNT)>;
+
+   //! Events beyond this many per thread overwrite the oldest ones, so tracing can be left on.
+   inline constexpr std::size_t cMAX_EVENTS_PER_THREAD = 1 << 16;
+   //! A SampledScope records one in this many calls on each thread.
+   inline constexpr std::uint32_t cSAMPLE_INTERVAL = 64;
+
+   //! Returns the current timestamp in ticks. Ticks are converted to time when exported.
+   RJCPT_CORE_EXPORT std::uint64_t Now();
+
+   namespace detail
+   {
+      RJCPT_CORE_EXPORT void RecordEvent(const char* aName, std::uint64_t aBegin, std::uint64_t aEnd);
+      RJCPT_CORE_EXPORT void AddCounters(const Counters& aCounters);
+
+#if RJCPT_ENABLE_TRACING
+      //! Calls left until the next SampledScope on this thread is recorded.
+      inline thread_local std::uint32_t tSampleCountdown = 0;
+#endif
+   }
+
+   //! Adds aValue to one of the calling thread's counters, or raises it to aValue for MaxParseStackDepth.
+   RJCPT_CORE_EXPORT void Add(Counter aCounter, std::uint64_t aValue);
+
+#if RJCPT_ENABLE_TRACING
+   //! Records the lifetime of the object as an event named aName, which must outlive the export (usually a literal).
+   //! If aTime is given, the duration is also added to that counter.
+   class Scope
+   {
+   public:
+      explicit Scope(const char* aName, Counter aTime = Counter::cCOUNT)
+         : mName(aName)
+         , mTime(aTime)
+         , mBegin(Now())
+      {
+      }
+      ~Scope()
+      {
+         const std::uint64_t end = Now();
+         detail::RecordEvent(mName, mBegin, end);
+         if (mTime != Counter::cCOUNT)
+         {
+            Add(mTime, end - mBegin);
+         }
+      }
+
+      Scope(const Scope&) = delete;
+      Scope& operator=(const Scope&) = delete;
+
+   private:
+      const char*   mName;
+      Counter       mTime;
+      std::uint64_t mBegin;
+   };
+
+   //! Records one in cSAMPLE_INTERVAL of the objects created on each thread as an event.
+   //! Reading the timestamp costs tens of nanoseconds, which is too much to do for every token or formula.
+   //! If aTime is given, the duration times cSAMPLE_INTERVAL is added to that counter, as an estimate of the total.
+   class SampledScope
+   {
+   public:
+      explicit SampledScope(const char* aName, Counter aTime = Counter::cCOUNT)
+         : mName(aName)
+         , mTime(aTime)
+      {
+         if (detail::tSampleCountdown == 0)
+         {
+            detail::tSampleCountdown = cSAMPLE_INTERVAL - 1;
+            mBegin = Now();
+         }
+         else
+         {
+            --detail::tSampleCountdown;
+         }
+      }
+      ~SampledScope()
+      {
+         if (mBegin != 0)
+         {
+            const std::uint64_t end = Now();
+            detail::RecordEvent(mName, mBegin, end);
+            if (mTime != Counter::cCOUNT)
+            {
+               Add(mTime, (end - mBegin) * cSAMPLE_INTERVAL);
+            }
+         }
+      }
+
+      SampledScope(const SampledScope&) = delete;
+      SampledScope& operator=(const SampledScope&) = delete;
+
+   private:
+      const char*   mName;
+      Counter       mTime;
+      std::uint64_t mBegin = 0;
+   };
+
+   //! Accumulates counters locally, and adds them to the thread's counters when destroyed.
+   //! Use it in loops, where calling Add for every step would cost too much.
+   class Tally
+   {
+   public:
+      Tally() = default;
+      ~Tally() { detail::AddCounters(mCounters); }
+
+      Tally(const Tally&) = delete;
+      Tally& operator=(const Tally&) = delete;
+
+      void Add(Counter aCounter, std::uint64_t aValue) { mCounters[static_cast<std::size_t>(aCounter)] += aValue; }
+      void Max(Counter aCounter, std::uint64_t aValue)
+      {
+         std::uint64_t& value = mCounters[static_cast<std::size_t>(aCounter)];
+         value = aValue > value ? aValue : value;
+      }
+
+   private:
+      Counters mCounters{};
+   };
+#else
+   class Scope
+   {
+   public:
+      explicit Scope(const char*, Counter = Counter::cCOUNT) {}
+   };
+
+   class SampledScope
+   {
+   public:
+      explicit SampledScope(const char*, Counter = Counter::cCOUNT) {}
+   };
+
+   class Tally
+   {
+   public:
+      void Add(Counter, std::uint64_t) {}
+      void Max(Counter, std::uint64_t) {}
+   };
+#endif
+
+   //! Returns the counters summed over all threads.
+   RJCPT_CORE_EXPORT Counters GetCounters();
+
+   //! Returns the recorded events and counters as Chrome trace JSON, which can be opened in chrome://tracing or
+   //! Perfetto. The counters are added as a counter event, and the lexer throughput as "tokens_per_second".
+   //! Events should not be recorded while exporting.
+   RJCPT_CORE_EXPORT std::string ExportChromeTrace();
+   //! Writes ExportChromeTrace() to a file. Returns false if the file could not be written.
+   RJCPT_CORE_EXPORT bool WriteChromeTrace(const std::filesystem::path& aPath);
+
+   //! Discards all recorded events and counters. Events should not be recorded while resetting.
+   RJCPT_CORE_EXPORT void Reset();
+}
@@ -0,0 +1,578 @@
+#include "WorkbookTemplate.hpp"
+
+#include "Compiler.hpp"
+#include "Evaluator.hpp"
+#include "MappedFile.hpp"
+
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace
+{
+   std::string_view Trim(std::string_view aText)
+   {
+      const std::size_t begin = aText.find_first_not_of(" \t\r");
+      if (begin == std::string_view::npos)
+      {
+         return {};
+      }
+      return aText.substr(begin, aText.find_last_not_of(" \t\r") + 1 - begin);
+   }
+
+   std::string LineError(std::size_t aLine, std::string_view aMessage)
+   {
+      return "Line " + std::to_string(aLine) + ": " + std::string(aMessage);
+   }
+
+   // The compiled form, in native byte order and without padding:
+   //    magic, u64 format hash
+   //    u32 parameter count, then for each: string name, f64 value
+   //    u32 formula count, then for each: string name, string formula, u8 compiled, and if compiled:
+   //       u32 max stack depth, u32 local count
+   //       u32 instruction count, then for each: u8 opcode, u32 operand
+   //       u32 constant count, then for each: f64 value
+   //       u32 name count, then for each: string name, u8 row lookup
+   // where a string is its u32 length followed by its bytes.
+
+   //! Starts the compiled form. No text template starts with a NUL byte.
+   constexpr std::string_view cCOMPILED_MAGIC("\0RJCPT-T", 8);
+   //! Change whenever the layout above changes, or the lexer, compiler or optimizer compile formulas differently.
+   //! Changes to the grammar are noticed without it.
+   constexpr std::uint64_t cCOMPILED_FORMAT_VERSION = 1;
+
+   //! Programs stored with a different hash were compiled by another version, or for another byte order.
+   std::uint64_t CompiledFormatHash()
+   {
+      const std::uint64_t parts[] = {cCOMPILED_FORMAT_VERSION,
+                                     static_cast<std::uint64_t>(rjcpt::OpCode::cMAX_OPCODE),
+                                     static_cast<std::uint64_t>(rjcpt::BuiltinFunction::cMAX_FUNCTION),
+                                     std::endian::native == std::endian::little ? 1U : 2U};
+      std::uint64_t retval = rjcpt::FormulaGrammarHash();
+      for (const std::uint64_t part : parts)
+      {
+         retval = (retval ^ part) * 1099511628211ULL;
+      }
+      return retval;
+   }
+
+   class CompiledWriter
+   {
+   public:
+      explicit CompiledWriter(std::string& aOutput)
+         : mOutput(aOutput)
+      {
+      }
+
+      template<typename T>
+      void Write(T aValue)
+      {
+         static_assert(std::is_trivially_copyable_v<T>);
+         mOutput.append(reinterpret_cast<const char*>(&aValue), sizeof(T));
+      }
+
+      void WriteString(std::string_view aText)
+      {
+         Write(static_cast<std::uint32_t>(aText.size()));
+         mOutput.append(aText);
+      }
+
+   private:
+      std::string& mOutput;
+   };
+
+   //! Reads what CompiledWriter wrote. Every read fails once the data runs out.
+   class CompiledReader
+   {
+   public:
+      explicit CompiledReader(std::string_view aData)
+         : mData(aData)
+      {
+      }
+
+      template<typename T>
+      bool Read(T& aValue)
+      {
+         static_assert(std::is_trivially_copyable_v<T>);
+         if (mData.size() < sizeof(T))
+         {
+            return false;
+         }
+         std::memcpy(&aValue, mData.data(), sizeof(T));
+         mData.remove_prefix(sizeof(T));
+         return true;
+      }
+
+      bool ReadString(std::string& aText)
+      {
+         std::uint32_t size = 0;
+         if (!Read(size) || mData.size() < size)
+         {
+            return false;
+         }
+         aText.assign(mData.substr(0, size));
+         mData.remove_prefix(size);
+         return true;
+      }
+
+      //! Reads a count of items that take at least aItemSize bytes each, so that a corrupt count can't make the
+      //! caller reserve more than the data holds.
+      bool ReadCount(std::uint32_t& aCount, std::size_t aItemSize)
+      {
+         return Read(aCount) && aCount <= mData.size() / aItemSize;
+      }
+
+      bool AtEnd() const { return mData.empty(); }
+
+   private:
+      std::string_view mData;
+   };
+
+   void WriteProgram(CompiledWriter& aWriter, const rjcpt::PrecompiledFormula& aFormula)
+   {
+      const rjcpt::Program& program = aFormula.mProgram;
+      aWriter.Write(program.mMaxStackDepth);
+      aWriter.Write(program.mLocalCount);
+      aWriter.Write(static_cast<std::uint32_t>(program.mCode.size()));
+      for (const rjcpt::EvaluatorInstruction& instruction : program.mCode)
+      {
+         aWriter.Write(static_cast<std::uint8_t>(instruction.mOpCode));
+         aWriter.Write(instruction.mOperand);
+      }
+      aWriter.Write(static_cast<std::uint32_t>(program.mConstants.size()));
+      for (const double constant : program.mConstants)
+      {
+         aWriter.Write(constant);
+      }
+      aWriter.Write(static_cast<std::uint32_t>(aFormula.mNames.size()));
+      for (std::size_t i = 0; i < aFormula.mNames.size(); i++)
+      {
+         aWriter.WriteString(aFormula.mNames[i]);
+         aWriter.Write(static_cast<std::uint8_t>(aFormula.mRowLookup[i]));
+      }
+   }
+
+   //! Returns true if aFormula's program is as the compiler and optimizer emit it, so that a damaged file can't make
+   //! binding or evaluation read or write out of bounds. Walks the code as the evaluators run it: the stack must
+   //! never underflow, must reach exactly the stored depth, and must hold one value at the final Return. Chains and
+   //! jumps must nest, each jump must land just past its matching AndEnd or OrEnd, and each local must be stored
+   //! once, before it is loaded, and not inside a right operand that it is loaded after.
+   bool IsWellFormed(const rjcpt::PrecompiledFormula& aFormula)
+   {
+      using OC = rjcpt::OpCode;
+      const rjcpt::Program& program = aFormula.mProgram;
+      if (program.mLocalCount > rjcpt::Program::cMAX_LOCALS)
+      {
+         return false;
+      }
+
+      struct OpenJump
+      {
+         std::size_t   mIndex  = 0;
+         std::uint32_t mValues = 0; // Stack depth with the left operand still on it.
+         std::uint32_t mChains = 0;
+      };
+      // Jumps that a local was stored inside of, or cNOT_STORED. cCLOSED once the right operand it was stored in ends.
+      constexpr std::uint32_t cNOT_STORED = 0xFFFFFFFFU;
+      constexpr std::uint32_t cCLOSED     = 0xFFFFFFFEU;
+      std::vector<std::uint32_t> locals(program.mLocalCount, cNOT_STORED);
+      std::vector<OpenJump>      jumps;
+      std::uint32_t              values   = 0;
+      std::uint32_t              chains   = 0;
+      std::uint32_t              maxDepth = 0;
+      for (std::size_t i = 0; i < program.mCode.size(); i++)
+      {
+         const OC            opCode  = program.mCode[i].mOpCode;
+         const std::uint32_t operand = program.mCode[i].mOperand;
+         // Values the instruction pops, and then pushes.
+         std::uint32_t pops   = 0;
+         std::uint32_t pushes = 0;
+         switch (opCode)
+         {
+         case OC::Return:
+            return i + 1 == program.mCode.size() && values == 1 && chains == 0 && jumps.empty() &&
+                   maxDepth == program.mMaxStackDepth;
+         case OC::PushConstant:
+            if (operand >= program.mConstants.size())
+            {
+               return false;
+            }
+            pushes = 1;
+            break;
+         case OC::LoadColumn:
+         case OC::LoadParameter:
+            if (operand >= aFormula.mNames.size())
+            {
+               return false;
+            }
+            pushes = 1;
+            break;
+         case OC::StoreLocal:
+            if (operand >= locals.size() || locals[operand] != cNOT_STORED || values == 0)
+            {
+               return false;
+            }
+            locals[operand] = static_cast<std::uint32_t>(jumps.size());
+            break;
+         case OC::LoadLocal:
+            if (operand >= locals.size() || locals[operand] == cNOT_STORED || locals[operand] == cCLOSED)
+            {
+               return false;
+            }
+            pushes = 1;
+            break;
+         case OC::Negate:
+         case OC::LogicalNot:
+            pops   = 1;
+            pushes = 1;
+            break;
+         case OC::Add:
+         case OC::Subtract:
+         case OC::Multiply:
+         case OC::Divide:
+         case OC::CompareEqual:
+         case OC::CompareNotEqual:
+         case OC::CompareLessThan:
+         case OC::CompareLessOrEqual:
+         case OC::CompareGreaterThan:
+         case OC::CompareGreaterOrEqual:
+            pops   = 2;
+            pushes = 1;
+            break;
+         case OC::ChainBegin:
+            // After the first operand.
+            if (values == 0)
+            {
+               return false;
+            }
+            ++chains;
+            maxDepth = std::max(maxDepth, chains);
+            break;
+         case OC::ChainCompare:
+            if (chains == 0 || (!jumps.empty() && chains == jumps.back().mChains) ||
+                operand > static_cast<std::uint32_t>(rjcpt::CompareKind::GreaterOrEqual))
+            {
+               return false;
+            }
+            pops   = 2;
+            pushes = 1;
+            break;
+         case OC::ChainEnd:
+            if (chains == 0 || (!jumps.empty() && chains == jumps.back().mChains))
+            {
+               return false;
+            }
+            --chains;
+            pops   = 1;
+            pushes = 1;
+            break;
+         case OC::AndJump:
+         case OC::OrJump:
+            // The left operand stays on the stack until the matching AndEnd or OrEnd.
+            if (values == 0 || operand < 2 || operand > program.mCode.size() - i)
+            {
+               return false;
+            }
+            jumps.push_back(OpenJump{i, values, chains});
+            break;
+         case OC::AndEnd:
+         case OC::OrEnd:
+         {
+            if (jumps.empty())
+            {
+               return false;
+            }
+            const OpenJump jump = jumps.back();
+            jumps.pop_back();
+            const OC expected = opCode == OC::AndEnd ? OC::AndJump : OC::OrJump;
+            if (program.mCode[jump.mIndex].mOpCode != expected ||
+                jump.mIndex + program.mCode[jump.mIndex].mOperand != i + 1 || values != jump.mValues + 1 ||
+                chains != jump.mChains)
+            {
+               return false;
+            }
+            // The right operand may not have run, so neither have the locals stored in it.
+            for (std::uint32_t& local : locals)
+            {
+               if (local != cNOT_STORED && local != cCLOSED && local > jumps.size())
+               {
+                  local = cCLOSED;
+               }
+            }
+            pops   = 2;
+            pushes = 1;
+            break;
+         }
+         case OC::Call:
+         {
+            const auto function = static_cast<rjcpt::BuiltinFunction>(operand & 0xFFU);
+            if ((operand & 0xFFU) >= static_cast<std::uint32_t>(rjcpt::BuiltinFunction::cMAX_FUNCTION) ||
+                !rjcpt::IsValidArgumentCount(function, operand >> 8))
+            {
+               return false;
+            }
+            pops   = operand >> 8;
+            pushes = 1;
+            break;
+         }
+         default:
+            return false;
+         }
+         if (pops > values || (!jumps.empty() && values - pops < jumps.back().mValues))
+         {
+            return false;
+         }
+         values   = values - pops + pushes;
+         maxDepth = std::max(maxDepth, values);
+      }
+      // No Return.
+      return false;
+   }
+
+   bool ReadProgram(CompiledReader& aReader, rjcpt::PrecompiledFormula& aFormula)
+   {
+      rjcpt::Program& program = aFormula.mProgram;
+      std::uint32_t   count   = 0;
+      if (!aReader.Read(program.mMaxStackDepth) || !aReader.Read(program.mLocalCount) ||
+          !aReader.ReadCount(count, sizeof(std::uint8_t) + sizeof(std::uint32_t)))
+      {
+         return false;
+      }
+      program.mCode.resize(count);
+      for (rjcpt::EvaluatorInstruction& instruction : program.mCode)
+      {
+         std::uint8_t opCode = 0;
+         if (!aReader.Read(opCode) || !aReader.Read(instruction.mOperand))
+         {
+            return false;
+         }
+         instruction.mOpCode = static_cast<rjcpt::OpCode>(opCode);
+      }
+      if (!aReader.ReadCount(count, sizeof(double)))
+      {
+         return false;
+      }
+      program.mConstants.resize(count);
+      for (double& constant : program.mConstants)
+      {
+         aReader.Read(constant);
+      }
+      if (!aReader.ReadCount(count, sizeof(std::uint32_t) + sizeof(std::uint8_t)))
+      {
+         return false;
+      }
+      aFormula.mNames.resize(count);
+      aFormula.mRowLookup.resize(count);
+      for (std::size_t i = 0; i < count; i++)
+      {
+         std::uint8_t rowLookup = 0;
+         if (!aReader.ReadString(aFormula.mNames[i]) || !aReader.Read(rowLookup))
+         {
+            return false;
+         }
+         aFormula.mRowLookup[i] = rowLookup != 0;
+      }
+      return IsWellFormed(aFormula);
+   }
+
+   std::expected<rjcpt::WorkbookTemplate, std::string> ReadCompiledTemplate(std::string_view aData)
+   {
+      const std::string cDAMAGED = "Damaged compiled template";
+      CompiledReader    reader(aData.substr(cCOMPILED_MAGIC.size()));
+      std::uint64_t     hash = 0;
+      std::uint32_t     count = 0;
+      if (!reader.Read(hash) || !reader.ReadCount(count, sizeof(std::uint32_t) + sizeof(double)))
+      {
+         return std::unexpected(cDAMAGED);
+      }
+      // Formulas compiled by another version are parsed from their text when the template is applied instead.
+      const bool keepPrograms = hash == CompiledFormatHash();
+
+      rjcpt::WorkbookTemplate retval;
+      retval.mParameters.resize(count);
+      for (rjcpt::WorkbookTemplate::Parameter& parameter : retval.mParameters)
+      {
+         if (!reader.ReadString(parameter.mName) || !reader.Read(parameter.mValue))
+         {
+            return std::unexpected(cDAMAGED);
+         }
+      }
+      if (!reader.ReadCount(count, 2 * sizeof(std::uint32_t) + sizeof(std::uint8_t)))
+      {
+         return std::unexpected(cDAMAGED);
+      }
+      retval.mFormulas.resize(count);
+      for (rjcpt::WorkbookTemplate::Formula& formula : retval.mFormulas)
+      {
+         std::uint8_t compiled = 0;
+         if (!reader.ReadString(formula.mName) || !reader.ReadString(formula.mFormula) || !reader.Read(compiled))
+         {
+            return std::unexpected(cDAMAGED);
+         }
+         if (compiled != 0)
+         {
+            auto program = std::make_shared<rjcpt::PrecompiledFormula>();
+            if (!ReadProgram(reader, *program))
+            {
+               return std::unexpected(cDAMAGED);
+            }
+            if (keepPrograms)
+            {
+               formula.mCompiled = std::move(program);
+            }
+         }
+      }
+      if (!reader.AtEnd())
+      {
+         return std::unexpected(cDAMAGED);
+      }
+      return retval;
+   }
+}
+
+std::expected<rjcpt::WorkbookTemplate, std::string> rjcpt::ParseWorkbookTemplate(std::string_view aData)
+{
+   if (aData.starts_with(cCOMPILED_MAGIC))
+   {
+      return ReadCompiledTemplate(aData);
+   }
+
+   std::string_view text = aData;
+   WorkbookTemplate retval;
+   std::size_t      lineNumber = 0;
+   while (!text.empty())
+   {
+      ++lineNumber;
+      const std::size_t      end  = text.find('\n');
+      const std::string_view line = Trim(text.substr(0, end));
+      text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+      if (line.empty() || line.starts_with('#'))
+      {
+         continue;
+      }
+
+      const std::size_t equals = line.find('=');
+      if (equals == std::string_view::npos)
+      {
+         return std::unexpected(LineError(lineNumber, "Expected 'name = formula'"));
+      }
+      std::string_view       name  = Trim(line.substr(0, equals));
+      const std::string_view value = Trim(line.substr(equals + 1));
+      const bool             isParameter = name.starts_with('$');
+      if (isParameter)
+      {
+         name = Trim(name.substr(1));
+      }
+      if (name.empty() || value.empty())
+      {
+         return std::unexpected(LineError(lineNumber, "Expected 'name = formula'"));
+      }
+
+      if (isParameter)
+      {
+         double number = 0.0;
+         const auto [ptr, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+         if (error != std::errc() || ptr != value.data() + value.size())
+         {
+            return std::unexpected(LineError(lineNumber, "Invalid value for $" + std::string(name) + ": " + std::string(value)));
+         }
+         retval.mParameters.push_back(WorkbookTemplate::Parameter{std::string(name), number});
+      }
+      else
+      {
+         retval.mFormulas.push_back(WorkbookTemplate::Formula{std::string(name), std::string(value)});
+      }
+   }
+   return retval;
+}
+
+std::expected<rjcpt::WorkbookTemplate, std::string> rjcpt::LoadWorkbookTemplate(const std::filesystem::path& aPath)
+{
+   const auto file = MappedFile::Open(aPath);
+   if (!file)
+   {
+      return std::unexpected(file.error());
+   }
+   return ParseWorkbookTemplate(file->Data());
+}
+
+std::expected<void, std::string> rjcpt::ApplyTemplate(Sheet& aSheet, const WorkbookTemplate& aTemplate)
+{
+   try
+   {
+      for (const WorkbookTemplate::Parameter& parameter : aTemplate.mParameters)
+      {
+         aSheet.SetParameter(parameter.mName, parameter.mValue);
+      }
+   }
+   catch (const std::invalid_argument& aError)
+   {
+      // A parameter has the name of an input column.
+      return std::unexpected(aError.what());
+   }
+   for (const WorkbookTemplate::Formula& formula : aTemplate.mFormulas)
+   {
+      const auto result = formula.mCompiled ? aSheet.SetFormula(formula.mName, formula.mFormula, *formula.mCompiled)
+                                            : aSheet.SetFormula(formula.mName, formula.mFormula);
+      if (!result)
+      {
+         return std::unexpected(formula.mName + ": " + result.error());
+      }
+   }
+   return {};
+}
+
+void rjcpt::PrecompileTemplate(WorkbookTemplate& aTemplate, ParserEngine aEngine)
+{
+   for (WorkbookTemplate::Formula& formula : aTemplate.mFormulas)
+   {
+      if (auto compiled = PrecompileFormula(formula.mFormula, aEngine))
+      {
+         formula.mCompiled = std::make_shared<const PrecompiledFormula>(std::move(*compiled));
+      }
+      else
+      {
+         formula.mCompiled = nullptr;
+      }
+   }
+}
+
+std::string rjcpt::WriteCompiledTemplate(const WorkbookTemplate& aTemplate)
+{
+   std::string    retval(cCOMPILED_MAGIC);
+   CompiledWriter writer(retval);
+   writer.Write(CompiledFormatHash());
+   writer.Write(static_cast<std::uint32_t>(aTemplate.mParameters.size()));
+   for (const WorkbookTemplate::Parameter& parameter : aTemplate.mParameters)
+   {
+      writer.WriteString(parameter.mName);
+      writer.Write(parameter.mValue);
+   }
+   writer.Write(static_cast<std::uint32_t>(aTemplate.mFormulas.size()));
+   for (const WorkbookTemplate::Formula& formula : aTemplate.mFormulas)
+   {
+      writer.WriteString(formula.mName);
+      writer.WriteString(formula.mFormula);
+      writer.Write(static_cast<std::uint8_t>(formula.mCompiled != nullptr));
+      if (formula.mCompiled)
+      {
+         WriteProgram(writer, *formula.mCompiled);
+      }
+   }
+   return retval;
+}
+
+std::expected<void, std::string> rjcpt::SaveCompiledTemplate(const WorkbookTemplate&      aTemplate,
+                                                            const std::filesystem::path& aPath)
+{
+   std::ofstream file(aPath, std::ios::binary);
+   file << WriteCompiledTemplate(aTemplate);
+   if (!file)
+   {
+      return std::unexpected("Cannot write " + aPath.string());
+   }
+   return {};
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "FormulaCache.hpp"
+#include "FormulaParser.hpp"
+#include "Sheet.hpp"
+
+#include <expected>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "rjcpt_core_export.h"
+
+namespace rjcpt
+{
+   //! The parameters and formulas of a workbook, without any data, so that they can be applied to many soundings.
+   //! In text form, each line is one of:
+   //!   * "$name = value" sets a parameter to a number.
+   //!   * "name = formula" sets the formula of a column.
+   //!   * Blank, or a comment starting with '#'.
+   //! Formulas may only refer to columns and parameters defined above them, or to input columns.
+   //! The compiled form, written by SaveCompiledTemplate, also holds each formula's precompiled program, so that
+   //! applying it to a sheet parses nothing.
+   struct WorkbookTemplate
+   {
+      struct Parameter
+      {
+         std::string mName;
+         double      mValue = 0.0;
+      };
+      struct Formula
+      {
+         std::string mName;
+         std::string mFormula;
+         //! Bound instead of parsing mFormula when set. Shared, since templates are applied by many threads.
+         std::shared_ptr<const PrecompiledFormula> mCompiled = nullptr;
+      };
+
+      std::vector<Parameter> mParameters;
+      std::vector<Formula>   mFormulas; // In the order they are set.
+   };
+
+   //! Reads a template from its text or compiled form. On failure, returns a description of the error.
+   //! Programs compiled by a different version of the formula grammar or compiler are dropped, so that their formulas
+   //! are parsed from their text when the template is applied.
+   RJCPT_CORE_EXPORT std::expected<WorkbookTemplate, std::string> ParseWorkbookTemplate(std::string_view aData);
+
+   //! Reads the template in the file at aPath. On failure, returns a description of the error.
+   RJCPT_CORE_EXPORT std::expected<WorkbookTemplate, std::string> LoadWorkbookTemplate(const std::filesystem::path& aPath);
+
+   //! Sets the parameters and then the formulas of aTemplate in aSheet, which should already hold the input columns.
+   //! On failure, returns a description of the error, and the sheet holds the parameters and formulas set so far.
+   RJCPT_CORE_EXPORT std::expected<void, std::string> ApplyTemplate(Sheet& aSheet, const WorkbookTemplate& aTemplate);
+
+   //! Precompiles every formula of aTemplate with aEngine. Formulas that cannot be precompiled are left as text.
+   RJCPT_CORE_EXPORT void PrecompileTemplate(WorkbookTemplate& aTemplate, ParserEngine aEngine = ParserEngine::Grammar);
+
+   //! Returns the compiled form of aTemplate, including the programs of the formulas that have been precompiled.
+   //! The programs are only valid for the build that wrote them, and are dropped when read by any other.
+   RJCPT_CORE_EXPORT std::string WriteCompiledTemplate(const WorkbookTemplate& aTemplate);
+
+   //! Writes the compiled form of aTemplate to the file at aPath. On failure, returns a description of the error.
+   RJCPT_CORE_EXPORT std::expected<void, std::string> SaveCompiledTemplate(const WorkbookTemplate&      aTemplate,
+                                                                           const std::filesystem::path& aPath);
+}
@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+
+#include "Arena.hpp"
+#include "Compiler.hpp"
+#include "FormulaParser.hpp"
+#include "Lexer.hpp"
+#include "test_formulas.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Counts calls to the global operator new, while tAllocationCounting is set on the calling thread.
+// Replacing operator new in the test program also replaces it for the core library.
+namespace
+{
+   thread_local bool          tAllocationCounting = false;
+   std::atomic<std::uint64_t> gAllocations{0};
+
+   void* CountedAllocate(std::size_t aSize)
+   {
+      if (tAllocationCounting)
+      {
+         gAllocations.fetch_add(1, std::memory_order_relaxed);
+      }
+      if (void* retval = std::malloc(aSize == 0 ? 1 : aSize))
+      {
+         return retval;
+      }
+      throw std::bad_alloc();
+   }
+
+   //! Counts allocations made on this thread during its lifetime.
+   class AllocationCounter
+   {
+   public:
+      AllocationCounter()
+         : mStart(gAllocations.load())
+      {
+         tAllocationCounting = true;
+      }
+      ~AllocationCounter() { tAllocationCounting = false; }
+
+      std::uint64_t Count() const { return gAllocations.load() - mStart; }
+
+   private:
+      std::uint64_t mStart;
+   };
+}
+
+void* operator new(std::size_t aSize)
+{
+   return CountedAllocate(aSize);
+}
+
+void* operator new[](std::size_t aSize)
+{
+   return CountedAllocate(aSize);
+}
+
+void operator delete(void* aPointer) noexcept
+{
+   std::free(aPointer);
+}
+
+void operator delete[](void* aPointer) noexcept
+{
+   std::free(aPointer);
+}
+
+void operator delete(void* aPointer, std::size_t) noexcept
+{
+   std::free(aPointer);
+}
+
+void operator delete[](void* aPointer, std::size_t) noexcept
+{
+   std::free(aPointer);
+}
+
+namespace
+{
+   //! Lexes, parses and compiles every formula into aArena. Returns the number of formulas that compiled.
+   std::size_t CompileAll(std::span<const std::string> aFormulas, rjcpt::Arena& aArena)
+   {
+      const rjcpt::test::TestResolver resolver;
+      std::size_t                     retval = 0;
+      for (const std::string& formula : aFormulas)
+      {
+         const auto tokens = rjcpt::TokenizeExpression(formula, aArena);
+         const auto nodes  = rjcpt::ParseFormula(tokens, aArena);
+         if (nodes && rjcpt::CompileFormula(formula, tokens, *nodes, resolver, &aArena))
+         {
+            ++retval;
+         }
+      }
+      return retval;
+   }
+}
+
+TEST(Arena, Allocate)
+{
+   rjcpt::Arena arena(1024);
+   EXPECT_EQ(arena.Capacity(), 0);
+
+   const std::array<int, 3> values = {1, 2, 3};
+   const auto copy = arena.Copy<int>(values);
+   EXPECT_TRUE(std::ranges::equal(copy, values));
+   EXPECT_NE(copy.data(), values.data());
+
+   void* aligned = arena.allocate(8, 64);
+   EXPECT_EQ(reinterpret_cast<std::uintptr_t>(aligned) % 64, 0);
+   EXPECT_GE(arena.BytesUsed(), 3 * sizeof(int) + 8);
+   EXPECT_EQ(arena.Capacity(), 1024);
+
+   // Larger than a chunk.
+   void* large = arena.allocate(4096, 8);
+   EXPECT_NE(large, nullptr);
+   EXPECT_GE(arena.Capacity(), 1024 + 4096);
+
+   // Chunks are reused after Reset(), starting with the first.
+   const std::size_t capacity = arena.Capacity();
+   arena.Reset();
+   EXPECT_EQ(arena.BytesUsed(), 0);
+   EXPECT_EQ(arena.Copy<int>(values).data(), copy.data());
+   EXPECT_NE(arena.allocate(4096, 8), nullptr);
+   EXPECT_EQ(arena.Capacity(), capacity);
+
+   arena.Release();
+   EXPECT_EQ(arena.Capacity(), 0);
+}
+
+TEST(Arena, Contiguous)
+{
+   rjcpt::Arena      arena;
+   const std::string formula = "min(qc, fs) * 2 + $gamma";
+   const auto        tokens  = rjcpt::TokenizeExpression(formula, arena);
+   const auto        nodes   = rjcpt::ParseFormula(tokens, arena);
+   ASSERT_TRUE(nodes.has_value()) << nodes.error();
+
+   EXPECT_TRUE(std::ranges::equal(tokens, rjcpt::TokenizeExpression(formula)));
+   EXPECT_TRUE(std::ranges::equal(*nodes, rjcpt::ParseFormula(tokens).value(), [](const auto& aLeft, const auto& aRight)
+      {
+         return aLeft.mType == aRight.mType && aLeft.mStartTokenIndex == aRight.mStartTokenIndex &&
+                aLeft.mStopTokenIndex == aRight.mStopTokenIndex && aLeft.mAuxData == aRight.mAuxData;
+      }));
+   // The nodes follow the tokens in the same chunk.
+   EXPECT_GE(reinterpret_cast<const char*>(nodes->data()), reinterpret_cast<const char*>(tokens.data() + tokens.size()));
+
+   EXPECT_FALSE(rjcpt::ParseFormula(rjcpt::TokenizeExpression("1 +", arena), arena).has_value());
+}
+
+TEST(Arena, NoAllocationsInSteadyState)
+{
+   std::vector<std::string> formulas;
+   for (int i = 0; i < 1000; i++)
+   {
+      const std::string n = std::to_string(i);
+      formulas.push_back("qc * " + n + " + (1 - $gamma) u2");
+      formulas.push_back("if(qc > " + n + ", sqrt(abs(fs)), ln(1 + abs(u2))) and depth < 3 or not (fs > 0.1)");
+      formulas.push_back("min(qc, " + n + ") * 0.5 + max(fs, u2, " + n + ".5e-2) * 0.5 < depth <= 4");
+   }
+
+   // The first pass grows the arena and the lexer, parser and compiler buffers.
+   rjcpt::Arena arena;
+   ASSERT_EQ(CompileAll(formulas, arena), formulas.size());
+
+   for (int pass = 0; pass < 3; pass++)
+   {
+      arena.Reset();
+      const AllocationCounter counter;
+      EXPECT_EQ(CompileAll(formulas, arena), formulas.size());
+      EXPECT_EQ(counter.Count(), 0) << "pass " << pass;
+   }
+
+   // Make sure the allocations would have been seen.
+   const AllocationCounter counter;
+   const auto tokens = rjcpt::TokenizeExpression(formulas[0]);
+   EXPECT_GT(counter.Count(), 0);
+}
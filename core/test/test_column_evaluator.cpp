@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#include "ColumnEvaluator.hpp"
+#include "Optimizer.hpp"
+#include "test_formulas.hpp"
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace
+{
+   using rjcpt::test::Compile;
+
+   //! Random values, with a sprinkling of zeros, infinities and NaNs.
+   std::vector<double> MakeColumn(std::mt19937& aRandom, std::size_t aRows)
+   {
+      constexpr double cSPECIAL[] = {0.0, -0.0, 1.0, std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN()};
+      std::uniform_real_distribution<double> value(-100.0, 100.0);
+      std::uniform_int_distribution<int>     pick(0, 19);
+      std::vector<double> retval(aRows);
+      for (double& v : retval)
+      {
+         const int p = pick(aRandom);
+         v = p < static_cast<int>(std::size(cSPECIAL)) ? cSPECIAL[p] : value(aRandom);
+      }
+      return retval;
+   }
+
+   //! Formulas covering every instruction.
+   constexpr std::string_view cFORMULAS[] = {
+      "qc + fs * 2 - u2 / 3",
+      "(qc - $gamma) / fs",
+      "-qc * -fs",
+      "qc < fs",
+      "qc = fs or qc <> u2",
+      "qc <= fs and fs >= u2 or not qc > 0",
+      "0 < qc < fs <= u2",
+      "not qc",
+      "(qc and fs) + (u2 or 0)",
+      "sqrt(abs(qc)) + max(qc, fs, u2) - min(u2, 1)",
+      "if(qc > 0, pow(fs, 2), ln(u2))",
+      "qc 2 fs"
+   };
+}
+
+TEST(ColumnEvaluator, MatchesScalar)
+{
+   constexpr std::size_t cROWS  = 3 * rjcpt::ColumnEvaluator::cBLOCK_SIZE + 37;
+   constexpr std::size_t cFIRST = 5;
+   std::mt19937 random(1234);
+   const auto qc = MakeColumn(random, cROWS + cFIRST);
+   const auto fs = MakeColumn(random, cROWS + cFIRST);
+   const auto u2 = MakeColumn(random, cROWS + cFIRST);
+   const std::array<const double*, 3> columns    = {qc.data(), fs.data(), u2.data()};
+   const std::array<double, 1>        parameters = {18.5};
+
+   for (int level = 0; level <= static_cast<int>(rjcpt::DetectSimdLevel()); level++)
+   {
+      rjcpt::ColumnEvaluator evaluator(static_cast<rjcpt::SimdLevel>(level));
+      for (const std::string_view formula : cFORMULAS)
+      {
+         const rjcpt::Program program = Compile(formula).value();
+         std::vector<double> output(cROWS);
+         evaluator.Evaluate(program, rjcpt::EvaluationContext{columns, parameters, cFIRST}, output);
+         for (std::size_t i = 0; i < cROWS; i++)
+         {
+            const double expected = rjcpt::Evaluate(program, rjcpt::EvaluationContext{columns, parameters, cFIRST + i});
+            ASSERT_EQ(std::bit_cast<std::uint64_t>(output[i]), std::bit_cast<std::uint64_t>(expected))
+               << formula << " at row " << i << " with SIMD level " << level;
+         }
+      }
+   }
+}
+
+TEST(ColumnEvaluator, ThreadedMatchesInterpreter)
+{
+   constexpr std::size_t cROWS  = 2 * rjcpt::ColumnEvaluator::cBLOCK_SIZE + 37;
+   constexpr std::size_t cFIRST = 3;
+   std::mt19937 random(5678);
+   const auto qc = MakeColumn(random, cROWS + cFIRST);
+   const auto fs = MakeColumn(random, cROWS + cFIRST);
+   const auto u2 = MakeColumn(random, cROWS + cFIRST);
+   const std::array<const double*, 3> columns    = {qc.data(), fs.data(), u2.data()};
+   const std::array<double, 1>        parameters = {-2.5};
+
+   std::vector<std::string_view> formulas(std::begin(cFORMULAS), std::end(cFORMULAS));
+   formulas.insert(formulas.end(), {
+      "qc",
+      "$gamma",
+      "2 + 3",
+      "qc < fs * 2 <= u2 + 1 > -qc",
+      "(qc < fs < u2) + (fs > u2 > qc) * (1 < qc < 2)",
+      "min(qc) + max(fs, qc, u2, 0, qc) - min(u2 * 2, qc, fs + 1)",
+      "exp(qc / 100) + log(abs(fs)) + pow(qc, fs) + if(u2, qc, fs)",
+      "(qc + fs) * (qc + fs) - sqrt(qc + fs) + (qc + fs > 1 or qc + fs < -1)",
+      "(qc * fs + 1) / (qc * fs + 1) + if(qc * fs > 0, qc * fs, -(qc * fs))"
+   });
+
+   for (int level = 0; level <= static_cast<int>(rjcpt::DetectSimdLevel()); level++)
+   {
+      rjcpt::ColumnEvaluator evaluator(static_cast<rjcpt::SimdLevel>(level));
+      for (const std::string_view formula : formulas)
+      {
+         // Optimized programs use locals.
+         for (const bool optimize : {false, true})
+         {
+            rjcpt::Program program = Compile(formula).value();
+            if (optimize)
+            {
+               rjcpt::OptimizeProgram(program);
+            }
+            const auto threaded = rjcpt::ThreadedProgram::Compile(program, static_cast<rjcpt::SimdLevel>(level));
+            ASSERT_TRUE(threaded.has_value()) << formula;
+
+            const rjcpt::EvaluationContext context{columns, parameters, cFIRST};
+            std::vector<double> expected(cROWS);
+            std::vector<double> actual(cROWS);
+            evaluator.Evaluate(program, context, expected);
+            evaluator.Evaluate(*threaded, context, actual);
+            for (std::size_t i = 0; i < cROWS; i++)
+            {
+               ASSERT_EQ(std::bit_cast<std::uint64_t>(actual[i]), std::bit_cast<std::uint64_t>(expected[i]))
+                  << formula << " at row " << i << " with SIMD level " << level << (optimize ? ", optimized" : "");
+            }
+         }
+      }
+   }
+}
+
+TEST(ColumnEvaluator, Empty)
+{
+   rjcpt::ColumnEvaluator evaluator;
+   evaluator.Evaluate(Compile("1 + 2").value(), rjcpt::EvaluationContext{}, {});
+   std::vector<double> output(3);
+   evaluator.Evaluate(Compile("1 + 2").value(), rjcpt::EvaluationContext{}, output);
+   EXPECT_EQ(output, std::vector<double>(3, 3.0));
+}
@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+
+#include "Compiler.hpp"
+#include "ConstantPool.hpp"
+#include "FormulaParser.hpp"
+#include "Lexer.hpp"
+
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+TEST(ConstantPool, Literals)
+{
+   EXPECT_EQ(rjcpt::ParseNumberLiteral("0.1"), 0.1);
+   EXPECT_EQ(rjcpt::ParseNumberLiteral("9.81e-1"), 0.981);
+   EXPECT_EQ(rjcpt::ParseNumberLiteral("9007199254740993"), 9007199254740992.0); // Ties round to even.
+   EXPECT_EQ(rjcpt::ParseNumberLiteral("2.2250738585072011e-308"), 2.2250738585072011e-308);
+   EXPECT_FALSE(rjcpt::ParseNumberLiteral("1e999").has_value());
+   EXPECT_FALSE(rjcpt::ParseNumberLiteral(".e5").has_value());
+
+   rjcpt::ConstantPool pool;
+   EXPECT_EQ(pool.Add("0.1"), 0U);
+   EXPECT_EQ(pool.Add("9.81"), 1U);
+   EXPECT_EQ(pool.Add("0.1"), 0U);
+   EXPECT_EQ(pool.Add("1e999"), rjcpt::ConstantPool::cINVALID);
+   EXPECT_EQ(pool.Add("0.10"), 2U);
+   EXPECT_EQ(pool.Size(), 3U);
+   EXPECT_EQ(pool.Value(1), 9.81);
+   EXPECT_EQ(pool.Value(2), 0.1);
+
+   // Formulas compiled with the pool share its literals.
+   class NoSymbols : public rjcpt::SymbolResolver
+   {
+   public:
+      rjcpt::Symbol Resolve(std::string_view) const override { return {}; }
+   };
+   const auto compile = [&](std::string_view aExpression)
+   {
+      const auto tokens = rjcpt::TokenizeExpression(aExpression);
+      const auto nodes  = rjcpt::ParseFormula(tokens);
+      return rjcpt::CompileFormula(aExpression, tokens, nodes.value(), NoSymbols(), std::pmr::get_default_resource(), &pool);
+   };
+   pool.Clear();
+   const auto first = compile("0.1 + 9.81 * 0.1");
+   ASSERT_TRUE(first.has_value());
+   EXPECT_EQ(first->mConstants, (std::pmr::vector<double>{0.1, 9.81}));
+   EXPECT_EQ(pool.Size(), 2U);
+   ASSERT_TRUE(compile("9.81 / 2").has_value());
+   EXPECT_EQ(pool.Size(), 3U);
+   EXPECT_EQ(compile("1 + 1e999").error(), "Invalid number: 1e999");
+   EXPECT_EQ(pool.Size(), 4U);
+}
@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+
+#include "DataFile.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace
+{
+   constexpr std::string_view cGEF =
+      "#GEFID= 1, 1, 0\r\n"
+      "#COLUMN= 4\r\n"
+      "#COLUMNINFO= 1, m, penetration length, 1\r\n"
+      "#COLUMNINFO= 2, MPa, cone resistance, 2\r\n"
+      "#COLUMNINFO= 3, MPa, local friction, 3\r\n"
+      "#COLUMNINFO= 4, -, temperature (C), 99\r\n"
+      "#COLUMNVOID= 3, -9999.0\r\n"
+      "#COLUMNSEPARATOR= ;\r\n"
+      "#RECORDSEPARATOR= !\r\n"
+      "#EOH=\r\n"
+      "0.02;0.45;0.011;12.5;!\r\n"
+      "0.04;+0.5;-9999.000;12.5;!\r\n"
+      "\r\n"
+      "0.06;1e1;0.02;;!\r\n";
+
+   std::filesystem::path WriteTempFile(std::string_view aName, std::string_view aText)
+   {
+      const auto path = std::filesystem::temp_directory_path() / aName;
+      std::ofstream(path, std::ios::binary) << aText;
+      return path;
+   }
+
+   void ExpectSame(const std::vector<double>& aActual, const std::vector<double>& aExpected)
+   {
+      ASSERT_EQ(aActual.size(), aExpected.size());
+      EXPECT_EQ(std::memcmp(aActual.data(), aExpected.data(), aActual.size() * sizeof(double)), 0);
+   }
+}
+
+TEST(DataFile, Gef)
+{
+   const auto table = rjcpt::ParseDataFile(cGEF);
+   ASSERT_TRUE(table.has_value()) << table.error();
+   EXPECT_EQ(table->mNames, (std::vector<std::string>{"length", "qc", "fs", "temperature_C"}));
+   ASSERT_EQ(table->RowCount(), 3U);
+   EXPECT_EQ(table->mColumns[0], (std::vector<double>{0.02, 0.04, 0.06}));
+   EXPECT_EQ(table->mColumns[1], (std::vector<double>{0.45, 0.5, 10.0}));
+   EXPECT_EQ(table->mColumns[2][0], 0.011);
+   EXPECT_TRUE(std::isnan(table->mColumns[2][1]));
+   EXPECT_TRUE(std::isnan(table->mColumns[3][2]));
+}
+
+TEST(DataFile, Delimited)
+{
+   const auto table = rjcpt::ParseDataFile("# exported\n\ndepth [m], qc, qc, and\n1, 2, 3, 4\n5,6,7,8\n");
+   ASSERT_TRUE(table.has_value()) << table.error();
+   EXPECT_EQ(table->mNames, (std::vector<std::string>{"depth_m", "qc", "qc_3", "and_"}));
+   EXPECT_EQ(table->mColumns[3], (std::vector<double>{4.0, 8.0}));
+
+   const auto noHeader = rjcpt::ParseDataFile("1 2\n\t3   4\n");
+   ASSERT_TRUE(noHeader.has_value()) << noHeader.error();
+   EXPECT_EQ(noHeader->mNames, (std::vector<std::string>{"column1", "column2"}));
+   EXPECT_EQ(noHeader->mColumns[1], (std::vector<double>{2.0, 4.0}));
+
+   const auto empty = rjcpt::ParseDataFile("");
+   ASSERT_TRUE(empty.has_value());
+   EXPECT_EQ(empty->RowCount(), 0U);
+}
+
+TEST(DataFile, Errors)
+{
+   EXPECT_EQ(rjcpt::ParseDataFile("a b\n1 2\n3\n").error(), "Line 3: Expected 2 values, found 1");
+   EXPECT_EQ(rjcpt::ParseDataFile("a b\n1 2\n3 4x\n").error(), "Line 3: Invalid value '4x'");
+   EXPECT_EQ(rjcpt::ParseDataFile("#GEFID= 1\n#COLUMN= 1\n").error(), "Missing #EOH in GEF header");
+   EXPECT_EQ(rjcpt::ParseDataFile(cGEF.substr(0, cGEF.size() - 5)).error(), "Line 14: Expected 4 values, found 3");
+}
+
+TEST(DataFile, Write)
+{
+   const std::vector<std::string> names   = {"depth", "qc", "short"};
+   const std::vector<double>      depth   = {0.02, 0.04, 1e-300, -0.0};
+   const std::vector<double>      qc      = {0.1, std::numeric_limits<double>::quiet_NaN(), 1.0 / 3.0, 12345678.9};
+   const std::vector<double>      shorter = {7.0};
+   const std::vector<std::span<const double>> columns = {depth, qc, shorter};
+
+   std::ostringstream stream;
+   ASSERT_TRUE(rjcpt::WriteDataFile(stream, names, columns));
+   EXPECT_TRUE(stream.str().starts_with("depth;qc;short\n0.02;0.1;7\n0.04;nan;nan\n"));
+
+   const auto table = rjcpt::ParseDataFile(stream.str());
+   ASSERT_TRUE(table.has_value()) << table.error();
+   EXPECT_EQ(table->mNames, names);
+   ExpectSame(table->mColumns[0], depth);
+   ExpectSame(table->mColumns[1], qc);
+   ASSERT_EQ(table->RowCount(), 4U);
+   EXPECT_EQ(table->mColumns[2][0], 7.0);
+   EXPECT_TRUE(std::isnan(table->mColumns[2][3]));
+}
+
+TEST(DataFile, Parallel)
+{
+   std::string text = "depth;qc;fs\n";
+   std::vector<double> depth;
+   for (int i = 0; i < 100000; i++)
+   {
+      depth.push_back(i * 0.01);
+      text += std::to_string(i * 0.01) + "; " + std::to_string(i % 37) + ";0.25\n";
+      if (i % 1000 == 0)
+      {
+         text += "\n";
+      }
+   }
+   const auto serial = rjcpt::ParseDataFile(text);
+   ASSERT_TRUE(serial.has_value()) << serial.error();
+   ASSERT_EQ(serial->RowCount(), 100000U);
+   EXPECT_EQ(serial->mColumns[0][12345], std::stod(std::to_string(123.45)));
+
+   rjcpt::ThreadPool pool(4);
+   const auto path   = WriteTempFile("rjcpt_test_parallel.csv", text);
+   const auto mapped = rjcpt::LoadDataFile(path, &pool);
+   ASSERT_TRUE(mapped.has_value()) << mapped.error();
+   for (std::size_t c = 0; c < 3; c++)
+   {
+      ExpectSame(mapped->mColumns[c], serial->mColumns[c]);
+   }
+
+   // Errors report the line number in the whole file, and the first error wins.
+   text += "1;2\n1;2\n";
+   const auto error = rjcpt::ParseDataFile(text, &pool);
+   ASSERT_FALSE(error.has_value());
+   EXPECT_EQ(error.error(), "Line " + std::to_string(100000 + 100 + 2) + ": Expected 3 values, found 2");
+   std::filesystem::remove(path);
+}
+
+TEST(DataFile, Reader)
+{
+   const auto path   = WriteTempFile("rjcpt_test_reader.gef", cGEF);
+   auto       reader = rjcpt::DataFileReader::Open(path);
+   ASSERT_TRUE(reader.has_value()) << reader.error();
+   EXPECT_EQ(reader->Layout().mColumnSeparator, ';');
+
+   rjcpt::DataTable table;
+   EXPECT_EQ(reader->ReadRows(2, table), 2U);
+   EXPECT_EQ(table.RowCount(), 2U);
+   EXPECT_FALSE(reader->AtEnd());
+   EXPECT_EQ(reader->ReadRows(2, table), 1U);
+   EXPECT_TRUE(reader->AtEnd());
+   EXPECT_EQ(reader->ReadRows(2, table), 0U);
+
+   const auto whole = rjcpt::ParseDataFile(cGEF);
+   for (std::size_t c = 0; c < table.mColumns.size(); c++)
+   {
+      ExpectSame(table.mColumns[c], whole->mColumns[c]);
+   }
+
+   rjcpt::Sheet sheet;
+   rjcpt::SetColumns(sheet, std::move(table));
+   ASSERT_TRUE(sheet.SetFormula("friction", "fs / qc * 100").has_value());
+   sheet.Recalculate();
+   EXPECT_DOUBLE_EQ(sheet.Column("friction")[2], 0.2);
+   std::filesystem::remove(path);
+
+   EXPECT_FALSE(rjcpt::DataFileReader::Open(path).has_value());
+}
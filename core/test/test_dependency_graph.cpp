@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+
+#include "DependencyGraph.hpp"
+
+#include <array>
+
+TEST(DependencyGraph, TopologicalOrder)
+{
+   rjcpt::DependencyGraph graph;
+   const auto a = graph.AddNode();
+   const auto b = graph.AddNode();
+   const auto c = graph.AddNode();
+   const auto d = graph.AddNode();
+   // d <- c <- {a, b}
+   ASSERT_TRUE(graph.SetDependencies(d, std::array{c}));
+   ASSERT_TRUE(graph.SetDependencies(c, std::array{b, a}));
+
+   // New nodes start out dirty.
+   const auto all = graph.TakeDirty();
+   ASSERT_EQ(all.size(), 4U);
+   EXPECT_EQ(all[2], c);
+   EXPECT_EQ(all[3], d);
+   EXPECT_TRUE(graph.TakeDirty().empty());
+
+   graph.MarkDirty(b);
+   EXPECT_FALSE(graph.IsDirty(a));
+   EXPECT_TRUE(graph.IsDirty(b));
+   EXPECT_TRUE(graph.IsDirty(c));
+   EXPECT_TRUE(graph.IsDirty(d));
+   EXPECT_EQ(graph.TakeDirty(), (std::vector<rjcpt::DependencyGraph::NodeId>{b, c, d}));
+
+   graph.MarkDirty(d);
+   EXPECT_EQ(graph.TakeDirty(), (std::vector<rjcpt::DependencyGraph::NodeId>{d}));
+}
+
+TEST(DependencyGraph, Cycles)
+{
+   rjcpt::DependencyGraph graph;
+   const auto a = graph.AddNode();
+   const auto b = graph.AddNode();
+   const auto c = graph.AddNode();
+   ASSERT_TRUE(graph.SetDependencies(b, std::array{a}));
+   ASSERT_TRUE(graph.SetDependencies(c, std::array{b}));
+   graph.TakeDirty();
+
+   EXPECT_FALSE(graph.SetDependencies(a, std::array{a}));
+   EXPECT_FALSE(graph.SetDependencies(a, std::array{c}));
+   // Rejected edits leave the graph unchanged.
+   EXPECT_TRUE(graph.Dependencies(a).empty());
+   EXPECT_FALSE(graph.IsDirty(a));
+
+   // Replacing dependencies removes the old edges.
+   ASSERT_TRUE(graph.SetDependencies(c, std::array{a, a}));
+   EXPECT_EQ(graph.Dependencies(c).size(), 1U);
+   EXPECT_TRUE(graph.Dependents(b).empty());
+   EXPECT_TRUE(graph.SetDependencies(b, std::array{c}));
+}
@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+
+#include "Evaluator.hpp"
+#include "test_formulas.hpp"
+
+#include <array>
+#include <cmath>
+#include <string>
+
+namespace
+{
+   using rjcpt::test::Compile;
+
+   //! Compiles and evaluates aExpression for the given row.
+   double Eval(std::string_view aExpression, std::size_t aRow = 0)
+   {
+      static constexpr std::array<double, 3> qc = {10.0, 20.0, 30.0};
+      static constexpr std::array<double, 3> fs = {0.1, 0.2, 0.3};
+      static constexpr std::array<double, 3> u2 = {-1.0, 0.0, 1.0};
+      static constexpr std::array<const double*, 3> columns = {qc.data(), fs.data(), u2.data()};
+      static constexpr std::array<double, 2> parameters = {18.5, 2.0};
+
+      const auto program = Compile(aExpression);
+      EXPECT_TRUE(program.has_value()) << aExpression << ": " << (program ? "" : program.error());
+      if (!program)
+      {
+         return std::nan("");
+      }
+      return rjcpt::Evaluate(*program, rjcpt::EvaluationContext{columns, parameters, aRow});
+   }
+}
+
+TEST(Evaluator, Arithmetic)
+{
+   EXPECT_EQ(Eval("1 + 2 * 3"), 7.0);
+   EXPECT_EQ(Eval("(1 + 2) * 3"), 9.0);
+   EXPECT_EQ(Eval("10 - 4 - 3"), 3.0);
+   EXPECT_EQ(Eval("12 / 4 / 3"), 1.0);
+   EXPECT_EQ(Eval("-2 * +3"), -6.0);
+   EXPECT_EQ(Eval("(3 + 4) 2"), 14.0);
+   EXPECT_EQ(Eval("1.5e2"), 150.0);
+   EXPECT_EQ(Eval(".5"), 0.5);
+   EXPECT_TRUE(std::isinf(Eval("1 / 0")));
+}
+
+TEST(Evaluator, Identifiers)
+{
+   EXPECT_EQ(Eval("qc", 0), 10.0);
+   EXPECT_EQ(Eval("qc", 2), 30.0);
+   EXPECT_EQ(Eval("qc - u2", 0), 11.0);
+   EXPECT_EQ(Eval("fs / qc * 100", 1), 0.2 / 20.0 * 100.0);
+   EXPECT_EQ(Eval("gamma depth"), 37.0);
+   EXPECT_EQ(Eval("$gamma * depth"), 37.0);
+
+   EXPECT_FALSE(Compile("$qc").has_value());
+   EXPECT_FALSE(Compile("$(gamma + 1)").has_value());
+   EXPECT_FALSE(Compile("unknown + 1").has_value());
+}
+
+TEST(Evaluator, Logic)
+{
+   EXPECT_EQ(Eval("true"), 1.0);
+   EXPECT_EQ(Eval("not true"), 0.0);
+   EXPECT_EQ(Eval("not 0"), 1.0);
+   EXPECT_EQ(Eval("true and false"), 0.0);
+   EXPECT_EQ(Eval("2 and 3"), 1.0);
+   EXPECT_EQ(Eval("0 or 5"), 1.0);
+   EXPECT_EQ(Eval("0 or 0"), 0.0);
+   EXPECT_EQ(Eval("false or true and true"), 1.0);
+   EXPECT_EQ(Eval("(1 and 0) or (1 and 2)"), 1.0);
+   EXPECT_EQ(Eval("1 + (0 or 0 or 3)"), 2.0);
+   EXPECT_EQ(Eval("0 and (1 or 1)"), 0.0);
+}
+
+TEST(Evaluator, ShortCircuit)
+{
+   // The right-hand side is skipped, so "qc" is never read from an out-of-range row.
+   const auto program = Compile("false and qc or true");
+   ASSERT_TRUE(program.has_value());
+   const std::array<const double*, 3> columns = {nullptr, nullptr, nullptr};
+   EXPECT_EQ(rjcpt::Evaluate(*program, rjcpt::EvaluationContext{columns, {}, 0}), 1.0);
+}
+
+TEST(Evaluator, Comparisons)
+{
+   EXPECT_EQ(Eval("1 < 2"), 1.0);
+   EXPECT_EQ(Eval("2 < 1"), 0.0);
+   EXPECT_EQ(Eval("1 <= 1 = 1"), 1.0);
+   EXPECT_EQ(Eval("1 < 2 < 3"), 1.0);
+   EXPECT_EQ(Eval("1 < 3 < 2"), 0.0);
+   EXPECT_EQ(Eval("3 > 2 >= 2 <> 1"), 1.0);
+   EXPECT_EQ(Eval("(1 < 2) + (2 < 1 < 3) + (0 < 1 < 2 < 3)"), 2.0);
+   EXPECT_EQ(Eval("0 <= qc < 15", 0), 1.0);
+   EXPECT_EQ(Eval("0 <= qc < 15", 1), 0.0);
+}
+
+TEST(Evaluator, Functions)
+{
+   EXPECT_EQ(Eval("abs(-2)"), 2.0);
+   EXPECT_EQ(Eval("sqrt(16)"), 4.0);
+   EXPECT_EQ(Eval("pow(2, 10)"), 1024.0);
+   EXPECT_EQ(Eval("log(1000)"), 3.0);
+   EXPECT_EQ(Eval("ln(exp(1))"), 1.0);
+   EXPECT_EQ(Eval("min(3, 1, 2)"), 1.0);
+   EXPECT_EQ(Eval("max(3, 1 + 5, 2) * 2"), 12.0);
+   EXPECT_EQ(Eval("if(qc > 15, 1, 2)", 0), 2.0);
+   EXPECT_EQ(Eval("if(qc > 15, 1, 2)", 1), 1.0);
+   EXPECT_EQ(Eval("2 sqrt(4)"), 4.0);
+
+   EXPECT_FALSE(Compile("sqrt(1, 2)").has_value());
+   EXPECT_FALSE(Compile("if(1, 2)").has_value());
+   EXPECT_FALSE(Compile("min()").has_value());
+   EXPECT_FALSE(Compile("foo(1)").has_value());
+}
+
+TEST(Evaluator, Program)
+{
+   const auto program = Compile("qc * 2 + 2 * fs");
+   ASSERT_TRUE(program.has_value());
+   // The constant 2 is only stored once.
+   EXPECT_EQ(program->mConstants.size(), 1U);
+   EXPECT_EQ(program->mMaxStackDepth, 3U);
+   EXPECT_EQ(program->mCode.back().mOpCode, rjcpt::OpCode::Return);
+}
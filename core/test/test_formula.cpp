@@ -0,0 +1,398 @@
+#include <gtest/gtest.h>
+
+#include "Evaluator.hpp"
+#include "FormulaParser.hpp"
+#include "Lexer.hpp"
+#include "Sheet.hpp"
+#include "ThreadPool.hpp"
+#include "test_formulas.hpp"
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+   //! Parses aExpression and returns a compact description of the ParseNodes, or the error message.
+   //! Leaves and operators are written with their source text, separated by spaces.
+   std::string ParseToPostfix(std::string_view aExpression)
+   {
+      using PNT = rjcpt::ParseNodeType;
+      const auto tokens = rjcpt::TokenizeExpression(aExpression);
+      const auto nodes  = rjcpt::ParseFormula(tokens);
+      if (!nodes)
+      {
+         return "error";
+      }
+      std::string retval;
+      for (const auto& node : *nodes)
+      {
+         const auto& token = tokens[node.mStartTokenIndex];
+         const auto  text  = std::string(aExpression.substr(token.mStartIndex, token.mLength));
+         switch (node.mType)
+         {
+         case PNT::Finished:
+            continue;
+         case PNT::CompareBegin:
+            retval += "[";
+            break;
+         case PNT::CompareEnd:
+            retval += "]";
+            break;
+         case PNT::Concatenation:
+            retval += "cat";
+            break;
+         case PNT::UnaryPlus:
+         case PNT::UnaryMinus:
+         case PNT::LogicalNot:
+         case PNT::RowLookup:
+            retval += "u" + text;
+            break;
+         case PNT::Invoke:
+            retval += "call" + std::to_string(node.mAuxData);
+            break;
+         default:
+            retval += text;
+            break;
+         }
+         retval += ' ';
+      }
+      if (!retval.empty())
+      {
+         retval.pop_back();
+      }
+      return retval;
+   }
+}
+
+TEST(Formula, Arithmetic)
+{
+   EXPECT_EQ(ParseToPostfix("1"), "1");
+   EXPECT_EQ(ParseToPostfix("qc + fs * 2"), "qc fs 2 * +");
+   EXPECT_EQ(ParseToPostfix("qc - fs - u2"), "qc fs - u2 -");
+   EXPECT_EQ(ParseToPostfix("qc / (fs - u2)"), "qc fs u2 - /");
+   EXPECT_EQ(ParseToPostfix("-qc * +2"), "qc u- 2 u+ *");
+   EXPECT_EQ(ParseToPostfix("--qc"), "qc u- u-");
+   EXPECT_EQ(ParseToPostfix("$gamma * qc"), "gamma u$ qc *");
+}
+
+TEST(Formula, Concatenation)
+{
+   EXPECT_EQ(ParseToPostfix("2 qc"), "2 qc cat");
+   EXPECT_EQ(ParseToPostfix("(qc + 1) 2"), "qc 1 + 2 cat");
+   EXPECT_EQ(ParseToPostfix("(qc) fs u2"), "qc fs cat u2 cat");
+   EXPECT_EQ(ParseToPostfix("2 $gamma"), "2 gamma u$ cat");
+   EXPECT_EQ(ParseToPostfix("2 qc * 3"), "2 qc cat 3 *");
+}
+
+TEST(Formula, Logic)
+{
+   EXPECT_EQ(ParseToPostfix("true or false and not true"), "true false true unot and or");
+   EXPECT_EQ(ParseToPostfix("not qc = 1"), "qc 1 [ = ] unot");
+   EXPECT_EQ(ParseToPostfix("qc < 1 or qc > 2"), "qc 1 [ < ] qc 2 [ > ] or");
+}
+
+TEST(Formula, CompareChain)
+{
+   EXPECT_EQ(ParseToPostfix("qc < fs"), "qc fs [ < ]");
+   EXPECT_EQ(ParseToPostfix("0 <= qc < fs + 1"), "0 qc [ <= fs 1 + < ]");
+   EXPECT_EQ(ParseToPostfix("a = b <> c >= d"), "a b [ = c <> d >= ]");
+}
+
+TEST(Formula, Invoke)
+{
+   EXPECT_EQ(ParseToPostfix("sqrt(qc)"), "qc sqrt call1");
+   EXPECT_EQ(ParseToPostfix("max(qc, fs, 1 + 2)"), "qc fs 1 2 + max call3");
+   EXPECT_EQ(ParseToPostfix("f()"), "f call0");
+   EXPECT_EQ(ParseToPostfix("2 pow(qc, 2)"), "2 qc 2 pow call2 cat");
+   EXPECT_EQ(ParseToPostfix("if(a < b, f(g(x)), 0)"), "a b [ < ] x g call1 f call1 0 if call3");
+}
+
+TEST(Formula, Errors)
+{
+   EXPECT_EQ(ParseToPostfix(""), "error");
+   EXPECT_EQ(ParseToPostfix("1 +"), "error");
+   EXPECT_EQ(ParseToPostfix("(1"), "error");
+   EXPECT_EQ(ParseToPostfix("1)"), "error");
+   EXPECT_EQ(ParseToPostfix("f(1,)"), "error");
+   EXPECT_EQ(ParseToPostfix("1 < "), "error");
+   EXPECT_EQ(ParseToPostfix("a and or b"), "error");
+   EXPECT_EQ(ParseToPostfix("1 2x"), "error");
+   // Parentheses after an operand are only allowed as a function call.
+   EXPECT_EQ(ParseToPostfix("2 (qc)"), "error");
+}
+
+TEST(Formula, DeepNesting)
+{
+   // Deeper than the parser's stacks hold inline.
+   std::string ifChain;
+   std::string expected;
+   for (int i = 0; i < 500; i++)
+   {
+      ifChain  += "if(a, " + std::to_string(i) + ", ";
+      expected += "a " + std::to_string(i) + " ";
+   }
+   ifChain  += "0" + std::string(500, ')');
+   expected += "0";
+   for (int i = 0; i < 500; i++)
+   {
+      expected += " if call3";
+   }
+   EXPECT_EQ(ParseToPostfix(ifChain), expected);
+
+   const std::string parentheses = std::string(5000, '(') + "1" + std::string(5000, ')');
+   EXPECT_EQ(ParseToPostfix(parentheses), "1");
+   EXPECT_EQ(ParseToPostfix(parentheses + ")"), "error");
+
+   // Deeper than the evaluators' stacks hold inline. Returns the first i above qc, or 0.
+   std::string comparisonChain;
+   for (int i = 0; i < 500; i++)
+   {
+      comparisonChain += "if(qc < " + std::to_string(i) + ", " + std::to_string(i) + ", ";
+   }
+   comparisonChain += "0" + std::string(500, ')');
+   const std::vector<double> qc      = {-1.0, 0.5, 250.0, 498.5, 1000.0};
+   const std::vector<double> results = {0.0, 1.0, 251.0, 499.0, 0.0};
+
+   const auto program = rjcpt::test::Compile(comparisonChain);
+   ASSERT_TRUE(program.has_value()) << program.error();
+   const std::array<const double*, 1> columns = {qc.data()};
+   for (std::size_t row = 0; row < qc.size(); row++)
+   {
+      EXPECT_EQ(rjcpt::Evaluate(*program, rjcpt::EvaluationContext{columns, {}, row}), results[row]) << row;
+   }
+
+   rjcpt::ThreadPool pool(2);
+   for (const std::uint64_t tierRows : {rjcpt::Sheet::cDEFAULT_THREADED_TIER_ROWS, std::uint64_t{0}})
+   {
+      rjcpt::Sheet sheet;
+      sheet.SetThreadedTierRows(tierRows);
+      sheet.SetColumn("qc", qc);
+      ASSERT_TRUE(sheet.SetFormula("r", comparisonChain).has_value());
+      sheet.Recalculate();
+      EXPECT_EQ(sheet.IsThreaded("r"), tierRows == 0);
+      EXPECT_TRUE(std::ranges::equal(sheet.Column("r"), results)) << tierRows;
+
+      sheet.SetColumn("qc", qc);
+      sheet.Recalculate(pool, 2);
+      EXPECT_TRUE(std::ranges::equal(sheet.Column("r"), results)) << tierRows;
+   }
+}
+
+TEST(Formula, DynamicDispatch)
+{
+   // Parsing through the virtual ParseContext gives exactly the same nodes and errors.
+   for (const std::string_view expression : {"1 + 2 * 3", "-a < $b <= 3 or not c", "2 qc / (fs + 1)", "if(a, f(g(x)), 0)",
+                                             "", "1 +", "(1", "f(1,)", "2 (qc)"})
+   {
+      const auto tokens  = rjcpt::TokenizeExpression(expression);
+      const auto nodes   = rjcpt::ParseFormula(tokens);
+      const auto dynamic = rjcpt::detail::ParseFormulaDynamic(tokens);
+      ASSERT_EQ(nodes.has_value(), dynamic.has_value()) << expression;
+      if (nodes)
+      {
+         ASSERT_EQ(nodes->size(), dynamic->size()) << expression;
+         for (std::size_t i = 0; i < nodes->size(); i++)
+         {
+            EXPECT_EQ((*nodes)[i].mType, (*dynamic)[i].mType) << expression;
+            EXPECT_EQ((*nodes)[i].mStartTokenIndex, (*dynamic)[i].mStartTokenIndex) << expression;
+            EXPECT_EQ((*nodes)[i].mStopTokenIndex, (*dynamic)[i].mStopTokenIndex) << expression;
+            EXPECT_EQ((*nodes)[i].mAuxData, (*dynamic)[i].mAuxData) << expression;
+         }
+      }
+      else
+      {
+         EXPECT_EQ(nodes.error(), dynamic.error()) << expression;
+      }
+   }
+}
+
+TEST(Formula, Streaming)
+{
+   // Lexing while parsing gives exactly the same tokens, nodes and errors as lexing first.
+   for (const std::string_view expression : {"1 + 2 * 3", "-a < $b <= 3 or not c", "2 qc / (fs + 1)", "if(a, f(g(x)), 0)",
+                                             "", "1 +", "(1", "f(1,)", "2 (qc)", "1 2x", "a # b"})
+   {
+      const auto tokens   = rjcpt::TokenizeExpression(expression);
+      const auto nodes    = rjcpt::ParseFormula(tokens);
+      const auto streamed = rjcpt::ParseFormula(expression);
+      ASSERT_EQ(nodes.has_value(), streamed.has_value()) << expression;
+      EXPECT_EQ(nodes.has_value(), rjcpt::ValidateFormula(expression).has_value()) << expression;
+
+      rjcpt::Arena arena;
+      const auto   parsed = rjcpt::ParseFormula(expression, arena);
+      ASSERT_EQ(nodes.has_value(), parsed.has_value()) << expression;
+      if (nodes)
+      {
+         EXPECT_TRUE(std::ranges::equal(tokens, parsed->mTokens)) << expression;
+         ASSERT_EQ(nodes->size(), streamed->size()) << expression;
+         ASSERT_EQ(nodes->size(), parsed->mNodes.size()) << expression;
+         for (std::size_t i = 0; i < nodes->size(); i++)
+         {
+            EXPECT_EQ((*nodes)[i].mType, (*streamed)[i].mType) << expression;
+            EXPECT_EQ((*nodes)[i].mStartTokenIndex, (*streamed)[i].mStartTokenIndex) << expression;
+            EXPECT_EQ((*nodes)[i].mStopTokenIndex, (*streamed)[i].mStopTokenIndex) << expression;
+            EXPECT_EQ((*nodes)[i].mAuxData, (*streamed)[i].mAuxData) << expression;
+            EXPECT_EQ((*nodes)[i].mType, parsed->mNodes[i].mType) << expression;
+         }
+      }
+      else
+      {
+         EXPECT_EQ(nodes.error(), streamed.error()) << expression;
+         EXPECT_EQ(nodes.error(), parsed.error()) << expression;
+      }
+   }
+}
+
+TEST(Formula, PrecedenceEngine)
+{
+   // The precedence engine gives exactly the same nodes as the grammar engine, and fails on the same token.
+   const auto check = [](const std::string& aExpression)
+   {
+      const auto tokens     = rjcpt::TokenizeExpression(aExpression);
+      const auto grammar    = rjcpt::ParseFormula(tokens, rjcpt::ParserEngine::Grammar);
+      const auto precedence = rjcpt::ParseFormula(tokens, rjcpt::ParserEngine::Precedence);
+      ASSERT_EQ(grammar.has_value(), precedence.has_value()) << aExpression;
+      if (!grammar)
+      {
+         const auto at = [](const std::string& aError) { return aError.substr(aError.rfind(" at token ")); };
+         ASSERT_EQ(at(grammar.error()), at(precedence.error())) << aExpression << ": " << precedence.error();
+         return;
+      }
+      ASSERT_EQ(grammar->size(), precedence->size()) << aExpression;
+      for (std::size_t i = 0; i < grammar->size(); i++)
+      {
+         ASSERT_EQ((*grammar)[i].mType, (*precedence)[i].mType) << aExpression << " at node " << i;
+         ASSERT_EQ((*grammar)[i].mStartTokenIndex, (*precedence)[i].mStartTokenIndex) << aExpression << " at node " << i;
+         ASSERT_EQ((*grammar)[i].mStopTokenIndex, (*precedence)[i].mStopTokenIndex) << aExpression << " at node " << i;
+         ASSERT_EQ((*grammar)[i].mAuxData, (*precedence)[i].mAuxData) << aExpression << " at node " << i;
+      }
+   };
+
+   for (const std::string expression : {"1 + 2 * 3", "-a < $b <= 3 or not c", "2 qc / (fs + 1)", "if(a, f(g(x)), 0)",
+                                        "a < b < c = d and not e <> f or g", "not not a < b", "2 $a b", "-2 x y * z",
+                                        "f()", "f (x, y)", "2 pow(qc, 2)", "(a) b", "true false", "$(a + 1)", "", "1 +",
+                                        "(1", "1)", "f(1,)", "2 (qc)", "1 + not a", "a < not b", "()", "a not b", "1, 2"})
+   {
+      check(expression);
+   }
+   check(std::string(5000, '(') + "1" + std::string(5000, ')'));
+   check(std::string(5000, '-') + "1");
+
+   // Random sequences of tokens, most of which are not formulas.
+   constexpr std::string_view cTOKENS[] = {"a", "2", "f(", "(", ")", ",", "+", "-", "*", "/", "$", "<", ">=", "=",
+                                           "and", "or", "not", "true", "b"};
+   std::mt19937 random(5678);
+   for (int i = 0; i < 20000; i++)
+   {
+      std::string expression;
+      const int   count = 1 + static_cast<int>(random() % 12);
+      for (int j = 0; j < count; j++)
+      {
+         expression += cTOKENS[random() % std::size(cTOKENS)];
+         expression += ' ';
+      }
+      check(expression);
+   }
+
+   // Random formulas.
+   const auto generate = [&](const auto& aSelf, int aDepth) -> std::string
+   {
+      constexpr std::string_view cBINARY[] = {" + ", " - ", " * ", " / ", " and ", " or ", " < ", " <= ", " = ", " "};
+      switch (aDepth > 0 ? random() % 7 : random() % 2)
+      {
+      case 0:
+         return "a";
+      case 1:
+         return "2";
+      case 2:
+         return "(" + aSelf(aSelf, aDepth - 1) + ")";
+      case 3:
+         return std::string(random() % 2 ? "-" : "not ") + aSelf(aSelf, aDepth - 1);
+      case 4:
+         return "f(" + aSelf(aSelf, aDepth - 1) + ", " + aSelf(aSelf, aDepth - 1) + ")";
+      default:
+         return aSelf(aSelf, aDepth - 1) + std::string(cBINARY[random() % std::size(cBINARY)]) + aSelf(aSelf, aDepth - 1);
+      }
+   };
+   for (int i = 0; i < 5000; i++)
+   {
+      check(generate(generate, 5));
+   }
+}
+
+TEST(Formula, RuntimeGrammar)
+{
+   // The grammar compiled at compile time matches the one compiled from the same text at run time.
+   const auto               runtime = rjcpt::detail::CompileFormulaGrammar();
+   const rjcpt::GrammarView view    = rjcpt::GetFormulaGrammar();
+   ASSERT_EQ(runtime.mRules.size(), view.mRules.size());
+   for (std::size_t i = 0; i < runtime.mRules.size(); i++)
+   {
+      EXPECT_EQ(runtime.mRules[i].mName, view.mRules[i].mName);
+      EXPECT_EQ(runtime.mRules[i].mBegin, view.mRules[i].mBegin);
+      EXPECT_EQ(runtime.mRules[i].mEnd, view.mRules[i].mEnd);
+   }
+   EXPECT_TRUE(std::ranges::equal(runtime.mNodes, view.mNodes));
+   EXPECT_TRUE(std::ranges::equal(runtime.mParseTable, view.mParseTable));
+   EXPECT_TRUE(std::ranges::equal(runtime.mNodeNames, view.mNodeNames));
+}
+
+TEST(Formula, Incremental)
+{
+   // Checks that aFormula matches parsing its expression from scratch.
+   const auto check = [](const rjcpt::IncrementalFormula& aFormula)
+   {
+      const auto tokens = rjcpt::TokenizeExpression(aFormula.Expression());
+      ASSERT_TRUE(std::ranges::equal(aFormula.Tokens(), tokens)) << aFormula.Expression();
+      const auto nodes = rjcpt::ParseFormula(tokens);
+      ASSERT_EQ(aFormula.Error(), nodes ? std::string() : nodes.error()) << aFormula.Expression();
+      if (nodes)
+      {
+         ASSERT_EQ(aFormula.Nodes().size(), nodes->size()) << aFormula.Expression();
+         for (std::size_t i = 0; i < nodes->size(); i++)
+         {
+            EXPECT_EQ(aFormula.Nodes()[i].mType, (*nodes)[i].mType) << aFormula.Expression();
+            EXPECT_EQ(aFormula.Nodes()[i].mStartTokenIndex, (*nodes)[i].mStartTokenIndex) << aFormula.Expression();
+            EXPECT_EQ(aFormula.Nodes()[i].mStopTokenIndex, (*nodes)[i].mStopTokenIndex) << aFormula.Expression();
+            EXPECT_EQ(aFormula.Nodes()[i].mAuxData, (*nodes)[i].mAuxData) << aFormula.Expression();
+         }
+      }
+   };
+
+   // Typing a formula one character at a time.
+   rjcpt::IncrementalFormula formula;
+   const std::string_view    typed = "if(qc < 2 and fs > 0.1, max(qc, 2 fs), -$a * (u2 + 1))";
+   for (std::uint32_t i = 0; i < typed.size(); i++)
+   {
+      formula.Edit(i, 0, typed.substr(i, 1));
+      check(formula);
+   }
+   EXPECT_TRUE(formula.Error().empty());
+
+   // Renaming an identifier keeps every token type, so nothing is parsed again.
+   formula.Edit(3, 2, "depth");
+   EXPECT_EQ(formula.FirstChangedToken(), formula.Tokens().size());
+   check(formula);
+
+   // Random edits, including ones that break the formula and fix it again.
+   constexpr std::string_view cPIECES[] = {"qc", " ", "+", "-", "1", "*", "(", ")", "<", "f(", ",", "and", "not ", "$a",
+                                           "2 ", "/"};
+   std::mt19937 random(1234);
+   for (int i = 0; i < 3000; i++)
+   {
+      const std::string_view expression = formula.Expression();
+      const auto start   = static_cast<std::uint32_t>(random() % (expression.size() + 1));
+      const auto removed = static_cast<std::uint32_t>(random() % std::min<std::size_t>(expression.size() - start + 1, 4));
+      formula.Edit(start, removed, random() % 3 == 0 ? std::string_view() : cPIECES[random() % std::size(cPIECES)]);
+      check(formula);
+      if (formula.Expression().size() > 80)
+      {
+         formula.SetExpression("qc + 1");
+      }
+   }
+
+   EXPECT_THROW(formula.Edit(100, 0, "x"), std::out_of_range);
+}
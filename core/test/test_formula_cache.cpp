@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+
+#include "FormulaCache.hpp"
+#include "FormulaParser.hpp"
+#include "Lexer.hpp"
+#include "Optimizer.hpp"
+#include "Sheet.hpp"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+   std::expected<rjcpt::Program, std::string> CompileUncached(std::string_view aFormula, const rjcpt::SymbolResolver& aResolver)
+   {
+      const auto tokens = rjcpt::TokenizeExpression(aFormula);
+      const auto nodes  = rjcpt::ParseFormula(tokens);
+      if (!nodes)
+      {
+         return std::unexpected(nodes.error());
+      }
+      auto retval = rjcpt::CompileFormula(aFormula, tokens, *nodes, aResolver);
+      if (retval)
+      {
+         rjcpt::OptimizeProgram(*retval);
+      }
+      return retval;
+   }
+
+   bool SameCode(const rjcpt::Program& aLeft, const rjcpt::Program& aRight)
+   {
+      return std::ranges::equal(aLeft.mCode, aRight.mCode, [](const auto& aA, const auto& aB)
+                                { return aA.mOpCode == aB.mOpCode && aA.mOperand == aB.mOperand; }) &&
+             std::ranges::equal(aLeft.mConstants, aRight.mConstants) && aLeft.mMaxStackDepth == aRight.mMaxStackDepth &&
+             aLeft.mLocalCount == aRight.mLocalCount;
+   }
+
+   rjcpt::Sheet MakeSheet()
+   {
+      rjcpt::Sheet retval;
+      retval.SetColumn("qc", {1.0, 2.0});
+      retval.SetColumn("fs", {0.1, 0.2});
+      retval.SetColumn("u2", {0.5, 0.6});
+      retval.SetParameter("a", 0.8);
+      retval.SetParameter("b", 2.0);
+      return retval;
+   }
+}
+
+TEST(FormulaCache, SharesShapes)
+{
+   const rjcpt::Sheet            sheet = MakeSheet();
+   rjcpt::FormulaCache           cache;
+   std::vector<std::string_view> references;
+
+   const std::vector<std::string> formulas = {"qc + (1 - $a) u2", "fs+(1-$b)qc", "u2 + (1 - $a) u2",
+                                              "qc + (1 - a) u2", "max(qc, fs) * 2", "max(u2, qc)*2"};
+   for (const std::string& formula : formulas)
+   {
+      const auto cached = cache.Compile(formula, sheet, std::pmr::get_default_resource(), references);
+      ASSERT_TRUE(cached.has_value()) << formula;
+      EXPECT_TRUE(SameCode(*cached, *CompileUncached(formula, sheet))) << formula;
+   }
+   // "a" without '$' is a different shape, as it may also refer to a column.
+   EXPECT_EQ(cache.Size(), 4U);
+   EXPECT_EQ(cache.Hits(), 2U);
+
+   cache.Compile("u2 + (1 - $a) u2", sheet, std::pmr::get_default_resource(), references);
+   EXPECT_EQ(references, (std::vector<std::string_view>{"u2", "a"}));
+
+   // Numbers and function names are part of the shape.
+   cache.Compile("max(qc, fs) * 3", sheet, std::pmr::get_default_resource(), references);
+   cache.Compile("min(qc, fs) * 2", sheet, std::pmr::get_default_resource(), references);
+   EXPECT_EQ(cache.Size(), 6U);
+}
+
+TEST(FormulaCache, Errors)
+{
+   const rjcpt::Sheet            sheet = MakeSheet();
+   rjcpt::FormulaCache           cache;
+   std::vector<std::string_view> references;
+
+   // Errors are the same as without the cache, whether the shape is cached already or not.
+   const std::vector<std::string> formulas = {"qc + fs", "qc + nope", "qc + $fs", "$a + $qc", "foo(qc)",
+                                              "max(nope, foo(qc))", "qc +", "qc # 2", "qc + fs"};
+   for (int pass = 0; pass < 2; pass++)
+   {
+      for (const std::string& formula : formulas)
+      {
+         const auto cached   = cache.Compile(formula, sheet, std::pmr::get_default_resource(), references);
+         const auto uncached = CompileUncached(formula, sheet);
+         ASSERT_EQ(cached.has_value(), uncached.has_value()) << formula;
+         if (!cached)
+         {
+            EXPECT_EQ(cached.error(), uncached.error()) << formula;
+         }
+      }
+   }
+}
+
+TEST(FormulaCache, Sheets)
+{
+   rjcpt::FormulaCache cache;
+   rjcpt::Sheet        plain  = MakeSheet();
+   rjcpt::Sheet        cached = MakeSheet();
+   cached.SetFormulaCache(&cache);
+
+   // The columns are in another order, so the same formulas compile to other slots.
+   rjcpt::Sheet other;
+   other.SetColumn("u2", {0.5, 0.6});
+   other.SetParameter("b", 2.0);
+   other.SetColumn("fs", {0.1, 0.2});
+   other.SetParameter("a", 0.8);
+   other.SetColumn("qc", {1.0, 2.0});
+   other.SetFormulaCache(&cache);
+
+   std::vector<std::pair<std::string, std::string>> formulas = {{"f0", "qc + (1 - $a) u2"}};
+   for (int i = 1; i < 30; i++)
+   {
+      const std::string previous = "f" + std::to_string(i - 1);
+      formulas.emplace_back("f" + std::to_string(i), i % 2 ? previous + " * $b + fs" : "max(" + previous + ", qc) / 2");
+   }
+   for (const auto& [name, formula] : formulas)
+   {
+      ASSERT_TRUE(plain.SetFormula(name, formula).has_value());
+      ASSERT_TRUE(cached.SetFormula(name, formula).has_value());
+      ASSERT_TRUE(other.SetFormula(name, formula).has_value());
+   }
+   EXPECT_EQ(cache.Size(), 3U);
+
+   plain.Recalculate();
+   cached.Recalculate();
+   other.Recalculate();
+   for (const auto& [name, formula] : formulas)
+   {
+      EXPECT_TRUE(std::ranges::equal(plain.Column(name), cached.Column(name))) << name;
+      EXPECT_TRUE(std::ranges::equal(plain.Column(name), other.Column(name))) << name;
+   }
+
+   // Dependencies are tracked as without the cache.
+   cached.SetParameter("b", 3.0);
+   EXPECT_TRUE(cached.IsDirty("f1"));
+   EXPECT_FALSE(cached.IsDirty("f0"));
+   EXPECT_FALSE(cached.SetFormula("f0", "f29 + 1").has_value());
+}
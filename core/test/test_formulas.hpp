@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Compiler.hpp"
+#include "FormulaParser.hpp"
+#include "Lexer.hpp"
+
+#include <expected>
+#include <string>
+#include <string_view>
+
+namespace rjcpt::test
+{
+   //! Resolves columns qc, fs and u2 to slots 0 to 2, and parameters gamma and depth to slots 0 and 1.
+   class TestResolver : public SymbolResolver
+   {
+   public:
+      Symbol Resolve(std::string_view aName) const override
+      {
+         using SK = SymbolKind;
+         if (aName == "qc") return {SK::Column, 0};
+         if (aName == "fs") return {SK::Column, 1};
+         if (aName == "u2") return {SK::Column, 2};
+         if (aName == "gamma") return {SK::Parameter, 0};
+         if (aName == "depth") return {SK::Parameter, 1};
+         return {};
+      }
+   };
+
+   //! Lexes, parses and compiles aExpression with a TestResolver, without optimizing it.
+   //! On failure, returns the parse or compile error.
+   inline std::expected<Program, std::string> Compile(std::string_view aExpression)
+   {
+      const auto tokens = TokenizeExpression(aExpression);
+      const auto nodes  = ParseFormula(tokens);
+      if (!nodes)
+      {
+         return std::unexpected(nodes.error());
+      }
+      return CompileFormula(aExpression, tokens, *nodes, TestResolver());
+   }
+}
@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
 
 #include "GrammarLL.hpp"
+#include "test_locator.hpp"
+
+#include <stdexcept>
 
 TEST(Grammar, SkipSpace)
 {
@@ -29,3 +32,94 @@ TEST(Grammar, ExtractWord)
 {
 
 }
+
+TEST(Grammar, ParseTable)
+{
+   const rjcpt::test::TestLocator locator;
+   const auto grammar = rjcpt::CompileGrammar(locator, rjcpt::test::cTEST_GRAMMAR);
+   ASSERT_EQ(grammar.mParseTable.size(), grammar.mRules.size() * rjcpt::cNUM_TOKEN_TYPES);
+
+   auto lookup = [&](std::string_view aRule, rjcpt::TokenType aType) -> std::string_view
+      {
+         for (std::size_t i = 0; i < grammar.mNodes.size(); i++)
+         {
+            const auto& node = grammar.mNodes[i];
+            if (!node.IsTerminal() && grammar.mNodeNames[i].view() == aRule)
+            {
+               const auto index = grammar.LookupRule(node, aType);
+               if (index == rjcpt::cNO_RULE)
+               {
+                  return "";
+               }
+               // Returns the first node of the rule, or "-" for an empty rule.
+               const auto& rule = grammar.mRules[index];
+               return rule.mBegin == rule.mEnd ? "-" : grammar.mNodeNames[rule.mBegin].view();
+            }
+         }
+         return "?";
+      };
+   using TT = rjcpt::TokenType;
+   EXPECT_EQ(lookup("Sum", TT::Number), "Product");
+   EXPECT_EQ(lookup("Sum", TT::Hyphen), "Product");
+   EXPECT_EQ(lookup("Sum", TT::Plus), "");
+   EXPECT_EQ(lookup("SumTail", TT::Plus), "Plus>");
+   EXPECT_EQ(lookup("SumTail", TT::EndOfData), "-");
+   EXPECT_EQ(lookup("SumTail", TT::RightParenthesis), "-");
+   EXPECT_EQ(lookup("SumTail", TT::Number), "");
+   EXPECT_EQ(lookup("ProductTail", TT::Plus), "-");
+   EXPECT_EQ(lookup("Unary", TT::Hyphen), "Hyphen>");
+   EXPECT_EQ(lookup("Unary", TT::Identifier), "Primary");
+   EXPECT_EQ(lookup("Primary", TT::Number), "Number>Number");
+   EXPECT_EQ(lookup("Primary", TT::Identifier), "Identifier>Identifier");
+   EXPECT_EQ(lookup("Primary", TT::LeftParenthesis), "LParen>");
+}
+
+TEST(Grammar, Conflicts)
+{
+   const rjcpt::test::TestLocator locator;
+   // Both alternatives start with a Number.
+   EXPECT_THROW(rjcpt::CompileGrammar(locator, "A= Number> Plus> | Number> Asterisk>"), std::runtime_error);
+   // Left recursion.
+   EXPECT_THROW(rjcpt::CompileGrammar(locator, "A= A Plus> Number> | Number>"), std::runtime_error);
+   // An empty alternative conflicts with what can follow the rule.
+   EXPECT_THROW(rjcpt::CompileGrammar(locator, "S= A Number> EOF>  A= Number> |"), std::runtime_error);
+   EXPECT_NO_THROW(rjcpt::CompileGrammar(locator, "S= A Number> EOF>  A= Plus> |"));
+}
+
+TEST(Grammar, CompileTime)
+{
+   constexpr auto cSIZE    = rjcpt::grammar_util::GetGrammarSize(rjcpt::test::cTEST_GRAMMAR);
+   constexpr auto cGRAMMAR = rjcpt::CompileStaticGrammar<cSIZE.mNumRules, cSIZE.mNumNodes>(rjcpt::test::TestLocator(),
+                                                                                         rjcpt::test::cTEST_GRAMMAR);
+   static_assert(cGRAMMAR.View().NonTerminal("Unary").RulesEnd() - cGRAMMAR.View().NonTerminal("Unary").RulesBegin() == 2);
+   static_assert(cGRAMMAR.View().LookupRule(cGRAMMAR.View().NonTerminal("SumTail"), rjcpt::TokenType::Number) ==
+                 rjcpt::cNO_RULE);
+
+   // The same tables as when compiled at run time.
+   const auto runtime = rjcpt::CompileGrammar(rjcpt::test::TestLocator(), rjcpt::test::cTEST_GRAMMAR);
+   ASSERT_EQ(runtime.mRules.size(), cGRAMMAR.mRules.size());
+   ASSERT_EQ(runtime.mNodes.size(), cGRAMMAR.mNodes.size());
+   for (std::size_t i = 0; i < runtime.mRules.size(); i++)
+   {
+      EXPECT_EQ(runtime.mRules[i].mName, cGRAMMAR.mRules[i].mName);
+      EXPECT_EQ(runtime.mRules[i].mBegin, cGRAMMAR.mRules[i].mBegin);
+      EXPECT_EQ(runtime.mRules[i].mEnd, cGRAMMAR.mRules[i].mEnd);
+   }
+   EXPECT_TRUE(std::ranges::equal(runtime.mParseTable, cGRAMMAR.mParseTable));
+   EXPECT_TRUE(std::ranges::equal(runtime.mNodeNames, cGRAMMAR.mNodeNames));
+}
+
+TEST(Grammar, NodeNames)
+{
+   const auto grammar = rjcpt::CompileGrammar(rjcpt::test::TestLocator(), rjcpt::test::cTEST_GRAMMAR);
+   ASSERT_EQ(grammar.mNodeNames.size(), grammar.mNodes.size());
+   const rjcpt::GrammarView view = grammar;
+   for (std::size_t i = 0; i < grammar.mNodes.size(); i++)
+   {
+      EXPECT_EQ(view.NodeName(grammar.mNodes[i]), grammar.mNodeNames[i].view());
+   }
+
+   rjcpt::GrammarNode unknown;
+   unknown.SetTerminal(rjcpt::test::TestLocator().FindValidator("EOF"), 0);
+   EXPECT_EQ(view.NodeName(unknown), "");
+}
@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+
+#include "Interner.hpp"
+#include "PerfectHash.hpp"
+
+#include <string>
+#include <vector>
+
+TEST(Interner, Ids)
+{
+   rjcpt::Interner interner;
+   EXPECT_EQ(interner.Find("qc"), rjcpt::Interner::cNOT_FOUND);
+   EXPECT_EQ(interner.Intern("qc"), 0U);
+   EXPECT_EQ(interner.Intern("fs"), 1U);
+   EXPECT_EQ(interner.Intern(""), 2U);
+   EXPECT_EQ(interner.Intern("qc"), 0U);
+   EXPECT_EQ(interner.Find("fs"), 1U);
+   EXPECT_EQ(interner.Find(""), 2U);
+   EXPECT_EQ(interner.Find("q"), rjcpt::Interner::cNOT_FOUND);
+   EXPECT_EQ(interner.Size(), 3U);
+
+   // Names are copies, and stay valid as more are added.
+   std::string name = "u2";
+   EXPECT_EQ(interner.Intern(name), 3U);
+   name[0] = 'x';
+   const std::string_view first = interner.Name(0);
+   for (int i = 0; i < 10000; i++)
+   {
+      EXPECT_EQ(interner.Intern("channel" + std::to_string(i)), static_cast<std::uint32_t>(i + 4));
+   }
+   EXPECT_EQ(interner.Name(3), "u2");
+   EXPECT_EQ(first, "qc");
+   EXPECT_EQ(interner.Find("channel1234"), 1238U);
+   EXPECT_EQ(interner.Name(1238), "channel1234");
+
+   interner.Clear();
+   EXPECT_EQ(interner.Size(), 0U);
+   EXPECT_EQ(interner.Find("qc"), rjcpt::Interner::cNOT_FOUND);
+   EXPECT_EQ(interner.Intern("fs"), 0U);
+}
+
+TEST(PerfectHashMap, Find)
+{
+   static constexpr rjcpt::PerfectHashMap<int, 4> cMAP({{{"abs", 1}, {"sqrt", 2}, {"ln", 3}, {"log", 4}}});
+   static_assert(*cMAP.Find("sqrt") == 2);
+   static_assert(cMAP.Find("sqr") == nullptr);
+   EXPECT_EQ(cMAP.FindOr("abs", 0), 1);
+   EXPECT_EQ(cMAP.FindOr("ln", 0), 3);
+   EXPECT_EQ(cMAP.FindOr("log", 0), 4);
+   EXPECT_EQ(cMAP.FindOr("", 0), 0);
+   EXPECT_EQ(cMAP.FindOr("logs", 0), 0);
+
+   const std::vector<std::string> keys = {"a", "b", "c", "d", "e", "f", "g", "h"};
+   std::array<rjcpt::PerfectHashMap<int, 8>::Entry, 8> entries;
+   for (std::size_t i = 0; i < keys.size(); i++)
+   {
+      entries[i] = {keys[i], static_cast<int>(i)};
+   }
+   const rjcpt::PerfectHashMap<int, 8> map(entries);
+   for (std::size_t i = 0; i < keys.size(); i++)
+   {
+      EXPECT_EQ(map.FindOr(keys[i], -1), static_cast<int>(i));
+   }
+   EXPECT_EQ(map.FindOr("ab", -1), -1);
+}
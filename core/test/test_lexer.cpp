@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+
+#include "Lexer.hpp"
+
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace
+{
+   //! Returns a compact description of the tokens in aExpression: one "Type:text" entry per token.
+   std::string Describe(std::string_view aExpression, std::span<const rjcpt::Token> aTokens)
+   {
+      static constexpr const char* cNAMES[] = {
+         "End", "Error", "Num", "Id", "+", "-", "*", "/", "^", ",", ":", "$", "(", ")", "[", "]", "{", "}",
+         "=", "<>", "<", "<=", ">", ">=", "and", "or", "not", "true", "false"};
+      static_assert(std::size(cNAMES) == rjcpt::cNUM_TOKEN_TYPES);
+
+      std::string retval;
+      for (const rjcpt::Token& token : aTokens)
+      {
+         if (!retval.empty())
+         {
+            retval += ' ';
+         }
+         retval += cNAMES[static_cast<int>(token.mType)];
+         retval += ':';
+         retval += aExpression.substr(token.mStartIndex, token.mLength);
+      }
+      return retval;
+   }
+
+   std::string Tokenize(std::string_view aExpression)
+   {
+      return Describe(aExpression, rjcpt::TokenizeExpression(aExpression));
+   }
+}
+
+TEST(Lexer, Operators)
+{
+   EXPECT_EQ(Tokenize("+-*/,$()[]="), "+:+ -:- *:* /:/ ,:, $:$ (:( ):) [:[ ]:] =:= End:");
+   EXPECT_EQ(Tokenize("< <= <> > >="), "<:< <=:<= <>:<> >:> >=:>= End:");
+   EXPECT_EQ(Tokenize("a<=>b"), "Id:a <=:<= >:> Id:b End:");
+   EXPECT_EQ(Tokenize(" \t\r\n\v\f"), "End:");
+   EXPECT_EQ(Tokenize(""), "End:");
+   // Tokenizing stops at the first error.
+   EXPECT_EQ(Tokenize("1 ^ 2"), "Num:1 Error:^");
+   EXPECT_EQ(Tokenize("a : b"), "Id:a Error::");
+   EXPECT_EQ(Tokenize("{"), "Error:{");
+   EXPECT_EQ(Tokenize("a # b"), "Id:a Error:#");
+   EXPECT_EQ(Tokenize("\xC3\xA9"), "Error:\xC3");
+}
+
+TEST(Lexer, Numbers)
+{
+   EXPECT_EQ(Tokenize("1 23 4.5 .5 6. 7e8 9E-1 2e+3"), "Num:1 Num:23 Num:4.5 Num:.5 Num:6. Num:7e8 Num:9E-1 Num:2e+3 End:");
+   EXPECT_EQ(Tokenize("1.5e3x"), "Num:1.5e3 Id:x End:");
+   EXPECT_EQ(Tokenize("1-2"), "Num:1 -:- Num:2 End:");
+   EXPECT_EQ(Tokenize(".e5"), "Num:.e5 End:");
+   EXPECT_EQ(Tokenize("."), "Error:.");
+   EXPECT_EQ(Tokenize("1.2.3"), "Error:1.2");
+   EXPECT_EQ(Tokenize("2abc"), "Error:2abc");
+   EXPECT_EQ(Tokenize("2a1"), "Error:2a");
+   EXPECT_EQ(Tokenize("2a_%b"), "Error:2a_%b");
+   EXPECT_EQ(Tokenize("1e"), "Error:1e");
+   EXPECT_EQ(Tokenize("1e+"), "Error:1e+");
+   EXPECT_EQ(Tokenize("1ex"), "Error:1e");
+}
+
+TEST(Lexer, Words)
+{
+   EXPECT_EQ(Tokenize("qc fs_1 _x %y a.b.c z9.5"), "Id:qc Id:fs_1 Id:_x Id:%y Id:a.b.c Id:z9.5 End:");
+   EXPECT_EQ(Tokenize("and or not true false"), "and:and or:or not:not true:true false:false End:");
+   EXPECT_EQ(Tokenize("And android nota trueish falsey"), "Id:And Id:android Id:nota Id:trueish Id:falsey End:");
+   EXPECT_EQ(Tokenize("sqrt(qc)"), "Id:sqrt (:( Id:qc ):) End:");
+   EXPECT_EQ(Tokenize("   a_very_long_identifier_that_spans_several_blocks_of_sixteen   +   b   "),
+             "Id:a_very_long_identifier_that_spans_several_blocks_of_sixteen +:+ Id:b End:");
+}
+
+TEST(Lexer, FindNextToken)
+{
+   const rjcpt::Token token = rjcpt::detail::FindNextToken("  abc + 1", 1);
+   EXPECT_EQ(token.mType, rjcpt::TokenType::Identifier);
+   EXPECT_EQ(token.mStartIndex, 2U);
+   EXPECT_EQ(token.mLength, 3U);
+
+   const rjcpt::Token end = rjcpt::detail::FindNextToken("abc   ", 3);
+   EXPECT_EQ(end.mType, rjcpt::TokenType::EndOfData);
+   EXPECT_EQ(end.mStartIndex, 6U);
+
+   EXPECT_EQ(rjcpt::detail::FindNumberEnd("12.5e-3+", 0), (std::pair<std::uint32_t, bool>(7, true)));
+   EXPECT_EQ(rjcpt::detail::FindExponentEnd("e-", 1), (std::pair<std::uint32_t, bool>(2, false)));
+}
+
+TEST(Lexer, Batch)
+{
+   const std::vector<std::string_view> expressions{"qc + 1", "", "2 (fs)", "a ^ b", "sqrt(u2)"};
+   const rjcpt::TokenBuffer            buffer = rjcpt::TokenizeExpressions(expressions);
+   ASSERT_EQ(buffer.Size(), expressions.size());
+   for (std::size_t i = 0; i < expressions.size(); i++)
+   {
+      EXPECT_EQ(Describe(expressions[i], buffer.Tokens(i)), Tokenize(expressions[i]));
+   }
+   EXPECT_EQ(buffer.mTokens.size(), 4U + 1U + 5U + 2U + 5U);
+   EXPECT_EQ(rjcpt::TokenizeExpressions({}).Size(), 0U);
+}
+
+TEST(Lexer, Retokenize)
+{
+   // Replaces aRemoved characters at aStart with aText, and checks the result against lexing from scratch.
+   const auto check = [](std::string aExpression, std::uint32_t aStart, std::uint32_t aRemoved, std::string_view aText)
+   {
+      auto tokens = rjcpt::TokenizeExpression(aExpression);
+      const auto before = tokens;
+      aExpression.replace(aStart, aRemoved, aText);
+      const std::uint32_t first = rjcpt::RetokenizeExpression(aExpression, {aStart, aRemoved, static_cast<std::uint32_t>(aText.size())}, tokens);
+      EXPECT_EQ(tokens, rjcpt::TokenizeExpression(aExpression)) << aExpression;
+      for (std::uint32_t i = 0; i < first && i < before.size(); i++)
+      {
+         EXPECT_EQ(tokens[i].mType, before[i].mType) << aExpression;
+      }
+      return first;
+   };
+
+   EXPECT_EQ(check("ab + 1", 2, 0, "c"), 4U);     // Extending an identifier changes no types.
+   EXPECT_EQ(check("a + 1", 4, 1, "2"), 4U);      // Same for replacing a digit.
+   EXPECT_EQ(check("a < 1", 3, 0, "="), 1U);      // "<" becomes "<=".
+   EXPECT_EQ(check("a + 1", 5, 0, " * b"), 3U);   // Appending.
+   EXPECT_EQ(check("1 # 2 + 3", 6, 1, "-"), 2U);  // After an error, nothing is lexed.
+   EXPECT_EQ(check("1 # 2 + 3", 2, 1, "*"), 1U);  // Removing the error lexes the rest.
+   EXPECT_EQ(check("a + b", 0, 5, ""), 0U);
+   EXPECT_EQ(check("", 0, 0, "x"), 0U);
+
+   // Random edits of random formulas.
+   constexpr std::string_view cPIECES[] = {"qc", " ", "+", "-", "1", ".5", "e", "2", "(", ")", "<", "=", ">", "and",
+                                           "$", ",", "#", "not", "x1", "  "};
+   std::mt19937 random(1234);
+   const auto   piece = [&]() { return cPIECES[random() % std::size(cPIECES)]; };
+   for (int i = 0; i < 2000; i++)
+   {
+      std::string expression;
+      for (std::size_t n = random() % 12; n > 0; n--)
+      {
+         expression += piece();
+      }
+      const auto        start   = static_cast<std::uint32_t>(random() % (expression.size() + 1));
+      const auto        removed = static_cast<std::uint32_t>(random() % (expression.size() - start + 1));
+      const std::string inserted(random() % 3 == 0 ? std::string_view() : piece());
+      check(expression, start, removed, inserted);
+   }
+}
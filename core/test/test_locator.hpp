@@ -0,0 +1,82 @@
+#pragma once
+
+#include "GrammarLL.hpp"
+
+#include <array>
+#include <string_view>
+
+namespace rjcpt::test
+{
+   //! A GrammarLocator for unit tests.
+   //! Each validator accepts exactly one token type, and is named after it.
+   //! Actors are looked up by name in a fixed list, starting from index 1.
+   class TestLocator : public GrammarLocator
+   {
+   public:
+      // Declared explicitly so that the locator can be used in constant expressions.
+      constexpr ~TestLocator() override {}
+
+      static constexpr std::array<std::string_view, 5> cACTORS = {"Number", "Identifier", "Add", "Multiply", "Negate"};
+
+      constexpr std::uint16_t FindValidator(std::string_view aName) const override
+      {
+         for (std::size_t i = 0; i < cVALIDATORS.size(); i++)
+         {
+            if (cVALIDATORS[i].first == aName)
+            {
+               return static_cast<std::uint16_t>(cVALIDATORS[i].second) + 1;
+            }
+         }
+         return 0;
+      }
+      constexpr std::uint16_t FindActor(std::string_view aName) const override
+      {
+         for (std::size_t i = 0; i < cACTORS.size(); i++)
+         {
+            if (cACTORS[i] == aName)
+            {
+               return static_cast<std::uint16_t>(i + 1);
+            }
+         }
+         return 0;
+      }
+      constexpr TokenSet ValidatorTokens(std::uint16_t aValidator) const override
+      {
+         TokenSet retval;
+         retval.set(aValidator - 1U);
+         return retval;
+      }
+
+      //! Returns the token type accepted by aValidator.
+      static constexpr TokenType ValidatorType(std::uint16_t aValidator) { return static_cast<TokenType>(aValidator - 1); }
+
+   private:
+      static constexpr std::array<std::pair<std::string_view, TokenType>, 8> cVALIDATORS = {{
+         {"EOF", TokenType::EndOfData},
+         {"Number", TokenType::Number},
+         {"Identifier", TokenType::Identifier},
+         {"Plus", TokenType::Plus},
+         {"Hyphen", TokenType::Hyphen},
+         {"Asterisk", TokenType::Asterisk},
+         {"LParen", TokenType::LeftParenthesis},
+         {"RParen", TokenType::RightParenthesis}
+      }};
+   };
+
+   //! A small arithmetic grammar that only TestLocator understands.
+   inline constexpr std::string_view cTEST_GRAMMAR = R"(
+      # Sums and products, with unary minus.
+      Start=       Sum
+      Sum=         Product SumTail
+      SumTail=     Plus> Product >Add SumTail
+         |
+      Product=     Unary ProductTail
+      ProductTail= Asterisk> Unary >Multiply ProductTail
+         |
+      Unary=       Hyphen> Unary >Negate
+         |         Primary
+      Primary=     Number>Number
+         |         Identifier>Identifier
+         |         LParen> Sum RParen>
+   )";
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+#include "ColumnEvaluator.hpp"
+#include "Optimizer.hpp"
+#include "test_formulas.hpp"
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace
+{
+   using rjcpt::test::Compile;
+
+   std::size_t OptimizedSize(std::string_view aExpression)
+   {
+      rjcpt::Program program = Compile(aExpression).value();
+      return rjcpt::OptimizeProgram(program).mInstructionsAfter;
+   }
+
+   //! Random values, with a sprinkling of zeros, infinities and NaNs.
+   std::vector<double> MakeColumn(std::mt19937& aRandom, std::size_t aRows)
+   {
+      constexpr double cSPECIAL[] = {0.0, -0.0, 1.0, std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN()};
+      std::uniform_real_distribution<double> value(-100.0, 100.0);
+      std::uniform_int_distribution<int>     pick(0, 19);
+      std::vector<double> retval(aRows);
+      for (double& v : retval)
+      {
+         const int p = pick(aRandom);
+         v = p < static_cast<int>(std::size(cSPECIAL)) ? cSPECIAL[p] : value(aRandom);
+      }
+      return retval;
+   }
+}
+
+TEST(Optimizer, MatchesUnoptimized)
+{
+   constexpr std::size_t cROWS = 2 * rjcpt::ColumnEvaluator::cBLOCK_SIZE + 11;
+   std::mt19937 random(4321);
+   const auto qc = MakeColumn(random, cROWS);
+   const auto fs = MakeColumn(random, cROWS);
+   const auto u2 = MakeColumn(random, cROWS);
+   const std::array<const double*, 3> columns    = {qc.data(), fs.data(), u2.data()};
+   const std::array<double, 1>        parameters = {18.5};
+
+   constexpr std::string_view cFORMULAS[] = {
+      "qc + 2 * 3 - fs",
+      "0 / 0 + qc",
+      "-(-qc) * 1 + fs / 1 - (u2 - 0) + 1 * u2",
+      "qc + 0 + -0 + (0 - qc)",
+      "(qc + fs) * (qc + fs) - sqrt(qc + fs)",
+      "(qc and 1) + (1 and fs) + (qc or 0) + (0 or fs) + (qc and 0) + (1 or fs)",
+      "(qc > 0 and 1) + (1 or qc) + (not qc and 1)",
+      "qc > 0 and (fs * 2 > 1 or fs * 2 < -1) and fs * 2 <> 0",
+      "(qc or fs * u2) + fs * u2",
+      "if(1 < 2, qc, fs) + if(0, qc, fs) + if(qc, fs, fs) + if(gamma > 0, 1, 2)",
+      "1 < 2 < 3 and 1 < qc < 1 + 2 and 0 = 0 <> 1",
+      "max(1, 2, 3) + min(qc, fs, qc) + pow(2, 10) * abs(-1) + ln(0)",
+      "$gamma * qc + $gamma * qc + $gamma / (qc + 1) / (qc + 1)",
+      "if(qc > fs, qc - fs, fs - qc) * if(qc > fs, qc - fs, fs - qc) + (qc > fs)",
+      "(qc u2 + fs u2) * (qc u2 + fs u2) * (qc u2 + fs u2) + (qc u2 + fs u2 > 1 or qc u2 + fs u2 < -1)",
+      "(not not qc) + (not not not 0) + -(-(-fs))",
+      "1 + 2"
+   };
+
+   rjcpt::ColumnEvaluator evaluator;
+   for (const std::string_view formula : cFORMULAS)
+   {
+      const rjcpt::Program original  = Compile(formula).value();
+      rjcpt::Program       optimized = Compile(formula).value();
+      const rjcpt::OptimizerReport report = rjcpt::OptimizeProgram(optimized);
+      EXPECT_EQ(report.mInstructionsBefore, original.mCode.size()) << formula;
+      EXPECT_EQ(report.mInstructionsAfter, optimized.mCode.size()) << formula;
+      EXPECT_LE(optimized.mCode.size(), original.mCode.size()) << formula;
+
+      // Optimizing again changes nothing.
+      rjcpt::Program twice = optimized;
+      rjcpt::OptimizeProgram(twice);
+      EXPECT_EQ(twice.mCode.size(), optimized.mCode.size()) << formula;
+
+      std::vector<double> output(cROWS);
+      evaluator.Evaluate(optimized, rjcpt::EvaluationContext{columns, parameters}, output);
+      for (std::size_t i = 0; i < cROWS; i++)
+      {
+         const double expected = rjcpt::Evaluate(original, rjcpt::EvaluationContext{columns, parameters, i});
+         const double actual   = rjcpt::Evaluate(optimized, rjcpt::EvaluationContext{columns, parameters, i});
+         ASSERT_EQ(std::bit_cast<std::uint64_t>(actual), std::bit_cast<std::uint64_t>(expected)) << formula << " at row " << i;
+         ASSERT_EQ(std::bit_cast<std::uint64_t>(output[i]), std::bit_cast<std::uint64_t>(expected)) << formula << " at row " << i;
+      }
+   }
+}
+
+TEST(Optimizer, FoldsConstants)
+{
+   EXPECT_EQ(OptimizedSize("1 + 2 * 3"), 2U);
+   EXPECT_EQ(OptimizedSize("qc + 2 * 3"), 4U);
+   EXPECT_EQ(OptimizedSize("max(1, 4, 2) < 5 < 6"), 2U);
+   EXPECT_EQ(OptimizedSize("-(-qc) * 1 / 1 - 0"), 2U);
+   // Not exact for -0.
+   EXPECT_EQ(OptimizedSize("qc + 0"), 4U);
+
+   rjcpt::Program program = Compile("1 + 2 + qc + 1 + 2").value();
+   rjcpt::OptimizeProgram(program);
+   EXPECT_EQ(program.mConstants, (std::pmr::vector<double>{3.0, 1.0, 2.0}));
+}
+
+TEST(Optimizer, RemovesDeadBranches)
+{
+   EXPECT_EQ(OptimizedSize("0 and qc"), 2U);
+   EXPECT_EQ(OptimizedSize("qc or 1"), 2U);
+   EXPECT_EQ(OptimizedSize("if(2 > 1, qc, fs)"), 2U);
+   EXPECT_EQ(OptimizedSize("if(qc, fs + 1, fs + 1)"), 4U);
+   // Still 0 or 1, so the operand is normalized.
+   EXPECT_EQ(OptimizedSize("1 and qc"), 4U);
+   EXPECT_EQ(OptimizedSize("1 and qc > fs"), 4U);
+}
+
+TEST(Optimizer, SharesSubexpressions)
+{
+   rjcpt::Program program = Compile("(qc + fs) * (qc + fs) + (qc + fs)").value();
+   const rjcpt::OptimizerReport report = rjcpt::OptimizeProgram(program);
+   EXPECT_EQ(report.mInstructionsBefore, 12U);
+   EXPECT_EQ(report.mInstructionsAfter, 9U);
+   EXPECT_EQ(report.mShared, 1U);
+   EXPECT_EQ(program.mLocalCount, 1U);
+
+   // The right operand of "or" is not always evaluated, so its values are not reused after it.
+   program = Compile("(qc or fs * u2) + fs * u2").value();
+   rjcpt::OptimizeProgram(program);
+   EXPECT_EQ(program.mLocalCount, 0U);
+   program = Compile("(fs * u2 or qc) + fs * u2").value();
+   rjcpt::OptimizeProgram(program);
+   EXPECT_EQ(program.mLocalCount, 1U);
+}
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+
+#include "Lexer.hpp"
+#include "ParserLL.hpp"
+#include "test_locator.hpp"
+
+#include <string>
+
+namespace
+{
+   //! Records each actor as a single character, in the order they are run.
+   class RecordingContext : public rjcpt::ParseContext
+   {
+   public:
+      RecordingContext()
+         : mGrammar(rjcpt::CompileGrammar(rjcpt::test::TestLocator(), rjcpt::test::cTEST_GRAMMAR))
+      {
+      }
+
+      rjcpt::GrammarView GetGrammar() const override { return mGrammar; }
+
+      rjcpt::GrammarNode GetEOF_Node() const override
+      {
+         rjcpt::GrammarNode retval;
+         retval.SetTerminal(rjcpt::test::TestLocator().FindValidator("EOF"), 0);
+         return retval;
+      }
+      rjcpt::GrammarNode GetStartRule() const override
+      {
+         const auto iter = std::ranges::find(mGrammar.mRules, std::string_view("Start"), [](const auto& aRule) { return aRule.mName.view(); });
+         rjcpt::GrammarNode retval;
+         retval.SetNonTerminal(static_cast<std::uint16_t>(iter - mGrammar.mRules.begin()),
+                               static_cast<std::uint16_t>(iter - mGrammar.mRules.begin() + 1));
+         return retval;
+      }
+
+      void BeginParsing() override { mOutput.clear(); }
+      bool CheckValidator(const rjcpt::Token& aToken, std::uint16_t aValidator) const override
+      {
+         return aToken.mType == rjcpt::test::TestLocator::ValidatorType(aValidator);
+      }
+      bool RunActor(const rjcpt::Token&, std::uint32_t, std::uint16_t aActor) override
+      {
+         mOutput += "ni+*-"[aActor - 1];
+         return true;
+      }
+
+      const std::string& Output() const { return mOutput; }
+
+   private:
+      rjcpt::CompiledGrammar mGrammar;
+      std::string            mOutput;
+   };
+
+   //! Parses aExpression and returns the actors run in postfix order, or the error message.
+   std::string ParseToPostfix(std::string_view aExpression)
+   {
+      RecordingContext context;
+      const auto tokens = rjcpt::TokenizeExpression(aExpression);
+      const auto error  = rjcpt::Parse(context, tokens);
+      return error.empty() ? context.Output() : "error: " + error;
+   }
+}
+
+TEST(Parser, Postfix)
+{
+   EXPECT_EQ(ParseToPostfix("1"), "n");
+   EXPECT_EQ(ParseToPostfix("x"), "i");
+   EXPECT_EQ(ParseToPostfix("1 + x"), "ni+");
+   EXPECT_EQ(ParseToPostfix("1 + 2 * 3"), "nnn*+");
+   EXPECT_EQ(ParseToPostfix("1 * 2 + 3"), "nn*n+");
+   EXPECT_EQ(ParseToPostfix("(1 + 2) * 3"), "nn+n*");
+   EXPECT_EQ(ParseToPostfix("--x * 2"), "i--n*");
+   EXPECT_EQ(ParseToPostfix("((((x))))"), "i");
+}
+
+TEST(Parser, Errors)
+{
+   EXPECT_EQ(ParseToPostfix("").substr(0, 6), "error:");
+   EXPECT_EQ(ParseToPostfix("1 +").substr(0, 6), "error:");
+   EXPECT_EQ(ParseToPostfix("1 2").substr(0, 6), "error:");
+   EXPECT_EQ(ParseToPostfix("(1").substr(0, 6), "error:");
+   EXPECT_EQ(ParseToPostfix("1)").substr(0, 6), "error:");
+   EXPECT_EQ(ParseToPostfix("* 1").substr(0, 6), "error:");
+
+   // Errors name the grammar node that failed.
+   EXPECT_EQ(ParseToPostfix("* 1"), "error: No matching rule for Start at token 0");
+   EXPECT_EQ(ParseToPostfix("(1"), "error: Failed validator RParen> at token 2");
+}
+
+TEST(Parser, TokenStream)
+{
+   // Nothing after the first error is lexed.
+   std::vector<rjcpt::Token> lexed;
+   rjcpt::TokenStream        stream("1 2 + 3 * 4", &lexed);
+   RecordingContext          context;
+   EXPECT_EQ(rjcpt::Parse(context, stream), "No matching rule for ProductTail at token 1");
+   EXPECT_EQ(lexed.size(), 2U);
+   EXPECT_EQ(stream.Index(), 1U);
+
+   // The stream stays at the end once it is reached.
+   lexed.clear();
+   rjcpt::TokenStream complete("1 + 2", &lexed);
+   EXPECT_EQ(rjcpt::Parse(context, complete), "");
+   EXPECT_EQ(context.Output(), "nn+");
+   EXPECT_EQ(lexed, rjcpt::TokenizeExpression("1 + 2"));
+   complete.Advance();
+   EXPECT_EQ(complete.Current().mType, rjcpt::TokenType::EndOfData);
+   EXPECT_EQ(lexed.size(), 4U);
+}
+
+TEST(Parser, FindRule)
+{
+   RecordingContext context;
+   const auto& grammar = context.GetGrammar();
+   const auto  start   = context.GetStartRule();
+
+   const auto rule = rjcpt::parser_util::FindRule(context, rjcpt::Token{rjcpt::TokenType::Number, 0, 1}, start);
+   ASSERT_TRUE(rule.has_value());
+   EXPECT_EQ(grammar.mRules[*rule].mName.view(), "Start");
+
+   EXPECT_FALSE(rjcpt::parser_util::FindRule(context, rjcpt::Token{rjcpt::TokenType::Asterisk, 0, 1}, start).has_value());
+}
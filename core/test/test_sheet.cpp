@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+
+#include "Sheet.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+TEST(Sheet, Recalculate)
+{
+   rjcpt::Sheet sheet;
+   sheet.SetColumn("qc", {1.0, 2.0, 3.0});
+   sheet.SetColumn("u2", {0.5, 0.5, 0.5});
+   sheet.SetParameter("a", 0.8);
+   ASSERT_TRUE(sheet.SetFormula("qt", "qc + (1 - $a) u2").has_value());
+   ASSERT_TRUE(sheet.SetFormula("double", "2 qt").has_value());
+
+   EXPECT_TRUE(sheet.IsDirty("qt"));
+   EXPECT_EQ(sheet.Recalculate(), 2U);
+   EXPECT_FALSE(sheet.IsDirty("qt"));
+   const auto qt = sheet.Column("qt");
+   ASSERT_EQ(qt.size(), 3U);
+   EXPECT_DOUBLE_EQ(qt[0], 1.1);
+   EXPECT_DOUBLE_EQ(sheet.Column("double")[2], 6.2);
+
+   // Nothing changed.
+   EXPECT_EQ(sheet.Recalculate(), 0U);
+
+   // Only the dependents of an edited value are recomputed.
+   ASSERT_TRUE(sheet.SetFormula("other", "qc * 10").has_value());
+   EXPECT_EQ(sheet.Recalculate(), 1U);
+   sheet.SetParameter("a", 0.5);
+   EXPECT_TRUE(sheet.IsDirty("qt"));
+   EXPECT_TRUE(sheet.IsDirty("double"));
+   EXPECT_FALSE(sheet.IsDirty("other"));
+   EXPECT_EQ(sheet.Recalculate(), 2U);
+   EXPECT_DOUBLE_EQ(sheet.Column("double")[0], 2.5);
+   sheet.SetParameter("a", 0.5);
+   EXPECT_EQ(sheet.Recalculate(), 0U);
+   sheet.SetColumn("qc", {10.0, 20.0, 30.0});
+   EXPECT_EQ(sheet.Recalculate(), 3U);
+   EXPECT_DOUBLE_EQ(sheet.Column("other")[1], 200.0);
+}
+
+TEST(Sheet, RowCount)
+{
+   rjcpt::Sheet sheet;
+   sheet.SetColumn("a", {1.0, 2.0});
+   ASSERT_TRUE(sheet.SetFormula("b", "a + 1").has_value());
+   sheet.Recalculate();
+   EXPECT_EQ(sheet.Column("b").size(), 2U);
+
+   sheet.SetColumn("c", {1.0, 2.0, 3.0, 4.0});
+   EXPECT_EQ(sheet.RowCount(), 4U);
+   EXPECT_TRUE(sheet.IsDirty("b"));
+   sheet.Recalculate();
+   ASSERT_EQ(sheet.Column("b").size(), 4U);
+   EXPECT_TRUE(std::isnan(sheet.Column("b")[3]));
+
+   // Replacing the longest input column with a shorter one shrinks the sheet, although "a" was padded to 4 rows.
+   sheet.SetColumn("c", {1.0});
+   EXPECT_EQ(sheet.RowCount(), 2U);
+   EXPECT_TRUE(sheet.IsDirty("b"));
+   sheet.Recalculate();
+   EXPECT_EQ(sheet.Column("a").size(), 2U);
+   EXPECT_EQ(sheet.Column("b").size(), 2U);
+   EXPECT_EQ(sheet.Column("b")[1], 3.0);
+   EXPECT_TRUE(std::isnan(sheet.Column("c")[1]));
+}
+
+TEST(Sheet, Errors)
+{
+   rjcpt::Sheet sheet;
+   sheet.SetColumn("qc", {1.0});
+   sheet.SetParameter("p", 1.0);
+   ASSERT_TRUE(sheet.SetFormula("a", "qc").has_value());
+   ASSERT_TRUE(sheet.SetFormula("b", "a + 1").has_value());
+
+   EXPECT_FALSE(sheet.SetFormula("a", "b").has_value());
+   EXPECT_FALSE(sheet.SetFormula("a", "a").has_value());
+   EXPECT_FALSE(sheet.SetFormula("a", "unknown").has_value());
+   EXPECT_FALSE(sheet.SetFormula("a", "1 +").has_value());
+   EXPECT_FALSE(sheet.SetFormula("p", "1").has_value());
+   EXPECT_EQ(sheet.Formula("a"), "qc");
+   EXPECT_THROW(sheet.SetColumn("p", {}), std::invalid_argument);
+   EXPECT_THROW(sheet.SetParameter("qc", 1.0), std::invalid_argument);
+
+   // Turning a formula column into an input column removes its dependencies.
+   sheet.SetColumn("b", {5.0});
+   EXPECT_TRUE(sheet.SetFormula("a", "b").has_value());
+   sheet.Recalculate();
+   EXPECT_EQ(sheet.Column("a")[0], 5.0);
+}
+
+TEST(Sheet, ParallelRecalculate)
+{
+   constexpr std::size_t cROWS = 10000;
+   std::vector<double> qc(cROWS);
+   std::vector<double> fs(cROWS);
+   for (std::size_t i = 0; i < cROWS; i++)
+   {
+      qc[i] = 1.0 + static_cast<double>(i % 97) / 7.0;
+      fs[i] = 0.01 * static_cast<double>(i % 13);
+   }
+
+   auto makeSheet = [&]()
+      {
+         rjcpt::Sheet sheet;
+         sheet.SetColumn("qc", qc);
+         sheet.SetColumn("fs", fs);
+         sheet.SetParameter("a", 0.8);
+         EXPECT_TRUE(sheet.SetFormula("qt", "qc + (1 - $a) fs").has_value());
+         EXPECT_TRUE(sheet.SetFormula("rf", "fs / qt * 100").has_value());
+         EXPECT_TRUE(sheet.SetFormula("ic", "sqrt(pow(3.47 - log(qt), 2) + pow(log(rf) + 1.22, 2))").has_value());
+         EXPECT_TRUE(sheet.SetFormula("soil", "if(ic < 2.6, 1, 0)").has_value());
+         EXPECT_TRUE(sheet.SetFormula("other", "qc * 2").has_value());
+         return sheet;
+      };
+
+   rjcpt::Sheet serial = makeSheet();
+   EXPECT_EQ(serial.Recalculate(), 5U);
+
+   for (const std::size_t threads : {1, 2, 7})
+   {
+      rjcpt::ThreadPool pool(threads);
+      rjcpt::Sheet parallel = makeSheet();
+      EXPECT_EQ(parallel.Recalculate(pool, 1000), 5U);
+      for (const char* name : {"qt", "rf", "ic", "soil", "other"})
+      {
+         const auto expected = serial.Column(name);
+         const auto actual   = parallel.Column(name);
+         ASSERT_EQ(actual.size(), cROWS);
+         EXPECT_EQ(std::memcmp(actual.data(), expected.data(), cROWS * sizeof(double)), 0) << name;
+      }
+
+      parallel.SetParameter("a", 0.7);
+      EXPECT_EQ(parallel.Recalculate(pool, 333), 4U);
+   }
+}
+
+TEST(Sheet, ThreadedTier)
+{
+   constexpr std::size_t cROWS = 3000;
+   std::vector<double> qc(cROWS);
+   std::vector<double> fs(cROWS);
+   for (std::size_t i = 0; i < cROWS; i++)
+   {
+      qc[i] = 1.0 + static_cast<double>(i % 97) / 7.0;
+      fs[i] = 0.01 * static_cast<double>(i % 13) - 0.02;
+   }
+
+   auto makeSheet = [&](std::uint64_t aTierRows)
+      {
+         rjcpt::Sheet sheet;
+         sheet.SetThreadedTierRows(aTierRows);
+         sheet.SetColumn("qc", qc);
+         sheet.SetColumn("fs", fs);
+         sheet.SetParameter("a", 0.8);
+         EXPECT_TRUE(sheet.SetFormula("qt", "qc + (1 - $a) fs").has_value());
+         EXPECT_TRUE(sheet.SetFormula("ic", "sqrt(pow(3.47 - log(qt), 2) + pow(ln(abs(fs)) + 1.22, 2))").has_value());
+         EXPECT_TRUE(sheet.SetFormula("soil", "if(1 < ic < 2.6 and qt > 2, max(qt, ic, 3), min(fs, 0))").has_value());
+         return sheet;
+      };
+
+   rjcpt::Sheet interpreted = makeSheet(std::numeric_limits<std::uint64_t>::max());
+   rjcpt::Sheet threaded    = makeSheet(0);
+   rjcpt::Sheet tiered      = makeSheet(2 * cROWS);
+   rjcpt::ThreadPool pool(3);
+   for (int pass = 0; pass < 4; pass++)
+   {
+      interpreted.SetParameter("a", 0.1 * pass);
+      threaded.SetParameter("a", 0.1 * pass);
+      tiered.SetParameter("a", 0.1 * pass);
+      interpreted.Recalculate();
+      threaded.Recalculate(pool, 1000);
+      tiered.Recalculate();
+
+      // Tiered up before the third evaluation.
+      EXPECT_EQ(tiered.IsThreaded("qt"), pass >= 2);
+      EXPECT_TRUE(threaded.IsThreaded("qt"));
+      EXPECT_FALSE(interpreted.IsThreaded("qt"));
+      for (const char* name : {"qt", "ic", "soil"})
+      {
+         EXPECT_EQ(std::memcmp(threaded.Column(name).data(), interpreted.Column(name).data(), cROWS * sizeof(double)), 0) << name;
+         EXPECT_EQ(std::memcmp(tiered.Column(name).data(), interpreted.Column(name).data(), cROWS * sizeof(double)), 0) << name;
+      }
+   }
+
+   // A new formula is interpreted again at first.
+   ASSERT_TRUE(tiered.SetFormula("qt", "qc - fs").has_value());
+   EXPECT_FALSE(tiered.IsThreaded("qt"));
+}
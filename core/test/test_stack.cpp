@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+
+#include "Stack.hpp"
+
+TEST(Stack, Grow)
+{
+   rjcpt::Stack<int, 4> stack;
+   EXPECT_EQ(stack.Capacity(), 4);
+   for (int i = 0; i < 100; i++)
+   {
+      stack.Push(i);
+      // Pushing an item of the stack itself, as the stack grows.
+      if (i % 4 == 3)
+      {
+         stack.Push(stack.Top());
+         EXPECT_EQ(stack.Pop(), i);
+      }
+   }
+   ASSERT_EQ(stack.Size(), 100);
+   EXPECT_GE(stack.Capacity(), 100);
+   for (int i = 0; i < 100; i++)
+   {
+      EXPECT_EQ(stack.Items()[i], i);
+   }
+
+   // Copies hold the same items.
+   rjcpt::Stack<int, 4> copy = stack;
+   EXPECT_TRUE(std::ranges::equal(copy.Items(), stack.Items()));
+
+   // The heap block is kept after Clear.
+   const std::size_t capacity = stack.Capacity();
+   const int*        data     = stack.Items().data();
+   stack.Clear();
+   for (int i = 0; i < 100; i++)
+   {
+      stack.Emplace(i);
+   }
+   EXPECT_EQ(stack.Capacity(), capacity);
+   EXPECT_EQ(stack.Items().data(), data);
+   EXPECT_EQ(stack.Pop(), 99);
+   EXPECT_EQ(stack.Top(), 98);
+}
+
+#ifndef NDEBUG
+TEST(Stack, Empty)
+{
+   rjcpt::Stack<int, 4> stack;
+   EXPECT_THROW(stack.Pop(), std::logic_error);
+   EXPECT_THROW(stack.Top(), std::logic_error);
+}
+#endif
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+TEST(ThreadPool, RunsAllTasks)
+{
+   rjcpt::ThreadPool pool(4);
+   EXPECT_EQ(pool.ThreadCount(), 4U);
+   std::atomic<int> count = 0;
+   for (int i = 0; i < 100; i++)
+   {
+      pool.Submit([&](std::size_t aWorker)
+         {
+            EXPECT_LT(aWorker, 4U);
+            // Tasks submitted by tasks are waited for too.
+            for (int j = 0; j < 10; j++)
+            {
+               pool.Submit([&](std::size_t) { ++count; });
+            }
+         });
+   }
+   pool.Wait();
+   EXPECT_EQ(count, 1000);
+
+   // The pool can be reused.
+   pool.Submit([&](std::size_t) { ++count; });
+   pool.Wait();
+   EXPECT_EQ(count, 1001);
+}
+
+TEST(ThreadPool, Exceptions)
+{
+   rjcpt::ThreadPool pool(2);
+   pool.Submit([](std::size_t) { throw std::runtime_error("oops"); });
+   EXPECT_THROW(pool.Wait(), std::runtime_error);
+   EXPECT_NO_THROW(pool.Wait());
+}
+
+TEST(ThreadPool, TaskGraph)
+{
+   // 0 -> {1, 2} -> 3
+   std::vector<rjcpt::GraphTask> tasks(4);
+   tasks[0].mRows = 10;
+   tasks[0].mDependents = {1, 2};
+   tasks[1].mRows = 25;
+   tasks[1].mDependencyCount = 1;
+   tasks[1].mDependents = {3};
+   tasks[2].mRows = 0;
+   tasks[2].mDependencyCount = 1;
+   tasks[2].mDependents = {3};
+   tasks[3].mRows = 7;
+   tasks[3].mDependencyCount = 2;
+
+   std::mutex mutex;
+   std::vector<std::vector<int>> rows(4);
+   for (std::size_t threads : {1, 3, 8})
+   {
+      rjcpt::ThreadPool pool(threads);
+      for (auto& r : rows)
+      {
+         r.assign(30, 0);
+      }
+      std::vector<int> chunksSeen(4);
+      rjcpt::RunTaskGraph(pool, tasks, 4, [&](std::size_t aTask, std::size_t aBegin, std::size_t aEnd, std::size_t)
+         {
+            std::lock_guard lock(mutex);
+            // Every row of every dependency is done.
+            for (std::size_t dependency = 0; dependency < tasks.size(); dependency++)
+            {
+               const auto& dependents = tasks[dependency].mDependents;
+               if (std::ranges::find(dependents, aTask) != dependents.end())
+               {
+                  EXPECT_EQ(std::count(rows[dependency].begin(), rows[dependency].end(), 1), tasks[dependency].mRows);
+               }
+            }
+            for (std::size_t r = aBegin; r < aEnd; r++)
+            {
+               ++rows[aTask][r];
+            }
+            ++chunksSeen[aTask];
+         });
+      for (std::size_t t = 0; t < tasks.size(); t++)
+      {
+         for (std::size_t r = 0; r < 30; r++)
+         {
+            EXPECT_EQ(rows[t][r], r < tasks[t].mRows ? 1 : 0);
+         }
+      }
+      EXPECT_EQ(chunksSeen, (std::vector<int>{3, 7, 1, 2}));
+   }
+}
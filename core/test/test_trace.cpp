@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include "FormulaParser.hpp"
+#include "Lexer.hpp"
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace
+{
+   std::size_t CountOccurrences(const std::string& aText, const std::string& aWord)
+   {
+      std::size_t retval = 0;
+      for (std::size_t pos = aText.find(aWord); pos != std::string::npos; pos = aText.find(aWord, pos + 1))
+      {
+         ++retval;
+      }
+      return retval;
+   }
+
+   std::uint64_t Get(const rjcpt::trace::Counters& aCounters, rjcpt::trace::Counter aCounter)
+   {
+      return aCounters[static_cast<std::size_t>(aCounter)];
+   }
+}
+
+TEST(Trace, Counters)
+{
+   using rjcpt::trace::Counter;
+   rjcpt::trace::Reset();
+   const auto tokens = rjcpt::TokenizeExpression("1 + f(2, x)");
+   ASSERT_TRUE(rjcpt::ParseFormula(tokens));
+
+   const auto counters = rjcpt::trace::GetCounters();
+   if (!RJCPT_ENABLE_TRACING)
+   {
+      EXPECT_EQ(counters, rjcpt::trace::Counters{});
+      return;
+   }
+   EXPECT_EQ(Get(counters, Counter::Tokens), tokens.size());
+   EXPECT_GT(Get(counters, Counter::RuleExpansions), tokens.size());
+   EXPECT_GT(Get(counters, Counter::MaxParseStackDepth), 2U);
+   EXPECT_LT(Get(counters, Counter::MaxParseStackDepth), 256U);
+
+   // The stack depth is a maximum rather than a sum.
+   const auto depth = Get(counters, Counter::MaxParseStackDepth);
+   ASSERT_TRUE(rjcpt::ParseFormula(tokens));
+   EXPECT_EQ(Get(rjcpt::trace::GetCounters(), Counter::MaxParseStackDepth), depth);
+
+   rjcpt::trace::Reset();
+   EXPECT_EQ(rjcpt::trace::GetCounters(), rjcpt::trace::Counters{});
+}
+
+TEST(Trace, ChromeTrace)
+{
+   rjcpt::trace::Reset();
+   rjcpt::ThreadPool pool(3);
+   for (int i = 0; i < 30; i++)
+   {
+      pool.Submit([](std::size_t)
+         {
+            const std::string_view expression = "a + b";
+            rjcpt::TokenizeExpressions(std::span(&expression, 1));
+         });
+   }
+   pool.Wait();
+
+   const std::string json = rjcpt::trace::ExportChromeTrace();
+   EXPECT_EQ(json.substr(0, 16), "{\"traceEvents\":[");
+   EXPECT_NE(json.find("\"tokens_per_second\":"), std::string::npos);
+   EXPECT_EQ(CountOccurrences(json, "\"ph\":\"C\""), 1U);
+   EXPECT_EQ(CountOccurrences(json, "\"name\":\"TokenizeExpressions\""), RJCPT_ENABLE_TRACING ? 30U : 0U);
+   EXPECT_NE(json.find(RJCPT_ENABLE_TRACING ? "\"tokens\":120" : "\"tokens\":0"), std::string::npos);
+   rjcpt::trace::Reset();
+}
+
+TEST(Trace, Sampling)
+{
+   rjcpt::trace::Reset();
+   for (std::uint32_t i = 0; i < 2 * rjcpt::trace::cSAMPLE_INTERVAL; i++)
+   {
+      rjcpt::TokenizeExpression("a + b");
+   }
+   const std::string json = rjcpt::trace::ExportChromeTrace();
+   EXPECT_EQ(CountOccurrences(json, "\"name\":\"TokenizeExpression\""), RJCPT_ENABLE_TRACING ? 2U : 0U);
+   // Every call is counted, whether it was sampled or not.
+   EXPECT_EQ(Get(rjcpt::trace::GetCounters(), rjcpt::trace::Counter::Tokens),
+             RJCPT_ENABLE_TRACING ? 8U * rjcpt::trace::cSAMPLE_INTERVAL : 0U);
+   rjcpt::trace::Reset();
+}
@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+
+#include "WorkbookTemplate.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+TEST(WorkbookTemplate, Parse)
+{
+   const auto result = rjcpt::ParseWorkbookTemplate("# Corrected cone resistance\r\n"
+                                                    "$a = 0.8\n"
+                                                    "\n"
+                                                    "qt = qc + (1 - $a) u2\n"
+                                                    "  rf=fs / qt * 100  \n"
+                                                    "$ gamma = 1.8e1");
+   ASSERT_TRUE(result.has_value()) << result.error();
+   ASSERT_EQ(result->mParameters.size(), 2U);
+   EXPECT_EQ(result->mParameters[0].mName, "a");
+   EXPECT_EQ(result->mParameters[0].mValue, 0.8);
+   EXPECT_EQ(result->mParameters[1].mName, "gamma");
+   EXPECT_EQ(result->mParameters[1].mValue, 18.0);
+   ASSERT_EQ(result->mFormulas.size(), 2U);
+   EXPECT_EQ(result->mFormulas[0].mName, "qt");
+   EXPECT_EQ(result->mFormulas[0].mFormula, "qc + (1 - $a) u2");
+   EXPECT_EQ(result->mFormulas[1].mName, "rf");
+   EXPECT_EQ(result->mFormulas[1].mFormula, "fs / qt * 100");
+
+   EXPECT_EQ(rjcpt::ParseWorkbookTemplate("a = 1\nqt\n").error(), "Line 2: Expected 'name = formula'");
+   EXPECT_EQ(rjcpt::ParseWorkbookTemplate(" = 1").error(), "Line 1: Expected 'name = formula'");
+   EXPECT_EQ(rjcpt::ParseWorkbookTemplate("$a = x").error(), "Line 1: Invalid value for $a: x");
+}
+
+TEST(WorkbookTemplate, Apply)
+{
+   const auto workbook = rjcpt::ParseWorkbookTemplate("$a = 0.5\nqt = qc + (1 - $a) u2\ndouble = 2 qt\n");
+   ASSERT_TRUE(workbook.has_value()) << workbook.error();
+
+   rjcpt::Sheet sheet;
+   sheet.SetColumn("qc", {1.0, 2.0});
+   sheet.SetColumn("u2", {1.0, 1.0});
+   ASSERT_TRUE(rjcpt::ApplyTemplate(sheet, *workbook).has_value());
+   sheet.Recalculate();
+   EXPECT_DOUBLE_EQ(sheet.Column("double")[1], 5.0);
+
+   // The data has no u2 column.
+   rjcpt::Sheet missing;
+   missing.SetColumn("qc", {1.0, 2.0});
+   EXPECT_EQ(rjcpt::ApplyTemplate(missing, *workbook).error(), "qt: Unknown identifier: u2");
+
+   // A parameter with the name of an input column.
+   rjcpt::Sheet clash;
+   clash.SetColumn("a", {1.0});
+   EXPECT_FALSE(rjcpt::ApplyTemplate(clash, *workbook).has_value());
+}
+
+TEST(WorkbookTemplate, Compiled)
+{
+   auto workbook = rjcpt::ParseWorkbookTemplate("$a = 0.5\n"
+                                                "qt = qc + (1 - $a) u2\n"
+                                                "rf = if(qt > 0, fs / qt * 100, 0)\n"
+                                                "bad = qc +\n");
+   ASSERT_TRUE(workbook.has_value()) << workbook.error();
+   rjcpt::PrecompileTemplate(*workbook);
+   EXPECT_NE(workbook->mFormulas[0].mCompiled, nullptr);
+   EXPECT_NE(workbook->mFormulas[1].mCompiled, nullptr);
+   EXPECT_EQ(workbook->mFormulas[2].mCompiled, nullptr);
+   workbook->mFormulas.pop_back();
+
+   const auto path = std::filesystem::temp_directory_path() / "rjcpt_test_compiled_template.bin";
+   ASSERT_TRUE(rjcpt::SaveCompiledTemplate(*workbook, path).has_value());
+   const auto loaded = rjcpt::LoadWorkbookTemplate(path);
+   std::filesystem::remove(path);
+   ASSERT_TRUE(loaded.has_value()) << loaded.error();
+   ASSERT_EQ(loaded->mParameters.size(), 1U);
+   EXPECT_EQ(loaded->mParameters[0].mValue, 0.5);
+   ASSERT_EQ(loaded->mFormulas.size(), 2U);
+   EXPECT_EQ(loaded->mFormulas[1].mFormula, "if(qt > 0, fs / qt * 100, 0)");
+   ASSERT_NE(loaded->mFormulas[1].mCompiled, nullptr);
+   EXPECT_EQ(loaded->mFormulas[1].mCompiled->mNames, (std::vector<std::string>{"qt", "fs"}));
+
+   // Same results as the text.
+   const auto text = rjcpt::ParseWorkbookTemplate("$a = 0.5\nqt = qc + (1 - $a) u2\nrf = if(qt > 0, fs / qt * 100, 0)\n");
+   rjcpt::Sheet expected;
+   rjcpt::Sheet actual;
+   for (rjcpt::Sheet* sheet : {&expected, &actual})
+   {
+      sheet->SetColumn("qc", {1.0, -2.0, 3.0});
+      sheet->SetColumn("fs", {0.1, 0.2, 0.3});
+      sheet->SetColumn("u2", {0.5, 0.5, 0.5});
+   }
+   ASSERT_TRUE(rjcpt::ApplyTemplate(expected, *text).has_value());
+   ASSERT_TRUE(rjcpt::ApplyTemplate(actual, *loaded).has_value());
+   expected.Recalculate();
+   actual.Recalculate();
+   EXPECT_EQ(std::vector<double>(actual.Column("rf").begin(), actual.Column("rf").end()),
+             std::vector<double>(expected.Column("rf").begin(), expected.Column("rf").end()));
+   EXPECT_EQ(actual.Formula("rf"), "if(qt > 0, fs / qt * 100, 0)");
+
+   // Unknown names are reported as for the text.
+   rjcpt::Sheet missing;
+   missing.SetColumn("qc", {1.0});
+   EXPECT_EQ(rjcpt::ApplyTemplate(missing, *loaded).error(), "qt: Unknown identifier: u2");
+
+   // Programs compiled by another version are dropped, and the text is used instead.
+   std::string data = rjcpt::WriteCompiledTemplate(*workbook);
+   data[8] ^= 1;
+   const auto stale = rjcpt::ParseWorkbookTemplate(data);
+   ASSERT_TRUE(stale.has_value()) << stale.error();
+   ASSERT_EQ(stale->mFormulas.size(), 2U);
+   EXPECT_EQ(stale->mFormulas[0].mCompiled, nullptr);
+   rjcpt::Sheet reparsed;
+   reparsed.SetColumn("qc", {1.0});
+   reparsed.SetColumn("fs", {0.1});
+   reparsed.SetColumn("u2", {0.5});
+   ASSERT_TRUE(rjcpt::ApplyTemplate(reparsed, *stale).has_value());
+   reparsed.Recalculate();
+   EXPECT_EQ(reparsed.Column("rf")[0], expected.Column("rf")[0]);
+
+   EXPECT_EQ(rjcpt::ParseWorkbookTemplate(data.substr(0, data.size() - 1)).error(), "Damaged compiled template");
+}
+
+TEST(WorkbookTemplate, CompiledProgramsAreChecked)
+{
+   // Everything the compiler and optimizer emit is accepted.
+   constexpr std::string_view cFORMULAS[] = {
+      "(qc + fs) * (qc + fs) - sqrt(qc + fs)",
+      "qc > 0 and (fs * 2 > 1 or fs * 2 < -1) and fs * 2 <> 0",
+      "(fs * u2 or qc) + fs * u2",
+      "1 < qc < 1 + fs and 0 = 0 <> u2",
+      "max(1, qc, 3) + min(qc, fs) + if($a > 0, qc, fs)",
+      "(qc u2 + fs u2) * (qc u2 + fs u2) + (qc u2 + fs u2 > 1 or qc u2 + fs u2 < -1)"
+   };
+   rjcpt::WorkbookTemplate workbook;
+   for (const std::string_view formula : cFORMULAS)
+   {
+      workbook.mFormulas.push_back(rjcpt::WorkbookTemplate::Formula{"f", std::string(formula)});
+   }
+   rjcpt::PrecompileTemplate(workbook);
+   const auto loaded = rjcpt::ParseWorkbookTemplate(rjcpt::WriteCompiledTemplate(workbook));
+   ASSERT_TRUE(loaded.has_value()) << loaded.error();
+   for (std::size_t i = 0; i < std::size(cFORMULAS); i++)
+   {
+      EXPECT_NE(loaded->mFormulas[i].mCompiled, nullptr) << cFORMULAS[i];
+   }
+
+   // Programs that could make evaluation go out of bounds are rejected.
+   const auto damaged = [](std::string_view aFormula, const auto& aDamage)
+      {
+         rjcpt::WorkbookTemplate workbook;
+         workbook.mFormulas.push_back(rjcpt::WorkbookTemplate::Formula{"f", std::string(aFormula)});
+         rjcpt::PrecompileTemplate(workbook);
+         auto compiled = std::make_shared<rjcpt::PrecompiledFormula>(*workbook.mFormulas[0].mCompiled);
+         aDamage(compiled->mProgram);
+         workbook.mFormulas[0].mCompiled = compiled;
+         const auto result = rjcpt::ParseWorkbookTemplate(rjcpt::WriteCompiledTemplate(workbook));
+         return !result.has_value() && result.error() == "Damaged compiled template";
+      };
+   using OC = rjcpt::OpCode;
+   EXPECT_TRUE(damaged("qc + fs * u2", [](rjcpt::Program& aProgram) { --aProgram.mMaxStackDepth; }));
+   EXPECT_TRUE(damaged("qc + fs * u2", [](rjcpt::Program& aProgram) { aProgram.mCode[0].mOpCode = OC::Negate; }));
+   EXPECT_TRUE(damaged("qc + fs", [](rjcpt::Program& aProgram) { aProgram.mCode[1] = {OC::Add, 0}; }));
+   EXPECT_TRUE(damaged("1 < qc < fs", [](rjcpt::Program& aProgram) { aProgram.mCode[1] = {OC::PushConstant, 0}; }));
+   EXPECT_TRUE(damaged("qc and fs", [](rjcpt::Program& aProgram) { --aProgram.mCode[1].mOperand; }));
+   EXPECT_TRUE(damaged("qc and fs", [](rjcpt::Program& aProgram) { aProgram.mCode[1].mOpCode = OC::OrJump; }));
+   EXPECT_TRUE(damaged("sqrt(qc)", [](rjcpt::Program& aProgram) { aProgram.mCode[1].mOperand &= 0xFFU; }));
+   EXPECT_TRUE(damaged("(qc + fs) * (qc + fs)", [](rjcpt::Program& aProgram)
+      {
+         // Loads the local before storing it.
+         const auto store = std::ranges::find(aProgram.mCode, OC::StoreLocal, &rjcpt::EvaluatorInstruction::mOpCode);
+         const auto load  = std::ranges::find(aProgram.mCode, OC::LoadLocal, &rjcpt::EvaluatorInstruction::mOpCode);
+         std::swap(*store, *load);
+      }));
+   EXPECT_TRUE(damaged("(qc + fs) * (qc + fs)", [](rjcpt::Program& aProgram)
+      {
+         // Stores the local twice.
+         const auto load = std::ranges::find(aProgram.mCode, OC::LoadLocal, &rjcpt::EvaluatorInstruction::mOpCode);
+         load->mOpCode = OC::StoreLocal;
+      }));
+}
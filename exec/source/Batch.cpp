@@ -0,0 +1,342 @@
+#include "Batch.hpp"
+
+#include "DataFile.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <map>
+
+namespace
+{
+   using Clock = std::chrono::steady_clock;
+
+   double SecondsSince(Clock::time_point aStart)
+   {
+      return std::chrono::duration<double>(Clock::now() - aStart).count();
+   }
+
+   //! Limits the files being processed at once, both by count and by their estimated memory.
+   class Admission
+   {
+   public:
+      Admission(std::size_t aMaxFiles, std::size_t aMaxBytes)
+         : mMaxFiles(std::max<std::size_t>(aMaxFiles, 1))
+         , mMaxBytes(aMaxBytes)
+      {
+      }
+
+      //! Blocks until a file needing aBytes may start. Returns the bytes to pass to Leave.
+      //! A file needing more than the whole budget may start once no other file is being processed.
+      std::size_t Enter(std::size_t aBytes)
+      {
+         aBytes = std::min(aBytes, mMaxBytes);
+         std::unique_lock lock(mMutex);
+         mChanged.wait(lock, [&] { return mFiles < mMaxFiles && mBytes + aBytes <= mMaxBytes; });
+         ++mFiles;
+         mBytes += aBytes;
+         return aBytes;
+      }
+
+      void Leave(std::size_t aBytes)
+      {
+         {
+            std::lock_guard lock(mMutex);
+            --mFiles;
+            mBytes -= aBytes;
+         }
+         mChanged.notify_all();
+      }
+
+   private:
+      std::size_t             mMaxFiles;
+      std::size_t             mMaxBytes;
+      std::mutex              mMutex;
+      std::condition_variable mChanged;
+      std::size_t             mFiles = 0;
+      std::size_t             mBytes = 0;
+   };
+
+   //! Estimates the memory needed to process a file. As text, a value takes about as many bytes as a double does,
+   //! so the input columns need about as much as the data records in the file, and each formula column about as much
+   //! as an input column. The file itself is mapped while it is read.
+   std::size_t EstimateMemory(std::string_view aText, std::size_t aFormulas)
+   {
+      const auto        layout  = rjcpt::ParseDataHeader(aText);
+      const std::size_t columns = layout && !layout->mNames.empty() ? layout->mNames.size() : 1;
+      const std::size_t data    = aText.size() - (layout ? std::min(layout->mDataOffset, aText.size()) : 0);
+      return aText.size() + data + data / columns * aFormulas;
+   }
+
+   //! Returns the names of the columns to write.
+   std::vector<std::string> OutputColumns(const rjcpt::batch::BatchOptions& aOptions,
+                                          const rjcpt::WorkbookTemplate&    aTemplate,
+                                          std::vector<std::string>          aInputNames)
+   {
+      if (!aOptions.mColumns.empty())
+      {
+         return aOptions.mColumns;
+      }
+      for (const auto& formula : aTemplate.mFormulas)
+      {
+         if (std::ranges::find(aInputNames, formula.mName) == aInputNames.end())
+         {
+            aInputNames.push_back(formula.mName);
+         }
+      }
+      return aInputNames;
+   }
+}
+
+std::vector<rjcpt::batch::InputFile> rjcpt::batch::ListInputFiles(const BatchOptions& aOptions)
+{
+   std::vector<InputFile> retval;
+   for (const auto& entry : std::filesystem::directory_iterator(aOptions.mInputDirectory))
+   {
+      if (entry.is_regular_file() && (aOptions.mExtension.empty() || entry.path().extension() == aOptions.mExtension))
+      {
+         InputFile& file = retval.emplace_back();
+         file.mPath = entry.path();
+         file.mSize = static_cast<std::size_t>(entry.file_size());
+      }
+   }
+   std::ranges::sort(retval, [](const InputFile& aLeft, const InputFile& aRight)
+      {
+         return aLeft.mSize != aRight.mSize ? aLeft.mSize > aRight.mSize : aLeft.mPath < aRight.mPath;
+      });
+
+   std::map<std::filesystem::path, std::size_t> outputs; // Output path to the first file writing it.
+   for (std::size_t i = 0; i < retval.size(); i++)
+   {
+      const auto [iter, added] = outputs.try_emplace(OutputPath(aOptions, retval[i].mPath), i);
+      if (!added)
+      {
+         retval[i].mCollidesWith = retval[iter->second].mPath;
+         if (retval[iter->second].mCollidesWith.empty())
+         {
+            retval[iter->second].mCollidesWith = retval[i].mPath;
+         }
+      }
+   }
+   return retval;
+}
+
+std::filesystem::path rjcpt::batch::OutputPath(const BatchOptions& aOptions, const std::filesystem::path& aInput)
+{
+   return aOptions.mOutputDirectory / aInput.filename().replace_extension(".csv");
+}
+
+std::string rjcpt::batch::CollisionError(const BatchOptions& aOptions, const InputFile& aFile)
+{
+   return "Result would be written to " + OutputPath(aOptions, aFile.mPath).string() + ", as for " +
+          aFile.mCollidesWith.filename().string();
+}
+
+std::vector<std::span<const double>> rjcpt::batch::ComputedFile::Columns() const
+{
+   std::vector<std::span<const double>> retval;
+   for (const std::string& name : mNames)
+   {
+      retval.push_back(mSheet.Column(name));
+   }
+   return retval;
+}
+
+std::expected<rjcpt::batch::ComputedFile, std::string> rjcpt::batch::ComputeFile(const std::filesystem::path& aPath,
+                                                                                 const BatchOptions&          aOptions,
+                                                                                 const WorkbookTemplate&      aTemplate,
+                                                                                 FormulaCache*                aCache)
+{
+   RJCPT_TRACE_SCOPE("ComputeFile");
+   ComputedFile retval;
+   retval.mSheet.SetFormulaCache(aCache);
+   retval.mSheet.SetParserEngine(aOptions.mParserEngine);
+   auto         start = Clock::now();
+   {
+      auto table = LoadDataFile(aPath);
+      if (!table)
+      {
+         return std::unexpected(table.error());
+      }
+      retval.mRows  = table->RowCount();
+      retval.mNames = OutputColumns(aOptions, aTemplate, table->mNames);
+      SetColumns(retval.mSheet, std::move(*table));
+   }
+   if (const auto applied = ApplyTemplate(retval.mSheet, aTemplate); !applied)
+   {
+      return std::unexpected(applied.error());
+   }
+   for (const std::string& name : retval.mNames)
+   {
+      if (retval.mSheet.Resolve(name).mKind != SymbolKind::Column)
+      {
+         return std::unexpected("No column named " + name);
+      }
+   }
+   retval.mLoadSeconds = SecondsSince(start);
+
+   start = Clock::now();
+   retval.mSheet.Recalculate();
+   retval.mCalcSeconds = SecondsSince(start);
+   return retval;
+}
+
+std::expected<void, std::string> rjcpt::batch::WriteResult(const std::filesystem::path&             aPath,
+                                                           std::span<const std::string>             aNames,
+                                                           std::span<const std::span<const double>> aColumns,
+                                                           char                                     aSeparator)
+{
+   RJCPT_TRACE_SCOPE("WriteResult");
+   std::filesystem::path partial = aPath;
+   partial += ".part";
+   {
+      std::ofstream stream(partial, std::ios::binary);
+      if (!stream || !WriteDataFile(stream, aNames, aColumns, aSeparator))
+      {
+         return std::unexpected("Cannot write " + partial.string());
+      }
+   }
+   std::error_code error;
+   std::filesystem::rename(partial, aPath, error);
+   if (error)
+   {
+      return std::unexpected("Cannot write " + aPath.string() + ": " + error.message());
+   }
+   return {};
+}
+
+rjcpt::batch::Progress::Progress(std::size_t aTotalFiles, std::ostream& aLog, std::ostream& aErrors)
+   : mTotalFiles(aTotalFiles)
+   , mLog(aLog)
+   , mErrors(aErrors)
+{
+}
+
+void rjcpt::batch::Progress::Finished(const InputFile&    aFile,
+                                      const ComputedFile& aResult,
+                                      double              aWriteSeconds,
+                                      std::string_view    aNote)
+{
+   Finished(aFile, aResult.mRows, aResult.mLoadSeconds, aResult.mCalcSeconds, aWriteSeconds, aNote);
+}
+
+void rjcpt::batch::Progress::Finished(const InputFile& aFile,
+                                      std::size_t      aRows,
+                                      double           aLoadSeconds,
+                                      double           aCalcSeconds,
+                                      double           aWriteSeconds,
+                                      std::string_view aNote)
+{
+   std::lock_guard lock(mMutex);
+   ++mSummary.mFiles;
+   mSummary.mBytes += aFile.mSize;
+   mSummary.mRows  += aRows;
+   char line[256];
+   std::snprintf(line, sizeof(line), "[%zu/%zu] %s: %zu rows, load %.1f ms, calc %.1f ms, write %.1f ms",
+                 mSummary.mFiles, mTotalFiles, aFile.mPath.filename().string().c_str(), aRows, aLoadSeconds * 1e3,
+                 aCalcSeconds * 1e3, aWriteSeconds * 1e3);
+   mLog << line << aNote << std::endl;
+}
+
+void rjcpt::batch::Progress::Failed(const InputFile& aFile, std::string_view aError)
+{
+   std::lock_guard lock(mMutex);
+   ++mSummary.mFiles;
+   ++mSummary.mFailed;
+   mSummary.mBytes += aFile.mSize;
+   mErrors << '[' << mSummary.mFiles << '/' << mTotalFiles << "] " << aFile.mPath.filename().string() << ": " << aError
+           << std::endl;
+}
+
+void rjcpt::batch::Progress::Note(std::string_view aMessage)
+{
+   std::lock_guard lock(mMutex);
+   mErrors << aMessage << std::endl;
+}
+
+void rjcpt::batch::Progress::Retried()
+{
+   std::lock_guard lock(mMutex);
+   ++mSummary.mRetries;
+}
+
+rjcpt::batch::BatchSummary rjcpt::batch::Progress::Summary() const
+{
+   std::lock_guard lock(mMutex);
+   return mSummary;
+}
+
+rjcpt::batch::BatchSummary rjcpt::batch::RunBatch(const BatchOptions&     aOptions,
+                                                  const WorkbookTemplate& aTemplate,
+                                                  std::ostream&           aLog,
+                                                  std::ostream&           aErrors)
+{
+   const auto start = Clock::now();
+   const std::vector<InputFile> files = ListInputFiles(aOptions);
+   std::filesystem::create_directories(aOptions.mOutputDirectory);
+
+   Progress     progress(files.size(), aLog, aErrors);
+   FormulaCache cache;
+   cache.SetParserEngine(aOptions.mParserEngine);
+   ThreadPool   pool(aOptions.mJobs);
+   Admission    admission(aOptions.mJobs, aOptions.mMemoryBudget);
+   for (const InputFile& file : files)
+   {
+      if (!file.mCollidesWith.empty())
+      {
+         progress.Failed(file, CollisionError(aOptions, file));
+         continue;
+      }
+      std::size_t bytes = 0;
+      {
+         const auto mapped = MappedFile::Open(file.mPath);
+         if (!mapped)
+         {
+            progress.Failed(file, mapped.error());
+            continue;
+         }
+         bytes = EstimateMemory(mapped->Data(), aTemplate.mFormulas.size());
+      }
+      bytes = admission.Enter(bytes);
+      pool.Submit([&, bytes](std::size_t)
+         {
+            try
+            {
+               const auto result = ComputeFile(file.mPath, aOptions, aTemplate, &cache);
+               if (!result)
+               {
+                  progress.Failed(file, result.error());
+               }
+               else
+               {
+                  const auto start   = Clock::now();
+                  const auto written = WriteResult(OutputPath(aOptions, file.mPath), result->mNames, result->Columns(),
+                                                   aOptions.mSeparator);
+                  if (written)
+                  {
+                     progress.Finished(file, *result, SecondsSince(start));
+                  }
+                  else
+                  {
+                     progress.Failed(file, written.error());
+                  }
+               }
+            }
+            catch (const std::exception& aError)
+            {
+               progress.Failed(file, aError.what());
+            }
+            admission.Leave(bytes);
+         });
+   }
+   pool.Wait();
+
+   BatchSummary retval = progress.Summary();
+   retval.mSeconds = SecondsSince(start);
+   return retval;
+}
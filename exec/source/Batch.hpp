@@ -0,0 +1,127 @@
+#pragma once
+
+#include "Sheet.hpp"
+#include "WorkbookTemplate.hpp"
+
+#include <cstddef>
+#include <expected>
+#include <filesystem>
+#include <mutex>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace rjcpt::batch
+{
+   struct BatchOptions
+   {
+      std::filesystem::path    mInputDirectory;
+      std::filesystem::path    mOutputDirectory;
+      //! Files processed at once.
+      std::size_t              mJobs = std::thread::hardware_concurrency();
+      //! Estimated memory that the files being processed may use together, in bytes.
+      //! A file that needs more than this is processed on its own.
+      std::size_t              mMemoryBudget = std::size_t{1} << 30;
+      //! Columns to write. If empty, the input columns are written, followed by the formula columns.
+      std::vector<std::string> mColumns;
+      //! Only files with this extension (such as ".gef") are processed. If empty, every file is.
+      std::string              mExtension;
+      char                     mSeparator = ';';
+      //! The engine that formulas are parsed with.
+      ParserEngine             mParserEngine = ParserEngine::Grammar;
+   };
+
+   struct BatchSummary
+   {
+      std::size_t mFiles   = 0;
+      std::size_t mFailed  = 0;
+      std::size_t mRows    = 0;
+      std::size_t mBytes   = 0; // Size of the input files.
+      std::size_t mRetries = 0; // Shards given to another worker after a worker crashed.
+      double      mSeconds = 0.0;
+   };
+
+   struct InputFile
+   {
+      std::filesystem::path mPath;
+      std::size_t           mSize = 0;
+      //! Another input file whose result goes to the same output path, such as "a.gef" for "a.txt". Neither file
+      //! is processed, so that one result can't overwrite the other.
+      std::filesystem::path mCollidesWith;
+   };
+
+   //! Returns the data files in aOptions.mInputDirectory, largest first, so that a large file doesn't start last and
+   //! keep one worker busy after all the others are done. Files whose results would go to the same output path are
+   //! marked with mCollidesWith.
+   std::vector<InputFile> ListInputFiles(const BatchOptions& aOptions);
+
+   //! Returns the path that the result for aInput is written to.
+   std::filesystem::path OutputPath(const BatchOptions& aOptions, const std::filesystem::path& aInput);
+   //! Describes why a file with mCollidesWith set is not processed.
+   std::string           CollisionError(const BatchOptions& aOptions, const InputFile& aFile);
+
+   //! A data file with the template applied and recalculated.
+   struct ComputedFile
+   {
+      Sheet                    mSheet;
+      std::vector<std::string> mNames; // The columns to write.
+      std::size_t              mRows        = 0;
+      double                   mLoadSeconds = 0.0; // Reading the data, and compiling the formulas.
+      double                   mCalcSeconds = 0.0;
+
+      //! The values of the columns in mNames.
+      std::vector<std::span<const double>> Columns() const;
+   };
+
+   //! Reads the data file at aPath, applies aTemplate and recalculates. On failure, returns a description of the error.
+   //! If aCache is given, the formulas are compiled with it, so that files after the first skip parsing.
+   std::expected<ComputedFile, std::string> ComputeFile(const std::filesystem::path& aPath,
+                                                        const BatchOptions&          aOptions,
+                                                        const WorkbookTemplate&      aTemplate,
+                                                        FormulaCache*                aCache = nullptr);
+
+   //! Writes a result to aPath with WriteDataFile. The result is written under another name first, and renamed
+   //! when complete, so that a run that is stopped never leaves a partial file behind.
+   std::expected<void, std::string> WriteResult(const std::filesystem::path&             aPath,
+                                                std::span<const std::string>             aNames,
+                                                std::span<const std::span<const double>> aColumns,
+                                                char                                     aSeparator);
+
+   //! Reports each file as it finishes, and sums up the results. Can be used from several threads at once.
+   class Progress
+   {
+   public:
+      Progress(std::size_t aTotalFiles, std::ostream& aLog, std::ostream& aErrors);
+
+      //! Writes a line with the timings of a file to the log. aNote is appended to the line if given.
+      void Finished(const InputFile& aFile, const ComputedFile& aResult, double aWriteSeconds, std::string_view aNote = {});
+      void Finished(const InputFile& aFile, std::size_t aRows, double aLoadSeconds, double aCalcSeconds,
+                    double aWriteSeconds, std::string_view aNote = {});
+      //! Writes the error of a file to the error stream.
+      void Failed(const InputFile& aFile, std::string_view aError);
+      //! Writes a message that is not about a single file to the error stream.
+      void Note(std::string_view aMessage);
+      void Retried();
+
+      BatchSummary Summary() const;
+
+   private:
+      mutable std::mutex mMutex;
+      std::size_t        mTotalFiles;
+      std::ostream&      mLog;
+      std::ostream&      mErrors;
+      BatchSummary       mSummary;
+   };
+
+   //! Applies aTemplate to every data file in aOptions.mInputDirectory, and writes each result to a file of the same
+   //! name with the extension ".csv" in aOptions.mOutputDirectory. Files are processed in parallel, largest first.
+   //! A line with the timings of each file is written to aLog as soon as the file is done. Failures are written to
+   //! aErrors, and do not stop the other files.
+   BatchSummary RunBatch(const BatchOptions&     aOptions,
+                         const WorkbookTemplate& aTemplate,
+                         std::ostream&           aLog,
+                         std::ostream&           aErrors);
+}
@@ -1,7 +1,252 @@
+#include "Batch.hpp"
+#include "Sharded.hpp"
+#include "Trace.hpp"
 
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
 
+namespace
+{
+   constexpr std::string_view cUSAGE =
+      "Usage: rjcpt-exec [options] <template> <input directory> <output directory>\n"
+      "\n"
+      "Applies the parameters and formulas in <template> to every data file in <input directory>, and writes the\n"
+      "columns of each result to <output directory>/<name>.csv. Files whose names only differ in their extension,\n"
+      "such as a.gef and a.txt, fail rather than overwrite each other's results.\n"
+      "\n"
+      "Template lines are '$name = value' for parameters and 'name = formula' for columns. Lines starting with '#'\n"
+      "are comments.\n"
+      "\n"
+      "Options:\n"
+      "  --jobs=<n>            Files processed at once. Defaults to the number of hardware threads.\n"
+      "  --memory=<MiB>        Memory that the files being processed may use together. Defaults to 1024.\n"
+      "  --columns=<a,b,...>   Columns to write. Defaults to the input columns followed by the formula columns.\n"
+      "  --extension=<.ext>    Only process files with this extension.\n"
+      "  --separator=<c>       Separator between values in the output. Defaults to ';'.\n"
+      "  --parser=<engine>     How formulas are parsed: 'grammar' (the default) or 'precedence', which is faster.\n"
+      "  --trace=<file>        Write a Chrome trace of the run, if tracing was enabled at build time.\n"
+      "  --precompile=<file>   Only write <template>, with its formulas compiled, to <file>, and take no directories.\n"
+      "                        Passing <file> as the template of a later run skips parsing the formulas.\n"
+      "\n"
+      "Worker processes (Linux only):\n"
+      "  --workers=<n>         Process the files in <n> worker processes instead of threads. A worker that crashes\n"
+      "                        is replaced, and its unfinished files are retried.\n"
+      "  --ring=<MiB>          Shared memory each worker sends its results through. Defaults to 16.\n"
+      "  --numa                Spread the workers over the NUMA nodes, and keep each on the CPUs of its node.\n";
+
+   bool ParseCount(std::string_view aText, std::size_t& aValue)
+   {
+      const auto [ptr, error] = std::from_chars(aText.data(), aText.data() + aText.size(), aValue);
+      return error == std::errc() && ptr == aText.data() + aText.size() && aValue > 0;
+   }
+
+   std::vector<std::string> SplitNames(std::string_view aText)
+   {
+      std::vector<std::string> retval;
+      while (!aText.empty())
+      {
+         const std::size_t end = aText.find(',');
+         if (end != 0)
+         {
+            retval.emplace_back(aText.substr(0, end));
+         }
+         aText.remove_prefix(end == std::string_view::npos ? aText.size() : end + 1);
+      }
+      return retval;
+   }
+
+   int UsageError(std::string_view aMessage)
+   {
+      std::cerr << aMessage << "\n\n" << cUSAGE;
+      return 2;
+   }
+}
 
 int main(int aArgc, char** aArgv)
 {
-   return 1;
+   rjcpt::batch::BatchOptions   options;
+   rjcpt::batch::ShardedOptions sharded;
+   std::vector<std::string>     positional;
+   std::string                  tracePath;
+   std::string                  precompilePath;
+   std::string_view             worker;
+   for (int i = 1; i < aArgc; i++)
+   {
+      const std::string_view argument(aArgv[i]);
+      if (!argument.starts_with("--workers=") && !argument.starts_with("--trace=") &&
+          !argument.starts_with("--worker="))
+      {
+         sharded.mWorkerArguments.emplace_back(argument);
+      }
+      const std::string_view value = argument.substr(std::min(argument.find('=') + 1, argument.size()));
+      if (argument == "--help" || argument == "-h")
+      {
+         std::cout << cUSAGE;
+         return 0;
+      }
+      else if (argument.starts_with("--jobs="))
+      {
+         if (!ParseCount(value, options.mJobs))
+         {
+            return UsageError("Invalid --jobs: " + std::string(value));
+         }
+      }
+      else if (argument.starts_with("--memory="))
+      {
+         std::size_t megabytes = 0;
+         if (!ParseCount(value, megabytes))
+         {
+            return UsageError("Invalid --memory: " + std::string(value));
+         }
+         options.mMemoryBudget = megabytes << 20;
+      }
+      else if (argument.starts_with("--columns="))
+      {
+         options.mColumns = SplitNames(value);
+      }
+      else if (argument.starts_with("--extension="))
+      {
+         options.mExtension = value;
+      }
+      else if (argument.starts_with("--separator="))
+      {
+         if (value.size() != 1)
+         {
+            return UsageError("Invalid --separator: " + std::string(value));
+         }
+         options.mSeparator = value.front();
+      }
+      else if (argument.starts_with("--parser="))
+      {
+         if (value == "grammar")
+         {
+            options.mParserEngine = rjcpt::ParserEngine::Grammar;
+         }
+         else if (value == "precedence")
+         {
+            options.mParserEngine = rjcpt::ParserEngine::Precedence;
+         }
+         else
+         {
+            return UsageError("Invalid --parser: " + std::string(value));
+         }
+      }
+      else if (argument.starts_with("--trace="))
+      {
+         tracePath = value;
+      }
+      else if (argument.starts_with("--precompile="))
+      {
+         precompilePath = value;
+      }
+      else if (argument.starts_with("--workers="))
+      {
+         if (!ParseCount(value, sharded.mWorkers))
+         {
+            return UsageError("Invalid --workers: " + std::string(value));
+         }
+      }
+      else if (argument.starts_with("--ring="))
+      {
+         std::size_t megabytes = 0;
+         if (!ParseCount(value, megabytes))
+         {
+            return UsageError("Invalid --ring: " + std::string(value));
+         }
+         sharded.mRingBytes = megabytes << 20;
+      }
+      else if (argument == "--numa")
+      {
+         sharded.mPinToNumaNodes = true;
+      }
+      else if (argument.starts_with("--worker="))
+      {
+         // Set by the coordinator when it starts a worker process.
+         worker = value;
+      }
+      else if (argument.starts_with("--"))
+      {
+         return UsageError("Unknown option " + std::string(argument));
+      }
+      else
+      {
+         positional.emplace_back(argument);
+      }
+   }
+   if (!precompilePath.empty())
+   {
+      if (positional.size() != 1)
+      {
+         return UsageError("Expected only a template with --precompile.");
+      }
+      auto workbook = rjcpt::LoadWorkbookTemplate(positional[0]);
+      if (!workbook)
+      {
+         std::cerr << positional[0] << ": " << workbook.error() << "\n";
+         return 2;
+      }
+      rjcpt::PrecompileTemplate(*workbook, options.mParserEngine);
+      if (const auto saved = rjcpt::SaveCompiledTemplate(*workbook, precompilePath); !saved)
+      {
+         std::cerr << saved.error() << "\n";
+         return 2;
+      }
+      return 0;
+   }
+   if (positional.size() != 3)
+   {
+      return UsageError("Expected a template, an input directory and an output directory.");
+   }
+   options.mInputDirectory  = positional[1];
+   options.mOutputDirectory = positional[2];
+
+   const auto workbook = rjcpt::LoadWorkbookTemplate(positional[0]);
+   if (!workbook)
+   {
+      std::cerr << positional[0] << ": " << workbook.error() << "\n";
+      return 2;
+   }
+   if (!std::filesystem::is_directory(options.mInputDirectory))
+   {
+      std::cerr << "Not a directory: " << positional[1] << "\n";
+      return 2;
+   }
+
+   if (!worker.empty())
+   {
+      return rjcpt::batch::RunWorker(worker, options, sharded, *workbook);
+   }
+
+   rjcpt::batch::BatchSummary summary;
+   try
+   {
+      summary = sharded.mWorkers > 0 ? rjcpt::batch::RunCoordinator(options, sharded, std::cout, std::cerr)
+                                     : rjcpt::batch::RunBatch(options, *workbook, std::cout, std::cerr);
+   }
+   catch (const std::exception& aError)
+   {
+      std::cerr << aError.what() << "\n";
+      return 2;
+   }
+
+   const double seconds = std::max(summary.mSeconds, 1e-9);
+   std::printf("Processed %zu files (%zu failed), %zu rows, %.1f MB in %.2f s: %.2f files/s, %.0f rows/s, %.2f MB/s\n",
+               summary.mFiles, summary.mFailed, summary.mRows, static_cast<double>(summary.mBytes) / 1e6, seconds,
+               static_cast<double>(summary.mFiles) / seconds, static_cast<double>(summary.mRows) / seconds,
+               static_cast<double>(summary.mBytes) / 1e6 / seconds);
+   if (summary.mRetries > 0)
+   {
+      std::printf("Retried %zu shards after worker crashes\n", summary.mRetries);
+   }
+
+   if (!tracePath.empty() && !rjcpt::trace::WriteChromeTrace(tracePath))
+   {
+      std::cerr << "Cannot write " << tracePath << "\n";
+   }
+   return summary.mFailed > 0 ? 1 : 0;
 }
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace rjcpt::batch
+{
+   //! Messages between the coordinator and its workers in sharded batch mode.
+   //! Payloads only hold plain values, so the same messages could be sent over a socket to workers on other machines.
+   enum class MessageType : std::uint32_t
+   {
+      // Coordinator to worker.
+      ProcessShard, // Shard id, file count, then the file id and input path of each file.
+      Stop,         // Empty. The worker exits.
+
+      // Worker to coordinator.
+      Ready,      // Empty. The worker has started, and is waiting for shards.
+      FileHeader, // File id, rows, load seconds, calc seconds, column count, then the column names.
+      FileValues, // File id, column index, first row, value count, then the values.
+      FileDone,   // File id. All values of the file have been sent.
+      FileFailed, // File id, error message.
+      ShardDone,  // Shard id.
+   };
+
+   //! Builds a message payload.
+   class MessageWriter
+   {
+   public:
+      template<typename T>
+      void Write(const T& aValue)
+      {
+         static_assert(std::is_trivially_copyable_v<T>);
+         const auto* bytes = reinterpret_cast<const std::byte*>(&aValue);
+         mBytes.insert(mBytes.end(), bytes, bytes + sizeof(T));
+      }
+      void WriteString(std::string_view aText)
+      {
+         Write(static_cast<std::uint32_t>(aText.size()));
+         const auto* bytes = reinterpret_cast<const std::byte*>(aText.data());
+         mBytes.insert(mBytes.end(), bytes, bytes + aText.size());
+      }
+      void WriteValues(std::span<const double> aValues)
+      {
+         Write(static_cast<std::uint64_t>(aValues.size()));
+         const auto bytes = std::as_bytes(aValues);
+         mBytes.insert(mBytes.end(), bytes.begin(), bytes.end());
+      }
+
+      std::span<const std::byte> Bytes() const { return mBytes; }
+      void                       Clear() { mBytes.clear(); }
+
+   private:
+      std::vector<std::byte> mBytes;
+   };
+
+   //! Reads a message payload in the order it was written. Throws if the payload is too short.
+   class MessageReader
+   {
+   public:
+      explicit MessageReader(std::span<const std::byte> aBytes)
+         : mBytes(aBytes)
+      {
+      }
+
+      template<typename T>
+      T Read()
+      {
+         static_assert(std::is_trivially_copyable_v<T>);
+         T retval;
+         std::memcpy(&retval, Take(sizeof(T)), sizeof(T));
+         return retval;
+      }
+      std::string_view ReadString()
+      {
+         const auto size = Read<std::uint32_t>();
+         return std::string_view(reinterpret_cast<const char*>(Take(size)), size);
+      }
+      //! Copies the values into aTarget, which must have room for them. Returns the number of values.
+      std::size_t ReadValues(std::span<double> aTarget)
+      {
+         const auto count = Read<std::uint64_t>();
+         if (count > aTarget.size())
+         {
+            throw std::runtime_error("Malformed message.");
+         }
+         std::memcpy(aTarget.data(), Take(count * sizeof(double)), count * sizeof(double));
+         return count;
+      }
+
+   private:
+      const std::byte* Take(std::size_t aSize)
+      {
+         if (aSize > mBytes.size())
+         {
+            throw std::runtime_error("Malformed message.");
+         }
+         const std::byte* retval = mBytes.data();
+         mBytes = mBytes.subspan(aSize);
+         return retval;
+      }
+
+      std::span<const std::byte> mBytes;
+   };
+}
@@ -0,0 +1,835 @@
+#include "Sharded.hpp"
+
+#include "Protocol.hpp"
+#include "SharedRing.hpp"
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+#ifdef __linux__
+namespace
+{
+   using Clock = std::chrono::steady_clock;
+   using rjcpt::batch::MessageReader;
+   using rjcpt::batch::MessageType;
+   using rjcpt::batch::MessageWriter;
+   using rjcpt::batch::SharedRing;
+
+   double SecondsSince(Clock::time_point aStart)
+   {
+      return std::chrono::duration<double>(Clock::now() - aStart).count();
+   }
+
+   // A file is given to a worker this many times in all before it fails.
+   constexpr std::size_t cMAX_ATTEMPTS = 3;
+   // Shards per worker, so that the last shards are small enough to keep every worker busy until the end.
+   constexpr std::size_t cSHARDS_PER_WORKER = 4;
+   constexpr std::size_t cMAX_SHARD_FILES   = 64;
+   // The request ring only holds shards, whose paths are short.
+   constexpr std::size_t cREQUEST_RING_BYTES = std::size_t{4} << 20;
+   constexpr std::size_t cRING_ALIGNMENT     = 4096;
+
+   constexpr std::chrono::milliseconds cIDLE_WAIT(100);
+
+   //! Start of the shared memory of a sharded run. The rings of each worker follow it.
+   struct SegmentHeader
+   {
+      //! Woken whenever a worker sends a message, so that the coordinator can wait for all rings at once.
+      alignas(64) std::atomic<std::uint32_t> mDoorbell;
+      std::uint32_t                          mWorkers;
+      std::uint64_t                          mRequestRingBytes;
+      std::uint64_t                          mResultRingBytes;
+   };
+
+   std::size_t AlignUp(std::size_t aSize)
+   {
+      return (aSize + cRING_ALIGNMENT - 1) / cRING_ALIGNMENT * cRING_ALIGNMENT;
+   }
+
+   //! Where the rings of each worker are in the shared memory.
+   struct SegmentLayout
+   {
+      std::size_t mRequestRingBytes = 0;
+      std::size_t mResultRingBytes  = 0;
+
+      std::size_t HeaderSize() const { return AlignUp(sizeof(SegmentHeader)); }
+      std::size_t RequestSize() const { return AlignUp(SharedRing::MemorySize(mRequestRingBytes)); }
+      std::size_t ResultSize() const { return AlignUp(SharedRing::MemorySize(mResultRingBytes)); }
+      std::size_t WorkerSize() const { return RequestSize() + ResultSize(); }
+      std::size_t TotalSize(std::size_t aWorkers) const { return HeaderSize() + aWorkers * WorkerSize(); }
+      std::size_t RequestOffset(std::size_t aWorker) const { return HeaderSize() + aWorker * WorkerSize(); }
+      std::size_t ResultOffset(std::size_t aWorker) const { return RequestOffset(aWorker) + RequestSize(); }
+   };
+
+   //! Parses a list of CPUs such as "0-3,8,10-11", as found in /sys.
+   bool ParseCpuList(std::string_view aText, cpu_set_t& aSet)
+   {
+      bool any = false;
+      while (!aText.empty())
+      {
+         const std::size_t      end   = std::min(aText.find(','), aText.size());
+         const std::string_view range = aText.substr(0, end);
+         const std::size_t      dash  = range.find('-');
+         unsigned               first = 0;
+         unsigned               last  = 0;
+         const auto             head  = range.substr(0, dash);
+         if (std::from_chars(head.data(), head.data() + head.size(), first).ec != std::errc())
+         {
+            return false;
+         }
+         last = first;
+         if (dash != std::string_view::npos)
+         {
+            const auto tail = range.substr(dash + 1);
+            if (std::from_chars(tail.data(), tail.data() + tail.size(), last).ec != std::errc())
+            {
+               return false;
+            }
+         }
+         for (unsigned cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+         {
+            CPU_SET(cpu, &aSet);
+            any = true;
+         }
+         aText.remove_prefix(std::min(end + 1, aText.size()));
+      }
+      return any;
+   }
+
+   //! Keeps the calling process on the CPUs of NUMA node aWorker modulo the number of nodes, so that the memory of
+   //! its sheets stays local. Does nothing if the nodes cannot be read.
+   void PinToNumaNode(std::size_t aWorker)
+   {
+      std::vector<std::string> cpuLists;
+      std::error_code          error;
+      std::vector<std::filesystem::path> nodes;
+      for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error))
+      {
+         const std::string name = entry.path().filename().string();
+         if (name.starts_with("node") && name.size() > 4 && name.find_first_not_of("0123456789", 4) == std::string::npos)
+         {
+            nodes.push_back(entry.path());
+         }
+      }
+      std::ranges::sort(nodes, [](const std::filesystem::path& aLeft, const std::filesystem::path& aRight)
+         {
+            return std::stoul(aLeft.filename().string().substr(4)) < std::stoul(aRight.filename().string().substr(4));
+         });
+      for (const auto& node : nodes)
+      {
+         std::ifstream stream(node / "cpulist");
+         std::string   list;
+         if (std::getline(stream, list) && !list.empty())
+         {
+            cpuLists.push_back(std::move(list));
+         }
+      }
+      if (cpuLists.empty())
+      {
+         return;
+      }
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      if (ParseCpuList(cpuLists[aWorker % cpuLists.size()], set))
+      {
+         ::sched_setaffinity(0, sizeof(set), &set);
+      }
+   }
+
+   bool Send(SharedRing&                  aRing,
+             MessageType                  aType,
+             const MessageWriter&         aMessage,
+             const std::function<bool()>& aKeepWaiting)
+   {
+      return aRing.Write(static_cast<std::uint32_t>(aType), aMessage.Bytes(), aKeepWaiting);
+   }
+
+   //! Computes one file in a worker, and sends the result. Returns false if the coordinator is gone.
+   bool ProcessFile(SharedRing&                       aResults,
+                    std::uint32_t                     aFile,
+                    const std::filesystem::path&      aPath,
+                    const rjcpt::batch::BatchOptions& aOptions,
+                    const rjcpt::WorkbookTemplate&    aTemplate,
+                    rjcpt::FormulaCache&              aCache,
+                    const std::function<bool()>&      aKeepWaiting)
+   {
+      MessageWriter message;
+      std::string   error;
+      try
+      {
+         const auto result = rjcpt::batch::ComputeFile(aPath, aOptions, aTemplate, &aCache);
+         if (result)
+         {
+            RJCPT_TRACE_SCOPE("SendResult");
+            message.Write(aFile);
+            message.Write(static_cast<std::uint64_t>(result->mRows));
+            message.Write(result->mLoadSeconds);
+            message.Write(result->mCalcSeconds);
+            message.Write(static_cast<std::uint32_t>(result->mNames.size()));
+            for (const std::string& name : result->mNames)
+            {
+               message.WriteString(name);
+            }
+            if (!Send(aResults, MessageType::FileHeader, message, aKeepWaiting))
+            {
+               return false;
+            }
+
+            // Values go in chunks that fit a message, next to their file id, column and first row.
+            const std::size_t chunk   = (aResults.MaxPayload() - 64) / sizeof(double);
+            const auto        columns = result->Columns();
+            for (std::uint32_t column = 0; column < columns.size(); column++)
+            {
+               const std::span<const double> values = columns[column].first(std::min(columns[column].size(), result->mRows));
+               for (std::size_t first = 0; first < values.size(); first += chunk)
+               {
+                  message.Clear();
+                  message.Write(aFile);
+                  message.Write(column);
+                  message.Write(static_cast<std::uint64_t>(first));
+                  message.WriteValues(values.subspan(first, std::min(chunk, values.size() - first)));
+                  if (!Send(aResults, MessageType::FileValues, message, aKeepWaiting))
+                  {
+                     return false;
+                  }
+               }
+            }
+            message.Clear();
+            message.Write(aFile);
+            return Send(aResults, MessageType::FileDone, message, aKeepWaiting);
+         }
+         error = result.error();
+      }
+      catch (const std::exception& aError)
+      {
+         error = aError.what();
+      }
+      message.Clear();
+      message.Write(aFile);
+      message.WriteString(error);
+      return Send(aResults, MessageType::FileFailed, message, aKeepWaiting);
+   }
+
+   std::string DescribeExit(int aStatus)
+   {
+      if (WIFSIGNALED(aStatus))
+      {
+         const char* name = ::strsignal(WTERMSIG(aStatus));
+         return "killed by signal " + std::to_string(WTERMSIG(aStatus)) + (name ? " (" + std::string(name) + ")" : "");
+      }
+      return "exited with code " + std::to_string(WEXITSTATUS(aStatus));
+   }
+
+   //! The coordinator of a sharded run: hands out shards, collects the results and writes them.
+   class Coordinator
+   {
+   public:
+      Coordinator(const rjcpt::batch::BatchOptions&   aOptions,
+                  const rjcpt::batch::ShardedOptions& aShardedOptions,
+                  rjcpt::batch::Progress&             aProgress)
+         : mOptions(aOptions)
+         , mShardedOptions(aShardedOptions)
+         , mProgress(aProgress)
+         , mWriters(aOptions.mJobs)
+      {
+      }
+
+      void Run(std::vector<rjcpt::batch::InputFile> aFiles)
+      {
+         mFiles = std::move(aFiles);
+         mDone.assign(mFiles.size(), false);
+         for (std::uint32_t file = 0; file < mFiles.size(); file++)
+         {
+            if (!mFiles[file].mCollidesWith.empty())
+            {
+               mProgress.Failed(mFiles[file], rjcpt::batch::CollisionError(mOptions, mFiles[file]));
+               MarkDone(file);
+            }
+         }
+         MakeShards();
+         if (mQueue.empty())
+         {
+            return;
+         }
+
+         CreateSegment();
+         for (std::size_t i = 0; i < mWorkers.size(); i++)
+         {
+            Spawn(i);
+         }
+         while (mDoneCount < mFiles.size())
+         {
+            const std::uint32_t doorbell = mHeader->mDoorbell.load(std::memory_order_acquire);
+            bool                busy     = false;
+            for (std::size_t i = 0; i < mWorkers.size(); i++)
+            {
+               busy |= Drain(i);
+            }
+            Reap();
+            for (std::size_t i = 0; i < mWorkers.size(); i++)
+            {
+               busy |= Assign(i);
+            }
+            if (!busy && mDoneCount < mFiles.size())
+            {
+               rjcpt::batch::WaitWhileEqual(mHeader->mDoorbell, doorbell, cIDLE_WAIT);
+            }
+         }
+         Stop();
+         mWriters.Wait();
+      }
+
+   private:
+      struct Shard
+      {
+         std::vector<std::uint32_t> mFiles;
+         std::size_t                mAttempts = 0;
+      };
+
+      //! A file whose values are being received.
+      struct IncomingFile
+      {
+         std::uint32_t                    mFile = 0;
+         std::size_t                      mRows = 0;
+         double                           mLoadSeconds = 0.0;
+         double                           mCalcSeconds = 0.0;
+         std::vector<std::string>         mNames;
+         std::vector<std::vector<double>> mColumns;
+      };
+
+      struct Worker
+      {
+         pid_t                       mPid = -1;
+         std::optional<SharedRing>   mRequests;
+         std::optional<SharedRing>   mResults;
+         std::optional<Shard>        mShard;
+         std::optional<IncomingFile> mIncoming;
+         bool                        mReady    = false; // The worker sent Ready since it was last started.
+         std::size_t                 mFailures = 0;     // Exits in a row before sending Ready.
+      };
+
+      //! Splits the files, which are sorted largest first, into shards. Consecutive files go to different shards, so
+      //! that each shard gets a share of the large files.
+      void MakeShards()
+      {
+         const std::size_t workers = std::max<std::size_t>(mShardedOptions.mWorkers, 1);
+         const std::size_t count   = std::clamp<std::size_t>(
+            std::max(workers * cSHARDS_PER_WORKER, (mFiles.size() + cMAX_SHARD_FILES - 1) / cMAX_SHARD_FILES), 1,
+            std::max<std::size_t>(mFiles.size(), 1));
+         std::vector<Shard> shards(count);
+         std::size_t        next = 0;
+         for (std::uint32_t file = 0; file < mFiles.size(); file++)
+         {
+            if (!mDone[file])
+            {
+               shards[next++ % count].mFiles.push_back(file);
+            }
+         }
+         for (Shard& shard : shards)
+         {
+            if (!shard.mFiles.empty())
+            {
+               mQueue.push_back(std::move(shard));
+            }
+         }
+         mWorkers.resize(std::min(workers, mQueue.size()));
+      }
+
+      void CreateSegment()
+      {
+         mLayout.mRequestRingBytes = cREQUEST_RING_BYTES;
+         mLayout.mResultRingBytes  = std::max<std::size_t>(mShardedOptions.mRingBytes, std::size_t{1} << 16);
+         mName = "/rjcpt-" + std::to_string(::getpid());
+         auto memory = rjcpt::batch::SharedMemory::Create(mName, mLayout.TotalSize(mWorkers.size()));
+         if (!memory)
+         {
+            throw std::runtime_error(memory.error());
+         }
+         mMemory = std::move(*memory);
+         mHeader = new (mMemory.Data()) SegmentHeader{};
+         mHeader->mWorkers          = static_cast<std::uint32_t>(mWorkers.size());
+         mHeader->mRequestRingBytes = mLayout.mRequestRingBytes;
+         mHeader->mResultRingBytes  = mLayout.mResultRingBytes;
+         for (std::size_t i = 0; i < mWorkers.size(); i++)
+         {
+            std::byte* requests = mMemory.Data() + mLayout.RequestOffset(i);
+            std::byte* results  = mMemory.Data() + mLayout.ResultOffset(i);
+            SharedRing::Create(requests, mLayout.mRequestRingBytes);
+            SharedRing::Create(results, mLayout.mResultRingBytes);
+            mWorkers[i].mRequests.emplace(requests);
+            mWorkers[i].mResults.emplace(results);
+         }
+      }
+
+      void Spawn(std::size_t aIndex)
+      {
+         Worker& worker = mWorkers[aIndex];
+         std::vector<std::string> arguments{"rjcpt-exec", "--worker=" + mName + ":" + std::to_string(aIndex)};
+         arguments.insert(arguments.end(), mShardedOptions.mWorkerArguments.begin(),
+                          mShardedOptions.mWorkerArguments.end());
+         std::vector<char*> argv;
+         for (std::string& argument : arguments)
+         {
+            argv.push_back(argument.data());
+         }
+         argv.push_back(nullptr);
+         // The path behind /proc/self/exe, so that the workers show up under the name of this program.
+         std::error_code             error;
+         const std::filesystem::path program = std::filesystem::read_symlink("/proc/self/exe", error);
+         pid_t                       pid     = -1;
+         const int status = ::posix_spawn(&pid, error ? "/proc/self/exe" : program.c_str(), nullptr, nullptr,
+                                          argv.data(), environ);
+         if (status != 0)
+         {
+            throw std::runtime_error("Cannot start a worker: " + std::string(std::strerror(status)));
+         }
+         worker.mPid   = pid;
+         worker.mReady = false;
+      }
+
+      //! Reads the messages of a worker. Returns true if there were any.
+      bool Drain(std::size_t aIndex)
+      {
+         Worker& worker = mWorkers[aIndex];
+         bool    retval = false;
+         // Stop reading while too many results wait to be written, so that the workers slow down instead of this
+         // process holding every result in memory.
+         while (mPendingWrites.load(std::memory_order_acquire) < 2 * mWriters.ThreadCount())
+         {
+            try
+            {
+               // A damaged ring throws, as does a malformed message.
+               if (!worker.mResults->TryRead(mType, mPayload).value())
+               {
+                  break;
+               }
+               retval = true;
+               Handle(aIndex, static_cast<MessageType>(mType), MessageReader(mPayload));
+            }
+            catch (const std::exception&)
+            {
+               // A worker that sends nonsense is treated as crashed.
+               retval = true;
+               if (worker.mPid > 0)
+               {
+                  ::kill(worker.mPid, SIGKILL);
+               }
+               worker.mResults->Clear();
+               break;
+            }
+         }
+         return retval;
+      }
+
+      void Handle(std::size_t aIndex, MessageType aType, MessageReader aMessage)
+      {
+         Worker& worker = mWorkers[aIndex];
+         switch (aType)
+         {
+         case MessageType::Ready:
+            worker.mReady    = true;
+            worker.mFailures = 0;
+            break;
+         case MessageType::FileHeader:
+         {
+            IncomingFile file;
+            file.mFile        = CheckFile(aMessage.Read<std::uint32_t>());
+            file.mRows        = aMessage.Read<std::uint64_t>();
+            file.mLoadSeconds = aMessage.Read<double>();
+            file.mCalcSeconds = aMessage.Read<double>();
+            file.mNames.resize(aMessage.Read<std::uint32_t>());
+            for (std::string& name : file.mNames)
+            {
+               name = aMessage.ReadString();
+            }
+            file.mColumns.assign(file.mNames.size(), std::vector<double>(file.mRows));
+            worker.mIncoming = std::move(file);
+            break;
+         }
+         case MessageType::FileValues:
+         {
+            const std::uint32_t file   = aMessage.Read<std::uint32_t>();
+            const std::uint32_t column = aMessage.Read<std::uint32_t>();
+            const std::uint64_t first  = aMessage.Read<std::uint64_t>();
+            if (!worker.mIncoming || worker.mIncoming->mFile != file || column >= worker.mIncoming->mColumns.size() ||
+                first > worker.mIncoming->mRows)
+            {
+               throw std::runtime_error("Malformed message.");
+            }
+            aMessage.ReadValues(std::span(worker.mIncoming->mColumns[column]).subspan(first));
+            break;
+         }
+         case MessageType::FileDone:
+         {
+            const std::uint32_t file = aMessage.Read<std::uint32_t>();
+            if (!worker.mIncoming || worker.mIncoming->mFile != file)
+            {
+               throw std::runtime_error("Malformed message.");
+            }
+            Write(aIndex, std::move(*worker.mIncoming));
+            worker.mIncoming.reset();
+            break;
+         }
+         case MessageType::FileFailed:
+         {
+            const std::uint32_t file = CheckFile(aMessage.Read<std::uint32_t>());
+            if (!mDone[file])
+            {
+               mProgress.Failed(mFiles[file], aMessage.ReadString());
+               MarkDone(file);
+            }
+            break;
+         }
+         case MessageType::ShardDone:
+            if (worker.mShard)
+            {
+               // Files the worker skipped would otherwise never finish.
+               for (const std::uint32_t file : worker.mShard->mFiles)
+               {
+                  if (!mDone[file])
+                  {
+                     mProgress.Failed(mFiles[file], "Not processed by worker " + std::to_string(aIndex));
+                     MarkDone(file);
+                  }
+               }
+               worker.mShard.reset();
+            }
+            break;
+         default:
+            throw std::runtime_error("Malformed message.");
+         }
+      }
+
+      std::uint32_t CheckFile(std::uint32_t aFile) const
+      {
+         if (aFile >= mFiles.size())
+         {
+            throw std::runtime_error("Malformed message.");
+         }
+         return aFile;
+      }
+
+      void MarkDone(std::uint32_t aFile)
+      {
+         mDone[aFile] = true;
+         ++mDoneCount;
+      }
+
+      //! Writes a received file on the writer threads.
+      void Write(std::size_t aIndex, IncomingFile aFile)
+      {
+         if (mDone[aFile.mFile])
+         {
+            return;
+         }
+         MarkDone(aFile.mFile);
+         mPendingWrites.fetch_add(1, std::memory_order_relaxed);
+         mWriters.Submit([this, aIndex, file = std::move(aFile)](std::size_t)
+            {
+               const rjcpt::batch::InputFile& input = mFiles[file.mFile];
+               const auto                     start = Clock::now();
+               const std::vector<std::span<const double>> columns(file.mColumns.begin(), file.mColumns.end());
+               const auto written = rjcpt::batch::WriteResult(rjcpt::batch::OutputPath(mOptions, input.mPath),
+                                                              file.mNames, columns, mOptions.mSeparator);
+               if (written)
+               {
+                  mProgress.Finished(input, file.mRows, file.mLoadSeconds, file.mCalcSeconds, SecondsSince(start),
+                                     " (worker " + std::to_string(aIndex) + ")");
+               }
+               else
+               {
+                  mProgress.Failed(input, written.error());
+               }
+               mPendingWrites.fetch_sub(1, std::memory_order_release);
+               rjcpt::batch::Wake(mHeader->mDoorbell);
+            });
+      }
+
+      //! Gives the next shard to an idle worker. Returns true if it did.
+      bool Assign(std::size_t aIndex)
+      {
+         Worker& worker = mWorkers[aIndex];
+         if (worker.mPid <= 0 || worker.mShard || mQueue.empty())
+         {
+            return false;
+         }
+         Shard shard = std::move(mQueue.front());
+         mQueue.pop_front();
+         ++shard.mAttempts;
+
+         MessageWriter message;
+         message.Write(mShardCount++);
+         message.Write(static_cast<std::uint32_t>(shard.mFiles.size()));
+         for (const std::uint32_t file : shard.mFiles)
+         {
+            message.Write(file);
+            message.WriteString(mFiles[file].mPath.string());
+         }
+         const pid_t pid = worker.mPid;
+         // If the worker is gone, Reap retries the shard.
+         Send(*worker.mRequests, MessageType::ProcessShard, message, [pid] { return ::kill(pid, 0) == 0; });
+         worker.mShard = std::move(shard);
+         return true;
+      }
+
+      //! Handles workers that exited: their unfinished files are retried, and the workers replaced.
+      void Reap()
+      {
+         int   status = 0;
+         pid_t pid    = 0;
+         while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0)
+         {
+            const auto found = std::ranges::find(mWorkers, pid, &Worker::mPid);
+            if (found == mWorkers.end())
+            {
+               continue;
+            }
+            const std::size_t index  = static_cast<std::size_t>(found - mWorkers.begin());
+            Worker&           worker = *found;
+            // Results sent before the worker died are still good.
+            while (worker.mPid > 0)
+            {
+               try
+               {
+                  if (!worker.mResults->TryRead(mType, mPayload).value())
+                  {
+                     break;
+                  }
+                  Handle(index, static_cast<MessageType>(mType), MessageReader(mPayload));
+               }
+               catch (const std::exception&)
+               {
+                  break;
+               }
+            }
+            worker.mPid = -1;
+            worker.mIncoming.reset();
+            worker.mRequests->Clear();
+            worker.mResults->Clear();
+            if (worker.mShard)
+            {
+               Retry(index, *worker.mShard, DescribeExit(status));
+               worker.mShard.reset();
+            }
+            // A worker that cannot even start would otherwise be replaced forever. One that crashed on a file
+            // has started, and Retry fails that file once it has crashed cMAX_ATTEMPTS workers.
+            if (!worker.mReady && ++worker.mFailures > cMAX_ATTEMPTS)
+            {
+               throw std::runtime_error("Worker " + std::to_string(index) + " " + DescribeExit(status));
+            }
+            if (mDoneCount < mFiles.size())
+            {
+               Spawn(index);
+            }
+         }
+      }
+
+      void Retry(std::size_t aIndex, const Shard& aShard, const std::string& aReason)
+      {
+         std::vector<std::uint32_t> remaining;
+         for (const std::uint32_t file : aShard.mFiles)
+         {
+            if (!mDone[file])
+            {
+               remaining.push_back(file);
+            }
+         }
+         if (remaining.empty())
+         {
+            return;
+         }
+         if (aShard.mAttempts >= cMAX_ATTEMPTS)
+         {
+            for (const std::uint32_t file : remaining)
+            {
+               mProgress.Failed(mFiles[file], "Worker " + aReason);
+               MarkDone(file);
+            }
+            return;
+         }
+         mProgress.Note("Worker " + std::to_string(aIndex) + " " + aReason + ", retrying " +
+                        std::to_string(remaining.size()) + " files");
+         mProgress.Retried();
+         // One file per shard from now on, so that a file that crashes the worker doesn't take the others with it.
+         for (const std::uint32_t file : remaining)
+         {
+            mQueue.push_front(Shard{{file}, aShard.mAttempts});
+         }
+      }
+
+      void Stop()
+      {
+         for (Worker& worker : mWorkers)
+         {
+            if (worker.mPid > 0)
+            {
+               const pid_t pid = worker.mPid;
+               Send(*worker.mRequests, MessageType::Stop, MessageWriter(), [pid] { return ::kill(pid, 0) == 0; });
+            }
+         }
+         for (Worker& worker : mWorkers)
+         {
+            if (worker.mPid > 0)
+            {
+               ::waitpid(worker.mPid, nullptr, 0);
+               worker.mPid = -1;
+            }
+         }
+      }
+
+      const rjcpt::batch::BatchOptions&    mOptions;
+      const rjcpt::batch::ShardedOptions&  mShardedOptions;
+      rjcpt::batch::Progress&              mProgress;
+      std::vector<rjcpt::batch::InputFile> mFiles;
+      std::vector<bool>                    mDone;
+      std::size_t                          mDoneCount = 0;
+      std::deque<Shard>                    mQueue;
+      std::vector<Worker>                  mWorkers;
+
+      std::string                mName;
+      SegmentLayout              mLayout;
+      rjcpt::batch::SharedMemory mMemory;
+      SegmentHeader*             mHeader = nullptr;
+
+      std::uint32_t          mShardCount = 0;
+      std::uint32_t          mType = 0;
+      std::vector<std::byte> mPayload;
+
+      // Declared last, so that pending writes finish before anything they use is destroyed.
+      std::atomic<std::size_t> mPendingWrites = 0;
+      rjcpt::ThreadPool        mWriters;
+   };
+}
+
+rjcpt::batch::BatchSummary rjcpt::batch::RunCoordinator(const BatchOptions&     aOptions,
+                                                        const ShardedOptions&   aShardedOptions,
+                                                        std::ostream&           aLog,
+                                                        std::ostream&           aErrors)
+{
+   const auto start = Clock::now();
+   std::vector<InputFile> files = ListInputFiles(aOptions);
+   std::filesystem::create_directories(aOptions.mOutputDirectory);
+
+   Progress progress(files.size(), aLog, aErrors);
+   {
+      Coordinator coordinator(aOptions, aShardedOptions, progress);
+      coordinator.Run(std::move(files));
+   }
+
+   BatchSummary retval = progress.Summary();
+   retval.mSeconds = SecondsSince(start);
+   return retval;
+}
+
+int rjcpt::batch::RunWorker(std::string_view        aWorker,
+                            const BatchOptions&     aOptions,
+                            const ShardedOptions&   aShardedOptions,
+                            const WorkbookTemplate& aTemplate)
+{
+   const std::size_t colon = aWorker.rfind(':');
+   std::size_t       index = 0;
+   if (colon == std::string_view::npos ||
+       std::from_chars(aWorker.data() + colon + 1, aWorker.data() + aWorker.size(), index).ec != std::errc())
+   {
+      return 2;
+   }
+   auto memory = SharedMemory::Open(std::string(aWorker.substr(0, colon)));
+   if (!memory)
+   {
+      return 2;
+   }
+   auto* header = reinterpret_cast<SegmentHeader*>(memory->Data());
+   const SegmentLayout layout{header->mRequestRingBytes, header->mResultRingBytes};
+   if (index >= header->mWorkers || layout.TotalSize(header->mWorkers) > memory->Size())
+   {
+      return 2;
+   }
+   if (aShardedOptions.mPinToNumaNodes)
+   {
+      PinToNumaNode(index);
+   }
+
+   SharedRing  requests(memory->Data() + layout.RequestOffset(index));
+   SharedRing  results(memory->Data() + layout.ResultOffset(index), &header->mDoorbell);
+   // The coordinator owns the rings. If it dies, this process becomes someone else's child, and stops.
+   const pid_t coordinator = ::getppid();
+   const std::function<bool()> keepWaiting = [coordinator] { return ::getppid() == coordinator; };
+
+   rjcpt::FormulaCache    cache;
+   cache.SetParserEngine(aOptions.mParserEngine);
+   std::uint32_t          type = 0;
+   std::vector<std::byte> payload;
+   if (!Send(results, MessageType::Ready, MessageWriter(), keepWaiting))
+   {
+      return 1;
+   }
+   while (keepWaiting())
+   {
+      const auto read = requests.TryRead(type, payload);
+      if (!read)
+      {
+         return 1;
+      }
+      if (!*read)
+      {
+         requests.WaitForMessage(cIDLE_WAIT);
+         continue;
+      }
+      if (static_cast<MessageType>(type) != MessageType::ProcessShard)
+      {
+         return 0;
+      }
+      MessageReader       message(payload);
+      const std::uint32_t shard = message.Read<std::uint32_t>();
+      const std::uint32_t count = message.Read<std::uint32_t>();
+      for (std::uint32_t i = 0; i < count; i++)
+      {
+         const std::uint32_t         file = message.Read<std::uint32_t>();
+         const std::filesystem::path path(message.ReadString());
+         if (!ProcessFile(results, file, path, aOptions, aTemplate, cache, keepWaiting))
+         {
+            return 1;
+         }
+      }
+      MessageWriter done;
+      done.Write(shard);
+      if (!Send(results, MessageType::ShardDone, done, keepWaiting))
+      {
+         return 1;
+      }
+   }
+   return 1;
+}
+#else
+rjcpt::batch::BatchSummary rjcpt::batch::RunCoordinator(const BatchOptions&,
+                                                        const ShardedOptions&,
+                                                        std::ostream&,
+                                                        std::ostream&)
+{
+   throw std::runtime_error("Worker processes are only supported on Linux.");
+}
+
+int rjcpt::batch::RunWorker(std::string_view, const BatchOptions&, const ShardedOptions&, const WorkbookTemplate&)
+{
+   return 2;
+}
+#endif
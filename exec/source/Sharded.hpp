@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Batch.hpp"
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rjcpt::batch
+{
+   //! Options of the sharded batch mode, where the files are processed by worker processes.
+   struct ShardedOptions
+   {
+      //! Number of worker processes.
+      std::size_t              mWorkers = 0;
+      //! Size of the ring each worker sends its results through, in bytes.
+      std::size_t              mRingBytes = std::size_t{16} << 20;
+      //! Spread the workers over the NUMA nodes, and keep each one on the CPUs of its node.
+      bool                     mPinToNumaNodes = false;
+      //! Command line arguments for the workers, apart from the executable and --worker. These are the arguments of
+      //! the coordinator, so that workers read the same template with the same options.
+      std::vector<std::string> mWorkerArguments;
+   };
+
+   //! Same as RunBatch, but the files are processed by aShardedOptions.mWorkers worker processes, so that a crash
+   //! only loses the files its worker was processing.
+   //!   * The files are split into shards of a few files each, and each idle worker is given the next shard.
+   //!   * Workers send the computed columns back through a ring in shared memory, and this process writes them.
+   //!   * If a worker dies, the unfinished files of its shard are given to a new worker, one file per shard, up to
+   //!     cMAX_ATTEMPTS times in all. So a file that crashes the worker every time fails on its own.
+   //! The workers load the template from their arguments. Only supported on Linux.
+   BatchSummary RunCoordinator(const BatchOptions&   aOptions,
+                               const ShardedOptions& aShardedOptions,
+                               std::ostream&         aLog,
+                               std::ostream&         aErrors);
+
+   //! Runs a worker started by RunCoordinator, with the value of its --worker argument. Returns the exit code.
+   int RunWorker(std::string_view        aWorker,
+                 const BatchOptions&     aOptions,
+                 const ShardedOptions&   aShardedOptions,
+                 const WorkbookTemplate& aTemplate);
+}
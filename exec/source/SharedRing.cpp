@@ -0,0 +1,316 @@
+#include "SharedRing.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+   //! Precedes each message in the ring. Messages start at multiples of 8 bytes.
+   struct FrameHeader
+   {
+      std::uint32_t mType = 0;
+      std::uint32_t mSize = 0;
+   };
+
+   constexpr std::uint64_t RoundUp(std::uint64_t aSize)
+   {
+      return (aSize + 7) & ~std::uint64_t{7};
+   }
+
+   // The futex system call works on the plain 32-bit value inside the atomic.
+   static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t));
+   static_assert(std::atomic<std::uint32_t>::is_always_lock_free && std::atomic<std::uint64_t>::is_always_lock_free);
+
+   // Waits are cut short this often to check whether the other process is still there.
+   constexpr std::chrono::milliseconds cPOLL_INTERVAL(10);
+}
+
+struct rjcpt::batch::SharedRing::Header
+{
+   alignas(64) std::atomic<std::uint64_t> mWritten; // Bytes written since the ring was created. Only the writer changes it.
+   alignas(64) std::atomic<std::uint64_t> mRead;    // Bytes read since the ring was created. Only the reader changes it.
+   alignas(64) std::atomic<std::uint32_t> mWrites;  // Woken after each write.
+   std::atomic<std::uint32_t>             mReads;   // Woken after each read.
+   std::uint64_t                          mCapacity;
+};
+
+#ifdef __linux__
+std::expected<rjcpt::batch::SharedMemory, std::string> rjcpt::batch::SharedMemory::Create(const std::string& aName,
+                                                                                          std::size_t        aSize)
+{
+   const int file = ::shm_open(aName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+   if (file < 0)
+   {
+      return std::unexpected("Cannot create shared memory " + aName + ": " + std::strerror(errno));
+   }
+   SharedMemory retval;
+   retval.mName  = aName;
+   retval.mOwner = true;
+   if (::ftruncate(file, static_cast<off_t>(aSize)) != 0)
+   {
+      ::close(file);
+      ::shm_unlink(aName.c_str());
+      return std::unexpected("Cannot size shared memory " + aName + ": " + std::strerror(errno));
+   }
+   void* data = ::mmap(nullptr, aSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+   ::close(file);
+   if (data == MAP_FAILED)
+   {
+      ::shm_unlink(aName.c_str());
+      return std::unexpected("Cannot map shared memory " + aName + ": " + std::strerror(errno));
+   }
+   retval.mData = static_cast<std::byte*>(data);
+   retval.mSize = aSize;
+   return retval;
+}
+
+std::expected<rjcpt::batch::SharedMemory, std::string> rjcpt::batch::SharedMemory::Open(const std::string& aName)
+{
+   const int file = ::shm_open(aName.c_str(), O_RDWR, 0);
+   if (file < 0)
+   {
+      return std::unexpected("Cannot open shared memory " + aName + ": " + std::strerror(errno));
+   }
+   struct stat status{};
+   void*       data = MAP_FAILED;
+   if (::fstat(file, &status) == 0 && status.st_size > 0)
+   {
+      data = ::mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+   }
+   ::close(file);
+   if (data == MAP_FAILED)
+   {
+      return std::unexpected("Cannot map shared memory " + aName + ": " + std::strerror(errno));
+   }
+   SharedMemory retval;
+   retval.mName = aName;
+   retval.mData = static_cast<std::byte*>(data);
+   retval.mSize = static_cast<std::size_t>(status.st_size);
+   return retval;
+}
+
+void rjcpt::batch::SharedMemory::Close()
+{
+   if (mData)
+   {
+      ::munmap(mData, mSize);
+   }
+   if (mOwner)
+   {
+      ::shm_unlink(mName.c_str());
+   }
+   mData  = nullptr;
+   mSize  = 0;
+   mOwner = false;
+}
+
+void rjcpt::batch::WaitWhileEqual(std::atomic<std::uint32_t>& aWord,
+                                  std::uint32_t               aExpected,
+                                  std::chrono::milliseconds   aTimeout)
+{
+   const timespec timeout{static_cast<time_t>(aTimeout.count() / 1000), static_cast<long>(aTimeout.count() % 1000 * 1000000)};
+   // Not FUTEX_PRIVATE_FLAG, since the word is shared with other processes.
+   ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&aWord), FUTEX_WAIT, aExpected, &timeout, nullptr, 0);
+}
+
+void rjcpt::batch::Wake(std::atomic<std::uint32_t>& aWord)
+{
+   aWord.fetch_add(1, std::memory_order_release);
+   ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&aWord), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+#else
+std::expected<rjcpt::batch::SharedMemory, std::string> rjcpt::batch::SharedMemory::Create(const std::string&, std::size_t)
+{
+   return std::unexpected("Shared memory is only supported on Linux");
+}
+
+std::expected<rjcpt::batch::SharedMemory, std::string> rjcpt::batch::SharedMemory::Open(const std::string&)
+{
+   return std::unexpected("Shared memory is only supported on Linux");
+}
+
+void rjcpt::batch::SharedMemory::Close()
+{
+}
+
+void rjcpt::batch::WaitWhileEqual(std::atomic<std::uint32_t>& aWord, std::uint32_t aExpected, std::chrono::milliseconds)
+{
+   aWord.wait(aExpected);
+}
+
+void rjcpt::batch::Wake(std::atomic<std::uint32_t>& aWord)
+{
+   aWord.fetch_add(1, std::memory_order_release);
+   aWord.notify_all();
+}
+#endif
+
+rjcpt::batch::SharedMemory::SharedMemory(SharedMemory&& aOther) noexcept
+   : mName(std::move(aOther.mName))
+   , mData(std::exchange(aOther.mData, nullptr))
+   , mSize(std::exchange(aOther.mSize, 0))
+   , mOwner(std::exchange(aOther.mOwner, false))
+{
+}
+
+rjcpt::batch::SharedMemory& rjcpt::batch::SharedMemory::operator=(SharedMemory&& aOther) noexcept
+{
+   if (this != &aOther)
+   {
+      Close();
+      mName  = std::move(aOther.mName);
+      mData  = std::exchange(aOther.mData, nullptr);
+      mSize  = std::exchange(aOther.mSize, 0);
+      mOwner = std::exchange(aOther.mOwner, false);
+   }
+   return *this;
+}
+
+rjcpt::batch::SharedMemory::~SharedMemory()
+{
+   Close();
+}
+
+std::size_t rjcpt::batch::SharedRing::MemorySize(std::size_t aCapacity)
+{
+   return sizeof(Header) + RoundUp(aCapacity);
+}
+
+void rjcpt::batch::SharedRing::Create(std::byte* aMemory, std::size_t aCapacity)
+{
+   Header* header = new (aMemory) Header{};
+   header->mCapacity = RoundUp(aCapacity);
+}
+
+rjcpt::batch::SharedRing::SharedRing(std::byte* aMemory, std::atomic<std::uint32_t>* aDoorbell)
+   : mHeader(reinterpret_cast<Header*>(aMemory))
+   , mData(aMemory + sizeof(Header))
+   , mCapacity(mHeader->mCapacity)
+   , mDoorbell(aDoorbell)
+{
+}
+
+std::size_t rjcpt::batch::SharedRing::MaxPayload() const
+{
+   // Small enough that a writer never waits for the reader to empty most of the ring.
+   return mCapacity / 4;
+}
+
+bool rjcpt::batch::SharedRing::Write(std::uint32_t                aType,
+                                     std::span<const std::byte>   aPayload,
+                                     const std::function<bool()>& aKeepWaiting)
+{
+   if (aPayload.size() > MaxPayload())
+   {
+      throw std::length_error("Message is too large for the ring.");
+   }
+   const std::uint64_t frameSize = sizeof(FrameHeader) + RoundUp(aPayload.size());
+   const std::uint64_t written   = mHeader->mWritten.load(std::memory_order_relaxed);
+   const auto          hasSpace  = [&]
+      {
+         return mCapacity - (written - mHeader->mRead.load(std::memory_order_acquire)) >= frameSize;
+      };
+   while (!hasSpace())
+   {
+      const std::uint32_t reads = mHeader->mReads.load(std::memory_order_acquire);
+      if (!hasSpace())
+      {
+         WaitWhileEqual(mHeader->mReads, reads, cPOLL_INTERVAL);
+      }
+      if (!aKeepWaiting())
+      {
+         return false;
+      }
+   }
+
+   const FrameHeader frame{aType, static_cast<std::uint32_t>(aPayload.size())};
+   Copy(written, &frame, sizeof(frame));
+   Copy(written + sizeof(frame), aPayload.data(), aPayload.size());
+   mHeader->mWritten.store(written + frameSize, std::memory_order_release);
+   Wake(mHeader->mWrites);
+   if (mDoorbell)
+   {
+      Wake(*mDoorbell);
+   }
+   return true;
+}
+
+std::expected<bool, std::string> rjcpt::batch::SharedRing::TryRead(std::uint32_t&          aType,
+                                                                  std::vector<std::byte>& aPayload)
+{
+   const std::uint64_t read      = mHeader->mRead.load(std::memory_order_relaxed);
+   const std::uint64_t available = mHeader->mWritten.load(std::memory_order_acquire) - read;
+   if (available == 0)
+   {
+      return false;
+   }
+   // The writer may have crashed halfway through a message, or scribbled over the ring, so nothing it wrote is
+   // trusted to stay inside the ring.
+   FrameHeader frame;
+   if (available > mCapacity || available < sizeof(frame))
+   {
+      return std::unexpected("Damaged message in the ring.");
+   }
+   CopyOut(read, &frame, sizeof(frame));
+   if (frame.mSize > MaxPayload() || sizeof(frame) + RoundUp(frame.mSize) > available)
+   {
+      return std::unexpected("Damaged message in the ring.");
+   }
+   aType = frame.mType;
+   aPayload.resize(frame.mSize);
+   CopyOut(read + sizeof(frame), aPayload.data(), frame.mSize);
+   mHeader->mRead.store(read + sizeof(frame) + RoundUp(frame.mSize), std::memory_order_release);
+   Wake(mHeader->mReads);
+   return true;
+}
+
+void rjcpt::batch::SharedRing::WaitForMessage(std::chrono::milliseconds aTimeout)
+{
+   const std::uint32_t writes = mHeader->mWrites.load(std::memory_order_acquire);
+   if (mHeader->mWritten.load(std::memory_order_acquire) == mHeader->mRead.load(std::memory_order_relaxed))
+   {
+      WaitWhileEqual(mHeader->mWrites, writes, aTimeout);
+   }
+}
+
+void rjcpt::batch::SharedRing::Clear()
+{
+   mHeader->mRead.store(mHeader->mWritten.load());
+}
+
+void rjcpt::batch::SharedRing::Copy(std::uint64_t aPosition, const void* aSource, std::size_t aSize)
+{
+   if (aSize == 0)
+   {
+      return;
+   }
+   const std::size_t offset = aPosition % mCapacity;
+   const std::size_t first  = std::min<std::size_t>(aSize, mCapacity - offset);
+   std::memcpy(mData + offset, aSource, first);
+   std::memcpy(mData, static_cast<const std::byte*>(aSource) + first, aSize - first);
+}
+
+void rjcpt::batch::SharedRing::CopyOut(std::uint64_t aPosition, void* aTarget, std::size_t aSize) const
+{
+   if (aSize == 0)
+   {
+      return;
+   }
+   const std::size_t offset = aPosition % mCapacity;
+   const std::size_t first  = std::min<std::size_t>(aSize, mCapacity - offset);
+   std::memcpy(aTarget, mData + offset, first);
+   std::memcpy(static_cast<std::byte*>(aTarget) + first, mData, aSize - first);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace rjcpt::batch
+{
+   //! A block of memory shared between processes, by name. Only available on Linux.
+   class SharedMemory
+   {
+   public:
+      //! Creates a zeroed block of aSize bytes. On failure, returns a description of the error.
+      static std::expected<SharedMemory, std::string> Create(const std::string& aName, std::size_t aSize);
+      //! Maps a block created by another process. On failure, returns a description of the error.
+      static std::expected<SharedMemory, std::string> Open(const std::string& aName);
+
+      SharedMemory() = default;
+      SharedMemory(SharedMemory&& aOther) noexcept;
+      SharedMemory& operator=(SharedMemory&& aOther) noexcept;
+      //! Unmaps the block, and removes its name if this process created it.
+      ~SharedMemory();
+
+      std::byte*  Data() const { return mData; }
+      std::size_t Size() const { return mSize; }
+
+   private:
+      void Close();
+
+      std::string mName;
+      std::byte*  mData  = nullptr;
+      std::size_t mSize  = 0;
+      bool        mOwner = false;
+   };
+
+   //! Blocks while aWord holds aExpected, until another process calls Wake on it, or aTimeout passes.
+   void WaitWhileEqual(std::atomic<std::uint32_t>& aWord, std::uint32_t aExpected, std::chrono::milliseconds aTimeout);
+   //! Increments aWord and wakes every process waiting on it.
+   void Wake(std::atomic<std::uint32_t>& aWord);
+
+   //! A queue of messages from one process to another, in shared memory. Each message is a type and a payload.
+   //! The ring is lock-free, so a process that dies while using it cannot leave the other one blocked for good.
+   class SharedRing
+   {
+   public:
+      //! Bytes of shared memory needed for a ring that holds aCapacity bytes of messages.
+      static std::size_t MemorySize(std::size_t aCapacity);
+
+      //! Sets up an empty ring in aMemory, which must be zeroed, 64-byte aligned, and MemorySize(aCapacity) long.
+      static void Create(std::byte* aMemory, std::size_t aCapacity);
+
+      //! Uses the ring in aMemory, set up by Create in this or another process.
+      //! If aDoorbell is given, writing a message also wakes anyone waiting on it, so that one process can wait for
+      //! messages on several rings at once.
+      explicit SharedRing(std::byte* aMemory, std::atomic<std::uint32_t>* aDoorbell = nullptr);
+
+      //! Largest payload a message may have.
+      std::size_t MaxPayload() const;
+
+      //! Appends a message, waiting for space if needed. While waiting, aKeepWaiting is called every few
+      //! milliseconds, and the write is abandoned if it returns false. Returns true if the message was written.
+      bool Write(std::uint32_t aType, std::span<const std::byte> aPayload, const std::function<bool()>& aKeepWaiting);
+
+      //! Removes the next message. Returns false if there is none. Fails if the writer left a message that does not
+      //! fit in what it has written, such as when it crashed; the ring should then be cleared.
+      std::expected<bool, std::string> TryRead(std::uint32_t& aType, std::vector<std::byte>& aPayload);
+
+      //! Waits until there may be a message to read, or aTimeout passes.
+      void WaitForMessage(std::chrono::milliseconds aTimeout);
+
+      //! Discards every message. Only allowed while no other process uses the ring.
+      void Clear();
+
+   private:
+      struct Header;
+
+      void Copy(std::uint64_t aPosition, const void* aSource, std::size_t aSize);
+      void CopyOut(std::uint64_t aPosition, void* aTarget, std::size_t aSize) const;
+
+      Header*                     mHeader;
+      std::byte*                  mData;
+      std::uint64_t               mCapacity; // Copied from the header, which the other process could overwrite.
+      std::atomic<std::uint32_t>* mDoorbell;
+   };
+}